@@ -0,0 +1,331 @@
+/**
+ * Energy attribution to cgroups, common to all implementations.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for pread, openat, O_CLOEXEC, O_DIRECTORY
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "raplcap.h"
+#include "raplcap-attrib.h"
+#include "raplcap-common.h"
+
+#define CPU_STAT_FILE "cpu.stat"
+#define CPU_STAT_USAGE "usage_usec "
+
+// usage_usec is the first field, so the rest of the file doesn't need to be read
+#define CPU_STAT_BUF_SIZE 128
+
+typedef struct attrib_cgroup {
+  // < 0 if the slot is free
+  int fd;
+  uint64_t usec;
+  // 0 if usec isn't a baseline for the next sample, e.g., after a failed read
+  int has_usec;
+  // CPU time in the latest sample interval
+  uint64_t delta_usec;
+  double joules;
+} attrib_cgroup;
+
+struct raplcap_attrib {
+  const raplcap* rc;
+  // indexed the same as raplcap_get_energy_snapshot
+  double* snapshot;
+  double* last;
+  // 0 for zones that aren't attributed
+  double* max;
+  uint32_t n;
+  // < 0 if there's no root cgroup
+  int root_fd;
+  uint64_t root_usec;
+  attrib_cgroup* cgroups;
+  int n_cgroups;
+  int cap_cgroups;
+  double unattributed;
+};
+
+static int open_cpu_stat(const char* cgroup) {
+  int dir_fd;
+  int fd;
+  int err_save;
+  if ((dir_fd = open(cgroup, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+    raplcap_perror(ERROR, cgroup);
+    return -1;
+  }
+  fd = openat(dir_fd, CPU_STAT_FILE, O_RDONLY | O_CLOEXEC);
+  err_save = errno;
+  close(dir_fd);
+  if (fd < 0) {
+    errno = err_save;
+    raplcap_perror(ERROR, "openat: "CPU_STAT_FILE);
+  }
+  return fd;
+}
+
+static int read_usage(int fd, uint64_t* usec) {
+  char buf[CPU_STAT_BUF_SIZE];
+  const char* field;
+  char* end;
+  ssize_t len;
+  if ((len = pread(fd, buf, sizeof(buf) - 1, 0)) < 0) {
+    return -1;
+  }
+  buf[len] = '\0';
+  // the field is at the start of a line
+  if ((field = strstr(buf, CPU_STAT_USAGE)) == NULL || (field != buf && field[-1] != '\n')) {
+    errno = ENODATA;
+    return -1;
+  }
+  errno = 0;
+  *usec = strtoull(field + sizeof(CPU_STAT_USAGE) - 1, &end, 10);
+  if (errno || end == field + sizeof(CPU_STAT_USAGE) - 1) {
+    errno = ENODATA;
+    return -1;
+  }
+  return 0;
+}
+
+static int init_zones(raplcap_attrib* a) {
+  const raplcap_zone zones[] = { RAPLCAP_ZONE_PACKAGE, RAPLCAP_ZONE_DRAM };
+  uint32_t n_pkg;
+  uint32_t n_die;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t off;
+  uint32_t idx;
+  uint32_t t;
+  if ((n_pkg = raplcap_get_num_packages(a->rc)) == 0) {
+    return -1;
+  }
+  for (pkg = 0, off = 0; pkg < n_pkg; pkg++, off += n_die) {
+    if ((n_die = raplcap_get_num_die(a->rc, pkg)) == 0) {
+      return -1;
+    }
+    for (die = 0; die < n_die; die++) {
+      for (t = 0; t < sizeof(zones) / sizeof(zones[0]); t++) {
+        idx = (off + die) * RAPLCAP_NZONES + (uint32_t) zones[t];
+        if (idx < a->n && a->snapshot[idx] >= 0 &&
+            (a->max[idx] = raplcap_pd_get_energy_counter_max(a->rc, pkg, die, zones[t])) < 0) {
+          a->max[idx] = 0;
+        }
+      }
+    }
+  }
+  memcpy(a->last, a->snapshot, a->n * sizeof(*a->last));
+  return 0;
+}
+
+// Get energy since the previous read, skipping zones that fail to read
+static double read_energy(raplcap_attrib* a) {
+  double joules = 0;
+  uint32_t i;
+  if (raplcap_get_energy_snapshot(a->rc, a->snapshot, a->n) < 0) {
+    return -1;
+  }
+  for (i = 0; i < a->n; i++) {
+    if (a->max[i] <= 0 || a->snapshot[i] < 0) {
+      continue;
+    }
+    if (a->last[i] >= 0) {
+      joules += a->snapshot[i] >= a->last[i] ? a->snapshot[i] - a->last[i] : (a->max[i] - a->last[i]) + a->snapshot[i];
+    }
+    a->last[i] = a->snapshot[i];
+  }
+  return joules;
+}
+
+raplcap_attrib* raplcap_attrib_init(const raplcap* rc, const char* root) {
+  raplcap_attrib* a;
+  int err_save;
+  int len;
+  raplcap_log(DEBUG, "raplcap_attrib_init: root=%s\n", root == NULL ? "(null)" : root);
+  if ((len = raplcap_get_energy_snapshot(rc, NULL, 0)) <= 0) {
+    return NULL;
+  }
+  if ((a = calloc(1, sizeof(*a))) == NULL) {
+    return NULL;
+  }
+  a->rc = rc;
+  a->n = (uint32_t) len;
+  a->root_fd = -1;
+  if ((a->snapshot = malloc(a->n * sizeof(*a->snapshot))) == NULL ||
+      (a->last = malloc(a->n * sizeof(*a->last))) == NULL ||
+      (a->max = calloc(a->n, sizeof(*a->max))) == NULL ||
+      raplcap_get_energy_snapshot(rc, a->snapshot, a->n) < 0 ||
+      init_zones(a) ||
+      (root != NULL && ((a->root_fd = open_cpu_stat(root)) < 0 || read_usage(a->root_fd, &a->root_usec)))) {
+    err_save = errno;
+    raplcap_attrib_destroy(a);
+    errno = err_save;
+    return NULL;
+  }
+  return a;
+}
+
+int raplcap_attrib_add_cgroup(raplcap_attrib* a, const char* cgroup) {
+  attrib_cgroup* tmp;
+  uint64_t usec;
+  int err_save;
+  int cap;
+  int fd;
+  int id;
+  raplcap_log(DEBUG, "raplcap_attrib_add_cgroup: cgroup=%s\n", cgroup == NULL ? "(null)" : cgroup);
+  if (a == NULL || cgroup == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((fd = open_cpu_stat(cgroup)) < 0) {
+    return -1;
+  }
+  if (read_usage(fd, &usec)) {
+    err_save = errno;
+    close(fd);
+    errno = err_save;
+    return -1;
+  }
+  // reuse a free slot if possible
+  id = 0;
+  while (id < a->n_cgroups && a->cgroups[id].fd >= 0) {
+    id++;
+  }
+  if (id == a->cap_cgroups) {
+    cap = a->cap_cgroups == 0 ? 16 : a->cap_cgroups * 2;
+    if ((tmp = realloc(a->cgroups, (size_t) cap * sizeof(*a->cgroups))) == NULL) {
+      close(fd);
+      return -1;
+    }
+    a->cgroups = tmp;
+    a->cap_cgroups = cap;
+  }
+  if (id == a->n_cgroups) {
+    a->n_cgroups++;
+  }
+  a->cgroups[id].fd = fd;
+  a->cgroups[id].usec = usec;
+  a->cgroups[id].has_usec = 1;
+  a->cgroups[id].delta_usec = 0;
+  a->cgroups[id].joules = 0;
+  return id;
+}
+
+int raplcap_attrib_remove_cgroup(raplcap_attrib* a, int id) {
+  if (a == NULL || id < 0 || id >= a->n_cgroups || a->cgroups[id].fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  close(a->cgroups[id].fd);
+  a->cgroups[id].fd = -1;
+  return 0;
+}
+
+int raplcap_attrib_sample(raplcap_attrib* a) {
+  attrib_cgroup* cg;
+  uint64_t total_usec = 0;
+  uint64_t denom_usec = 0;
+  uint64_t usec;
+  double attributed = 0;
+  double joules;
+  double share;
+  int attribute = 1;
+  int i;
+  if (a == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((joules = read_energy(a)) < 0) {
+    raplcap_perror(WARN, "raplcap_attrib_sample: raplcap_get_energy_snapshot");
+    return -1;
+  }
+  if (a->root_fd >= 0) {
+    if (read_usage(a->root_fd, &usec)) {
+      raplcap_perror(WARN, "raplcap_attrib_sample: Failed to read root cgroup CPU time");
+      return -1;
+    }
+    if (usec < a->root_usec) {
+      raplcap_log(WARN, "raplcap_attrib_sample: Root cgroup CPU time decreased, not attributing this interval\n");
+      attribute = 0;
+    } else {
+      denom_usec = usec - a->root_usec;
+    }
+    a->root_usec = usec;
+  }
+  for (i = 0; i < a->n_cgroups; i++) {
+    cg = &a->cgroups[i];
+    cg->delta_usec = 0;
+    if (cg->fd < 0) {
+      continue;
+    }
+    if (read_usage(cg->fd, &usec)) {
+      raplcap_log(WARN, "raplcap_attrib_sample: Failed to read CPU time for cgroup ID %d\n", i);
+      cg->has_usec = 0;
+      continue;
+    }
+    // without a valid baseline, this read is the new baseline
+    if (cg->has_usec && usec >= cg->usec) {
+      cg->delta_usec = usec - cg->usec;
+      total_usec += cg->delta_usec;
+    }
+    cg->usec = usec;
+    cg->has_usec = 1;
+  }
+  // tracked cgroups can exceed the root's time only because their files are read after the root's
+  if (denom_usec < total_usec) {
+    denom_usec = total_usec;
+  }
+  if (attribute && denom_usec > 0) {
+    for (i = 0; i < a->n_cgroups; i++) {
+      cg = &a->cgroups[i];
+      if (cg->delta_usec > 0) {
+        share = joules * (double) cg->delta_usec / (double) denom_usec;
+        cg->joules += share;
+        attributed += share;
+      }
+    }
+  }
+  a->unattributed += joules > attributed ? joules - attributed : 0;
+  return 0;
+}
+
+double raplcap_attrib_get_energy(const raplcap_attrib* a, int id) {
+  if (a == NULL || id < 0 || id >= a->n_cgroups || a->cgroups[id].fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return a->cgroups[id].joules;
+}
+
+double raplcap_attrib_get_unattributed_energy(const raplcap_attrib* a) {
+  if (a == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  return a->unattributed;
+}
+
+int raplcap_attrib_destroy(raplcap_attrib* a) {
+  int i;
+  if (a == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (i = 0; i < a->n_cgroups; i++) {
+    if (a->cgroups[i].fd >= 0) {
+      close(a->cgroups[i].fd);
+    }
+  }
+  if (a->root_fd >= 0) {
+    close(a->root_fd);
+  }
+  free(a->cgroups);
+  free(a->max);
+  free(a->last);
+  free(a->snapshot);
+  free(a);
+  return 0;
+}
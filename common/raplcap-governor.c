@@ -0,0 +1,374 @@
+/**
+ * Power budget governor, common to all implementations.
+ *
+ * Each update, a zone is saturated if its power is within GOVERNOR_SATURATION of its limit, i.e., it's likely being
+ * capped and would use more power if allowed.
+ * Unsaturated zones are assigned their power plus GOVERNOR_HEADROOM, and saturated zones are assigned at least their
+ * power, so the remaining budget is the slack.
+ * Slack is divided among saturated zones in proportion to their power, or among all zones if none are saturated.
+ * If the assignments exceed the budget, everything above the zones' minimum limits is scaled down to fit.
+ *
+ * Writes that lower limits are applied before writes that raise them, and raises are capped by the budget that's
+ * actually been released, so the sum of written limits never exceeds the budget, even when a decrease is skipped.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for clock_gettime
+#define _POSIX_C_SOURCE 199309L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+#include "raplcap.h"
+#include "raplcap-common.h"
+#include "raplcap-governor.h"
+
+#define ONE_BILLION 1000000000ULL
+
+#ifndef GOVERNOR_SATURATION
+  #define GOVERNOR_SATURATION 0.05
+#endif
+
+#ifndef GOVERNOR_HEADROOM
+  #define GOVERNOR_HEADROOM 0.1
+#endif
+
+typedef struct governor_zone {
+  uint32_t pkg;
+  uint32_t die;
+  raplcap_zone zone;
+  // index into snapshot-ordered arrays
+  uint32_t idx;
+  double max;
+  // the last energy counter value, or < 0 if unknown
+  double last;
+  // the last measured power, or < 0 if unknown
+  double watts;
+  // the assigned limit, and the last written (or initially read) limit, or < 0 if unknown
+  double limit;
+  double written;
+  // if the zone was running at its limit in the latest update
+  int saturated;
+  // 0 if never written
+  uint64_t write_ns;
+} governor_zone;
+
+struct raplcap_governor {
+  const raplcap* rc;
+  raplcap_governor_config cfg;
+  governor_zone* zones;
+  uint32_t n_zones;
+  double* snapshot;
+  uint32_t n;
+  uint64_t ns;
+  uint64_t n_writes;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * ONE_BILLION) + (uint64_t) ts.tv_nsec;
+}
+
+static double max_dbl(double a, double b) {
+  return a > b ? a : b;
+}
+
+static int check_budget(const raplcap_governor_config* cfg, uint32_t n_zones) {
+  if (!(cfg->budget_watts > 0) || cfg->budget_watts < cfg->min_watts * n_zones) {
+    raplcap_log(ERROR, "Budget %.3f W can't cover minimum %.3f W for %"PRIu32" zones\n",
+                cfg->budget_watts, cfg->min_watts, n_zones);
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+static int is_governed(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  return raplcap_pd_is_zone_supported(rc, pkg, die, zone) > 0 &&
+         raplcap_pd_is_constraint_supported(rc, pkg, die, zone, RAPLCAP_CONSTRAINT_LONG_TERM) > 0;
+}
+
+static int init_zones(raplcap_governor* g) {
+  const raplcap_zone zones[] = { RAPLCAP_ZONE_PACKAGE, RAPLCAP_ZONE_DRAM };
+  const uint32_t n_types = g->cfg.dram ? 2 : 1;
+  raplcap_limit limit;
+  governor_zone* z;
+  uint32_t n_pkg;
+  uint32_t n_die;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t off;
+  uint32_t t;
+  if ((n_pkg = raplcap_get_num_packages(g->rc)) == 0) {
+    return -1;
+  }
+  // at most one zone of each type per die in the snapshot
+  if ((g->zones = calloc(g->n / RAPLCAP_NZONES * n_types, sizeof(*g->zones))) == NULL) {
+    return -1;
+  }
+  for (pkg = 0, off = 0; pkg < n_pkg; pkg++, off += n_die) {
+    if ((n_die = raplcap_get_num_die(g->rc, pkg)) == 0) {
+      return -1;
+    }
+    for (die = 0; die < n_die; die++) {
+      for (t = 0; t < n_types; t++) {
+        if ((off + die + 1) * RAPLCAP_NZONES > g->n || !is_governed(g->rc, pkg, die, zones[t])) {
+          continue;
+        }
+        z = &g->zones[g->n_zones];
+        z->pkg = pkg;
+        z->die = die;
+        z->zone = zones[t];
+        z->idx = (off + die) * RAPLCAP_NZONES + (uint32_t) zones[t];
+        if (g->snapshot[z->idx] < 0 || (z->max = raplcap_pd_get_energy_counter_max(g->rc, pkg, die, zones[t])) < 0) {
+          continue;
+        }
+        z->last = g->snapshot[z->idx];
+        z->watts = -1;
+        // start from the current limit so that unchanged limits aren't rewritten
+        z->written = raplcap_pd_get_limit(g->rc, pkg, die, zones[t], RAPLCAP_CONSTRAINT_LONG_TERM, &limit) ? -1 :
+                     limit.watts;
+        z->limit = z->written;
+        g->n_zones++;
+      }
+    }
+  }
+  return 0;
+}
+
+static void measure(raplcap_governor* g, double seconds) {
+  governor_zone* z;
+  double joules;
+  double cur;
+  uint32_t i;
+  for (i = 0; i < g->n_zones; i++) {
+    z = &g->zones[i];
+    if ((cur = g->snapshot[z->idx]) < 0) {
+      // keep the previous measurement, and restart from the next good read
+      z->last = -1;
+      continue;
+    }
+    if (z->last >= 0 && seconds > 0) {
+      joules = cur >= z->last ? cur - z->last : (z->max - z->last) + cur;
+      z->watts = joules / seconds;
+    }
+    z->last = cur;
+  }
+}
+
+static int is_saturated(const governor_zone* z) {
+  // without a measurement or a known limit, assume the zone wants its share
+  return z->watts < 0 || z->limit <= 0 || z->watts >= z->limit * (1 - GOVERNOR_SATURATION);
+}
+
+static void allocate(raplcap_governor* g) {
+  const double min = g->cfg.min_watts;
+  governor_zone* z;
+  double total = 0;
+  double weight = 0;
+  double slack;
+  double scale;
+  uint32_t n_saturated = 0;
+  uint32_t i;
+  // baseline assignments
+  for (i = 0; i < g->n_zones; i++) {
+    z = &g->zones[i];
+    if ((z->saturated = is_saturated(z))) {
+      z->limit = max_dbl(min, max_dbl(z->watts, 0));
+      n_saturated++;
+    } else {
+      z->limit = max_dbl(min, z->watts * (1 + GOVERNOR_HEADROOM));
+    }
+    total += z->limit;
+  }
+  if (total > g->cfg.budget_watts) {
+    // shrink toward the minimums, which check_budget guarantees fit
+    scale = (g->cfg.budget_watts - min * g->n_zones) / (total - min * g->n_zones);
+    for (i = 0; i < g->n_zones; i++) {
+      g->zones[i].limit = min + (g->zones[i].limit - min) * scale;
+    }
+    return;
+  }
+  // distribute slack by size, so a zone that's idle at its minimum doesn't take an equal share
+  slack = g->cfg.budget_watts - total;
+  for (i = 0; i < g->n_zones; i++) {
+    if (n_saturated == 0 || g->zones[i].saturated) {
+      weight += max_dbl(g->zones[i].limit, 1);
+    }
+  }
+  for (i = 0; i < g->n_zones; i++) {
+    z = &g->zones[i];
+    if (n_saturated == 0 || z->saturated) {
+      z->limit += slack * max_dbl(z->limit, 1) / weight;
+    }
+  }
+}
+
+static int write_limit(raplcap_governor* g, governor_zone* z, double watts, uint64_t ns) {
+  // a time window of 0 leaves the current window unchanged
+  const raplcap_limit limit = { 0, watts };
+  raplcap_log(DEBUG, "raplcap_governor_update: pkg=%"PRIu32", die=%"PRIu32", zone=%d: %.3f -> %.3f W\n",
+              z->pkg, z->die, z->zone, z->written, watts);
+  if (raplcap_pd_set_limit(g->rc, z->pkg, z->die, z->zone, RAPLCAP_CONSTRAINT_LONG_TERM, &limit)) {
+    return -1;
+  }
+  z->written = watts;
+  z->write_ns = ns;
+  g->n_writes++;
+  return 0;
+}
+
+static int can_write(const raplcap_governor* g, const governor_zone* z, double watts, uint64_t ns) {
+  const double step = watts > z->written ? watts - z->written : z->written - watts;
+  if (z->written >= 0 && step < g->cfg.min_step_watts) {
+    return 0;
+  }
+  return z->write_ns == 0 || ns - z->write_ns >= g->cfg.min_write_interval_ns;
+}
+
+static int apply(raplcap_governor* g, uint64_t ns) {
+  governor_zone* z;
+  double headroom = g->cfg.budget_watts;
+  double watts;
+  uint32_t n_failed = 0;
+  uint32_t i;
+  int err = 0;
+  // lower limits first, and unknown limits must be written to be accounted for
+  for (i = 0; i < g->n_zones; i++) {
+    z = &g->zones[i];
+    if ((z->written < 0 || z->limit < z->written) && can_write(g, z, z->limit, ns) &&
+        write_limit(g, z, z->limit, ns) && n_failed++ == 0) {
+      err = errno;
+    }
+    // a zone whose limit is still unknown reserves its assignment
+    headroom -= z->written < 0 ? z->limit : z->written;
+  }
+  // then raise limits with the budget that was released
+  for (i = 0; i < g->n_zones && headroom > 0; i++) {
+    z = &g->zones[i];
+    if (z->written < 0 || z->limit <= z->written) {
+      continue;
+    }
+    watts = z->written + (z->limit - z->written < headroom ? z->limit - z->written : headroom);
+    if (can_write(g, z, watts, ns)) {
+      headroom -= watts - z->written;
+      if (write_limit(g, z, watts, ns) && n_failed++ == 0) {
+        err = errno;
+      }
+    }
+  }
+  if (n_failed > 0) {
+    raplcap_log(ERROR, "raplcap_governor_update: Failed to write %"PRIu32" limit(s)\n", n_failed);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+raplcap_governor* raplcap_governor_init(const raplcap* rc, const raplcap_governor_config* cfg) {
+  raplcap_governor* g;
+  int len;
+  raplcap_log(DEBUG, "raplcap_governor_init\n");
+  if (cfg == NULL || cfg->min_watts < 0 || cfg->min_step_watts < 0 || check_budget(cfg, 0)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((len = raplcap_get_energy_snapshot(rc, NULL, 0)) <= 0) {
+    return NULL;
+  }
+  if ((g = calloc(1, sizeof(*g))) == NULL) {
+    return NULL;
+  }
+  g->rc = rc;
+  g->cfg = *cfg;
+  g->n = (uint32_t) len;
+  if ((g->snapshot = malloc(g->n * sizeof(*g->snapshot))) == NULL) {
+    free(g);
+    return NULL;
+  }
+  g->ns = now_ns();
+  if (raplcap_get_energy_snapshot(rc, g->snapshot, g->n) < 0 || init_zones(g)) {
+    raplcap_governor_destroy(g);
+    return NULL;
+  }
+  if (g->n_zones == 0) {
+    raplcap_log(ERROR, "raplcap_governor_init: No zones support long term power limits\n");
+    raplcap_governor_destroy(g);
+    errno = ENOTSUP;
+    return NULL;
+  }
+  if (check_budget(cfg, g->n_zones)) {
+    raplcap_governor_destroy(g);
+    errno = EINVAL;
+    return NULL;
+  }
+  return g;
+}
+
+int raplcap_governor_update(raplcap_governor* g) {
+  uint64_t ns;
+  if (g == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (raplcap_get_energy_snapshot(g->rc, g->snapshot, g->n) < 0) {
+    raplcap_perror(WARN, "raplcap_governor_update: raplcap_get_energy_snapshot");
+    return -1;
+  }
+  ns = now_ns();
+  measure(g, (double) (ns - g->ns) / ONE_BILLION);
+  g->ns = ns;
+  allocate(g);
+  return apply(g, ns);
+}
+
+int raplcap_governor_set_budget(raplcap_governor* g, double budget_watts) {
+  raplcap_governor_config cfg;
+  if (g == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  cfg = g->cfg;
+  cfg.budget_watts = budget_watts;
+  if (check_budget(&cfg, g->n_zones)) {
+    return -1;
+  }
+  g->cfg.budget_watts = budget_watts;
+  return 0;
+}
+
+double raplcap_governor_get_limit(const raplcap_governor* g, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  uint32_t i;
+  if (g == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (i = 0; i < g->n_zones; i++) {
+    if (g->zones[i].pkg == pkg && g->zones[i].die == die && g->zones[i].zone == zone) {
+      return g->zones[i].limit;
+    }
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+uint64_t raplcap_governor_get_num_writes(const raplcap_governor* g) {
+  if (g == NULL) {
+    errno = EINVAL;
+    return 0;
+  }
+  return g->n_writes;
+}
+
+int raplcap_governor_destroy(raplcap_governor* g) {
+  if (g == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  free(g->zones);
+  free(g->snapshot);
+  free(g);
+  return 0;
+}
@@ -0,0 +1,102 @@
+/**
+ * Instantaneous power estimates, common to all implementations.
+ *
+ * RAPL energy counters only update about once per millisecond, so the energy difference between two arbitrary reads
+ * is off by up to an update period of energy at each end, regardless of how accurately the reads are timestamped.
+ * Instead, the counter is polled at each end of the window until it ticks, so both samples are aligned with counter
+ * updates, and each read is timestamped at its midpoint.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for clock_nanosleep
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include "raplcap.h"
+#include "raplcap-common.h"
+
+#define ONE_BILLION 1000000000ULL
+
+// How long to poll for a counter update - a few update periods, after which the zone is assumed to be idle
+#ifndef RAPLCAP_POWER_EDGE_TIMEOUT_NS
+  #define RAPLCAP_POWER_EDGE_TIMEOUT_NS 3000000ULL
+#endif
+
+// CLOCK_MONOTONIC is served by the vDSO from the TSC on x86, so timestamps don't require a syscall
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * ONE_BILLION) + (uint64_t) ts.tv_nsec;
+}
+
+static int read_energy(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                       double* joules, uint64_t* ns) {
+  const uint64_t before = now_ns();
+  *joules = raplcap_pd_get_energy_counter(rc, pkg, die, zone);
+  *ns = before + (now_ns() - before) / 2;
+  return *joules < 0 ? -1 : 0;
+}
+
+// Poll until the counter changes, or until the timeout expires, in which case the latest read is used
+static int read_energy_edge(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                            double* joules, uint64_t* ns) {
+  uint64_t timeout_ns;
+  double first;
+  if (read_energy(rc, pkg, die, zone, &first, ns)) {
+    return -1;
+  }
+  timeout_ns = *ns + RAPLCAP_POWER_EDGE_TIMEOUT_NS;
+  do {
+    if (read_energy(rc, pkg, die, zone, joules, ns)) {
+      return -1;
+    }
+  } while (is_zero_dbl(*joules - first) && *ns < timeout_ns);
+  return 0;
+}
+
+static int sleep_until(uint64_t deadline_ns) {
+  struct timespec ts;
+  int err;
+  ts.tv_sec = (time_t) (deadline_ns / ONE_BILLION);
+  ts.tv_nsec = (long) (deadline_ns % ONE_BILLION);
+  while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) == EINTR) {
+    // interrupted by a signal handler - keep sleeping
+  }
+  if (err) {
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+double raplcap_pd_get_power(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone, double seconds) {
+  double joules_max;
+  double joules_start;
+  double joules_end;
+  double joules;
+  uint64_t ns_start;
+  uint64_t ns_end;
+  raplcap_log(DEBUG, "raplcap_pd_get_power: pkg=%"PRIu32", die=%"PRIu32", zone=%d, seconds=%f\n",
+              pkg, die, zone, seconds);
+  if (!(seconds > 0)) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((joules_max = raplcap_pd_get_energy_counter_max(rc, pkg, die, zone)) < 0 ||
+      read_energy_edge(rc, pkg, die, zone, &joules_start, &ns_start)) {
+    return -1;
+  }
+  // the window is then extended to the next counter update, and measured as such
+  if (sleep_until(ns_start + (uint64_t) (seconds * ONE_BILLION))) {
+    raplcap_perror(ERROR, "raplcap_pd_get_power: clock_nanosleep");
+    return -1;
+  }
+  if (read_energy_edge(rc, pkg, die, zone, &joules_end, &ns_end)) {
+    return -1;
+  }
+  // the counter can roll over at most once in a window, which is much shorter than the rollover period
+  joules = joules_end >= joules_start ? joules_end - joules_start : (joules_max - joules_start) + joules_end;
+  return joules / ((double) (ns_end - ns_start) / ONE_BILLION);
+}
@@ -0,0 +1,277 @@
+/**
+ * Region-of-interest energy profiling, common to all implementations.
+ *
+ * Each thread owns a cache-aligned table, so markers only write thread-private memory, except when a thread first
+ * claims its table (or fails to).
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for clock_gettime, posix_memalign
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "raplcap.h"
+#include "raplcap-common.h"
+#include "raplcap-roi.h"
+#include "raplcap-sampler.h"
+
+#define ONE_BILLION 1000000000ULL
+
+typedef struct roi_entry {
+  // totals
+  uint64_t count;
+  uint64_t ns;
+  double joules;
+  uint64_t errors;
+  // the outermost open region
+  uint64_t begin_ns;
+  double begin_joules;
+  uint32_t depth;
+} roi_entry;
+
+typedef struct roi_state {
+  const raplcap* rc;
+  const raplcap_sampler* s;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t n_regions;
+  uint32_t max_threads;
+  // the energy counter's rollover value, if not using a sampler
+  double max;
+  // max_threads tables of table_size bytes each
+  unsigned char* tables;
+  size_t table_size;
+  // shared by all threads
+  uint32_t n_threads;
+  uint64_t dropped;
+  uint64_t gen;
+} roi_state;
+
+static roi_state* roi = NULL;
+// distinguishes tables claimed in previous initializations
+static uint64_t roi_gen = 0;
+static __thread roi_entry* tls_table = NULL;
+static __thread uint64_t tls_gen = 0;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * ONE_BILLION) + (uint64_t) ts.tv_nsec;
+}
+
+static roi_entry* get_table(roi_state* r) {
+  uint32_t idx;
+  if (tls_gen != r->gen) {
+    tls_gen = r->gen;
+    idx = __atomic_fetch_add(&r->n_threads, 1, __ATOMIC_RELAXED);
+    tls_table = idx < r->max_threads ? (roi_entry*) (void*) &r->tables[idx * r->table_size] : NULL;
+  }
+  return tls_table;
+}
+
+static roi_entry* get_entry(uint32_t id) {
+  roi_state* r = roi;
+  roi_entry* table;
+  if (r == NULL) {
+    return NULL;
+  }
+  if ((table = get_table(r)) == NULL) {
+    __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  if (id >= r->n_regions) {
+    // charged to the first region, since there's nowhere else to put it
+    table[0].errors++;
+    return NULL;
+  }
+  return &table[id];
+}
+
+static int read_energy(const roi_state* r, double* joules, uint64_t* ns) {
+  uint64_t sample_ns;
+  double watts;
+  if (r->s == NULL) {
+    *joules = raplcap_pd_get_energy_counter(r->rc, r->pkg, r->die, RAPLCAP_ZONE_PACKAGE);
+    *ns = now_ns();
+    return *joules < 0 ? -1 : 0;
+  }
+  if ((*joules = raplcap_sampler_get_energy(r->s, r->pkg, r->die, RAPLCAP_ZONE_PACKAGE, &sample_ns)) < 0) {
+    return -1;
+  }
+  *ns = now_ns();
+  // power isn't available until the sampler has two samples
+  if ((watts = raplcap_sampler_get_power(r->s, r->pkg, r->die, RAPLCAP_ZONE_PACKAGE)) > 0 && *ns > sample_ns) {
+    *joules += watts * (double) (*ns - sample_ns) / ONE_BILLION;
+  }
+  return 0;
+}
+
+void raplcap_roi_begin(uint32_t id) {
+  roi_entry* e;
+  if ((e = get_entry(id)) == NULL) {
+    return;
+  }
+  if (e->depth++ > 0) {
+    return;
+  }
+  if (read_energy(roi, &e->begin_joules, &e->begin_ns)) {
+    e->begin_joules = -1;
+  }
+}
+
+void raplcap_roi_end(uint32_t id) {
+  roi_entry* e;
+  uint64_t ns;
+  double joules;
+  if ((e = get_entry(id)) == NULL) {
+    return;
+  }
+  if (e->depth == 0) {
+    e->errors++;
+    return;
+  }
+  if (--e->depth > 0) {
+    return;
+  }
+  if (e->begin_joules < 0 || read_energy(roi, &joules, &ns)) {
+    e->errors++;
+    return;
+  }
+  joules -= e->begin_joules;
+  if (joules < 0) {
+    // counters roll over, but extrapolated sampler energy can overestimate slightly
+    joules = roi->s == NULL ? joules + roi->max : 0;
+  }
+  e->count++;
+  e->ns += ns - e->begin_ns;
+  e->joules += joules;
+}
+
+int raplcap_roi_init(const raplcap* rc, const raplcap_sampler* s, uint32_t pkg, uint32_t die,
+                     uint32_t n_regions, uint32_t max_threads) {
+  roi_state* r;
+  void* tables;
+  raplcap_log(DEBUG, "raplcap_roi_init: pkg=%"PRIu32", die=%"PRIu32", n_regions=%"PRIu32", max_threads=%"PRIu32"\n",
+              pkg, die, n_regions, max_threads);
+  if (roi != NULL || n_regions == 0 || max_threads == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((r = calloc(1, sizeof(*r))) == NULL) {
+    return -1;
+  }
+  r->rc = rc;
+  r->s = s;
+  r->pkg = pkg;
+  r->die = die;
+  r->n_regions = n_regions;
+  r->max_threads = max_threads;
+  if ((r->max = raplcap_pd_get_energy_counter_max(rc, pkg, die, RAPLCAP_ZONE_PACKAGE)) < 0) {
+    free(r);
+    return -1;
+  }
+  // no false sharing between threads' tables
+  r->table_size = (n_regions * sizeof(roi_entry) + RAPLCAP_CACHE_LINE_SIZE - 1) / RAPLCAP_CACHE_LINE_SIZE *
+                  RAPLCAP_CACHE_LINE_SIZE;
+  if ((errno = posix_memalign(&tables, RAPLCAP_CACHE_LINE_SIZE, r->table_size * max_threads))) {
+    free(r);
+    return -1;
+  }
+  r->tables = memset(tables, 0, r->table_size * max_threads);
+  r->gen = ++roi_gen;
+  roi = r;
+  return 0;
+}
+
+static void get_totals(const roi_state* r, uint32_t id, uint64_t* count, uint64_t* ns, double* joules,
+                       uint64_t* errors) {
+  const roi_entry* e;
+  uint32_t n_threads = __atomic_load_n(&r->n_threads, __ATOMIC_RELAXED);
+  uint32_t t;
+  if (n_threads > r->max_threads) {
+    n_threads = r->max_threads;
+  }
+  *count = 0;
+  *ns = 0;
+  *joules = 0;
+  *errors = 0;
+  for (t = 0; t < n_threads; t++) {
+    e = &((const roi_entry*) (const void*) &r->tables[t * r->table_size])[id];
+    *count += e->count;
+    *ns += e->ns;
+    *joules += e->joules;
+    *errors += e->errors;
+  }
+}
+
+int raplcap_roi_get(uint32_t id, uint64_t* count, double* seconds, double* joules) {
+  uint64_t c;
+  uint64_t ns;
+  uint64_t errors;
+  double j;
+  if (roi == NULL || id >= roi->n_regions) {
+    errno = EINVAL;
+    return -1;
+  }
+  get_totals(roi, id, &c, &ns, &j, &errors);
+  if (count != NULL) {
+    *count = c;
+  }
+  if (seconds != NULL) {
+    *seconds = (double) ns / ONE_BILLION;
+  }
+  if (joules != NULL) {
+    *joules = j;
+  }
+  return 0;
+}
+
+int raplcap_roi_report(FILE* f) {
+  uint64_t count;
+  uint64_t ns;
+  uint64_t errors;
+  uint64_t dropped;
+  double joules;
+  double seconds;
+  uint32_t id;
+  if (roi == NULL || f == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (fprintf(f, "%8s %12s %14s %14s %10s %8s\n", "REGION", "COUNT", "SECONDS", "JOULES", "WATTS", "ERRORS") < 0) {
+    return -1;
+  }
+  for (id = 0; id < roi->n_regions; id++) {
+    get_totals(roi, id, &count, &ns, &joules, &errors);
+    if (count == 0 && errors == 0) {
+      continue;
+    }
+    seconds = (double) ns / ONE_BILLION;
+    if (fprintf(f, "%8"PRIu32" %12"PRIu64" %14.6f %14.6f %10.3f %8"PRIu64"\n",
+                id, count, seconds, joules, seconds > 0 ? joules / seconds : 0, errors) < 0) {
+      return -1;
+    }
+  }
+  if ((dropped = __atomic_load_n(&roi->dropped, __ATOMIC_RELAXED)) > 0 &&
+      fprintf(f, "Markers dropped from threads beyond the limit of %"PRIu32": %"PRIu64"\n",
+              roi->max_threads, dropped) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int raplcap_roi_destroy(void) {
+  if (roi == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  free(roi->tables);
+  free(roi);
+  roi = NULL;
+  return 0;
+}
@@ -0,0 +1,517 @@
+/**
+ * Background energy sampler.
+ *
+ * The ring buffer has a single producer (the sampler thread) and any number of consumers.
+ * Each slot has a sequence number that is odd while the producer is writing the slot, and which increases by 2 every
+ * time the slot is written, so consumers can validate both that a sample is consistent and that it's the sample they
+ * expected (and not a newer one that has since overwritten it).
+ *
+ * In adaptive mode, each supported zone is read individually on its own cadence, which doubles (up to a maximum) every
+ * time the zone's measured power is within the error bound of its previous measurement, and otherwise resets to every
+ * interval.
+ * Between reads, a zone's published energy is extrapolated at its last measured power, and published energy never
+ * decreases when a read shows that the extrapolation overestimated.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for clock_nanosleep, posix_memalign, pthread_attr_setaffinity_np
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "raplcap.h"
+#include "raplcap-common.h"
+#include "raplcap-sampler.h"
+
+#define ONE_BILLION 1000000000ULL
+
+// adaptive scheduling state for a supported zone, only used by the producer
+typedef struct sampler_zone {
+  uint32_t pkg;
+  uint32_t die;
+  raplcap_zone zone;
+  // index into snapshot-ordered arrays
+  uint32_t idx;
+  // read every skip intervals, and countdown intervals remain until the next read
+  uint32_t skip;
+  uint32_t countdown;
+  // the last measured power, or < 0 if unknown
+  double watts;
+  uint64_t read_ns;
+} sampler_zone;
+
+typedef struct raplcap_sampler_slot {
+  uint64_t seq;
+  uint64_t ns;
+  // indexed the same as raplcap_get_energy_snapshot, but accumulated since the sampler was started
+  double joules[];
+} raplcap_sampler_slot;
+
+struct raplcap_sampler {
+  const raplcap* rc;
+  pthread_t thread;
+  unsigned char* slots;
+  size_t slot_size;
+  uint32_t capacity;
+  uint32_t n;
+  uint32_t n_pkg;
+  // n_pkg + 1 elements; die counts may differ between packages, so die of package pkg are in range
+  // [die_offsets[pkg], die_offsets[pkg + 1])
+  uint32_t* die_offsets;
+  uint64_t interval_ns;
+  // adaptive mode - zones are read at most every max_skip intervals, NULL if not adaptive
+  sampler_zone* zones;
+  uint32_t n_zones;
+  uint32_t max_skip;
+  double max_error_watts;
+  // the number of published samples - shared with consumers
+  uint64_t head;
+  int stop;
+  // only used by the producer
+  double* snapshot;
+  double* last;
+  double* max;
+  double* total;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * ONE_BILLION) + (uint64_t) ts.tv_nsec;
+}
+
+static raplcap_sampler_slot* get_slot(const raplcap_sampler* s, uint64_t k) {
+  return (raplcap_sampler_slot*) (void*) (s->slots + ((k % s->capacity) * s->slot_size));
+}
+
+// Accumulate a counter value, returning the energy since the previous value, or < 0 if there is no previous value
+static double sampler_accumulate(raplcap_sampler* s, uint32_t i, double joules) {
+  double delta = -1;
+  if (s->last[i] >= 0) {
+    delta = joules >= s->last[i] ? joules - s->last[i] : (s->max[i] - s->last[i]) + joules;
+    s->total[i] += delta;
+  }
+  s->last[i] = joules;
+  return delta;
+}
+
+static int sampler_read_snapshot(raplcap_sampler* s) {
+  uint32_t i;
+  if (raplcap_get_energy_snapshot(s->rc, s->snapshot, s->n) < 0) {
+    raplcap_perror(WARN, "sampler_sample: raplcap_get_energy_snapshot");
+    return -1;
+  }
+  for (i = 0; i < s->n; i++) {
+    if (s->snapshot[i] >= 0 && s->max[i] > 0) {
+      sampler_accumulate(s, i, s->snapshot[i]);
+    }
+    // otherwise an unsupported zone or a failed read - keep the previous value as the baseline
+  }
+  return 0;
+}
+
+static void sampler_read_adaptive(raplcap_sampler* s, uint64_t ns) {
+  sampler_zone* z;
+  double joules;
+  double watts;
+  double err;
+  double est;
+  uint32_t i;
+  for (i = 0; i < s->n_zones; i++) {
+    z = &s->zones[i];
+    if (--z->countdown > 0) {
+      // not due - extrapolate at the last measured power for up to skip intervals, which can overshoot the next read
+      if (z->watts > 0) {
+        est = s->total[z->idx] + (z->watts * (double) (ns - z->read_ns) / ONE_BILLION);
+        s->snapshot[z->idx] = est > s->snapshot[z->idx] ? est : s->snapshot[z->idx];
+      }
+      continue;
+    }
+    if ((joules = raplcap_pd_get_energy_counter(s->rc, z->pkg, z->die, z->zone)) < 0) {
+      // retry next interval
+      z->countdown = 1;
+      continue;
+    }
+    if ((joules = sampler_accumulate(s, z->idx, joules)) >= 0 && ns > z->read_ns) {
+      watts = joules / ((double) (ns - z->read_ns) / ONE_BILLION);
+      err = watts >= z->watts ? watts - z->watts : z->watts - watts;
+      if (z->watts >= 0 && err <= s->max_error_watts) {
+        z->skip = z->skip < s->max_skip / 2 ? z->skip * 2 : s->max_skip;
+      } else {
+        z->skip = 1;
+      }
+      z->watts = watts;
+    }
+    z->read_ns = ns;
+    z->countdown = z->skip;
+    // the published value is the extrapolation if it overestimated, until actual energy catches up
+    s->snapshot[z->idx] = s->total[z->idx] > s->snapshot[z->idx] ? s->total[z->idx] : s->snapshot[z->idx];
+  }
+}
+
+static void sampler_sample(raplcap_sampler* s) {
+  raplcap_sampler_slot* slot;
+  uint64_t head;
+  uint64_t seq;
+  uint64_t ns;
+  uint32_t i;
+  if (s->zones != NULL) {
+    ns = now_ns();
+    sampler_read_adaptive(s, ns);
+  } else if (sampler_read_snapshot(s)) {
+    return;
+  } else {
+    ns = now_ns();
+  }
+  // only this thread writes head
+  head = __atomic_load_n(&s->head, __ATOMIC_RELAXED);
+  slot = get_slot(s, head);
+  seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&slot->ns, ns, __ATOMIC_RELAXED);
+  for (i = 0; i < s->n; i++) {
+    // in adaptive mode, the snapshot holds the published totals
+    __atomic_store(&slot->joules[i], s->max[i] > 0 && s->zones == NULL ? &s->total[i] : &s->snapshot[i],
+                   __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&s->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void* sampler_main(void* arg) {
+  raplcap_sampler* s = (raplcap_sampler*) arg;
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+    next.tv_sec += (time_t) (s->interval_ns / ONE_BILLION);
+    next.tv_nsec += (long) (s->interval_ns % ONE_BILLION);
+    if (next.tv_nsec >= (long) ONE_BILLION) {
+      next.tv_sec++;
+      next.tv_nsec -= (long) ONE_BILLION;
+    }
+    // an absolute deadline prevents drift from accumulating
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+    sampler_sample(s);
+  }
+  return NULL;
+}
+
+static void sampler_free(raplcap_sampler* s) {
+  free(s->zones);
+  free(s->total);
+  free(s->max);
+  free(s->last);
+  free(s->snapshot);
+  free(s->slots);
+  free(s->die_offsets);
+  free(s);
+}
+
+// Build the adaptive schedule from zones that are supported and have a rollover value
+static int sampler_init_adaptive(raplcap_sampler* s) {
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t i;
+  int zone;
+  if ((s->zones = calloc(s->n, sizeof(*s->zones))) == NULL) {
+    return -1;
+  }
+  for (pkg = 0, i = 0; pkg < s->n_pkg; pkg++) {
+    for (die = 0; die < s->die_offsets[pkg + 1] - s->die_offsets[pkg]; die++) {
+      for (zone = 0; zone < RAPLCAP_NZONES; zone++, i++) {
+        if (raplcap_pd_is_zone_supported(s->rc, pkg, die, (raplcap_zone) zone) > 0 &&
+            (s->max[i] = raplcap_pd_get_energy_counter_max(s->rc, pkg, die, (raplcap_zone) zone)) > 0) {
+          s->zones[s->n_zones].pkg = pkg;
+          s->zones[s->n_zones].die = die;
+          s->zones[s->n_zones].zone = (raplcap_zone) zone;
+          s->zones[s->n_zones].idx = i;
+          s->zones[s->n_zones].skip = 1;
+          s->zones[s->n_zones].countdown = 1;
+          s->zones[s->n_zones].watts = -1;
+          s->n_zones++;
+          s->snapshot[i] = 0;
+        } else {
+          // never read, so never available
+          s->max[i] = 0;
+          s->snapshot[i] = -1;
+        }
+        s->last[i] = -1;
+      }
+    }
+  }
+  raplcap_log(DEBUG, "sampler_init_adaptive: n_zones=%"PRIu32", max_skip=%"PRIu32"\n", s->n_zones, s->max_skip);
+  return 0;
+}
+
+// Discover which zones are supported and their rollover values
+static int sampler_init_snapshot(raplcap_sampler* s) {
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t i;
+  int zone;
+  if (raplcap_get_energy_snapshot(s->rc, s->snapshot, s->n) < 0) {
+    return -1;
+  }
+  for (pkg = 0, i = 0; pkg < s->n_pkg; pkg++) {
+    for (die = 0; die < s->die_offsets[pkg + 1] - s->die_offsets[pkg]; die++) {
+      for (zone = 0; zone < RAPLCAP_NZONES; zone++, i++) {
+        if (s->snapshot[i] >= 0) {
+          s->max[i] = raplcap_pd_get_energy_counter_max(s->rc, pkg, die, (raplcap_zone) zone);
+        }
+        s->last[i] = -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static raplcap_sampler* sampler_start(const raplcap* rc, uint64_t interval_ns, uint64_t max_interval_ns,
+                                      double max_error_watts, uint32_t capacity, int cpu) {
+  raplcap_sampler* s;
+  pthread_attr_t attr;
+  cpu_set_t cpus;
+  void* slots;
+  uint32_t pkg;
+  int n;
+  int ret;
+  if (interval_ns == 0 || capacity < 2 || cpu >= CPU_SETSIZE) {
+    raplcap_log(ERROR, "Sampler interval must be > 0, capacity must be >= 2, and cpu must be < %d\n", CPU_SETSIZE);
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((n = raplcap_get_energy_snapshot(rc, NULL, 0)) <= 0) {
+    return NULL;
+  }
+  if ((s = calloc(1, sizeof(*s))) == NULL) {
+    return NULL;
+  }
+  s->rc = rc;
+  s->capacity = capacity;
+  s->n = (uint32_t) n;
+  s->n_pkg = raplcap_get_num_packages(rc);
+  s->interval_ns = interval_ns;
+  s->max_skip = max_interval_ns / interval_ns > UINT32_MAX ? UINT32_MAX : (uint32_t) (max_interval_ns / interval_ns);
+  s->max_error_watts = max_error_watts;
+  // round slots up to cache line size so consumers reading one slot don't contend with the producer writing another
+  s->slot_size = sizeof(raplcap_sampler_slot) + (s->n * sizeof(double));
+  s->slot_size = ((s->slot_size + RAPLCAP_CACHE_LINE_SIZE - 1) / RAPLCAP_CACHE_LINE_SIZE) * RAPLCAP_CACHE_LINE_SIZE;
+  if ((s->die_offsets = calloc(s->n_pkg + 1, sizeof(*s->die_offsets))) == NULL) {
+    sampler_free(s);
+    return NULL;
+  }
+  for (pkg = 0; pkg < s->n_pkg; pkg++) {
+    s->die_offsets[pkg + 1] = s->die_offsets[pkg] + raplcap_get_num_die(rc, pkg);
+  }
+  if (s->n_pkg == 0 || s->die_offsets[s->n_pkg] * RAPLCAP_NZONES != s->n) {
+    // the snapshot layout doesn't match the expected topology
+    raplcap_log(ERROR, "raplcap_sampler_start: Unexpected snapshot length: %"PRIu32"\n", s->n);
+    sampler_free(s);
+    errno = ENOTSUP;
+    return NULL;
+  }
+  if ((s->snapshot = malloc(s->n * sizeof(*s->snapshot))) == NULL ||
+      (s->last = malloc(s->n * sizeof(*s->last))) == NULL ||
+      (s->max = calloc(s->n, sizeof(*s->max))) == NULL ||
+      (s->total = calloc(s->n, sizeof(*s->total))) == NULL) {
+    sampler_free(s);
+    return NULL;
+  }
+  if ((ret = posix_memalign(&slots, RAPLCAP_CACHE_LINE_SIZE, capacity * s->slot_size)) != 0) {
+    sampler_free(s);
+    errno = ret;
+    return NULL;
+  }
+  memset(slots, 0, capacity * s->slot_size);
+  s->slots = slots;
+  // max_interval_ns is 0 if not adaptive
+  if (s->max_skip > 0 ? sampler_init_adaptive(s) : sampler_init_snapshot(s)) {
+    sampler_free(s);
+    return NULL;
+  }
+  // the first sample is the baseline
+  sampler_sample(s);
+  if ((ret = pthread_attr_init(&attr)) != 0) {
+    sampler_free(s);
+    errno = ret;
+    return NULL;
+  }
+  if (cpu >= 0) {
+    CPU_ZERO(&cpus);
+    CPU_SET((size_t) cpu, &cpus);
+    ret = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+  }
+  if (ret == 0) {
+    ret = pthread_create(&s->thread, &attr, sampler_main, s);
+  }
+  pthread_attr_destroy(&attr);
+  if (ret != 0) {
+    raplcap_log(ERROR, "raplcap_sampler_start: Failed to start thread: %s\n", strerror(ret));
+    sampler_free(s);
+    errno = ret;
+    return NULL;
+  }
+  return s;
+}
+
+raplcap_sampler* raplcap_sampler_start(const raplcap* rc, uint64_t interval_ns, uint32_t capacity, int cpu) {
+  raplcap_log(DEBUG, "raplcap_sampler_start: interval_ns=%"PRIu64", capacity=%"PRIu32", cpu=%d\n",
+              interval_ns, capacity, cpu);
+  return sampler_start(rc, interval_ns, 0, 0, capacity, cpu);
+}
+
+raplcap_sampler* raplcap_sampler_start_adaptive(const raplcap* rc, uint64_t interval_ns, uint64_t max_interval_ns,
+                                                double max_error_watts, uint32_t capacity, int cpu) {
+  raplcap_log(DEBUG, "raplcap_sampler_start_adaptive: interval_ns=%"PRIu64", max_interval_ns=%"PRIu64", "
+              "max_error_watts=%f, capacity=%"PRIu32", cpu=%d\n",
+              interval_ns, max_interval_ns, max_error_watts, capacity, cpu);
+  if (interval_ns == 0 || max_interval_ns < interval_ns || !(max_error_watts >= 0)) {
+    raplcap_log(ERROR, "Sampler max interval must be >= interval > 0, and max error must be >= 0\n");
+    errno = EINVAL;
+    return NULL;
+  }
+  return sampler_start(rc, interval_ns, max_interval_ns, max_error_watts, capacity, cpu);
+}
+
+int raplcap_sampler_stop(raplcap_sampler* s) {
+  int ret;
+  if (s == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  __atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+  if ((ret = pthread_join(s->thread, NULL)) != 0) {
+    raplcap_log(ERROR, "raplcap_sampler_stop: Failed to join thread: %s\n", strerror(ret));
+    errno = ret;
+    return -1;
+  }
+  sampler_free(s);
+  return 0;
+}
+
+uint64_t raplcap_sampler_get_num_samples(const raplcap_sampler* s) {
+  return s == NULL ? 0 : __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+}
+
+static int get_index(const raplcap_sampler* s, uint32_t pkg, uint32_t die, raplcap_zone zone, uint32_t* idx) {
+  if (s == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (pkg >= s->n_pkg) {
+    raplcap_log(ERROR, "Package %"PRIu32" not in range [0, %"PRIu32")\n", pkg, s->n_pkg);
+    errno = EINVAL;
+    return -1;
+  }
+  if (die >= s->die_offsets[pkg + 1] - s->die_offsets[pkg]) {
+    raplcap_log(ERROR, "Die %"PRIu32" not in range [0, %"PRIu32")\n", die,
+                s->die_offsets[pkg + 1] - s->die_offsets[pkg]);
+    errno = EINVAL;
+    return -1;
+  }
+  if ((int) zone < 0 || (int) zone >= RAPLCAP_NZONES) {
+    errno = EINVAL;
+    return -1;
+  }
+  *idx = ((s->die_offsets[pkg] + die) * RAPLCAP_NZONES) + (uint32_t) zone;
+  return 0;
+}
+
+// Returns 0 on success, or -1 if sample k is being written or has been overwritten
+static int read_sample(const raplcap_sampler* s, uint64_t k, uint32_t idx, uint64_t* ns, double* joules) {
+  const raplcap_sampler_slot* slot = get_slot(s, k);
+  // sample k is the (k / capacity + 1)-th write to its slot
+  const uint64_t seq = 2 * ((k / s->capacity) + 1);
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq) {
+    return -1;
+  }
+  *ns = __atomic_load_n(&slot->ns, __ATOMIC_RELAXED);
+  __atomic_load(&slot->joules[idx], joules, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq ? 0 : -1;
+}
+
+double raplcap_sampler_get_energy(const raplcap_sampler* s, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                  uint64_t* ns) {
+  uint64_t head;
+  uint64_t t;
+  uint32_t idx;
+  double joules;
+  if (get_index(s, pkg, die, zone, &idx)) {
+    return -1;
+  }
+  do {
+    if ((head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE)) == 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+  } while (read_sample(s, head - 1, idx, &t, &joules));
+  if (joules < 0) {
+    errno = ENODATA;
+    return -1;
+  }
+  if (ns != NULL) {
+    *ns = t;
+  }
+  return joules;
+}
+
+double raplcap_sampler_get_power(const raplcap_sampler* s, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  return raplcap_sampler_get_power_avg(s, pkg, die, zone, 0);
+}
+
+double raplcap_sampler_get_power_avg(const raplcap_sampler* s, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                     uint64_t window_ns) {
+  uint64_t head;
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t mid;
+  uint64_t ns0;
+  uint64_t ns1;
+  uint64_t ns;
+  uint32_t idx;
+  double j0;
+  double j1;
+  double joules;
+  if (get_index(s, pkg, die, zone, &idx)) {
+    return -1;
+  }
+  for (;;) {
+    head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+    if (head < 2) {
+      errno = EAGAIN;
+      return -1;
+    }
+    if (read_sample(s, head - 1, idx, &ns1, &j1)) {
+      continue;
+    }
+    // binary search for the oldest sample in the window, excluding the slot the producer will write next
+    lo = head > s->capacity ? head - s->capacity + 1 : 0;
+    hi = head - 2;
+    while (lo < hi) {
+      mid = lo + ((hi - lo) / 2);
+      if (read_sample(s, mid, idx, &ns, &joules)) {
+        break;
+      }
+      if (ns1 - ns <= window_ns) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    if (lo == hi && !read_sample(s, lo, idx, &ns0, &j0)) {
+      break;
+    }
+    // the producer overwrote a sample we needed - try again
+  }
+  if (j0 < 0 || j1 < 0) {
+    errno = ENODATA;
+    return -1;
+  }
+  return (j1 - j0) / ((double) (ns1 - ns0) / ONE_BILLION);
+}
@@ -0,0 +1,245 @@
+/**
+ * Apply limits to all packages concurrently, common to all implementations.
+ *
+ * Writes to different packages are independent (and on some implementations each write requires an IPI to a CPU in
+ * the package), so each package is handled by its own thread, with the calling thread taking the first package.
+ * Threads are kept in a pool with the context, so they're only created by the first call.
+ * If another thread's call is using the pool, or the pool can't be created, packages are written by the calling thread.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for pthread, posix_memalign
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raplcap.h"
+#include "raplcap-common.h"
+#include "raplcap-set-all.h"
+
+typedef struct set_all_job {
+  const raplcap* rc;
+  const raplcap_limit* limit_long;
+  const raplcap_limit* limit_short;
+  raplcap_zone zone;
+} set_all_job;
+
+// each worker writes its results from its own thread, so workers are in their own cache line(s)
+typedef struct set_all_worker {
+  raplcap_set_all_pool* pool;
+  uint32_t pkg;
+  // results
+  uint32_t n_failed;
+  int err;
+  pthread_t thread;
+} RAPLCAP_CACHE_ALIGNED set_all_worker;
+
+struct raplcap_set_all_pool {
+  // held by a pool_run caller for its entire job
+  pthread_mutex_t run_lock;
+  // protects the fields below
+  pthread_mutex_t lock;
+  pthread_cond_t job_cond;
+  pthread_cond_t done_cond;
+  set_all_job job;
+  // incremented for each job
+  uint64_t gen;
+  // workers that haven't finished the current job
+  uint32_t pending;
+  int stop;
+  // n_pkg elements: workers[0] is the calling thread, workers [1, n_threads] have threads
+  set_all_worker* workers;
+  uint32_t n_pkg;
+  uint32_t n_threads;
+};
+
+static void set_all_pkg(const set_all_job* job, set_all_worker* w) {
+  uint32_t n_die;
+  uint32_t die;
+  if ((n_die = raplcap_get_num_die(job->rc, w->pkg)) == 0) {
+    if (w->n_failed++ == 0) {
+      w->err = errno;
+    }
+    return;
+  }
+  for (die = 0; die < n_die; die++) {
+    if (raplcap_pd_set_limits(job->rc, w->pkg, die, job->zone, job->limit_long, job->limit_short)) {
+      if (w->n_failed++ == 0) {
+        w->err = errno;
+      }
+    }
+  }
+}
+
+static void* set_all_thread(void* arg) {
+  set_all_worker* w = (set_all_worker*) arg;
+  raplcap_set_all_pool* pool = w->pool;
+  uint64_t gen = 0;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->stop && pool->gen == gen) {
+      pthread_cond_wait(&pool->job_cond, &pool->lock);
+    }
+    if (pool->stop) {
+      break;
+    }
+    gen = pool->gen;
+    pthread_mutex_unlock(&pool->lock);
+    set_all_pkg(&pool->job, w);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->pending == 0) {
+      pthread_cond_signal(&pool->done_cond);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+void raplcap_set_all_pool_destroy(raplcap_set_all_pool* pool) {
+  uint32_t i;
+  if (pool == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->job_cond);
+  pthread_mutex_unlock(&pool->lock);
+  for (i = 1; i <= pool->n_threads; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+  pthread_cond_destroy(&pool->done_cond);
+  pthread_cond_destroy(&pool->job_cond);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_mutex_destroy(&pool->run_lock);
+  free(pool->workers);
+  free(pool);
+  raplcap_log(DEBUG, "raplcap_set_all_pool_destroy: Destroyed\n");
+}
+
+static raplcap_set_all_pool* pool_create(uint32_t n_pkg) {
+  raplcap_set_all_pool* pool;
+  void* workers;
+  uint32_t i;
+  if ((pool = calloc(1, sizeof(*pool))) == NULL) {
+    return NULL;
+  }
+  if ((errno = posix_memalign(&workers, RAPLCAP_CACHE_LINE_SIZE, n_pkg * sizeof(*pool->workers))) != 0) {
+    free(pool);
+    return NULL;
+  }
+  pool->workers = workers;
+  memset(pool->workers, 0, n_pkg * sizeof(*pool->workers));
+  pool->n_pkg = n_pkg;
+  pthread_mutex_init(&pool->run_lock, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->job_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+  for (i = 0; i < n_pkg; i++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].pkg = i;
+  }
+  // packages without a thread are written by the calling thread
+  for (i = 1; i < n_pkg; i++) {
+    if ((errno = pthread_create(&pool->workers[i].thread, NULL, set_all_thread, &pool->workers[i])) != 0) {
+      raplcap_perror(DEBUG, "raplcap_set_limits_all: pthread_create");
+      break;
+    }
+    pool->n_threads++;
+  }
+  raplcap_log(DEBUG, "raplcap_set_limits_all: Created pool with %"PRIu32" threads\n", pool->n_threads);
+  return pool;
+}
+
+// Get the context's pool, creating it if needed - returns NULL if the context doesn't have one
+static raplcap_set_all_pool* get_pool(const raplcap* rc, uint32_t n_pkg) {
+  raplcap_set_all_pool** pp;
+  raplcap_set_all_pool* pool;
+  raplcap_set_all_pool* expected = NULL;
+  if ((pp = raplcap_get_set_all_pool(rc)) == NULL) {
+    return NULL;
+  }
+  if ((pool = __atomic_load_n(pp, __ATOMIC_ACQUIRE)) == NULL && (pool = pool_create(n_pkg)) != NULL) {
+    // concurrent first callers may race to create a pool, but only one is kept
+    if (!__atomic_compare_exchange_n(pp, &expected, pool, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      raplcap_set_all_pool_destroy(pool);
+      pool = expected;
+    }
+  }
+  // the topology doesn't change for a context's lifetime
+  return pool != NULL && pool->n_pkg == n_pkg ? pool : NULL;
+}
+
+// Returns non-zero without running the job if another thread is using the pool
+static int pool_run(raplcap_set_all_pool* pool, const set_all_job* job, uint32_t* n_failed, int* err) {
+  uint32_t i;
+  if (pthread_mutex_trylock(&pool->run_lock)) {
+    return 1;
+  }
+  for (i = 0; i < pool->n_pkg; i++) {
+    pool->workers[i].n_failed = 0;
+    pool->workers[i].err = 0;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->job = *job;
+  pool->pending = pool->n_threads;
+  pool->gen++;
+  pthread_cond_broadcast(&pool->job_cond);
+  pthread_mutex_unlock(&pool->lock);
+  set_all_pkg(job, &pool->workers[0]);
+  for (i = pool->n_threads + 1; i < pool->n_pkg; i++) {
+    set_all_pkg(job, &pool->workers[i]);
+  }
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->done_cond, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  // results in package order, so the first failure is reported
+  for (i = 0; i < pool->n_pkg; i++) {
+    if (pool->workers[i].n_failed > 0 && *n_failed == 0) {
+      *err = pool->workers[i].err;
+    }
+    *n_failed += pool->workers[i].n_failed;
+  }
+  pthread_mutex_unlock(&pool->run_lock);
+  return 0;
+}
+
+int raplcap_set_limits_all(const raplcap* rc, raplcap_zone zone,
+                           const raplcap_limit* limit_long, const raplcap_limit* limit_short) {
+  const set_all_job job = { rc, limit_long, limit_short, zone };
+  raplcap_set_all_pool* pool = NULL;
+  set_all_worker w;
+  uint32_t n_pkg;
+  uint32_t n_failed = 0;
+  int err = 0;
+  raplcap_log(DEBUG, "raplcap_set_limits_all: zone=%d\n", zone);
+  if ((int) zone < 0 || (int) zone >= RAPLCAP_NZONES) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((n_pkg = raplcap_get_num_packages(rc)) == 0) {
+    return -1;
+  }
+  if (n_pkg > 1) {
+    pool = get_pool(rc, n_pkg);
+  }
+  if (pool == NULL || pool_run(pool, &job, &n_failed, &err)) {
+    memset(&w, 0, sizeof(w));
+    for (w.pkg = 0; w.pkg < n_pkg; w.pkg++) {
+      set_all_pkg(&job, &w);
+    }
+    n_failed = w.n_failed;
+    err = w.err;
+  }
+  if (n_failed > 0) {
+    raplcap_log(ERROR, "raplcap_set_limits_all: Failed to set limits for %"PRIu32" package/die: %s\n",
+                n_failed, strerror(err));
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
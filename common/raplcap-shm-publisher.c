@@ -0,0 +1,235 @@
+/**
+ * Shared memory publisher, common to all implementations.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for clock_gettime
+#define _POSIX_C_SOURCE 199309L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "raplcap.h"
+#include "raplcap-common.h"
+#include "raplcap-shm.h"
+
+#define ONE_BILLION 1000000000ULL
+
+typedef struct shm_layout {
+  uint32_t size;
+  uint32_t n_pkg;
+  uint32_t n_pkg_die;
+  uint32_t die_offsets_offset;
+  uint32_t joules_offset;
+  uint32_t watts_offset;
+} shm_layout;
+
+struct raplcap_shm_publisher {
+  const raplcap* rc;
+  raplcap_shm_header* hdr;
+  double* joules;
+  double* watts;
+  uint32_t n;
+  // only used by the publisher
+  double* snapshot;
+  double* last;
+  double* max;
+  double* total;
+  double* total_prev;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * ONE_BILLION) + (uint64_t) ts.tv_nsec;
+}
+
+static uint32_t align8(size_t off) {
+  return (uint32_t) ((off + 7) & ~(size_t) 7);
+}
+
+// Compute the layout, returning the total size, or 0 on error
+static size_t get_layout(const raplcap* rc, shm_layout* hdr) {
+  uint64_t size;
+  uint32_t n;
+  int len;
+  memset(hdr, 0, sizeof(*hdr));
+  if ((hdr->n_pkg = raplcap_get_num_packages(rc)) == 0 || (len = raplcap_get_energy_snapshot(rc, NULL, 0)) <= 0) {
+    return 0;
+  }
+  n = (uint32_t) len;
+  hdr->n_pkg_die = n / RAPLCAP_NZONES;
+  hdr->die_offsets_offset = align8(sizeof(raplcap_shm_header));
+  hdr->joules_offset = align8(hdr->die_offsets_offset + (hdr->n_pkg + 1) * sizeof(uint32_t));
+  hdr->watts_offset = (uint32_t) (hdr->joules_offset + n * sizeof(double));
+  size = hdr->watts_offset + (uint64_t) n * sizeof(double);
+  if (size > UINT32_MAX) {
+    errno = EOVERFLOW;
+    return 0;
+  }
+  hdr->size = (uint32_t) size;
+  return hdr->size;
+}
+
+size_t raplcap_shm_get_size(const raplcap* rc) {
+  shm_layout hdr;
+  return get_layout(rc, &hdr);
+}
+
+static void publish(raplcap_shm_publisher* p, uint64_t ns, double seconds) {
+  uint64_t seq = __atomic_load_n(&p->hdr->seq, __ATOMIC_RELAXED);
+  double watts;
+  uint32_t i;
+  __atomic_store_n(&p->hdr->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&p->hdr->ns, ns, __ATOMIC_RELAXED);
+  for (i = 0; i < p->n; i++) {
+    // unsupported zones remain negative
+    if (p->max[i] > 0) {
+      watts = seconds > 0 ? (p->total[i] - p->total_prev[i]) / seconds : -1;
+      __atomic_store(&p->joules[i], &p->total[i], __ATOMIC_RELAXED);
+      __atomic_store(&p->watts[i], &watts, __ATOMIC_RELAXED);
+    }
+  }
+  __atomic_store_n(&p->hdr->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static int read_energy(raplcap_shm_publisher* p) {
+  uint32_t i;
+  if (raplcap_get_energy_snapshot(p->rc, p->snapshot, p->n) < 0) {
+    raplcap_perror(WARN, "raplcap_shm_publish: raplcap_get_energy_snapshot");
+    return -1;
+  }
+  memcpy(p->total_prev, p->total, p->n * sizeof(*p->total));
+  for (i = 0; i < p->n; i++) {
+    if (p->snapshot[i] < 0 || p->max[i] <= 0) {
+      // unsupported zone or a failed read - keep the previous value as the baseline
+      continue;
+    }
+    if (p->last[i] >= 0) {
+      p->total[i] += p->snapshot[i] >= p->last[i] ? p->snapshot[i] - p->last[i] :
+                                                    (p->max[i] - p->last[i]) + p->snapshot[i];
+    }
+    p->last[i] = p->snapshot[i];
+  }
+  return 0;
+}
+
+raplcap_shm_publisher* raplcap_shm_publisher_init(const raplcap* rc, void* mem, size_t len) {
+  raplcap_shm_publisher* p;
+  shm_layout layout;
+  uint32_t* die_offsets;
+  uint32_t magic;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t i;
+  int zone;
+  raplcap_log(DEBUG, "raplcap_shm_publisher_init: len=%zu\n", len);
+  if (mem == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (get_layout(rc, &layout) == 0) {
+    return NULL;
+  }
+  if (len < layout.size) {
+    raplcap_log(ERROR, "Shared memory length %zu is less than required length %"PRIu32"\n", len, layout.size);
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((p = calloc(1, sizeof(*p))) == NULL) {
+    return NULL;
+  }
+  p->rc = rc;
+  p->n = layout.n_pkg_die * RAPLCAP_NZONES;
+  if ((p->snapshot = malloc(p->n * sizeof(*p->snapshot))) == NULL ||
+      (p->last = malloc(p->n * sizeof(*p->last))) == NULL ||
+      (p->max = calloc(p->n, sizeof(*p->max))) == NULL ||
+      (p->total = calloc(p->n, sizeof(*p->total))) == NULL ||
+      (p->total_prev = calloc(p->n, sizeof(*p->total_prev))) == NULL) {
+    raplcap_shm_publisher_destroy(p);
+    return NULL;
+  }
+  // readers validate the magic, so it's written last
+  memset(mem, 0, layout.size);
+  p->hdr = mem;
+  p->hdr->version = RAPLCAP_SHM_VERSION;
+  p->hdr->size = layout.size;
+  p->hdr->n_pkg = layout.n_pkg;
+  p->hdr->n_pkg_die = layout.n_pkg_die;
+  p->hdr->die_offsets_offset = layout.die_offsets_offset;
+  p->hdr->joules_offset = layout.joules_offset;
+  p->hdr->watts_offset = layout.watts_offset;
+  die_offsets = (uint32_t*) (void*) ((char*) mem + layout.die_offsets_offset);
+  p->joules = (double*) (void*) ((char*) mem + layout.joules_offset);
+  p->watts = (double*) (void*) ((char*) mem + layout.watts_offset);
+  for (pkg = 0; pkg < layout.n_pkg; pkg++) {
+    die_offsets[pkg + 1] = die_offsets[pkg] + raplcap_get_num_die(rc, pkg);
+  }
+  if (die_offsets[layout.n_pkg] != layout.n_pkg_die) {
+    // the snapshot layout doesn't match the expected topology
+    raplcap_log(ERROR, "raplcap_shm_publisher_init: Unexpected snapshot length: %"PRIu32"\n", p->n);
+    raplcap_shm_publisher_destroy(p);
+    errno = ENOTSUP;
+    return NULL;
+  }
+  // discover which zones are supported and their rollover values
+  if (raplcap_get_energy_snapshot(rc, p->snapshot, p->n) < 0) {
+    raplcap_shm_publisher_destroy(p);
+    return NULL;
+  }
+  for (pkg = 0, i = 0; pkg < layout.n_pkg; pkg++) {
+    for (die = 0; die < die_offsets[pkg + 1] - die_offsets[pkg]; die++) {
+      for (zone = 0; zone < RAPLCAP_NZONES; zone++, i++) {
+        if (p->snapshot[i] >= 0) {
+          p->max[i] = raplcap_pd_get_energy_counter_max(rc, pkg, die, (raplcap_zone) zone);
+        }
+        p->last[i] = -1;
+        p->joules[i] = -1;
+        p->watts[i] = -1;
+      }
+    }
+  }
+  // the first read is the baseline
+  if (read_energy(p)) {
+    raplcap_shm_publisher_destroy(p);
+    return NULL;
+  }
+  publish(p, now_ns(), 0);
+  memcpy(&magic, RAPLCAP_SHM_MAGIC, sizeof(magic));
+  __atomic_store_n((uint32_t*) (void*) p->hdr->magic, magic, __ATOMIC_RELEASE);
+  return p;
+}
+
+int raplcap_shm_publish(raplcap_shm_publisher* p) {
+  uint64_t prev_ns;
+  uint64_t ns;
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (read_energy(p)) {
+    return -1;
+  }
+  ns = now_ns();
+  // only this thread writes the timestamp
+  prev_ns = __atomic_load_n(&p->hdr->ns, __ATOMIC_RELAXED);
+  publish(p, ns, (double) (ns - prev_ns) / ONE_BILLION);
+  return 0;
+}
+
+int raplcap_shm_publisher_destroy(raplcap_shm_publisher* p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  free(p->total_prev);
+  free(p->total);
+  free(p->max);
+  free(p->last);
+  free(p->snapshot);
+  free(p);
+  return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * Shared memory reader, independent of RAPLCap implementations.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for shm_open
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "raplcap-shm.h"
+
+#define SHM_NZONES (RAPLCAP_ZONE_PSYS + 1)
+
+struct raplcap_shm {
+  void* map;
+  size_t map_len;
+  const raplcap_shm_header* hdr;
+  const uint32_t* die_offsets;
+  const double* joules;
+  const double* watts;
+};
+
+static int validate_header(const raplcap_shm_header* hdr, size_t len) {
+  uint64_t n;
+  // the magic is checked first, by the caller
+  if (hdr->version != RAPLCAP_SHM_VERSION || hdr->size > len || hdr->n_pkg == 0 || hdr->n_pkg_die == 0 ||
+      hdr->die_offsets_offset % sizeof(uint64_t) || hdr->joules_offset % sizeof(double) ||
+      hdr->watts_offset % sizeof(double)) {
+    return -1;
+  }
+  n = (uint64_t) hdr->n_pkg_die * SHM_NZONES;
+  if (hdr->die_offsets_offset < sizeof(*hdr) ||
+      hdr->die_offsets_offset + (hdr->n_pkg + 1) * (uint64_t) sizeof(uint32_t) > hdr->size ||
+      hdr->joules_offset + n * sizeof(double) > hdr->size || hdr->watts_offset + n * sizeof(double) > hdr->size) {
+    return -1;
+  }
+  return 0;
+}
+
+static int validate_die_offsets(const raplcap_shm* shm) {
+  uint32_t pkg;
+  for (pkg = 0; pkg < shm->hdr->n_pkg; pkg++) {
+    if (shm->die_offsets[pkg + 1] <= shm->die_offsets[pkg]) {
+      return -1;
+    }
+  }
+  return shm->die_offsets[0] == 0 && shm->die_offsets[shm->hdr->n_pkg] == shm->hdr->n_pkg_die ? 0 : -1;
+}
+
+raplcap_shm* raplcap_shm_open(const char* name) {
+  raplcap_shm* shm;
+  struct stat st;
+  uint32_t magic;
+  int err_save;
+  int fd;
+  if ((shm = calloc(1, sizeof(*shm))) == NULL) {
+    return NULL;
+  }
+  if ((fd = shm_open(name == NULL ? RAPLCAP_SHM_DEFAULT_NAME : name, O_RDONLY, 0)) < 0) {
+    free(shm);
+    return NULL;
+  }
+  if (fstat(fd, &st)) {
+    err_save = errno;
+    close(fd);
+    free(shm);
+    errno = err_save;
+    return NULL;
+  }
+  if ((size_t) st.st_size < sizeof(raplcap_shm_header)) {
+    // the publisher may not have sized the region yet
+    close(fd);
+    free(shm);
+    errno = ENODATA;
+    return NULL;
+  }
+  shm->map_len = (size_t) st.st_size;
+  shm->map = mmap(NULL, shm->map_len, PROT_READ, MAP_SHARED, fd, 0);
+  err_save = errno;
+  close(fd);
+  if (shm->map == MAP_FAILED) {
+    free(shm);
+    errno = err_save;
+    return NULL;
+  }
+  shm->hdr = (const raplcap_shm_header*) shm->map;
+  // the layout is fixed once the magic is written, so it's read before any other header fields
+  magic = __atomic_load_n((const uint32_t*) (const void*) shm->hdr->magic, __ATOMIC_ACQUIRE);
+  if (memcmp(&magic, RAPLCAP_SHM_MAGIC, sizeof(magic)) || validate_header(shm->hdr, shm->map_len)) {
+    raplcap_shm_close(shm);
+    errno = EINVAL;
+    return NULL;
+  }
+  shm->die_offsets = (const uint32_t*) (const void*) ((const char*) shm->map + shm->hdr->die_offsets_offset);
+  shm->joules = (const double*) (const void*) ((const char*) shm->map + shm->hdr->joules_offset);
+  shm->watts = (const double*) (const void*) ((const char*) shm->map + shm->hdr->watts_offset);
+  if (validate_die_offsets(shm)) {
+    raplcap_shm_close(shm);
+    errno = EINVAL;
+    return NULL;
+  }
+  return shm;
+}
+
+int raplcap_shm_close(raplcap_shm* shm) {
+  int ret = 0;
+  if (shm == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (shm->map != NULL && munmap(shm->map, shm->map_len)) {
+    ret = -1;
+  }
+  free(shm);
+  return ret;
+}
+
+uint32_t raplcap_shm_get_num_packages(const raplcap_shm* shm) {
+  if (shm == NULL) {
+    errno = EINVAL;
+    return 0;
+  }
+  return shm->hdr->n_pkg;
+}
+
+uint32_t raplcap_shm_get_num_die(const raplcap_shm* shm, uint32_t pkg) {
+  if (shm == NULL || pkg >= shm->hdr->n_pkg) {
+    errno = EINVAL;
+    return 0;
+  }
+  return shm->die_offsets[pkg + 1] - shm->die_offsets[pkg];
+}
+
+int raplcap_shm_read(const raplcap_shm* shm, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                     double* joules, double* watts, uint64_t* ns) {
+  uint64_t seq;
+  uint64_t t;
+  uint32_t idx;
+  double j;
+  double w;
+  if (shm == NULL || pkg >= shm->hdr->n_pkg || die >= shm->die_offsets[pkg + 1] - shm->die_offsets[pkg] ||
+      (int) zone < 0 || (int) zone >= SHM_NZONES) {
+    errno = EINVAL;
+    return -1;
+  }
+  idx = (shm->die_offsets[pkg] + die) * SHM_NZONES + (uint32_t) zone;
+  do {
+    // an odd sequence number means the publisher is writing
+    while ((seq = __atomic_load_n(&shm->hdr->seq, __ATOMIC_ACQUIRE)) & 1) {
+      // spin - the writer holds the lock only while copying values
+    }
+    t = __atomic_load_n(&shm->hdr->ns, __ATOMIC_RELAXED);
+    __atomic_load(&shm->joules[idx], &j, __ATOMIC_RELAXED);
+    __atomic_load(&shm->watts[idx], &w, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (__atomic_load_n(&shm->hdr->seq, __ATOMIC_RELAXED) != seq);
+  if (j < 0 || (watts != NULL && w < 0)) {
+    errno = ENODATA;
+    return -1;
+  }
+  if (joules != NULL) {
+    *joules = j;
+  }
+  if (watts != NULL) {
+    *watts = w;
+  }
+  if (ns != NULL) {
+    *ns = t;
+  }
+  return 0;
+}
@@ -0,0 +1,283 @@
+/**
+ * Binary trace reader, independent of RAPLCap implementations.
+ *
+ * Records are variable only in time, so the file is scanned once at open to build a sparse index of cumulative time
+ * and energy every TRACE_INDEX_STRIDE records.
+ * Random access then costs a binary search of the index plus a scan of fewer than TRACE_INDEX_STRIDE records.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for posix_madvise
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "raplcap-trace.h"
+
+#define TRACE_INDEX_STRIDE 1024
+
+struct raplcap_trace {
+  void* map;
+  size_t map_len;
+  const raplcap_trace_header* hdr;
+  const raplcap_trace_column* cols;
+  // record i is at records + i * (n_columns + 1)
+  const uint32_t* records;
+  uint64_t n_records;
+  // cumulative ticks for record i * TRACE_INDEX_STRIDE
+  uint64_t* index_ticks;
+  // cumulative counts for record i * TRACE_INDEX_STRIDE, n_columns per entry
+  uint64_t* index_counts;
+  uint64_t n_index;
+};
+
+static const uint32_t* get_record(const raplcap_trace* t, uint64_t idx) {
+  return t->records + idx * (t->hdr->n_columns + 1);
+}
+
+// Accumulate the deltas of record idx, which must be > 0
+static void accumulate(const raplcap_trace* t, uint64_t idx, uint64_t* ticks, uint64_t* counts) {
+  const uint32_t* prev = get_record(t, idx - 1);
+  const uint32_t* cur = get_record(t, idx);
+  uint32_t i;
+  *ticks += cur[0];
+  if (counts != NULL) {
+    for (i = 0; i < t->hdr->n_columns; i++) {
+      // counters wrap modulo 2^32
+      counts[i] += (uint32_t) (cur[i + 1] - prev[i + 1]);
+    }
+  }
+}
+
+// Get cumulative ticks and (optionally) counts for record idx, starting from the nearest index entry
+static void get_cumulative(const raplcap_trace* t, uint64_t idx, uint64_t* ticks, uint64_t* counts) {
+  uint64_t i = idx / TRACE_INDEX_STRIDE;
+  *ticks = t->index_ticks[i];
+  if (counts != NULL) {
+    memcpy(counts, &t->index_counts[i * t->hdr->n_columns], t->hdr->n_columns * sizeof(*counts));
+  }
+  for (i = i * TRACE_INDEX_STRIDE + 1; i <= idx; i++) {
+    accumulate(t, i, ticks, counts);
+  }
+}
+
+static int build_index(raplcap_trace* t) {
+  const uint32_t n_cols = t->hdr->n_columns;
+  uint64_t* counts;
+  uint64_t ticks = 0;
+  uint64_t i;
+  t->n_index = (t->n_records + TRACE_INDEX_STRIDE - 1) / TRACE_INDEX_STRIDE;
+  if (t->n_index == 0) {
+    return 0;
+  }
+  if ((t->index_ticks = malloc(t->n_index * sizeof(*t->index_ticks))) == NULL ||
+      (t->index_counts = calloc(t->n_index * n_cols, sizeof(*t->index_counts))) == NULL ||
+      (counts = calloc(n_cols, sizeof(*counts))) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < t->n_records; i++) {
+    if (i > 0) {
+      accumulate(t, i, &ticks, counts);
+    }
+    if (i % TRACE_INDEX_STRIDE == 0) {
+      t->index_ticks[i / TRACE_INDEX_STRIDE] = ticks;
+      memcpy(&t->index_counts[(i / TRACE_INDEX_STRIDE) * n_cols], counts, n_cols * sizeof(*counts));
+    }
+  }
+  free(counts);
+  return 0;
+}
+
+static int validate_header(const raplcap_trace_header* hdr, size_t len) {
+  if (memcmp(hdr->magic, RAPLCAP_TRACE_MAGIC, sizeof(hdr->magic)) || hdr->version != RAPLCAP_TRACE_VERSION ||
+      hdr->n_columns == 0 || hdr->time_unit_ns == 0 ||
+      hdr->record_size != (hdr->n_columns + 1) * sizeof(uint32_t) ||
+      hdr->header_size < sizeof(*hdr) + (uint64_t) hdr->n_columns * sizeof(raplcap_trace_column) ||
+      hdr->header_size > len || hdr->header_size % sizeof(uint32_t)) {
+    return -1;
+  }
+  return 0;
+}
+
+raplcap_trace* raplcap_trace_open(const char* path) {
+  raplcap_trace* t;
+  struct stat st;
+  int err_save;
+  int fd;
+  if (path == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((t = calloc(1, sizeof(*t))) == NULL) {
+    return NULL;
+  }
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    free(t);
+    return NULL;
+  }
+  if (fstat(fd, &st)) {
+    err_save = errno;
+    close(fd);
+    free(t);
+    errno = err_save;
+    return NULL;
+  }
+  if ((size_t) st.st_size < sizeof(raplcap_trace_header)) {
+    close(fd);
+    free(t);
+    errno = EINVAL;
+    return NULL;
+  }
+  t->map_len = (size_t) st.st_size;
+  t->map = mmap(NULL, t->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+  err_save = errno;
+  close(fd);
+  if (t->map == MAP_FAILED) {
+    free(t);
+    errno = err_save;
+    return NULL;
+  }
+  t->hdr = (const raplcap_trace_header*) t->map;
+  if (validate_header(t->hdr, t->map_len)) {
+    raplcap_trace_close(t);
+    errno = EINVAL;
+    return NULL;
+  }
+  t->cols = (const raplcap_trace_column*) (t->hdr + 1);
+  t->records = (const uint32_t*) ((const char*) t->map + t->hdr->header_size);
+  // ignore a trailing partial record, e.g., if the trace is still being written
+  t->n_records = (t->map_len - t->hdr->header_size) / t->hdr->record_size;
+  // sequential access while indexing
+  posix_madvise(t->map, t->map_len, POSIX_MADV_SEQUENTIAL);
+  if (build_index(t)) {
+    err_save = errno;
+    raplcap_trace_close(t);
+    errno = err_save;
+    return NULL;
+  }
+  posix_madvise(t->map, t->map_len, POSIX_MADV_RANDOM);
+  return t;
+}
+
+int raplcap_trace_close(raplcap_trace* t) {
+  int ret = 0;
+  if (t == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (t->map != NULL && munmap(t->map, t->map_len)) {
+    ret = -1;
+  }
+  free(t->index_counts);
+  free(t->index_ticks);
+  free(t);
+  return ret;
+}
+
+const raplcap_trace_header* raplcap_trace_get_header(const raplcap_trace* t) {
+  if (t == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return t->hdr;
+}
+
+const raplcap_trace_column* raplcap_trace_get_columns(const raplcap_trace* t) {
+  if (t == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return t->cols;
+}
+
+uint64_t raplcap_trace_get_num_records(const raplcap_trace* t) {
+  if (t == NULL) {
+    errno = EINVAL;
+    return 0;
+  }
+  return t->n_records;
+}
+
+int raplcap_trace_get_record(const raplcap_trace* t, uint64_t idx, uint64_t* ns, double* joules) {
+  uint64_t* counts = NULL;
+  uint64_t ticks;
+  uint32_t i;
+  if (t == NULL || idx >= t->n_records) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (joules != NULL && (counts = malloc(t->hdr->n_columns * sizeof(*counts))) == NULL) {
+    return -1;
+  }
+  get_cumulative(t, idx, &ticks, counts);
+  if (ns != NULL) {
+    *ns = ticks * t->hdr->time_unit_ns;
+  }
+  if (joules != NULL) {
+    for (i = 0; i < t->hdr->n_columns; i++) {
+      joules[i] = (double) counts[i] * t->cols[i].energy_unit;
+    }
+  }
+  free(counts);
+  return 0;
+}
+
+int raplcap_trace_find_record(const raplcap_trace* t, uint64_t ns, uint64_t* idx) {
+  uint64_t target;
+  uint64_t ticks;
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t mid;
+  uint64_t i;
+  if (t == NULL || idx == NULL || t->n_records == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  target = ns / t->hdr->time_unit_ns;
+  // last index entry at or before the target - the first entry is always at time 0
+  for (lo = 0, hi = t->n_index; hi - lo > 1;) {
+    mid = lo + (hi - lo) / 2;
+    if (t->index_ticks[mid] <= target) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  ticks = t->index_ticks[lo];
+  for (i = lo * TRACE_INDEX_STRIDE; i + 1 < t->n_records && ticks + get_record(t, i + 1)[0] <= target; i++) {
+    ticks += get_record(t, i + 1)[0];
+  }
+  *idx = i;
+  return 0;
+}
+
+double raplcap_trace_get_energy(const raplcap_trace* t, uint32_t col, uint64_t start_ns, uint64_t end_ns) {
+  uint64_t* counts_start;
+  uint64_t* counts_end;
+  uint64_t idx_start;
+  uint64_t idx_end;
+  uint64_t ticks;
+  double joules;
+  if (t == NULL || col >= t->hdr->n_columns || end_ns < start_ns) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (raplcap_trace_find_record(t, start_ns, &idx_start) || raplcap_trace_find_record(t, end_ns, &idx_end)) {
+    return -1;
+  }
+  if ((counts_start = malloc(2 * t->hdr->n_columns * sizeof(*counts_start))) == NULL) {
+    return -1;
+  }
+  counts_end = counts_start + t->hdr->n_columns;
+  get_cumulative(t, idx_start, &ticks, counts_start);
+  get_cumulative(t, idx_end, &ticks, counts_end);
+  joules = (double) (counts_end[col] - counts_start[col]) * t->cols[col].energy_unit;
+  free(counts_start);
+  return joules;
+}
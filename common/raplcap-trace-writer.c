@@ -0,0 +1,187 @@
+/**
+ * Binary trace writer, common to all implementations.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for clock_gettime
+#define _POSIX_C_SOURCE 199309L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "raplcap.h"
+#include "raplcap-common.h"
+#include "raplcap-trace.h"
+
+// microsecond timestamp deltas allow over an hour between records
+#define TRACE_TIME_UNIT_NS 1000
+
+typedef struct trace_writer_counter {
+  // added to the counter (modulo 2^32), so a new baseline continues from the previously written value
+  uint32_t offset;
+  // 0 if the previous read failed, so the next successful read is a new baseline
+  int valid;
+} trace_writer_counter;
+
+struct raplcap_trace_writer {
+  raplcap_trace_header hdr;
+  const raplcap* rc;
+  FILE* f;
+  raplcap_trace_column* cols;
+  // the record being written: dt, then counters
+  uint32_t* record;
+  trace_writer_counter* counters;
+  uint32_t n_cols;
+  uint64_t start_ns;
+  // total ticks written so far, so that rounding doesn't accumulate
+  uint64_t ticks;
+};
+
+static uint64_t now_ns(clockid_t clk) {
+  struct timespec ts;
+  clock_gettime(clk, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// A 32-bit counter in the column's unit - exact when the implementation's counter is at most 32 bits wide
+static double get_energy_unit(const raplcap* rc, const raplcap_trace_column* col) {
+  const double max = raplcap_pd_get_energy_counter_max(rc, col->pkg, col->die, (raplcap_zone) col->zone);
+  const double unit = max / 4294967296.0;
+  return (unit > 0 && unit <= RAPLCAP_TRACE_ENERGY_UNIT_MAX) ? unit : RAPLCAP_TRACE_ENERGY_UNIT_MAX;
+}
+
+static void read_counters(raplcap_trace_writer* w) {
+  trace_writer_counter* c;
+  double joules;
+  uint32_t raw;
+  uint32_t i;
+  for (i = 0; i < w->n_cols; i++) {
+    c = &w->counters[i];
+    joules = raplcap_pd_get_energy_counter(w->rc, w->cols[i].pkg, w->cols[i].die, (raplcap_zone) w->cols[i].zone);
+    if (joules < 0) {
+      // the previous value is repeated
+      c->valid = 0;
+      continue;
+    }
+    // modulo 2^32
+    raw = (uint32_t) (uint64_t) (joules / w->cols[i].energy_unit + 0.5);
+    if (!c->valid) {
+      // without a baseline, the energy since the previous record is unknown, so none is recorded
+      c->offset = w->record[i + 1] - raw;
+      c->valid = 1;
+    }
+    w->record[i + 1] = raw + c->offset;
+  }
+}
+
+static int write_record(raplcap_trace_writer* w) {
+  if (fwrite(w->record, sizeof(*w->record), w->n_cols + 1, w->f) != w->n_cols + 1) {
+    raplcap_perror(ERROR, "raplcap_trace_writer: fwrite");
+    return -1;
+  }
+  return 0;
+}
+
+raplcap_trace_writer* raplcap_trace_writer_start(const raplcap* rc, FILE* f, const raplcap_trace_column* cols,
+                                                 uint32_t n_cols) {
+  raplcap_trace_writer* w;
+  uint32_t i;
+  int err_save;
+  if (f == NULL || cols == NULL || n_cols == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  for (i = 0; i < n_cols; i++) {
+    if ((int) cols[i].zone < 0 || cols[i].zone >= RAPLCAP_NZONES) {
+      errno = EINVAL;
+      return NULL;
+    }
+  }
+  if ((w = calloc(1, sizeof(*w))) == NULL ||
+      (w->cols = malloc(n_cols * sizeof(*w->cols))) == NULL ||
+      (w->record = calloc(n_cols + 1, sizeof(*w->record))) == NULL ||
+      (w->counters = calloc(n_cols, sizeof(*w->counters))) == NULL) {
+    raplcap_perror(ERROR, "raplcap_trace_writer_start: malloc");
+    if (w != NULL) {
+      free(w->record);
+      free(w->cols);
+      free(w);
+    }
+    return NULL;
+  }
+  w->rc = rc;
+  w->f = f;
+  w->n_cols = n_cols;
+  memcpy(w->cols, cols, n_cols * sizeof(*cols));
+  for (i = 0; i < n_cols; i++) {
+    w->cols[i].reserved = 0;
+    w->cols[i].energy_unit = get_energy_unit(rc, &w->cols[i]);
+    // the first read is the baseline, with counters written unchanged
+    w->counters[i].valid = 1;
+  }
+  memcpy(w->hdr.magic, RAPLCAP_TRACE_MAGIC, sizeof(w->hdr.magic));
+  w->hdr.version = RAPLCAP_TRACE_VERSION;
+  w->hdr.header_size = (uint32_t) (sizeof(w->hdr) + n_cols * sizeof(*w->cols));
+  w->hdr.record_size = (uint32_t) ((n_cols + 1) * sizeof(*w->record));
+  w->hdr.n_columns = n_cols;
+  w->hdr.time_unit_ns = TRACE_TIME_UNIT_NS;
+  w->hdr.start_realtime_ns = now_ns(CLOCK_REALTIME);
+  w->start_ns = now_ns(CLOCK_MONOTONIC);
+  read_counters(w);
+  if (fwrite(&w->hdr, sizeof(w->hdr), 1, f) != 1 || fwrite(w->cols, sizeof(*w->cols), n_cols, f) != n_cols) {
+    raplcap_perror(ERROR, "raplcap_trace_writer_start: fwrite");
+    err_save = errno;
+    raplcap_trace_writer_finish(w);
+    errno = err_save;
+    return NULL;
+  }
+  if (write_record(w)) {
+    err_save = errno;
+    raplcap_trace_writer_finish(w);
+    errno = err_save;
+    return NULL;
+  }
+  raplcap_log(DEBUG, "raplcap_trace_writer_start: n_cols=%"PRIu32"\n", n_cols);
+  return w;
+}
+
+int raplcap_trace_writer_sample(raplcap_trace_writer* w) {
+  uint64_t ticks;
+  if (w == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  ticks = (now_ns(CLOCK_MONOTONIC) - w->start_ns) / TRACE_TIME_UNIT_NS;
+  if (ticks - w->ticks > UINT32_MAX) {
+    raplcap_log(ERROR, "raplcap_trace_writer_sample: Too long since previous record\n");
+    errno = ERANGE;
+    return -1;
+  }
+  w->record[0] = (uint32_t) (ticks - w->ticks);
+  read_counters(w);
+  if (write_record(w)) {
+    return -1;
+  }
+  w->ticks = ticks;
+  return 0;
+}
+
+int raplcap_trace_writer_finish(raplcap_trace_writer* w) {
+  int ret = 0;
+  if (w == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (fflush(w->f)) {
+    raplcap_perror(ERROR, "raplcap_trace_writer_finish: fflush");
+    ret = -1;
+  }
+  free(w->counters);
+  free(w->record);
+  free(w->cols);
+  free(w);
+  return ret;
+}
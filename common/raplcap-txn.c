@@ -0,0 +1,53 @@
+/**
+ * Transaction staging, common to all implementations.
+ * Implementations provide raplcap_txn_commit.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include "raplcap.h"
+#include "raplcap-common.h"
+
+raplcap_txn* raplcap_txn_begin(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  raplcap_txn* txn;
+  if ((int) zone < 0 || (int) zone >= RAPLCAP_NZONES) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((txn = calloc(1, sizeof(*txn))) == NULL) {
+    return NULL;
+  }
+  txn->rc = rc;
+  txn->pkg = pkg;
+  txn->die = die;
+  txn->zone = zone;
+  raplcap_log(DEBUG, "raplcap_txn_begin: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
+  return txn;
+}
+
+int raplcap_txn_set_zone_enabled(raplcap_txn* txn, int enabled) {
+  if (txn == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  txn->enabled = enabled;
+  txn->staged |= RAPLCAP_TXN_ENABLED;
+  return 0;
+}
+
+int raplcap_txn_set_limit(raplcap_txn* txn, raplcap_constraint constraint, const raplcap_limit* limit) {
+  if (txn == NULL || limit == NULL || (int) constraint < 0 || (int) constraint >= RAPLCAP_NCONSTRAINTS) {
+    errno = EINVAL;
+    return -1;
+  }
+  txn->limits[constraint] = *limit;
+  txn->staged |= RAPLCAP_TXN_LIMIT(constraint);
+  return 0;
+}
+
+void raplcap_txn_abort(raplcap_txn* txn) {
+  free(txn);
+}
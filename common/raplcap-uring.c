@@ -0,0 +1,354 @@
+/**
+ * A minimal io_uring engine for batched reads, common to all implementations.
+ *
+ * liburing isn't required - rings are set up and mapped with raw system calls, and only IORING_OP_READ on registered
+ * (fixed) files is used.
+ * Without io_uring headers at build time, or without io_uring (or its read operation) at runtime, initialization fails
+ * so that callers use blocking reads instead.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for syscall, MAP_POPULATE, pthread
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef RAPLCAP_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "raplcap-common.h"
+#include "raplcap-uring.h"
+
+// read buffers are aligned for their contents, e.g., MSR values
+#define BUF_ALIGN sizeof(uint64_t)
+
+int raplcap_uring_is_enabled(void) {
+  const char* env = getenv(ENV_RAPLCAP_IO_URING);
+  return env != NULL && strtol(env, NULL, 0) != 0;
+}
+
+#ifdef RAPLCAP_HAVE_IO_URING
+
+struct raplcap_uring {
+  pthread_mutex_t lock;
+  int fd;
+  // the SQ and CQ rings share a mapping if the kernel supports it, in which case cq_ring is NULL
+  void* sq_ring;
+  size_t sq_ring_size;
+  void* cq_ring;
+  size_t cq_ring_size;
+  struct io_uring_sqe* sqes;
+  size_t sqes_size;
+  uint32_t* sq_tail;
+  uint32_t* sq_array;
+  uint32_t sq_mask;
+  uint32_t* cq_head;
+  const uint32_t* cq_tail;
+  const struct io_uring_cqe* cqes;
+  uint32_t cq_mask;
+  raplcap_uring_read* reads;
+  size_t* buf_offsets;
+  unsigned char* bufs;
+  ssize_t* results;
+  uint32_t n_reads;
+  // set if a batch couldn't be completed - reads may still be in flight, so the engine is never used again
+  int failed;
+};
+
+static int uring_setup(uint32_t entries, struct io_uring_params* p) {
+  return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+  return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, uint32_t opcode, const void* arg, uint32_t nr_args) {
+  return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void* ring_ptr(void* ring, uint32_t offset) {
+  return (unsigned char*) ring + offset;
+}
+
+// IORING_OP_READ was added after io_uring itself, so check for it rather than failing every read
+static int has_read_op(int fd) {
+  struct io_uring_probe* probe;
+  const size_t size = sizeof(*probe) + ((size_t) IORING_OP_LAST * sizeof(probe->ops[0]));
+  int ret = 0;
+  if ((probe = calloc(1, size)) == NULL) {
+    return 0;
+  }
+  if (uring_register(fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0 && probe->last_op >= IORING_OP_READ &&
+      (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)) {
+    ret = 1;
+  }
+  free(probe);
+  return ret;
+}
+
+static int map_rings(raplcap_uring* u, const struct io_uring_params* p) {
+  void* cq_ring;
+  u->sq_ring_size = p->sq_off.array + (p->sq_entries * sizeof(uint32_t));
+  u->cq_ring_size = p->cq_off.cqes + (p->cq_entries * sizeof(struct io_uring_cqe));
+  if (p->features & IORING_FEAT_SINGLE_MMAP) {
+    if (u->cq_ring_size > u->sq_ring_size) {
+      u->sq_ring_size = u->cq_ring_size;
+    }
+    u->cq_ring_size = 0;
+  }
+  if ((u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                         IORING_OFF_SQ_RING)) == MAP_FAILED) {
+    u->sq_ring = NULL;
+    return -1;
+  }
+  cq_ring = u->sq_ring;
+  if (u->cq_ring_size > 0) {
+    if ((u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                           IORING_OFF_CQ_RING)) == MAP_FAILED) {
+      u->cq_ring = NULL;
+      return -1;
+    }
+    cq_ring = u->cq_ring;
+  }
+  u->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+  if ((u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                      IORING_OFF_SQES)) == MAP_FAILED) {
+    u->sqes = NULL;
+    return -1;
+  }
+  u->sq_tail = ring_ptr(u->sq_ring, p->sq_off.tail);
+  u->sq_array = ring_ptr(u->sq_ring, p->sq_off.array);
+  u->sq_mask = *(uint32_t*) ring_ptr(u->sq_ring, p->sq_off.ring_mask);
+  u->cq_head = ring_ptr(cq_ring, p->cq_off.head);
+  u->cq_tail = ring_ptr(cq_ring, p->cq_off.tail);
+  u->cqes = ring_ptr(cq_ring, p->cq_off.cqes);
+  u->cq_mask = *(uint32_t*) ring_ptr(cq_ring, p->cq_off.ring_mask);
+  return 0;
+}
+
+static int uring_open(raplcap_uring* u, const int* fds, uint32_t n_fds) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  if ((u->fd = uring_setup(u->n_reads, &p)) < 0) {
+    raplcap_perror(INFO, "io_uring_setup");
+    return -1;
+  }
+  if (!has_read_op(u->fd)) {
+    raplcap_log(INFO, "io_uring read operation is not supported\n");
+    errno = ENOTSUP;
+    return -1;
+  }
+  if (map_rings(u, &p)) {
+    raplcap_perror(INFO, "io_uring: mmap");
+    return -1;
+  }
+  if (uring_register(u->fd, IORING_REGISTER_FILES, fds, n_fds)) {
+    raplcap_perror(INFO, "io_uring_register: IORING_REGISTER_FILES");
+    return -1;
+  }
+  return 0;
+}
+
+raplcap_uring* raplcap_uring_init(const int* fds, uint32_t n_fds, const raplcap_uring_read* reads, uint32_t n_reads) {
+  raplcap_uring* u;
+  size_t size = 0;
+  uint32_t i;
+  int err_save;
+  if (fds == NULL || n_fds == 0 || reads == NULL || n_reads == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  for (i = 0; i < n_reads; i++) {
+    if (reads[i].file >= n_fds || reads[i].len == 0) {
+      errno = EINVAL;
+      return NULL;
+    }
+  }
+  if ((u = calloc(1, sizeof(*u))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&u->lock, NULL);
+  u->fd = -1;
+  u->n_reads = n_reads;
+  if ((u->reads = malloc(n_reads * sizeof(*u->reads))) == NULL ||
+      (u->buf_offsets = malloc(n_reads * sizeof(*u->buf_offsets))) == NULL ||
+      (u->results = malloc(n_reads * sizeof(*u->results))) == NULL) {
+    err_save = errno;
+    raplcap_uring_destroy(u);
+    errno = err_save;
+    return NULL;
+  }
+  memcpy(u->reads, reads, n_reads * sizeof(*u->reads));
+  for (i = 0; i < n_reads; i++) {
+    u->buf_offsets[i] = size;
+    u->results[i] = -ENODATA;
+    size += (reads[i].len + BUF_ALIGN - 1) / BUF_ALIGN * BUF_ALIGN;
+  }
+  if ((u->bufs = malloc(size)) == NULL || uring_open(u, fds, n_fds)) {
+    err_save = errno;
+    raplcap_uring_destroy(u);
+    errno = err_save;
+    return NULL;
+  }
+  raplcap_log(DEBUG, "raplcap_uring_init: n_fds=%"PRIu32", n_reads=%"PRIu32"\n", n_fds, n_reads);
+  return u;
+}
+
+// Harvest all available completions, returning how many there were
+static uint32_t harvest(raplcap_uring* u) {
+  const struct io_uring_cqe* cqe;
+  uint32_t head = *u->cq_head;
+  const uint32_t tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+  uint32_t n = 0;
+  for (; head != tail; head++, n++) {
+    cqe = &u->cqes[head & u->cq_mask];
+    if (cqe->user_data < u->n_reads) {
+      u->results[cqe->user_data] = cqe->res;
+    }
+  }
+  __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+  return n;
+}
+
+int raplcap_uring_submit(raplcap_uring* u) {
+  struct io_uring_sqe* sqe;
+  uint32_t tail;
+  uint32_t idx;
+  uint32_t i;
+  uint32_t submitted = 0;
+  uint32_t completed = 0;
+  int ret;
+  if (pthread_mutex_trylock(&u->lock)) {
+    return 1;
+  }
+  if (u->failed) {
+    pthread_mutex_unlock(&u->lock);
+    return 1;
+  }
+  // queue every read - the ring is at least as large as the set, and empty between submissions
+  tail = *u->sq_tail;
+  for (i = 0; i < u->n_reads; i++, tail++) {
+    idx = tail & u->sq_mask;
+    sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = (int32_t) u->reads[i].file;
+    sqe->addr = (uint64_t) (uintptr_t) (u->bufs + u->buf_offsets[i]);
+    sqe->len = u->reads[i].len;
+    sqe->off = u->reads[i].offset;
+    sqe->user_data = i;
+    u->sq_array[idx] = idx;
+    u->results[i] = -ENODATA;
+  }
+  __atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+  // usually a single call submits the whole batch and waits for it
+  while (completed < u->n_reads) {
+    if ((ret = uring_enter(u->fd, u->n_reads - submitted, u->n_reads - completed, IORING_ENTER_GETEVENTS)) < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+        continue;
+      }
+      // reads may still be in flight, and queued entries can't be withdrawn, so the ring can't be used again
+      raplcap_perror(WARN, "io_uring_enter");
+      u->failed = 1;
+      pthread_mutex_unlock(&u->lock);
+      return -1;
+    }
+    submitted += (uint32_t) ret;
+    completed += harvest(u);
+  }
+  return 0;
+}
+
+ssize_t raplcap_uring_get_result(const raplcap_uring* u, uint32_t read, const void** buf) {
+  if (read >= u->n_reads) {
+    return -EINVAL;
+  }
+  if (buf != NULL) {
+    *buf = u->bufs + u->buf_offsets[read];
+  }
+  return u->results[read];
+}
+
+void raplcap_uring_release(raplcap_uring* u) {
+  pthread_mutex_unlock(&u->lock);
+}
+
+int raplcap_uring_destroy(raplcap_uring* u) {
+  if (u == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (u->sqes != NULL) {
+    munmap(u->sqes, u->sqes_size);
+  }
+  if (u->cq_ring != NULL) {
+    munmap(u->cq_ring, u->cq_ring_size);
+  }
+  if (u->sq_ring != NULL) {
+    munmap(u->sq_ring, u->sq_ring_size);
+  }
+  if (u->fd >= 0) {
+    // cancels anything in flight
+    close(u->fd);
+  }
+  if (!u->failed) {
+    free(u->bufs);
+  }
+  // otherwise cancelled reads may still complete into the buffers, so leak them
+  free(u->results);
+  free(u->buf_offsets);
+  free(u->reads);
+  pthread_mutex_destroy(&u->lock);
+  free(u);
+  return 0;
+}
+
+#else
+
+struct raplcap_uring {
+  uint32_t n_reads;
+};
+
+raplcap_uring* raplcap_uring_init(const int* fds, uint32_t n_fds, const raplcap_uring_read* reads, uint32_t n_reads) {
+  (void) fds;
+  (void) n_fds;
+  (void) reads;
+  (void) n_reads;
+  raplcap_log(INFO, "Not built with io_uring support\n");
+  errno = ENOSYS;
+  return NULL;
+}
+
+int raplcap_uring_submit(raplcap_uring* u) {
+  (void) u;
+  errno = ENOSYS;
+  return -1;
+}
+
+ssize_t raplcap_uring_get_result(const raplcap_uring* u, uint32_t read, const void** buf) {
+  (void) u;
+  (void) read;
+  (void) buf;
+  return -ENOSYS;
+}
+
+void raplcap_uring_release(raplcap_uring* u) {
+  (void) u;
+}
+
+int raplcap_uring_destroy(raplcap_uring* u) {
+  (void) u;
+  errno = EINVAL;
+  return -1;
+}
+
+#endif
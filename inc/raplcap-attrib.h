@@ -0,0 +1,104 @@
+/**
+ * Attribute energy to cgroups by their CPU time.
+ *
+ * At each sample, the node's PACKAGE and DRAM energy since the previous sample is divided among tracked cgroups in
+ * proportion to the CPU time each consumed in that interval, as reported by the cgroup v2 `cpu.stat` file's
+ * `usage_usec` field.
+ * If a root cgroup is specified (e.g., "/sys/fs/cgroup"), its CPU time is the denominator, so energy consumed by
+ * untracked work (and idle energy shared by it) is left unattributed; otherwise, tracked cgroups share all energy.
+ * Nested cgroups are not deduplicated - avoid tracking both a cgroup and its descendants.
+ *
+ * Only deltas since the previous sample are processed, and each cgroup's `cpu.stat` file is kept open, so a sample
+ * costs one read per cgroup, regardless of how long the cgroup has been tracked.
+ * Attributed energy is cumulative from when a cgroup was added.
+ *
+ * Functions are not thread-safe - the caller must synchronize access to an attribution handle.
+ * The raplcap context must remain initialized while an attribution handle is in use.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#ifndef _RAPLCAP_ATTRIB_H_
+#define _RAPLCAP_ATTRIB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include "raplcap.h"
+
+/**
+ * An opaque attribution handle
+ */
+typedef struct raplcap_attrib raplcap_attrib;
+
+/**
+ * Initialize attribution and take a baseline energy measurement.
+ *
+ * @param rc
+ * @param root the cgroup directory whose CPU time is the attribution denominator, or NULL to use the tracked cgroups
+ * @return an attribution handle on success, NULL on error
+ */
+raplcap_attrib* raplcap_attrib_init(const raplcap* rc, const char* root);
+
+/**
+ * Start tracking a cgroup, taking a baseline CPU time measurement.
+ * IDs of removed cgroups may be reused.
+ *
+ * @param a
+ * @param cgroup the cgroup directory, e.g., "/sys/fs/cgroup/system.slice/foo.service"
+ * @return a non-negative cgroup ID on success, a negative value on error
+ */
+int raplcap_attrib_add_cgroup(raplcap_attrib* a, const char* cgroup);
+
+/**
+ * Stop tracking a cgroup.
+ *
+ * @param a
+ * @param id
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_attrib_remove_cgroup(raplcap_attrib* a, int id);
+
+/**
+ * Read energy and CPU time, and attribute energy since the previous sample.
+ * A cgroup whose CPU time can't be read (e.g., because it was deleted) or decreased is attributed nothing until the
+ * sample after its next successful read.
+ * If the root cgroup's CPU time decreased (e.g., after a remount), the interval's energy is unattributed.
+ *
+ * @param a
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_attrib_sample(raplcap_attrib* a);
+
+/**
+ * Get a cgroup's attributed energy in Joules since it was added, as of the most recent sample.
+ *
+ * @param a
+ * @param id
+ * @return Joules on success, a negative value on error
+ */
+double raplcap_attrib_get_energy(const raplcap_attrib* a, int id);
+
+/**
+ * Get energy in Joules that wasn't attributed to any cgroup since attribution was initialized.
+ *
+ * @param a
+ * @return Joules on success, a negative value on error
+ */
+double raplcap_attrib_get_unattributed_energy(const raplcap_attrib* a);
+
+/**
+ * Stop tracking all cgroups and release resources.
+ *
+ * @param a
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_attrib_destroy(raplcap_attrib* a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -12,8 +12,10 @@ extern "C" {
 #endif
 
 #include <float.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include "raplcap.h"
 
 // Environment variable to request read-only access when the option is available
 // This is an undocumented capability and may be removed at any time
@@ -22,6 +24,13 @@ extern "C" {
 #define RAPLCAP_NZONES (RAPLCAP_ZONE_PSYS + 1)
 #define RAPLCAP_NCONSTRAINTS (RAPLCAP_CONSTRAINT_PEAK_POWER + 1)
 
+// State that's written at runtime and kept per package/die is aligned to cache lines, so that threads using
+// different package/die don't falsely share them
+#ifndef RAPLCAP_CACHE_LINE_SIZE
+  #define RAPLCAP_CACHE_LINE_SIZE 64
+#endif
+#define RAPLCAP_CACHE_ALIGNED __attribute__((aligned(RAPLCAP_CACHE_LINE_SIZE)))
+
 typedef enum raplcap_loglevel {
   DEBUG = 0,
   INFO,
@@ -66,6 +75,53 @@ typedef enum raplcap_loglevel {
  */
 #define is_zero_dbl(val) ((val) >= 0 ? (val) < DBL_EPSILON : (val) > -DBL_EPSILON)
 
+/**
+ * Tracks a rolling energy counter as a monotonically increasing 64-bit total in the counter's native units.
+ */
+typedef struct raplcap_energy_acc {
+  uint64_t last;
+  uint64_t total;
+  // the counter value at which rollover occurs
+  uint64_t max;
+  int valid;
+} raplcap_energy_acc;
+
+/**
+ * Update an accumulator with a new counter value, assuming at most one rollover since the last update.
+ * The first update only records a baseline.
+ */
+#define raplcap_energy_acc_update(acc, val) \
+  do { if ((acc)->valid) { \
+      (acc)->total += (val) >= (acc)->last ? (val) - (acc)->last : ((acc)->max - (acc)->last) + (val); \
+    } \
+    (acc)->last = (val); \
+    (acc)->valid = 1; \
+  } while (0)
+
+// Staged transaction operations
+#define RAPLCAP_TXN_ENABLED 0x1
+#define RAPLCAP_TXN_CLAMPED 0x2
+#define RAPLCAP_TXN_LIMIT(constraint) (0x4 << (constraint))
+#define RAPLCAP_TXN_LOCKED(constraint) (0x20 << (constraint))
+#define RAPLCAP_TXN_LOCKED_ANY \
+  (RAPLCAP_TXN_LOCKED(RAPLCAP_CONSTRAINT_LONG_TERM) | RAPLCAP_TXN_LOCKED(RAPLCAP_CONSTRAINT_SHORT_TERM) | \
+   RAPLCAP_TXN_LOCKED(RAPLCAP_CONSTRAINT_PEAK_POWER))
+
+/**
+ * Changes staged for a single package, die, and zone, applied by the implementation's raplcap_txn_commit.
+ */
+struct raplcap_txn {
+  const raplcap* rc;
+  uint32_t pkg;
+  uint32_t die;
+  raplcap_zone zone;
+  // RAPLCAP_TXN_* flags
+  uint32_t staged;
+  int enabled;
+  int clamped;
+  raplcap_limit limits[RAPLCAP_NCONSTRAINTS];
+};
+
 #ifdef __cplusplus
 }
 #endif
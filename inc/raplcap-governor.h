@@ -0,0 +1,113 @@
+/**
+ * A power budget governor for RAPLCap.
+ *
+ * The governor holds a node-wide power budget by periodically measuring the power of every package's PACKAGE and
+ * (optionally) DRAM zones and redistributing their long term power limits toward the zones with demand.
+ * Zones that are running below their limits give up the unused part of their budget to zones that are running at their
+ * limits, so that budget can shift between sockets with imbalanced work.
+ *
+ * Limit writes are rate-limited per zone, and are skipped when a zone's new limit is within a minimum step of its
+ * current limit, so that limits are only written when they actually change.
+ * For libraplcap-msr, raplcap_msr_pd_get_power_units reports the granularity of power limits.
+ *
+ * The governor doesn't start a thread - call raplcap_governor_update periodically (e.g., every 100 ms - 1 s).
+ * The raplcap context must remain initialized while a governor is in use.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#ifndef _RAPLCAP_GOVERNOR_H_
+#define _RAPLCAP_GOVERNOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include "raplcap.h"
+
+/**
+ * An opaque governor handle
+ */
+typedef struct raplcap_governor raplcap_governor;
+
+/**
+ * Governor configuration.
+ */
+typedef struct raplcap_governor_config {
+  // the total power budget for all governed zones, in Watts
+  double budget_watts;
+  // the minimum limit for any governed zone, in Watts
+  double min_watts;
+  // limits are not written if they change by less than this value, in Watts
+  double min_step_watts;
+  // the minimum time between limit writes to a zone, in nanoseconds
+  uint64_t min_write_interval_ns;
+  // if non-zero, DRAM zones are also governed
+  int dram;
+} raplcap_governor_config;
+
+/**
+ * Initialize a governor and take baseline energy measurements.
+ * Limits are not written until the first update.
+ * Fails with ENOTSUP if no zones can be governed, or with EINVAL if the budget can't cover the minimum limit of every
+ * governed zone.
+ *
+ * @param rc
+ * @param cfg
+ * @return a governor on success, NULL on error
+ */
+raplcap_governor* raplcap_governor_init(const raplcap* rc, const raplcap_governor_config* cfg);
+
+/**
+ * Measure power since the previous update, redistribute the budget, and write limits that have changed.
+ * If any writes fail, a single error is reported after all writes are attempted, and errno is set by the first failure.
+ *
+ * @param g
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_governor_update(raplcap_governor* g);
+
+/**
+ * Change the budget, which is applied by the next update.
+ *
+ * @param g
+ * @param budget_watts must cover the minimum limit of every governed zone
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_governor_set_budget(raplcap_governor* g, double budget_watts);
+
+/**
+ * Get the power limit the governor currently assigns to a zone.
+ * The limit may not have been written yet if the last change was smaller than the minimum step or was rate-limited.
+ *
+ * @param g
+ * @param pkg
+ * @param die
+ * @param zone
+ * @return Watts on success, a negative value on error (including if the zone isn't governed)
+ */
+double raplcap_governor_get_limit(const raplcap_governor* g, uint32_t pkg, uint32_t die, raplcap_zone zone);
+
+/**
+ * Get the number of limit writes the governor has performed.
+ *
+ * @param g
+ * @return the number of writes
+ */
+uint64_t raplcap_governor_get_num_writes(const raplcap_governor* g);
+
+/**
+ * Release the governor's resources.
+ * Limits are left as they were last written.
+ *
+ * @param g
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_governor_destroy(raplcap_governor* g);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * Region-of-interest energy profiling.
+ *
+ * Mark code regions with raplcap_roi_begin and raplcap_roi_end to accumulate their call counts, elapsed time, and
+ * PACKAGE zone energy of a single package/die in a preallocated per-thread table.
+ * Each thread claims one of max_threads tables the first time it marks a region - threads beyond the limit aren't
+ * recorded.
+ *
+ * Without a sampler, each marker reads the energy counter once.
+ * With a sampler, markers don't read counters or perform system calls: energy at a marker is the sampler's latest
+ * energy extrapolated at its latest power to the marker's time, so regions that are shorter than a sampling interval
+ * (or the ~1 ms RAPL update interval) are estimated from power instead of appearing to consume nothing.
+ *
+ * Regions with different IDs may overlap or nest, and recursive regions with the same ID are measured at the outermost
+ * level.
+ * Markers are thread-safe, but raplcap_roi_init, raplcap_roi_report, and raplcap_roi_destroy must not be called
+ * concurrently with markers.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#ifndef _RAPLCAP_ROI_H_
+#define _RAPLCAP_ROI_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "raplcap.h"
+#include "raplcap-sampler.h"
+
+/**
+ * Initialize region-of-interest profiling.
+ * The raplcap context, and the sampler if specified, must remain valid until raplcap_roi_destroy is called.
+ *
+ * @param rc
+ * @param s a sampler to estimate energy from, or NULL to read energy counters
+ * @param pkg
+ * @param die
+ * @param n_regions region IDs must be in range [0, n_regions)
+ * @param max_threads the maximum number of threads that can record regions
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_roi_init(const raplcap* rc, const raplcap_sampler* s, uint32_t pkg, uint32_t die,
+                     uint32_t n_regions, uint32_t max_threads);
+
+/**
+ * Begin a region.
+ * Errors, including an invalid ID, are counted and reported rather than returned.
+ *
+ * @param id
+ */
+void raplcap_roi_begin(uint32_t id);
+
+/**
+ * End a region.
+ * Errors, including an invalid ID or a region that wasn't begun, are counted and reported rather than returned.
+ *
+ * @param id
+ */
+void raplcap_roi_end(uint32_t id);
+
+/**
+ * Get a region's totals for all threads.
+ *
+ * @param id
+ * @param count if not NULL, is set to the number of times the region completed
+ * @param seconds if not NULL, is set to the total elapsed time in seconds
+ * @param joules if not NULL, is set to the total energy in Joules
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_roi_get(uint32_t id, uint64_t* count, double* seconds, double* joules);
+
+/**
+ * Write a table of the totals for all regions that completed at least once or had errors.
+ *
+ * @param f
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_roi_report(FILE* f);
+
+/**
+ * Release profiling resources.
+ *
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_roi_destroy(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
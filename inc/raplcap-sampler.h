@@ -0,0 +1,124 @@
+/**
+ * A background sampler for RAPLCap energy counters.
+ *
+ * The sampler spawns a thread that periodically reads all energy counters using raplcap_get_energy_snapshot (or, in
+ * adaptive mode, reads individual zones on their own schedules) and publishes timestamped samples to a ring buffer.
+ * Counter rollover is handled by the sampler, so published energy values increase monotonically.
+ * Any number of threads may concurrently get values from the sampler - these functions are lock-free and do not perform
+ * system calls, so they are suitable for latency-sensitive code paths.
+ *
+ * The raplcap context must remain initialized while a sampler is running.
+ * Other threads may use the context concurrently with the sampler thread, as described in raplcap.h.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#ifndef _RAPLCAP_SAMPLER_H_
+#define _RAPLCAP_SAMPLER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include "raplcap.h"
+
+/**
+ * An opaque sampler handle
+ */
+typedef struct raplcap_sampler raplcap_sampler;
+
+/**
+ * Start a sampler.
+ * The first sample is taken before this function returns.
+ *
+ * @param rc
+ * @param interval_ns the sampling interval in nanoseconds, must be > 0
+ * @param capacity the number of samples to retain, must be >= 2
+ * @param cpu the CPU to pin the sampler thread to, or a negative value to not pin the thread
+ * @return a sampler on success, NULL on error
+ */
+raplcap_sampler* raplcap_sampler_start(const raplcap* rc, uint64_t interval_ns, uint32_t capacity, int cpu);
+
+/**
+ * Start an adaptive sampler, which reads each supported zone individually and backs off zones whose power is stable.
+ * Unsupported zones are never read.
+ * A zone's read interval doubles, up to max_interval_ns, every time its measured power is within max_error_watts of
+ * its previous measurement, and returns to interval_ns when it isn't.
+ * Samples are still published every interval_ns - between reads, a zone's energy is extrapolated at its last measured
+ * power, so raplcap_sampler_get_power reports that power until the zone is read again.
+ * Published energy never decreases, so if a read shows that extrapolation overestimated, the zone's energy holds until
+ * actual consumption catches up.
+ *
+ * @param rc
+ * @param interval_ns the sampling interval in nanoseconds, must be > 0
+ * @param max_interval_ns the maximum read interval for a zone in nanoseconds, must be >= interval_ns
+ * @param max_error_watts the power difference between consecutive reads within which a zone is considered stable
+ * @param capacity the number of samples to retain, must be >= 2
+ * @param cpu the CPU to pin the sampler thread to, or a negative value to not pin the thread
+ * @return a sampler on success, NULL on error
+ */
+raplcap_sampler* raplcap_sampler_start_adaptive(const raplcap* rc, uint64_t interval_ns, uint64_t max_interval_ns,
+                                                double max_error_watts, uint32_t capacity, int cpu);
+
+/**
+ * Stop a sampler and release its resources.
+ * No other threads may be using the sampler.
+ *
+ * @param s
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_sampler_stop(raplcap_sampler* s);
+
+/**
+ * Get the number of samples published since the sampler started.
+ *
+ * @param s
+ * @return the number of samples
+ */
+uint64_t raplcap_sampler_get_num_samples(const raplcap_sampler* s);
+
+/**
+ * Get a zone's energy consumption in Joules since the sampler started, as of the most recent sample.
+ *
+ * @param s
+ * @param pkg
+ * @param die
+ * @param zone
+ * @param ns if not NULL, is set to the sample's CLOCK_MONOTONIC timestamp in nanoseconds
+ * @return Joules on success, a negative value on error
+ */
+double raplcap_sampler_get_energy(const raplcap_sampler* s, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                  uint64_t* ns);
+
+/**
+ * Get a zone's power in Watts over the most recent sampling interval.
+ *
+ * @param s
+ * @param pkg
+ * @param die
+ * @param zone
+ * @return Watts on success, a negative value on error
+ */
+double raplcap_sampler_get_power(const raplcap_sampler* s, uint32_t pkg, uint32_t die, raplcap_zone zone);
+
+/**
+ * Get a zone's average power in Watts over a time window ending at the most recent sample.
+ * The window is rounded down to a whole number of sampling intervals, but is never less than one interval.
+ * If the window exceeds the retained sample history, the oldest retained sample is used.
+ *
+ * @param s
+ * @param pkg
+ * @param die
+ * @param zone
+ * @param window_ns
+ * @return Watts on success, a negative value on error
+ */
+double raplcap_sampler_get_power_avg(const raplcap_sampler* s, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                     uint64_t window_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
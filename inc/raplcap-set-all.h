@@ -0,0 +1,44 @@
+/**
+ * Worker threads for raplcap_set_limits_all, kept with a context so that each call doesn't create and join threads.
+ *
+ * A context's pool is created by the first raplcap_set_limits_all call on it that needs more than one thread, with one
+ * worker per package after the first (the calling thread takes the first package).
+ * Implementations own the pool pointer and destroy the pool in raplcap_destroy.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#ifndef _RAPLCAP_SET_ALL_H_
+#define _RAPLCAP_SET_ALL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "raplcap.h"
+
+#pragma GCC visibility push(hidden)
+
+typedef struct raplcap_set_all_pool raplcap_set_all_pool;
+
+/**
+ * Defined by each implementation: get the address of a context's pool pointer, which the implementation initializes
+ * to NULL, or NULL if the context isn't initialized.
+ * The pointer is only set atomically by raplcap_set_limits_all.
+ */
+raplcap_set_all_pool** raplcap_get_set_all_pool(const raplcap* rc);
+
+/**
+ * Stop and join a pool's workers, then free it.
+ * The caller must ensure that no raplcap_set_limits_all calls are using the pool.
+ * Does nothing if pool is NULL.
+ */
+void raplcap_set_all_pool_destroy(raplcap_set_all_pool* pool);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
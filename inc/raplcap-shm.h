@@ -0,0 +1,162 @@
+/**
+ * Publish live energy and power data through shared memory, so that many local processes can read it without each
+ * initializing their own RAPLCap context and reading the same registers.
+ *
+ * A single publisher (e.g., the raplcap-shmd daemon) owns a RAPLCap context and periodically writes accumulated energy
+ * and average power for all packages, die, and zones to a shared memory region.
+ * Readers map the region and read it without system calls or locks.
+ * Updates are protected by a sequence lock: the sequence number is odd while the publisher is writing, and readers retry
+ * if the sequence number is odd or changes while they read.
+ *
+ * The region starts with a raplcap_shm_header, whose offsets locate the arrays that follow it.
+ * All values are in the publisher's byte order.
+ *
+ * Publisher functions are provided by RAPLCap implementations.
+ * Reader functions are provided by the raplcap-shm library, which doesn't depend on an implementation.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#ifndef _RAPLCAP_SHM_H_
+#define _RAPLCAP_SHM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "raplcap.h"
+
+#define RAPLCAP_SHM_MAGIC "RCSM"
+#define RAPLCAP_SHM_VERSION 1
+
+/**
+ * The POSIX shared memory object name used by raplcap-shmd by default.
+ */
+#define RAPLCAP_SHM_DEFAULT_NAME "/raplcap"
+
+/**
+ * The shared memory region header.
+ */
+typedef struct raplcap_shm_header {
+  // RAPLCAP_SHM_MAGIC, without a NUL terminator - written last when the region is initialized
+  char magic[4];
+  uint32_t version;
+  // total bytes in the region
+  uint32_t size;
+  uint32_t n_pkg;
+  // total die of all packages
+  uint32_t n_pkg_die;
+  // byte offset of uint32_t die_offsets[n_pkg + 1] - die of package pkg start at index die_offsets[pkg]
+  uint32_t die_offsets_offset;
+  // byte offset of double joules[n_pkg_die * (RAPLCAP_ZONE_PSYS + 1)], accumulated since publishing started
+  uint32_t joules_offset;
+  // byte offset of double watts[n_pkg_die * (RAPLCAP_ZONE_PSYS + 1)], averaged over the latest publishing interval
+  uint32_t watts_offset;
+  // the sequence lock
+  uint64_t seq;
+  // CLOCK_MONOTONIC nanoseconds when the latest values were read
+  uint64_t ns;
+} raplcap_shm_header;
+
+/**
+ * An opaque publisher handle
+ */
+typedef struct raplcap_shm_publisher raplcap_shm_publisher;
+
+/**
+ * Get the size of the shared memory region required to publish a context's data.
+ *
+ * @param rc
+ * @return bytes on success, 0 on error
+ */
+size_t raplcap_shm_get_size(const raplcap* rc);
+
+/**
+ * Initialize a shared memory region and publish baseline values.
+ * Zones that aren't supported have negative values, as does power until the next publish.
+ *
+ * @param rc
+ * @param mem the writable shared memory region, which is not unmapped by the publisher
+ * @param len the region length, must be >= raplcap_shm_get_size
+ * @return a publisher on success, NULL on error
+ */
+raplcap_shm_publisher* raplcap_shm_publisher_init(const raplcap* rc, void* mem, size_t len);
+
+/**
+ * Read energy counters and publish updated energy and power values.
+ *
+ * @param p
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_shm_publish(raplcap_shm_publisher* p);
+
+/**
+ * Release the publisher's resources.
+ *
+ * @param p
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_shm_publisher_destroy(raplcap_shm_publisher* p);
+
+/**
+ * An opaque reader handle
+ */
+typedef struct raplcap_shm raplcap_shm;
+
+/**
+ * Map a published shared memory object for reading.
+ * If the publisher restarts, the object must be opened again to see new values - check that timestamps advance.
+ *
+ * @param name the POSIX shared memory object name, or NULL for RAPLCAP_SHM_DEFAULT_NAME
+ * @return a reader on success, NULL on error
+ */
+raplcap_shm* raplcap_shm_open(const char* name);
+
+/**
+ * Unmap a shared memory object and release the reader's resources.
+ *
+ * @param shm
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_shm_close(raplcap_shm* shm);
+
+/**
+ * Get the number of packages.
+ *
+ * @param shm
+ * @return the number of packages, or 0 on error
+ */
+uint32_t raplcap_shm_get_num_packages(const raplcap_shm* shm);
+
+/**
+ * Get the number of die in a package.
+ *
+ * @param shm
+ * @param pkg
+ * @return the number of die, or 0 on error
+ */
+uint32_t raplcap_shm_get_num_die(const raplcap_shm* shm, uint32_t pkg);
+
+/**
+ * Read a zone's latest published values, without system calls or locks.
+ * Fails with ENODATA if the zone isn't supported, or if watts are requested but power isn't available yet.
+ *
+ * @param shm
+ * @param pkg
+ * @param die
+ * @param zone
+ * @param joules if not NULL, is set to Joules accumulated since publishing started
+ * @param watts if not NULL, is set to the average power in Watts over the latest publishing interval
+ * @param ns if not NULL, is set to the values' CLOCK_MONOTONIC timestamp in nanoseconds
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_shm_read(const raplcap_shm* shm, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                     double* joules, double* watts, uint64_t* ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * A compact binary trace format for long-running energy logs, and functions to write and read traces.
+ *
+ * A trace file contains a raplcap_trace_header, then header.n_columns raplcap_trace_column entries, then fixed-width
+ * records until the end of the file.
+ * Each record is a uint32_t timestamp delta followed by a uint32_t energy counter value for each column:
+ *
+ *   uint32_t dt;                     // ticks of header.time_unit_ns since the previous record (0 for the first one)
+ *   uint32_t counters[n_columns];    // energy counter in units of column.energy_unit, wrapping modulo 2^32
+ *
+ * All values are in the writer's byte order, without padding.
+ * The first record is a baseline - energy is the difference in counter values between records.
+ * Counters are the implementation's raw counters when they are at most 32 bits wide (e.g., MSRs), and are otherwise
+ * scaled to an equivalent 32-bit counter, so less than 2^32 units of energy may elapse between records.
+ * If a counter can't be read, its previous value is repeated, and the next successful read is a new baseline that
+ * continues from that value, so energy between them isn't recorded.
+ *
+ * Writer functions are provided by RAPLCap implementations.
+ * Reader functions are provided by the raplcap-trace library, which doesn't depend on an implementation.
+ * A trace may be read while it's still being written - a trailing partial record is ignored.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#ifndef _RAPLCAP_TRACE_H_
+#define _RAPLCAP_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "raplcap.h"
+
+#define RAPLCAP_TRACE_MAGIC "RCTR"
+#define RAPLCAP_TRACE_VERSION 1
+
+/**
+ * The coarsest energy unit that a writer uses for a column (2^-14 Joules).
+ * Counters with a coarser 32-bit resolution, or that are wider than 32 bits, are scaled to this unit.
+ */
+#define RAPLCAP_TRACE_ENERGY_UNIT_MAX 6.103515625e-05
+
+/**
+ * The trace file header.
+ */
+typedef struct raplcap_trace_header {
+  // RAPLCAP_TRACE_MAGIC, without a NUL terminator
+  char magic[4];
+  uint32_t version;
+  // bytes before the first record, including columns
+  uint32_t header_size;
+  // bytes per record: 4 * (n_columns + 1)
+  uint32_t record_size;
+  uint32_t n_columns;
+  // nanoseconds per timestamp delta tick
+  uint32_t time_unit_ns;
+  // CLOCK_REALTIME nanoseconds when the first record was written
+  uint64_t start_realtime_ns;
+} raplcap_trace_header;
+
+/**
+ * A package, die, and zone that's recorded in a trace.
+ */
+typedef struct raplcap_trace_column {
+  uint32_t pkg;
+  uint32_t die;
+  // a raplcap_zone value
+  uint32_t zone;
+  uint32_t reserved;
+  // Joules per counter increment
+  double energy_unit;
+} raplcap_trace_column;
+
+/**
+ * An opaque trace writer handle
+ */
+typedef struct raplcap_trace_writer raplcap_trace_writer;
+
+/**
+ * Start writing a trace, including the header and a baseline record.
+ * The columns' energy_unit fields are ignored - the writer chooses units based on the zones' counters.
+ *
+ * @param rc
+ * @param f the output file, which is not closed by the writer
+ * @param cols the packages, die, and zones to record
+ * @param n_cols the number of columns, must be > 0
+ * @return a writer on success, NULL on error
+ */
+raplcap_trace_writer* raplcap_trace_writer_start(const raplcap* rc, FILE* f, const raplcap_trace_column* cols,
+                                                 uint32_t n_cols);
+
+/**
+ * Read energy counters and write a record.
+ * Fails with ERANGE if too long has elapsed since the previous record to represent the timestamp delta.
+ *
+ * @param w
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_trace_writer_sample(raplcap_trace_writer* w);
+
+/**
+ * Flush the output file and release the writer's resources.
+ *
+ * @param w
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_trace_writer_finish(raplcap_trace_writer* w);
+
+/**
+ * An opaque trace reader handle
+ */
+typedef struct raplcap_trace raplcap_trace;
+
+/**
+ * Open a trace file for reading by mapping it into memory.
+ * The file is scanned once to index records for random access by time.
+ *
+ * @param path
+ * @return a trace on success, NULL on error
+ */
+raplcap_trace* raplcap_trace_open(const char* path);
+
+/**
+ * Unmap a trace file and release the reader's resources.
+ *
+ * @param t
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_trace_close(raplcap_trace* t);
+
+/**
+ * Get the trace header.
+ *
+ * @param t
+ * @return the header
+ */
+const raplcap_trace_header* raplcap_trace_get_header(const raplcap_trace* t);
+
+/**
+ * Get the trace columns.
+ *
+ * @param t
+ * @return header.n_columns columns
+ */
+const raplcap_trace_column* raplcap_trace_get_columns(const raplcap_trace* t);
+
+/**
+ * Get the number of complete records in the trace.
+ *
+ * @param t
+ * @return the number of records
+ */
+uint64_t raplcap_trace_get_num_records(const raplcap_trace* t);
+
+/**
+ * Get a record's time and cumulative energy since the first record.
+ *
+ * @param t
+ * @param idx the record index
+ * @param ns if not NULL, is set to the record's time in nanoseconds since the first record
+ * @param joules if not NULL, is set to Joules since the first record for each column - must have header.n_columns
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_trace_get_record(const raplcap_trace* t, uint64_t idx, uint64_t* ns, double* joules);
+
+/**
+ * Find the last record at or before a time.
+ *
+ * @param t
+ * @param ns nanoseconds since the first record
+ * @param idx is set to the record index
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_trace_find_record(const raplcap_trace* t, uint64_t ns, uint64_t* idx);
+
+/**
+ * Get a column's energy consumption between the last records at or before two times.
+ *
+ * @param t
+ * @param col the column index
+ * @param start_ns nanoseconds since the first record
+ * @param end_ns nanoseconds since the first record, must be >= start_ns
+ * @return Joules on success, a negative value on error
+ */
+double raplcap_trace_get_energy(const raplcap_trace* t, uint32_t col, uint64_t start_ns, uint64_t end_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * A minimal io_uring engine that reads a fixed set of files in a single batch, using raw system calls.
+ *
+ * The set of reads is prepared once: files are registered with the ring as fixed files, and each read has its own
+ * buffer owned by the engine.
+ * Every submission queues all the reads together with one io_uring_enter(2), then harvests their completions.
+ * Only one thread may use the engine at a time - raplcap_uring_submit doesn't block if another thread is using it, so
+ * callers can fall back to blocking reads instead.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#ifndef _RAPLCAP_URING_H_
+#define _RAPLCAP_URING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#pragma GCC visibility push(hidden)
+
+// If set to a non-zero value, implementations read energy snapshots with io_uring when it's available
+#define ENV_RAPLCAP_IO_URING "RAPLCAP_IO_URING"
+
+typedef struct raplcap_uring raplcap_uring;
+
+typedef struct raplcap_uring_read {
+  // index into the registered files
+  uint32_t file;
+  uint32_t len;
+  uint64_t offset;
+} raplcap_uring_read;
+
+/**
+ * Returns 1 if io_uring reads are requested by the environment, 0 otherwise.
+ */
+int raplcap_uring_is_enabled(void);
+
+/**
+ * Create an engine for a set of reads.
+ * Returns NULL and sets errno if io_uring or its read operation isn't available, which callers should treat as a
+ * reason to use blocking reads rather than a failure.
+ */
+raplcap_uring* raplcap_uring_init(const int* fds, uint32_t n_fds, const raplcap_uring_read* reads, uint32_t n_reads);
+
+/**
+ * Submit all reads and wait for them to complete.
+ * Returns 0 when results are available, in which case the caller must call raplcap_uring_release when done with them.
+ * Returns a non-zero value without holding the engine if another thread is using it, or if the batch failed.
+ */
+int raplcap_uring_submit(raplcap_uring* u);
+
+/**
+ * Get a read's result from the most recent submission: the number of bytes read, or a negative errno value.
+ * If buf is not NULL, it's set to the read's buffer.
+ */
+ssize_t raplcap_uring_get_result(const raplcap_uring* u, uint32_t read, const void** buf);
+
+/**
+ * Release the engine after a successful raplcap_uring_submit.
+ */
+void raplcap_uring_release(raplcap_uring* u);
+
+int raplcap_uring_destroy(raplcap_uring* u);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,7 +4,11 @@
  * If a NULL value is passed to functions for the raplcap (rc) parameter, a global default context is used.
  * This global (NULL) context must be initialized/destroyed the same as an application-managed (non-NULL) context.
  *
- * It is the developer's responsibility to synchronize as needed when a context is accessed by multiple threads.
+ * An initialized context may be used by multiple threads concurrently, except with raplcap_init, raplcap_destroy,
+ * and raplcap_set_energy_accumulation, which the developer must synchronize with all other uses of the context.
+ * Reads don't take locks, except energy reads while energy accumulation is enabled, which serialize per package/die.
+ * Writes only lock their package/die, so threads operating on different packages/die don't contend.
+ * Implementations that don't support these guarantees document otherwise.
  *
  * RAPL "clamping" may be managed automatically as part of enabling, disabling, or setting power caps.
  * It is implementation-specific if clamping is considered when getting or setting a zone's "enabled" status.
@@ -123,6 +127,8 @@ uint32_t raplcap_get_num_sockets(const raplcap* rc);
 
 /**
  * Get the number of available die in a package.
+ * Die counts may differ between packages, e.g., if all CPUs in a die are offline.
+ * Die are indexed contiguously from 0, even if the underlying die IDs in a package are not contiguous.
  * If the raplcap context is not initialized, the function will attempt to discover the number of available die.
  *
  * @param rc
@@ -239,6 +245,50 @@ int raplcap_pd_get_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_
 int raplcap_pd_set_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
                          raplcap_constraint constraint, const raplcap_limit* limit);
 
+/**
+ * Set the long_term and short_term limits for a zone on all packages and die, as with raplcap_pd_set_limits.
+ * Packages are written concurrently so that limits take effect across all packages as close together as possible.
+ * Worker threads are created by the first call on a context and kept until raplcap_destroy.
+ * If any writes fail, a single error is reported after all writes are attempted, and errno is set by the first failure.
+ *
+ * @param rc
+ * @param zone
+ * @param limit_long
+ * @param limit_short
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_set_limits_all(const raplcap* rc, raplcap_zone zone,
+                           const raplcap_limit* limit_long, const raplcap_limit* limit_short);
+
+/**
+ * A zone's configuration, as read by raplcap_pd_get_zone_states.
+ * The enabled, clamped, and locked fields are 1 or 0, or a negative value if the zone isn't supported, couldn't be
+ * read, or the implementation doesn't expose the property.
+ * Limits are indexed by constraint, and are zero for unsupported constraints.
+ */
+typedef struct raplcap_zone_state {
+  int enabled;
+  int clamped;
+  int locked;
+  raplcap_limit limits[RAPLCAP_CONSTRAINT_PEAK_POWER + 1];
+} raplcap_zone_state;
+
+/**
+ * Get the configuration of all zones of a package/die in a single call.
+ * Values are stored in an array indexed by zone, which must have at least `RAPLCAP_ZONE_PSYS + 1` entries.
+ * Implementations that support it read all the zones' registers in one batch, which is much cheaper than getting each
+ * zone's limits and status separately when monitoring.
+ *
+ * @param rc
+ * @param pkg
+ * @param die
+ * @param states
+ * @param len
+ * @return the number of array entries populated on success, a negative value on error
+ */
+int raplcap_pd_get_zone_states(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone_state* states,
+                               uint32_t len);
+
 /**
  * Get the current energy counter value for a zone in Joules.
  * Note that the counter rolls over - check the max value.
@@ -262,6 +312,130 @@ double raplcap_pd_get_energy_counter(const raplcap* rc, uint32_t pkg, uint32_t d
  */
 double raplcap_pd_get_energy_counter_max(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone);
 
+/**
+ * Get a zone's average power in Watts over a time window, blocking for the duration of the window.
+ * Each end of the window is aligned with an energy counter update by polling the counter until it changes, and reads
+ * are timestamped within the same call, so estimates are far less noisy than computing power from separate energy
+ * counter reads, particularly for short windows.
+ * The window is extended by up to a counter update period (about 1 ms) while polling, or by a few update periods for
+ * idle zones whose counters don't change.
+ * The window must be shorter than the counter's rollover period.
+ *
+ * @param rc
+ * @param pkg
+ * @param die
+ * @param zone
+ * @param seconds the minimum window duration, must be > 0
+ * @return Watts on success, a negative value on error
+ */
+double raplcap_pd_get_power(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone, double seconds);
+
+/**
+ * Get the current energy counter values in Joules for all zones of all packages and die in a single call.
+ * Values are stored in a flat array ordered by package, then die, then zone, i.e., the value for a zone is at index:
+ * `(die_offset + die) * (RAPLCAP_ZONE_PSYS + 1) + zone`, where `die_offset` is the sum of `raplcap_get_num_die` for
+ * all lower-numbered packages (die counts may differ between packages).
+ * Entries for zones that are not supported or could not be read are set to a negative value.
+ * Note that the counters roll over - check the max values.
+ *
+ * If the environment variable RAPLCAP_IO_URING is set to a non-zero value at initialization, implementations that
+ * support it submit all of a snapshot's reads together with io_uring when the kernel supports it, falling back to
+ * reading each package/die if not, or if another thread's snapshot is in progress.
+ *
+ * If joules is NULL, the required array length is returned and len is ignored.
+ *
+ * @param rc
+ * @param joules
+ * @param len
+ * @return the number of array entries populated (or required) on success, a negative value on error
+ */
+int raplcap_get_energy_snapshot(const raplcap* rc, double* joules, uint32_t len);
+
+/**
+ * Enable/disable energy accumulation.
+ * When enabled, every energy counter read updates monotonically increasing 64-bit totals for each zone, accounting
+ * for counter rollover, including reads by raplcap_pd_get_energy_counter and raplcap_get_energy_snapshot.
+ * Totals start at 0 when accumulation is enabled; enabling accumulation when it is already enabled has no effect.
+ * Counters must be read at least once per rollover period, otherwise energy will be lost.
+ *
+ * @param rc
+ * @param enabled
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_set_energy_accumulation(const raplcap* rc, int enabled);
+
+/**
+ * Read a zone's energy counter and get its accumulated energy in Joules since accumulation was enabled.
+ * Energy accumulation must be enabled.
+ *
+ * @param rc
+ * @param pkg
+ * @param die
+ * @param zone
+ * @return Joules on success, a negative value on error
+ * @see raplcap_set_energy_accumulation
+ */
+double raplcap_pd_get_energy_accumulated(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone);
+
+/**
+ * An opaque transaction handle
+ */
+typedef struct raplcap_txn raplcap_txn;
+
+/**
+ * Begin a transaction to stage changes for a zone, which are then applied together by raplcap_txn_commit.
+ * Implementations apply staged changes with as few register or file accesses as possible, and without exposing
+ * intermediate states where they can, e.g., enabling a zone only after its new limits are in place.
+ * Parameters are validated at commit time.
+ * A transaction must only be used by one thread at a time.
+ *
+ * @param rc
+ * @param pkg
+ * @param die
+ * @param zone
+ * @return a transaction on success, NULL on error
+ */
+raplcap_txn* raplcap_txn_begin(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone);
+
+/**
+ * Stage enabling/disabling a zone.
+ *
+ * @param txn
+ * @param enabled
+ * @return 0 on success, a negative value on error
+ * @see raplcap_pd_set_zone_enabled
+ */
+int raplcap_txn_set_zone_enabled(raplcap_txn* txn, int enabled);
+
+/**
+ * Stage a limit for a constraint.
+ * As with raplcap_pd_set_limit, only values > 0 are applied.
+ * Staging the same constraint again replaces the previously staged limit.
+ *
+ * @param txn
+ * @param constraint
+ * @param limit
+ * @return 0 on success, a negative value on error
+ * @see raplcap_pd_set_limit
+ */
+int raplcap_txn_set_limit(raplcap_txn* txn, raplcap_constraint constraint, const raplcap_limit* limit);
+
+/**
+ * Apply staged changes and release the transaction, even on failure.
+ * If an error occurs, some changes may have been applied.
+ *
+ * @param txn
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_txn_commit(raplcap_txn* txn);
+
+/**
+ * Discard staged changes and release the transaction.
+ *
+ * @param txn
+ */
+void raplcap_txn_abort(raplcap_txn* txn);
+
 /**
  * Assumes die=0.
  *
@@ -11,8 +11,8 @@
 #include "raplcap-cpuid.h"
 #include "raplcap-msr-common.h"
 
-#define HAS_SHORT_TERM(ctx, zone) (ctx->cfg[zone].constraints > 1)
-#define HAS_MAX_POWER(ctx, zone) (ctx->cfg[zone].constraints > 2)
+#define HAS_SHORT_TERM(ctx, zone) (MSR_CFG(ctx)[zone].constraints > 1)
+#define HAS_MAX_POWER(ctx, zone) (MSR_CFG(ctx)[zone].constraints > 2)
 
 #define PU_MASK   0xF
 #define PU_SHIFT  0
@@ -159,10 +159,7 @@ static double from_msr_tw_default(uint64_t bits, double time_units) {
   // "F" is an unsigned integer value represented by upper 2 bits
   const uint64_t y = bits & 0x1F;
   const uint64_t f = (bits >> 5) & 0x3;
-  const double seconds = pow2_u64(y) * ((4 + f) / 4.0) * time_units;
-  raplcap_log(DEBUG, "from_msr_tw_default: bits=0x%02lX, time_units=%.12f, y=0x%02lX, f=0x%lX, seconds=%.12f\n",
-              bits, time_units, y, f, seconds);
-  return seconds;
+  return pow2_u64(y) * ((4 + f) / 4.0) * time_units;
 }
 
 // Section 16.10.3
@@ -197,9 +194,7 @@ static uint64_t to_msr_tw_default(double seconds, double time_units) {
 static double from_msr_tw_atom(uint64_t bits, double time_units) {
   assert(time_units > 0);
   // If 0 is specified in bits [23:17], defaults to 1 second window, which should be the same as time_units.
-  const double seconds = bits ? (bits * time_units) : time_units;
-  raplcap_log(DEBUG, "from_msr_tw_atom: bits=0x%02lX, seconds=%.12f\n", bits, seconds);
-  return seconds;
+  return bits ? (bits * time_units) : time_units;
 }
 
 // Table 2-8
@@ -229,9 +224,7 @@ static double from_msr_tw_atom_airmont(uint64_t bits, double time_units) {
   // Used only for Airmont PP0 (CORE) zone
   (void) time_units;
   // If 0 is specified in bits [23:17], defaults to 1 second window.
-  const double seconds = bits ? bits * 5.0 : 1.0;
-  raplcap_log(DEBUG, "from_msr_tw_atom_airmont: bits=0x%02lX, seconds=%.12f\n", bits, seconds);
-  return seconds;
+  return bits ? bits * 5.0 : 1.0;
 }
 
 // Table 2-11
@@ -314,21 +307,20 @@ static const raplcap_msr_zone_cfg CFG_ATOM_AIRMONT[RAPLCAP_NZONES] = {
   CFG_STATIC_INIT(to_msr_tw_atom, from_msr_tw_atom, to_msr_pl_default, from_msr_pl_default, to_msr_pl4_default, 2), // PSYS
 };
 
-uint32_t msr_get_supported_cpu_model(void) {
-  uint32_t cpu_family;
-  uint32_t cpu_model;
-  cpuid_get_family_model(&cpu_family, &cpu_model);
-  if (!cpuid_is_vendor_intel() || !cpuid_is_cpu_supported(cpu_family, cpu_model)) {
-    raplcap_log(ERROR, "CPU not supported: Family=%"PRIu32", Model=%02X\n", cpu_family, cpu_model);
-    return 0;
-  }
-  return cpu_model;
-}
-
-void msr_get_context(raplcap_msr_ctx* ctx, uint32_t cpu_model, uint64_t units_msrval) {
-  assert(ctx != NULL);
-  assert(cpu_model > 0);
-  ctx->cpu_model = cpu_model;
+// CPU models that share zone configurations and units
+typedef enum msr_model_group {
+  MSR_MODEL_GROUP_UNKNOWN = 0,
+  MSR_MODEL_GROUP_DEFAULT,
+  MSR_MODEL_GROUP_SPR,
+  MSR_MODEL_GROUP_DEFAULT_PL4,
+  MSR_MODEL_GROUP_METEORLAKE,
+  MSR_MODEL_GROUP_SERVER,
+  MSR_MODEL_GROUP_ATOM,
+  MSR_MODEL_GROUP_ATOM_SILVERMONT_D,
+  MSR_MODEL_GROUP_ATOM_AIRMONT
+} msr_model_group;
+
+static inline msr_model_group get_model_group(uint32_t cpu_model) {
   switch (cpu_model) {
     case CPUID_MODEL_SANDYBRIDGE:
     case CPUID_MODEL_SANDYBRIDGE_X:
@@ -368,24 +360,12 @@ void msr_get_context(raplcap_msr_ctx* ctx, uint32_t cpu_model, uint64_t units_ms
     case CPUID_MODEL_ATOM_TREMONT_L:
     //
     case CPUID_MODEL_ATOM_CRESTMONT_X:
-      ctx->power_units = from_msr_pu_default(units_msrval);
-      ctx->energy_units = from_msr_eu_default(units_msrval);
-      ctx->energy_units_dram = ctx->energy_units;
-      ctx->energy_units_psys = ctx->energy_units;
-      ctx->time_units = from_msr_tu_default(units_msrval);
-      ctx->cfg = CFG_DEFAULT;
-      break;
+      return MSR_MODEL_GROUP_DEFAULT;
     //----
     case CPUID_MODEL_SAPPHIRERAPIDS_X:
     //
     case CPUID_MODEL_EMERALDRAPIDS_X:
-      ctx->power_units = from_msr_pu_default(units_msrval);
-      ctx->energy_units = from_msr_eu_default(units_msrval);
-      ctx->energy_units_dram = 0.000061;
-      ctx->energy_units_psys = 1.0;
-      ctx->time_units = from_msr_tu_default(units_msrval);
-      ctx->cfg = CFG_SPR;
-      break;
+      return MSR_MODEL_GROUP_SPR;
     //----
     case CPUID_MODEL_TIGERLAKE_L:
     case CPUID_MODEL_TIGERLAKE:
@@ -396,24 +376,12 @@ void msr_get_context(raplcap_msr_ctx* ctx, uint32_t cpu_model, uint64_t units_ms
     case CPUID_MODEL_RAPTORLAKE:
     case CPUID_MODEL_RAPTORLAKE_P:
     case CPUID_MODEL_RAPTORLAKE_S:
-      ctx->power_units = from_msr_pu_default(units_msrval);
-      ctx->energy_units = from_msr_eu_default(units_msrval);
-      ctx->energy_units_dram = ctx->energy_units;
-      ctx->energy_units_psys = ctx->energy_units;
-      ctx->time_units = from_msr_tu_default(units_msrval);
-      ctx->cfg = CFG_DEFAULT_PL4;
-      break;
+      return MSR_MODEL_GROUP_DEFAULT_PL4;
     //----
     case CPUID_MODEL_METEORLAKE_L:
     //
     case CPUID_MODEL_LUNARLAKE_M:
-      ctx->power_units = from_msr_pu_default(units_msrval);
-      ctx->energy_units = from_msr_eu_default(units_msrval);
-      ctx->energy_units_dram = ctx->energy_units;
-      ctx->energy_units_psys = ctx->energy_units;
-      ctx->time_units = from_msr_tu_default(units_msrval);
-      ctx->cfg = CFG_METEORLAKE;
-      break;
+      return MSR_MODEL_GROUP_METEORLAKE;
     //----
     case CPUID_MODEL_HASWELL_X:
     case CPUID_MODEL_BROADWELL_X:
@@ -423,50 +391,209 @@ void msr_get_context(raplcap_msr_ctx* ctx, uint32_t cpu_model, uint64_t units_ms
     case CPUID_MODEL_ICELAKE_D:
     case CPUID_MODEL_XEON_PHI_KNL:
     case CPUID_MODEL_XEON_PHI_KNM:
+      return MSR_MODEL_GROUP_SERVER;
+    //----
+    case CPUID_MODEL_ATOM_SILVERMONT:
+    case CPUID_MODEL_ATOM_SILVERMONT_MID:
+    case CPUID_MODEL_ATOM_AIRMONT_MID:
+    case CPUID_MODEL_ATOM_SOFIA:
+      return MSR_MODEL_GROUP_ATOM;
+    case CPUID_MODEL_ATOM_SILVERMONT_D:
+      return MSR_MODEL_GROUP_ATOM_SILVERMONT_D;
+    //----
+    case CPUID_MODEL_ATOM_AIRMONT:
+      return MSR_MODEL_GROUP_ATOM_AIRMONT;
+    //----
+    default:
+      return MSR_MODEL_GROUP_UNKNOWN;
+  }
+}
+
+static inline const raplcap_msr_zone_cfg* get_group_cfg(msr_model_group group) {
+  switch (group) {
+    case MSR_MODEL_GROUP_SPR:
+      return CFG_SPR;
+    case MSR_MODEL_GROUP_DEFAULT_PL4:
+      return CFG_DEFAULT_PL4;
+    case MSR_MODEL_GROUP_METEORLAKE:
+      return CFG_METEORLAKE;
+    case MSR_MODEL_GROUP_ATOM:
+      return CFG_ATOM;
+    case MSR_MODEL_GROUP_ATOM_AIRMONT:
+      return CFG_ATOM_AIRMONT;
+    case MSR_MODEL_GROUP_DEFAULT:
+    case MSR_MODEL_GROUP_SERVER:
+    case MSR_MODEL_GROUP_ATOM_SILVERMONT_D:
+    case MSR_MODEL_GROUP_UNKNOWN:
+    default:
+      return CFG_DEFAULT;
+  }
+}
+
+#if defined(RAPLCAP_MSR_FIXED_MODEL)
+// The model is known at compile time, so its zone configurations and quirks are constants
+#define MSR_CPU_MODEL(ctx) ((void) (ctx), (uint32_t) (RAPLCAP_MSR_FIXED_MODEL))
+#define MSR_CFG(ctx) ((void) (ctx), get_group_cfg(get_model_group(RAPLCAP_MSR_FIXED_MODEL)))
+// Index the configurations with constant zones so the compiler can make conversions direct (and inlinable) calls
+#define MSR_CFG_CALL(ctx, zone, fn, value, units) ( \
+  (zone) == RAPLCAP_ZONE_PACKAGE ? MSR_CFG(ctx)[RAPLCAP_ZONE_PACKAGE].fn(value, units) : \
+  (zone) == RAPLCAP_ZONE_CORE ? MSR_CFG(ctx)[RAPLCAP_ZONE_CORE].fn(value, units) : \
+  (zone) == RAPLCAP_ZONE_UNCORE ? MSR_CFG(ctx)[RAPLCAP_ZONE_UNCORE].fn(value, units) : \
+  (zone) == RAPLCAP_ZONE_DRAM ? MSR_CFG(ctx)[RAPLCAP_ZONE_DRAM].fn(value, units) : \
+  MSR_CFG(ctx)[RAPLCAP_ZONE_PSYS].fn(value, units))
+#else
+#define MSR_CPU_MODEL(ctx) ((ctx)->cpu_model)
+#define MSR_CFG(ctx) ((ctx)->cfg)
+#define MSR_CFG_CALL(ctx, zone, fn, value, units) ((ctx)->cfg[zone].fn(value, units))
+#endif
+
+uint32_t msr_get_supported_cpu_model(void) {
+#if defined(RAPLCAP_MSR_MOCK_CPU_MODEL)
+  // mock builds don't depend on the host CPU
+  return RAPLCAP_MSR_MOCK_CPU_MODEL;
+#else
+  uint32_t cpu_family;
+  uint32_t cpu_model;
+  cpuid_get_family_model(&cpu_family, &cpu_model);
+  if (!cpuid_is_vendor_intel() || !cpuid_is_cpu_supported(cpu_family, cpu_model)) {
+    raplcap_log(ERROR, "CPU not supported: Family=%"PRIu32", Model=%02X\n", cpu_family, cpu_model);
+    return 0;
+  }
+#if defined(RAPLCAP_MSR_FIXED_MODEL)
+  // conversions are compiled for one model, and would silently misbehave for others
+  if (cpu_model != RAPLCAP_MSR_FIXED_MODEL) {
+    raplcap_log(ERROR, "CPU model %02X doesn't match the model this library was built for: %02X\n",
+                cpu_model, (uint32_t) (RAPLCAP_MSR_FIXED_MODEL));
+    return 0;
+  }
+#endif
+  return cpu_model;
+#endif
+}
+
+static void tw_table_init(raplcap_msr_zone_tw* tw, const raplcap_msr_ctx* ctx, raplcap_zone zone) {
+  uint32_t i;
+  uint32_t j;
+  uint8_t bits;
+  for (i = 0; i < MSR_TW_NVALS; i++) {
+    tw->seconds[i] = MSR_CFG_CALL(ctx, zone, from_msr_tw, i, ctx->time_units);
+    // insertion sort, keeping lower field values first for equal time windows
+    bits = (uint8_t) i;
+    for (j = i; j > 0 && tw->seconds[tw->sorted[j - 1]] > tw->seconds[bits]; j--) {
+      tw->sorted[j] = tw->sorted[j - 1];
+    }
+    tw->sorted[j] = bits;
+  }
+  // the default encoding selects the largest time window that doesn't exceed the requested one, which the search
+  // reproduces exactly; other encodings round to nearest, and are simple enough to compute directly anyway
+  tw->use_sorted = MSR_CFG(ctx)[zone].to_msr_tw == to_msr_tw_default;
+}
+
+// Same result as to_msr_tw_default, but a binary search instead of arithmetic
+static uint64_t to_msr_tw_sorted(const raplcap_msr_zone_tw* tw, double seconds, double time_units) {
+  assert(seconds > 0);
+  static const double MSR_TIME_MAX = (double) 0xFFFFFFFF;
+  uint32_t lo = 0;
+  uint32_t hi = MSR_TW_NVALS;
+  uint32_t mid;
+  uint64_t bits;
+  // find the first time window larger than requested
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (tw->seconds[tw->sorted[mid]] <= seconds) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    raplcap_log(WARN, "Time window too small: %.12f sec, using min: %.12f sec\n", seconds, time_units);
+    bits = tw->sorted[0];
+  } else {
+    if (seconds / time_units > MSR_TIME_MAX) {
+      raplcap_log(WARN, "Time window too large: %.12f sec, trying max: %.12f sec\n", seconds,
+                  MSR_TIME_MAX * time_units);
+    }
+    bits = tw->sorted[lo - 1];
+  }
+  raplcap_log(DEBUG, "to_msr_tw_sorted: seconds=%.12f, bits=0x%02lX\n", seconds, bits);
+  return bits;
+}
+
+static uint64_t to_msr_tw(const raplcap_msr_ctx* ctx, raplcap_zone zone, double seconds) {
+  return ctx->tw[zone].use_sorted ? to_msr_tw_sorted(&ctx->tw[zone], seconds, ctx->time_units) :
+                                    MSR_CFG_CALL(ctx, zone, to_msr_tw, seconds, ctx->time_units);
+}
+
+void msr_get_context(raplcap_msr_ctx* ctx, uint32_t cpu_model, uint64_t units_msrval) {
+  int i;
+  assert(ctx != NULL);
+  assert(cpu_model > 0);
+#if defined(RAPLCAP_MSR_FIXED_MODEL)
+  assert(cpu_model == RAPLCAP_MSR_FIXED_MODEL);
+  // only the fixed model's configuration is compiled in
+  const msr_model_group group = get_model_group(RAPLCAP_MSR_FIXED_MODEL);
+#else
+  const msr_model_group group = get_model_group(cpu_model);
+#endif
+  ctx->cpu_model = cpu_model;
+  ctx->cfg = get_group_cfg(group);
+  switch (group) {
+    case MSR_MODEL_GROUP_DEFAULT:
+    case MSR_MODEL_GROUP_DEFAULT_PL4:
+    case MSR_MODEL_GROUP_METEORLAKE:
+      ctx->power_units = from_msr_pu_default(units_msrval);
+      ctx->energy_units = from_msr_eu_default(units_msrval);
+      ctx->energy_units_dram = ctx->energy_units;
+      ctx->energy_units_psys = ctx->energy_units;
+      ctx->time_units = from_msr_tu_default(units_msrval);
+      break;
+    case MSR_MODEL_GROUP_SPR:
+      ctx->power_units = from_msr_pu_default(units_msrval);
+      ctx->energy_units = from_msr_eu_default(units_msrval);
+      ctx->energy_units_dram = 0.000061;
+      ctx->energy_units_psys = 1.0;
+      ctx->time_units = from_msr_tu_default(units_msrval);
+      break;
+    case MSR_MODEL_GROUP_SERVER:
       ctx->power_units = from_msr_pu_default(units_msrval);
       ctx->energy_units = from_msr_eu_default(units_msrval);
       ctx->energy_units_dram = 0.0000153;
       ctx->energy_units_psys = ctx->energy_units;
       ctx->time_units = from_msr_tu_default(units_msrval);
-      ctx->cfg = CFG_DEFAULT;
       break;
-    //----
-    case CPUID_MODEL_ATOM_SILVERMONT:
-    case CPUID_MODEL_ATOM_SILVERMONT_MID:
-    case CPUID_MODEL_ATOM_AIRMONT_MID:
-    case CPUID_MODEL_ATOM_SOFIA:
+    case MSR_MODEL_GROUP_ATOM:
       ctx->power_units = from_msr_pu_atom(units_msrval);
       ctx->energy_units = from_msr_eu_atom(units_msrval);
       ctx->energy_units_dram = ctx->energy_units;
       ctx->energy_units_psys = ctx->energy_units;
       ctx->time_units = from_msr_tu_default(units_msrval);
-      ctx->cfg = CFG_ATOM;
       break;
-    case CPUID_MODEL_ATOM_SILVERMONT_D:
+    case MSR_MODEL_GROUP_ATOM_SILVERMONT_D:
       ctx->power_units = from_msr_pu_atom(units_msrval);
       // The Intel SDM claims we should use from_msr_eu_atom, but that appears to be incorrect
       ctx->energy_units = from_msr_eu_default(units_msrval);
       ctx->energy_units_dram = ctx->energy_units;
       ctx->energy_units_psys = ctx->energy_units;
       ctx->time_units = from_msr_tu_default(units_msrval);
-      ctx->cfg = CFG_DEFAULT;
       break;
-    //----
-    case CPUID_MODEL_ATOM_AIRMONT:
+    case MSR_MODEL_GROUP_ATOM_AIRMONT:
       ctx->power_units = from_msr_pu_atom(units_msrval);
       ctx->energy_units = from_msr_eu_default(units_msrval);
       ctx->energy_units_dram = ctx->energy_units;
       ctx->energy_units_psys = ctx->energy_units;
       ctx->time_units = from_msr_tu_default(units_msrval);
-      ctx->cfg = CFG_ATOM_AIRMONT;
       break;
-    //----
+    case MSR_MODEL_GROUP_UNKNOWN:
     default:
       raplcap_log(ERROR, "Unknown architecture\n");
       raplcap_log(ERROR, "Please report a bug if you see this message, it should never occur!\n");
       assert(0);
       return;
   }
+  for (i = 0; i < RAPLCAP_NZONES; i++) {
+    tw_table_init(&ctx->tw[i], ctx, (raplcap_zone) i);
+  }
   raplcap_log(DEBUG, "msr_get_context: model=%02X, "
               "power_units=%.12f, energy_units=%.12f, energy_units_dram=%.12f, energy_units_psys=%.12f, "
               "time_units=%.12f\n",
@@ -510,7 +637,7 @@ static void zone_enabled_quirks(const raplcap_msr_ctx* ctx, raplcap_zone zone, u
   assert(bit1 != NULL);
   assert(bit2 != NULL);
   if (zone == RAPLCAP_ZONE_PSYS &&
-      (ctx->cpu_model == CPUID_MODEL_SAPPHIRERAPIDS_X || ctx->cpu_model == CPUID_MODEL_EMERALDRAPIDS_X)) {
+      (MSR_CPU_MODEL(ctx) == CPUID_MODEL_SAPPHIRERAPIDS_X || MSR_CPU_MODEL(ctx) == CPUID_MODEL_EMERALDRAPIDS_X)) {
     *bit1 = 17;
     *bit2 = 49;
   }
@@ -557,7 +684,7 @@ static void zone_clamped_quirks(const raplcap_msr_ctx* ctx, raplcap_zone zone, u
   assert(bit1 != NULL);
   assert(bit2 != NULL);
   if (zone == RAPLCAP_ZONE_PSYS &&
-      (ctx->cpu_model == CPUID_MODEL_SAPPHIRERAPIDS_X || ctx->cpu_model == CPUID_MODEL_EMERALDRAPIDS_X)) {
+      (MSR_CPU_MODEL(ctx) == CPUID_MODEL_SAPPHIRERAPIDS_X || MSR_CPU_MODEL(ctx) == CPUID_MODEL_EMERALDRAPIDS_X)) {
     *bit1 = 18;
     *bit2 = 50;
   }
@@ -621,7 +748,7 @@ static void zone_limits_quirks(const raplcap_msr_ctx* ctx, raplcap_zone zone, ui
   assert(tw1_first != NULL);
   assert(tw2_first != NULL);
   if (zone == RAPLCAP_ZONE_PSYS &&
-      (ctx->cpu_model == CPUID_MODEL_SAPPHIRERAPIDS_X || ctx->cpu_model == CPUID_MODEL_EMERALDRAPIDS_X)) {
+      (MSR_CPU_MODEL(ctx) == CPUID_MODEL_SAPPHIRERAPIDS_X || MSR_CPU_MODEL(ctx) == CPUID_MODEL_EMERALDRAPIDS_X)) {
     if (pl1_last != NULL) {
       *pl1_last = 16;
     }
@@ -650,17 +777,17 @@ void msr_get_limits(const raplcap_msr_ctx* ctx, raplcap_zone zone, uint64_t msrv
   uint64_t pl_mask = PL_MASK;
   zone_limits_quirks(ctx, zone, NULL, &tw1_shift, NULL, NULL, &tw2_shift, NULL, &pl_mask);
   if (limit_long != NULL) {
-    limit_long->watts = ctx->cfg[zone].from_msr_pl((msrval >> PL1_SHIFT) & pl_mask, ctx->power_units);
-    limit_long->seconds = ctx->cfg[zone].from_msr_tw((msrval >> tw1_shift) & TL_MASK, ctx->time_units);
+    limit_long->watts = MSR_CFG_CALL(ctx, zone, from_msr_pl, (msrval >> PL1_SHIFT) & pl_mask, ctx->power_units);
+    limit_long->seconds = ctx->tw[zone].seconds[(msrval >> tw1_shift) & TL_MASK];
     raplcap_log(DEBUG, "msr_get_limits: zone=%d, long_term:\n\ttime=%.12f s\n\tpower=%.12f W\n",
                 zone, limit_long->seconds, limit_long->watts);
   }
   if (limit_short != NULL && HAS_SHORT_TERM(ctx, zone)) {
-    limit_short->watts = ctx->cfg[zone].from_msr_pl((msrval >> PL2_SHIFT) & pl_mask, ctx->power_units);
+    limit_short->watts = MSR_CFG_CALL(ctx, zone, from_msr_pl, (msrval >> PL2_SHIFT) & pl_mask, ctx->power_units);
     if (zone == RAPLCAP_ZONE_PSYS) {
       raplcap_log(DEBUG, "msr_get_limits: Documentation does not specify PSys/Platform short term time window\n");
     }
-    limit_short->seconds = ctx->cfg[zone].from_msr_tw((msrval >> tw2_shift) & TL_MASK, ctx->time_units);
+    limit_short->seconds = ctx->tw[zone].seconds[(msrval >> tw2_shift) & TL_MASK];
     raplcap_log(DEBUG, "msr_get_limits: zone=%d, short_term:\n\ttime=%.12f s\n\tpower=%.12f W\n",
                 zone, limit_short->seconds, limit_short->watts);
   }
@@ -680,18 +807,19 @@ uint64_t msr_set_limits(const raplcap_msr_ctx* ctx, raplcap_zone zone, uint64_t
     raplcap_log(DEBUG, "msr_set_limits: zone=%d, long_term:\n\ttime=%.12f s\n\tpower=%.12f W\n",
                 zone, limit_long->seconds, limit_long->watts);
     if (limit_long->watts > 0) {
-      msrval = replace_bits(msrval, ctx->cfg[zone].to_msr_pl(limit_long->watts, ctx->power_units), 0, pl1_last);
+      msrval = replace_bits(msrval, MSR_CFG_CALL(ctx, zone, to_msr_pl, limit_long->watts, ctx->power_units),
+                            0, pl1_last);
     }
     if (limit_long->seconds > 0) {
-      msrval = replace_bits(msrval, ctx->cfg[zone].to_msr_tw(limit_long->seconds, ctx->time_units), tw1_first,
-                            tw1_last);
+      msrval = replace_bits(msrval, to_msr_tw(ctx, zone, limit_long->seconds), tw1_first, tw1_last);
     }
   }
   if (limit_short != NULL && HAS_SHORT_TERM(ctx, zone)) {
     raplcap_log(DEBUG, "msr_set_limits: zone=%d, short_term:\n\ttime=%.12f s\n\tpower=%.12f W\n",
                 zone, limit_short->seconds, limit_short->watts);
     if (limit_short->watts > 0) {
-      msrval = replace_bits(msrval, ctx->cfg[zone].to_msr_pl(limit_short->watts, ctx->power_units), 32, pl2_last);
+      msrval = replace_bits(msrval, MSR_CFG_CALL(ctx, zone, to_msr_pl, limit_short->watts, ctx->power_units),
+                            32, pl2_last);
     }
     if (limit_short->seconds > 0) {
       // 16.10.3: This field may have a hard-coded value in hardware and ignores values written by software.
@@ -699,8 +827,7 @@ uint64_t msr_set_limits(const raplcap_msr_ctx* ctx, raplcap_zone zone, uint64_t
         // Table 2-39: PSYS has power limit #2, but time window #2 is chosen by the processor
         raplcap_log(WARN, "Not allowed to set PSys/Platform short term time window\n");
       } else {
-        msrval = replace_bits(msrval, ctx->cfg[zone].to_msr_tw(limit_short->seconds, ctx->time_units), tw2_first,
-                              tw2_last);
+        msrval = replace_bits(msrval, to_msr_tw(ctx, zone, limit_short->seconds), tw2_first, tw2_last);
       }
     }
   }
@@ -723,7 +850,7 @@ uint64_t msr_set_pl4_locked(const raplcap_msr_ctx* ctx, raplcap_zone zone, uint6
 }
 
 static void pl4_limit_quirks(const raplcap_msr_ctx* ctx, uint8_t* pl_last, uint64_t* pl_mask) {
-  if (ctx->cpu_model == CPUID_MODEL_METEORLAKE_L || ctx->cpu_model == CPUID_MODEL_LUNARLAKE_M) {
+  if (MSR_CPU_MODEL(ctx) == CPUID_MODEL_METEORLAKE_L || MSR_CPU_MODEL(ctx) == CPUID_MODEL_LUNARLAKE_M) {
     if (pl_last != NULL) {
       *pl_last = 15;
     }
@@ -737,7 +864,7 @@ double msr_get_pl4_limit(const raplcap_msr_ctx* ctx, raplcap_zone zone, uint64_t
   assert(ctx != NULL);
   uint64_t pl_mask = PL4_MASK;
   pl4_limit_quirks(ctx, NULL, &pl_mask);
-  double watts = ctx->cfg[zone].from_msr_pl((msrval >> PL4_SHIFT) & pl_mask, ctx->power_units);
+  double watts = MSR_CFG_CALL(ctx, zone, from_msr_pl, (msrval >> PL4_SHIFT) & pl_mask, ctx->power_units);
   raplcap_log(DEBUG, "msr_get_pl4_limit: zone=%d, power=%.12f W\n", zone, watts);
   return watts;
 }
@@ -748,7 +875,7 @@ uint64_t msr_set_pl4_limit(const raplcap_msr_ctx* ctx, raplcap_zone zone, uint64
   uint8_t pl_last = 12;
   pl4_limit_quirks(ctx, &pl_last, NULL);
   if (watts > 0) {
-    msrval = replace_bits(msrval, ctx->cfg[zone].to_msr_pl4(watts, ctx->power_units), 0, pl_last);
+    msrval = replace_bits(msrval, MSR_CFG_CALL(ctx, zone, to_msr_pl4, watts, ctx->power_units), 0, pl_last);
   }
   return msrval;
 }
@@ -760,6 +887,14 @@ double msr_get_energy_counter(const raplcap_msr_ctx* ctx, uint64_t msrval, raplc
   return joules;
 }
 
+uint64_t msr_get_energy_counter_raw(uint64_t msrval) {
+  return (msrval >> EY_SHIFT) & EY_MASK;
+}
+
+uint64_t msr_get_energy_counter_raw_max(void) {
+  return pow2_u64(32);
+}
+
 double msr_get_energy_counter_max(const raplcap_msr_ctx* ctx, raplcap_zone zone) {
   assert(ctx != NULL);
   // Get actual rollover value (2^32 * units) rather than max value that can be read ((2^32 - 1) * units)
@@ -771,7 +906,7 @@ double msr_get_energy_counter_max(const raplcap_msr_ctx* ctx, raplcap_zone zone)
 double msr_get_time_units(const raplcap_msr_ctx* ctx, raplcap_zone zone) {
   assert(ctx != NULL);
   // Airmont PACKAGE domain doesn't use normal time units
-  const double sec = ctx->cfg[zone].to_msr_tw == to_msr_tw_atom_airmont ? 5.0 : ctx->time_units;
+  const double sec = MSR_CFG(ctx)[zone].to_msr_tw == to_msr_tw_atom_airmont ? 5.0 : ctx->time_units;
   raplcap_log(DEBUG, "msr_get_time_units: sec=%.12f\n", sec);
   return sec;
 }
@@ -42,8 +42,24 @@ typedef struct raplcap_msr_zone_cfg {
   uint8_t constraints;
 } raplcap_msr_zone_cfg;
 
+// the time window field is 7 bits
+#define MSR_TW_NVALS 128
+
+/**
+ * Time window conversions, precomputed for a zone's time units.
+ */
+typedef struct raplcap_msr_zone_tw {
+  // time window in seconds for each field value
+  double seconds[MSR_TW_NVALS];
+  // field values ordered by increasing time window
+  uint8_t sorted[MSR_TW_NVALS];
+  // if set, encoding is a search of the sorted values, otherwise use the zone cfg's to_msr_tw function
+  int use_sorted;
+} raplcap_msr_zone_tw;
+
 typedef struct raplcap_msr_ctx {
   const raplcap_msr_zone_cfg* cfg;
+  raplcap_msr_zone_tw tw[RAPLCAP_NZONES];
   double power_units;
   double energy_units;
   double energy_units_dram;
@@ -138,6 +154,16 @@ uint64_t msr_set_pl4_limit(const raplcap_msr_ctx* ctx, raplcap_zone zone, uint64
  */
 double msr_get_energy_counter(const raplcap_msr_ctx* ctx, uint64_t msrval, raplcap_zone zone);
 
+/**
+ * Get the energy counter value in energy units.
+ */
+uint64_t msr_get_energy_counter_raw(uint64_t msrval);
+
+/**
+ * Get the energy counter rollover value in energy units.
+ */
+uint64_t msr_get_energy_counter_raw_max(void);
+
 /**
  * Get the max energy counter value in Joules.
  */
@@ -4,25 +4,75 @@
  * @author Connor Imes
  * @date 2020-06-09
  */
-// for popen, pread, pwrite, sysconf
-#define _POSIX_C_SOURCE 200809L
+// for popen, pread, pwrite, pthread, sched_getcpu
+#define _GNU_SOURCE
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include "raplcap-common.h"
 #include "raplcap-msr-sys.h"
+#include "raplcap-uring.h"
+
+// Batch interface provided by msr-safe (see msr_batch.h in the msr-safe sources)
+#define MSR_BATCH_DEV "/dev/cpu/msr_batch"
+#define MSR_BATCH_MAX_OPS 16
+
+struct msr_batch_op {
+  uint16_t cpu;
+  uint16_t isrdmsr;
+  int32_t err;
+  uint32_t msr;
+  uint64_t msrdata;
+  uint64_t wmask;
+};
+
+struct msr_batch_array {
+  uint32_t numops;
+  struct msr_batch_op* ops;
+};
+
+#define X86_IOC_MSR_BATCH _IOWR('c', 0xA2, struct msr_batch_array)
+
+// If set to a non-zero value, reads use the calling thread's current CPU when it's in the target die
+#define ENV_RAPLCAP_MSR_LOCAL_CPU "RAPLCAP_MSR_LOCAL_CPU"
+
+// A per-CPU fd that failed to open, so isn't tried again
+#define LOCAL_FD_FAILED -2
+
+// Only written during initialization, so not padded to cache lines - sharing lines between die is harmless
+typedef struct msr_sys_die {
+  int fd;
+  // the CPU that fd was opened for
+  uint32_t cpu;
+} msr_sys_die;
 
 struct raplcap_msr_sys_ctx {
-  int* fds;
+  // indexed by die_offsets[pkg] + die
+  msr_sys_die* dies;
+  // die of package pkg are in range [die_offsets[pkg], die_offsets[pkg + 1])
+  uint32_t* die_offsets;
   uint32_t n_fds;
   uint32_t n_pkg;
-  uint32_t n_die;
+  // only opened if msr-safe is in use, otherwise -1
+  int batch_fd;
+  // local CPU reads - NULL if not enabled
+  // die index of each CPU, or UINT32_MAX if unknown
+  uint32_t* cpu_dies;
+  // opened lazily for reading, -1 if not yet opened
+  int* cpu_fds;
+  // length of cpu_dies and cpu_fds: the max CPU ID + 1
+  uint32_t n_cpu_ids;
+  // the read set, with the die fds registered as fixed files - NULL if not prepared
+  raplcap_uring* uring;
 };
 
 typedef struct msr_topology {
@@ -31,99 +81,280 @@ typedef struct msr_topology {
   uint32_t cpu;
 } msr_topology;
 
-static int open_msr(uint32_t core, int flags) {
+// Topology is sorted by pkg and die, and is immutable once created
+// Die counts may differ between packages, so die are stored compactly (CSR-style) as offsets and entries, where the
+// entries are the unique combinations of pkg and die
+typedef struct msr_topology_cache {
+  msr_topology* topo;
+  // n_pkg + 1 elements; die of package pkg are entries [die_offsets[pkg], die_offsets[pkg + 1])
+  uint32_t* die_offsets;
+  // online CPUs, which are the entries in topo
+  uint32_t n_cpus;
+  // CPU IDs may not be contiguous (e.g., if CPUs are offline), so this is the max online CPU ID + 1
+  uint32_t n_cpu_ids;
+  uint32_t n_pkg;
+  // unique combinations of pkg and die
+  uint32_t n_pkg_die;
+} msr_topology_cache;
+
+// may be overridden for testing
+#ifndef SYSFS_CPU_DIR
+  #define SYSFS_CPU_DIR "/sys/devices/system/cpu"
+#endif
+
+typedef enum msr_driver {
+  MSR_DRIVER_UNKNOWN = 0,
+  MSR_DRIVER_MSR_SAFE,
+  MSR_DRIVER_MSR,
+} msr_driver;
+
+// Process-wide topology cache, created lazily and replaced only by an explicit refresh
+static pthread_mutex_t topo_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static msr_topology_cache* topo_cache = NULL;
+
+// Process-wide record of which driver last worked, so we don't keep probing for msr-safe when it's not available
+static int msr_driver_hint = MSR_DRIVER_UNKNOWN;
+
+static int open_msr(uint32_t core, int flags, int* is_msr_safe) {
   char msr_filename[32];
-  int fd;
+  int fd = -1;
+  const int hint = __atomic_load_n(&msr_driver_hint, __ATOMIC_RELAXED);
+  *is_msr_safe = 0;
   // first try using the msr_safe kernel module
-  snprintf(msr_filename, sizeof(msr_filename), "/dev/cpu/%"PRIu32"/msr_safe", core);
-  if ((fd = open(msr_filename, flags)) < 0) {
+  if (hint != MSR_DRIVER_MSR) {
+    snprintf(msr_filename, sizeof(msr_filename), "/dev/cpu/%"PRIu32"/msr_safe", core);
+    if ((fd = open(msr_filename, flags)) >= 0) {
+      __atomic_store_n(&msr_driver_hint, MSR_DRIVER_MSR_SAFE, __ATOMIC_RELAXED);
+      *is_msr_safe = 1;
+      return fd;
+    }
     raplcap_perror(DEBUG, msr_filename);
     raplcap_log(INFO, "msr-safe not available, falling back on standard msr\n");
-    // fall back on the standard msr kernel module
-    snprintf(msr_filename, sizeof(msr_filename), "/dev/cpu/%"PRIu32"/msr", core);
-    if ((fd = open(msr_filename, flags)) < 0) {
-      raplcap_perror(ERROR, msr_filename);
-      if (errno == ENOENT) {
-        raplcap_log(WARN, "Is the msr kernel module loaded?\n");
-      }
+  }
+  // fall back on the standard msr kernel module
+  snprintf(msr_filename, sizeof(msr_filename), "/dev/cpu/%"PRIu32"/msr", core);
+  if ((fd = open(msr_filename, flags)) < 0) {
+    raplcap_perror(ERROR, msr_filename);
+    if (errno == ENOENT) {
+      raplcap_log(WARN, "Is the msr kernel module loaded?\n");
     }
+  } else if (hint == MSR_DRIVER_UNKNOWN) {
+    __atomic_store_n(&msr_driver_hint, MSR_DRIVER_MSR, __ATOMIC_RELAXED);
   }
   return fd;
 }
 
-static uint32_t get_cpu_count(void) {
-  long n = sysconf(_SC_NPROCESSORS_ONLN);
-  if (n <= 0 || n > UINT32_MAX) {
-    errno = ENODEV;
-    return 0;
+// Parse an unsigned decimal integer, returning a pointer to the first unparsed char, or NULL on failure
+static const char* parse_u32(const char* str, uint32_t* val) {
+  uint64_t v = 0;
+  const char* c;
+  for (c = str; *c >= '0' && *c <= '9'; c++) {
+    if ((v = (v * 10) + (uint64_t) (*c - '0')) > UINT32_MAX) {
+      return NULL;
+    }
   }
-  return (uint32_t) n;
+  if (c == str) {
+    return NULL;
+  }
+  *val = (uint32_t) v;
+  return c;
+}
+
+// Parse a range in a CPU list (e.g., "8-11" in "0-3,8-11"), returning a pointer to the next range, "" at the end of
+// the list, or NULL on failure
+static const char* parse_cpu_range(const char* list, uint32_t* first, uint32_t* last) {
+  const char* c;
+  if ((c = parse_u32(list, first)) == NULL) {
+    return NULL;
+  }
+  *last = *first;
+  if (*c == '-' && ((c = parse_u32(c + 1, last)) == NULL || *last < *first)) {
+    return NULL;
+  }
+  if (*c == ',') {
+    return c + 1;
+  }
+  // sysfs lists end with a newline
+  return *c == '\n' || *c == '\0' ? "" : NULL;
 }
 
-static int get_physical_package_id(uint32_t cpu, uint32_t* pkg) {
-  char fname[92] = { 0 };
-  FILE* f;
-  int fret;
-  snprintf(fname, sizeof(fname), "/sys/devices/system/cpu/cpu%"PRIu32"/topology/physical_package_id", cpu);
-  if ((f = fopen(fname, "r")) == NULL) {
-    raplcap_perror(ERROR, fname);
+// Read a file relative to the sysfs CPU directory, returns the (NUL-terminated) length read
+static ssize_t read_sysfs_file(int dirfd, const char* fname, char* buf, size_t len) {
+  ssize_t n;
+  int fd;
+  int err_save;
+  assert(len > 0);
+  if ((fd = openat(dirfd, fname, O_RDONLY)) < 0) {
+    return -1;
+  }
+  if ((n = read(fd, buf, len - 1)) < 0) {
+    err_save = errno;
+    close(fd);
+    errno = err_save;
     return -1;
   }
-  fret = fscanf(f, "%"PRIu32, pkg);
-  if (fclose(f)) {
-    raplcap_perror(WARN, "get_physical_package_id: fclose");
+  close(fd);
+  buf[n] = '\0';
+  return n;
+}
+
+// Read a topology file for a CPU relative to the sysfs CPU directory, returns the (NUL-terminated) length read
+static ssize_t read_topology_file(int dirfd, uint32_t cpu, const char* file, char* buf, size_t len) {
+  char fname[64];
+  snprintf(fname, sizeof(fname), "cpu%"PRIu32"/topology/%s", cpu, file);
+  return read_sysfs_file(dirfd, fname, buf, len);
+}
+
+static int read_topology_u32(int dirfd, uint32_t cpu, const char* file, uint32_t* val) {
+  char buf[16];
+  if (read_topology_file(dirfd, cpu, file, buf, sizeof(buf)) < 0) {
+    return -1;
   }
-  if (fret != 1) {
-    raplcap_log(ERROR, "get_physical_package_id: Failed to read physical_package_id for cpu%"PRIu32"\n", cpu);
+  if (parse_u32(buf, val) == NULL) {
+    raplcap_log(ERROR, "read_topology_u32: Failed to read %s for cpu%"PRIu32"\n", file, cpu);
     errno = ENODATA;
     return -1;
   }
-  raplcap_log(DEBUG, "get_physical_package_id: cpu=%"PRIu32", pkg=%"PRIu32"\n", cpu, *pkg);
   return 0;
 }
 
-static int get_die_id(uint32_t cpu, uint32_t* die) {
-  char fname[92] = { 0 };
-  struct stat ss;
-  FILE* f;
-  int fret;
-  snprintf(fname, sizeof(fname), "/sys/devices/system/cpu/cpu%"PRIu32"/topology/die_id", cpu);
-  // die_id does not exist on all systems, so check for it first
-  if (stat(fname, &ss)) {
-    raplcap_log(DEBUG, "get_die_id: %s: %s\n", fname, strerror(errno));
-    *die = 0;
-  } else {
-    if ((f = fopen(fname, "r")) == NULL) {
-      raplcap_perror(ERROR, fname);
-      return -1;
-    }
-    fret = fscanf(f, "%"PRIu32, die);
-    if (fclose(f)) {
-      raplcap_perror(WARN, "get_die_id: fclose");
+// Assign pkg and die to unassigned CPUs in a list (e.g., "0-3,8-11"); ignore malformed lists since this is only an
+// optimization (skipped CPUs are read individually)
+static void assign_cpu_list(msr_topology* topo, uint32_t n_cpu_ids, const char* list, uint32_t pkg, uint32_t die) {
+  const char* c = list;
+  uint32_t first;
+  uint32_t last;
+  uint32_t cpu;
+  while (*c != '\0' && (c = parse_cpu_range(c, &first, &last)) != NULL) {
+    for (cpu = first; cpu <= last && cpu < n_cpu_ids; cpu++) {
+      if (topo[cpu].cpu == UINT32_MAX) {
+        topo[cpu].pkg = pkg;
+        topo[cpu].die = die;
+        topo[cpu].cpu = cpu;
+      }
     }
-    if (fret != 1) {
-      raplcap_log(ERROR, "get_die_id: Failed to read die_id for cpu%"PRIu32"\n", cpu);
+  }
+}
+
+// Read the list of online CPUs and the max online CPU ID + 1
+static int get_online_cpus(int dirfd, char* online, size_t len, uint32_t* n_cpu_ids) {
+  const char* c = online;
+  uint32_t first;
+  uint32_t last = 0;
+  ssize_t n;
+  if ((n = read_sysfs_file(dirfd, "online", online, len)) < 0) {
+    raplcap_perror(ERROR, "get_online_cpus: "SYSFS_CPU_DIR"/online");
+    return -1;
+  }
+  // unlike sibling lists, the online list can't be skipped
+  if ((size_t) n >= len - 1) {
+    raplcap_log(ERROR, "get_online_cpus: Online CPU list is too long\n");
+    errno = ENOBUFS;
+    return -1;
+  }
+  // ranges are in increasing order
+  while (*c != '\0') {
+    if ((c = parse_cpu_range(c, &first, &last)) == NULL || last == UINT32_MAX) {
+      raplcap_log(ERROR, "get_online_cpus: Failed to parse online CPU list: %s\n", online);
       errno = ENODATA;
       return -1;
     }
   }
-  raplcap_log(DEBUG, "get_die_id: cpu=%"PRIu32", die=%"PRIu32"\n", cpu, *die);
+  if (c == online) {
+    raplcap_log(ERROR, "get_online_cpus: No online CPUs\n");
+    errno = ENODEV;
+    return -1;
+  }
+  *n_cpu_ids = last + 1;
+  return 0;
+}
+
+// Read the topology of a CPU and assign it to its siblings too
+static int get_cpu_topology(int dirfd, msr_topology* topo, uint32_t n_cpu_ids, uint32_t cpu) {
+  char list[4096];
+  const char* list_file;
+  ssize_t n;
+  if (read_topology_u32(dirfd, cpu, "physical_package_id", &topo[cpu].pkg) < 0) {
+    raplcap_perror(ERROR, "get_topology: physical_package_id");
+    return -1;
+  }
+  // die_id (and die_cpus_list) does not exist on all systems
+  if (read_topology_u32(dirfd, cpu, "die_id", &topo[cpu].die) == 0) {
+    list_file = "die_cpus_list";
+  } else if (errno == ENOENT) {
+    raplcap_log(DEBUG, "get_topology: cpu%"PRIu32": die_id: %s\n", cpu, strerror(errno));
+    topo[cpu].die = 0;
+    list_file = "package_cpus_list";
+  } else {
+    raplcap_perror(ERROR, "get_topology: die_id");
+    return -1;
+  }
+  topo[cpu].cpu = cpu;
+  raplcap_log(DEBUG, "get_topology: cpu=%"PRIu32", pkg=%"PRIu32", die=%"PRIu32"\n",
+              cpu, topo[cpu].pkg, topo[cpu].die);
+  // all CPUs in the list share the same pkg and die, so we won't need to read their IDs
+  // a list that fills the buffer may be truncated, in which case it's not safe to use
+  if ((n = read_topology_file(dirfd, cpu, list_file, list, sizeof(list))) > 0 && (size_t) n < sizeof(list) - 1) {
+    assign_cpu_list(topo, n_cpu_ids, list, topo[cpu].pkg, topo[cpu].die);
+  }
   return 0;
 }
 
-static int get_topology(msr_topology* topo, uint32_t ncpus) {
-  // assumes cpus are numbered from 0 to ncpus-1
+// Get the topology of online CPUs, which may not be numbered contiguously; offline CPUs have no topology
+static msr_topology* read_topology(int dirfd, uint32_t* n_cpus, uint32_t* n_cpu_ids) {
+  char online[4096];
+  msr_topology* topo;
+  const char* c;
+  uint32_t first;
+  uint32_t last;
+  uint32_t cpu;
   uint32_t i;
-  for (i = 0; i < ncpus; i++) {
-    if (get_physical_package_id(i, &topo[i].pkg) < 0) {
-      return -1;
+  int err_save;
+  if (get_online_cpus(dirfd, online, sizeof(online), n_cpu_ids)) {
+    return NULL;
+  }
+  // indexed by CPU ID while discovering, then compacted to only the online CPUs
+  if ((topo = malloc(*n_cpu_ids * sizeof(*topo))) == NULL) {
+    raplcap_perror(ERROR, "get_topology: malloc");
+    return NULL;
+  }
+  for (i = 0; i < *n_cpu_ids; i++) {
+    topo[i].cpu = UINT32_MAX;
+  }
+  for (c = online; *c != '\0' && (c = parse_cpu_range(c, &first, &last)) != NULL;) {
+    for (cpu = first; cpu <= last && cpu < *n_cpu_ids; cpu++) {
+      // skip CPUs already assigned from a sibling's CPU list
+      if (topo[cpu].cpu == UINT32_MAX && get_cpu_topology(dirfd, topo, *n_cpu_ids, cpu)) {
+        err_save = errno;
+        free(topo);
+        errno = err_save;
+        return NULL;
+      }
     }
-    if (get_die_id(i, &topo[i].die) < 0) {
-      return -1;
+  }
+  for (i = 0, *n_cpus = 0; i < *n_cpu_ids; i++) {
+    if (topo[i].cpu != UINT32_MAX) {
+      topo[(*n_cpus)++] = topo[i];
     }
-    topo[i].cpu = i;
   }
-  return 0;
+  return topo;
+}
+
+static msr_topology* get_topology(uint32_t* n_cpus, uint32_t* n_cpu_ids) {
+  msr_topology* topo;
+  int dirfd;
+  int err_save;
+  if ((dirfd = open(SYSFS_CPU_DIR, O_RDONLY | O_DIRECTORY)) < 0) {
+    raplcap_perror(ERROR, SYSFS_CPU_DIR);
+    return NULL;
+  }
+  topo = read_topology(dirfd, n_cpus, n_cpu_ids);
+  err_save = errno;
+  if (close(dirfd)) {
+    raplcap_perror(WARN, "get_topology: close");
+  }
+  errno = err_save;
+  return topo;
 }
 
 static int cmp_u32(const void* a, const void* b) {
@@ -138,18 +369,23 @@ static int cmp_msr_topology_pkg_die(const void* a, const void* b) {
   return rc ? rc : cmp_u32(&ta->die, &tb->die);
 }
 
-// Count unique combinations of pkg and die in topo (must be pre-sorted).
-static uint32_t count_unique_pkg_die(const msr_topology* topo, uint32_t n) {
+// Populate the n_pkg + 1 die offsets from topo (must be pre-sorted), and return the number of unique pkg and die.
+// Die IDs are not necessarily contiguous (e.g., if all of a die's CPUs are offline), so die are indexed compactly.
+static uint32_t get_die_offsets(uint32_t* die_offsets, uint32_t n_pkg, const msr_topology* topo, uint32_t n) {
   assert(n > 0);
-  uint32_t unique = 1;
+  uint32_t pkg;
   uint32_t i;
-  for (i = 1; i < n; i++) {
-    if (cmp_msr_topology_pkg_die(&topo[i], &topo[i - 1])) {
-      unique++;
+  memset(die_offsets, 0, (n_pkg + 1) * sizeof(*die_offsets));
+  for (i = 0; i < n; i++) {
+    if (i == 0 || cmp_msr_topology_pkg_die(&topo[i], &topo[i - 1])) {
+      die_offsets[topo[i].pkg + 1]++;
     }
   }
-  raplcap_log(DEBUG, "count_unique_pkg_die: unique=%"PRIu32"\n", unique);
-  return unique;
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    raplcap_log(DEBUG, "get_die_offsets: pkg=%"PRIu32", n_die=%"PRIu32"\n", pkg, die_offsets[pkg + 1]);
+    die_offsets[pkg + 1] += die_offsets[pkg];
+  }
+  return die_offsets[n_pkg];
 }
 
 // Determine which CPUs to open MSRs for based on topo (must be pre-sorted)
@@ -170,111 +406,232 @@ static void get_cpus_to_open(uint32_t* cpus_to_open, uint32_t n_cpus_to_open, co
 }
 
 // Note: doesn't close previously opened file descriptors if one fails to open
-static int open_msrs(int* fds, const uint32_t* cpus_to_open, uint32_t n_fds) {
+static int open_msrs(msr_sys_die* dies, uint32_t n_fds, int* batch_fd) {
   uint32_t i;
+  int is_msr_safe;
+  int all_msr_safe = 1;
   const char* env_ro = getenv(ENV_RAPLCAP_READ_ONLY);
   int ro = env_ro == NULL ? 0 : atoi(env_ro);
   for (i = 0; i < n_fds; i++) {
-    if ((fds[i] = open_msr(cpus_to_open[i], ro == 0 ? O_RDWR : O_RDONLY)) < 0) {
+    if ((dies[i].fd = open_msr(dies[i].cpu, ro == 0 ? O_RDWR : O_RDONLY, &is_msr_safe)) < 0) {
       return -1;
     }
+    all_msr_safe &= is_msr_safe;
+  }
+  // batch operations are only possible with msr-safe, and failing to open the device isn't fatal
+  if (all_msr_safe && (*batch_fd = open(MSR_BATCH_DEV, ro == 0 ? O_RDWR : O_RDONLY)) < 0) {
+    raplcap_perror(DEBUG, MSR_BATCH_DEV);
+    raplcap_log(INFO, "msr-safe batch operations not available, falling back on individual reads\n");
   }
   return 0;
 }
 
-int msr_sys_get_num_pkg_die(const raplcap_msr_sys_ctx* ctx, uint32_t *n_pkg, uint32_t* n_die) {
-  msr_topology* topo;
-  uint32_t ncpus;
+static void topology_cache_destroy(msr_topology_cache* tc) {
+  if (tc != NULL) {
+    free(tc->die_offsets);
+    free(tc->topo);
+    free(tc);
+  }
+}
+
+static msr_topology_cache* topology_cache_create(void) {
+  msr_topology_cache* tc;
+  // need to decide which CPU MSRs to open to cover all RAPL zones
+  if ((tc = calloc(1, sizeof(*tc))) == NULL) {
+    raplcap_perror(ERROR, "topology_cache_create: calloc");
+    return NULL;
+  }
+  // get topology for all CPUs, sort by pkg and die, then count unique combinations to determine how many MSRs to open
+  if ((tc->topo = get_topology(&tc->n_cpus, &tc->n_cpu_ids)) == NULL) {
+    free(tc);
+    return NULL;
+  }
+  qsort(tc->topo, tc->n_cpus, sizeof(*tc->topo), cmp_msr_topology_pkg_die);
+  tc->n_pkg = tc->topo[tc->n_cpus - 1].pkg + 1;
+  if ((tc->die_offsets = malloc((tc->n_pkg + 1) * sizeof(*tc->die_offsets))) == NULL) {
+    raplcap_perror(ERROR, "topology_cache_create: malloc");
+    topology_cache_destroy(tc);
+    return NULL;
+  }
+  tc->n_pkg_die = get_die_offsets(tc->die_offsets, tc->n_pkg, tc->topo, tc->n_cpus);
+  raplcap_log(DEBUG, "topology_cache_create: n_cpus=%"PRIu32", n_cpu_ids=%"PRIu32", n_pkg=%"PRIu32
+              ", n_pkg_die=%"PRIu32"\n", tc->n_cpus, tc->n_cpu_ids, tc->n_pkg, tc->n_pkg_die);
+  return tc;
+}
+
+// Caller must hold topo_cache_lock
+static const msr_topology_cache* get_topology_cache(void) {
+  if (topo_cache == NULL) {
+    topo_cache = topology_cache_create();
+  }
+  return topo_cache;
+}
+
+int msr_sys_refresh_topology(void) {
+  // build the replacement without holding the lock for the (slow) sysfs scan
+  msr_topology_cache* tc = topology_cache_create();
+  int err_save = errno;
+  // the available drivers may have changed too
+  __atomic_store_n(&msr_driver_hint, MSR_DRIVER_UNKNOWN, __ATOMIC_RELAXED);
+  pthread_mutex_lock(&topo_cache_lock);
+  topology_cache_destroy(topo_cache);
+  // if discovery failed, it will be attempted again when next needed
+  topo_cache = tc;
+  pthread_mutex_unlock(&topo_cache_lock);
+  errno = err_save;
+  return tc == NULL ? -1 : 0;
+}
+
+int msr_sys_get_num_pkg(const raplcap_msr_sys_ctx* ctx, uint32_t* n_pkg) {
+  const msr_topology_cache* tc;
+  int ret = -1;
   assert(n_pkg);
-  assert(n_die);
   if (ctx) {
     *n_pkg = ctx->n_pkg;
-    *n_die = ctx->n_die;
     return 0;
   }
-  if ((ncpus = get_cpu_count()) == 0) {
-    raplcap_perror(ERROR, "msr_sys_get_num_pkg_die: get_cpu_count");
-    return -1;
+  pthread_mutex_lock(&topo_cache_lock);
+  if ((tc = get_topology_cache()) != NULL) {
+    *n_pkg = tc->n_pkg;
+    ret = 0;
+    raplcap_log(DEBUG, "msr_sys_get_num_pkg: n_pkg=%"PRIu32"\n", *n_pkg);
   }
-  if ((topo = malloc(ncpus * sizeof(*topo))) == NULL) {
-    raplcap_perror(ERROR, "msr_sys_get_num_pkg_die: malloc");
+  pthread_mutex_unlock(&topo_cache_lock);
+  return ret;
+}
+
+static int get_num_die(const uint32_t* die_offsets, uint32_t n_pkg, uint32_t pkg, uint32_t* n_die) {
+  if (pkg >= n_pkg) {
+    raplcap_log(ERROR, "Package %"PRIu32" not in range [0, %"PRIu32")\n", pkg, n_pkg);
+    errno = EINVAL;
     return -1;
   }
-  if (get_topology(topo, ncpus)) {
-    free(topo);
+  *n_die = die_offsets[pkg + 1] - die_offsets[pkg];
+  return 0;
+}
+
+int msr_sys_get_num_die(const raplcap_msr_sys_ctx* ctx, uint32_t pkg, uint32_t* n_die) {
+  const msr_topology_cache* tc;
+  int ret = -1;
+  assert(n_die);
+  if (ctx) {
+    return get_num_die(ctx->die_offsets, ctx->n_pkg, pkg, n_die);
+  }
+  pthread_mutex_lock(&topo_cache_lock);
+  if ((tc = get_topology_cache()) != NULL) {
+    ret = get_num_die(tc->die_offsets, tc->n_pkg, pkg, n_die);
+  }
+  pthread_mutex_unlock(&topo_cache_lock);
+  return ret;
+}
+
+uint32_t msr_sys_get_die_index(const raplcap_msr_sys_ctx* ctx, uint32_t pkg, uint32_t die) {
+  assert(ctx);
+  assert(pkg <= ctx->n_pkg);
+  return ctx->die_offsets[pkg] + die;
+}
+
+static int is_local_cpu_enabled(void) {
+  const char* env = getenv(ENV_RAPLCAP_MSR_LOCAL_CPU);
+  return env != NULL && atoi(env) != 0;
+}
+
+// Map CPUs to die indexes from the topology cache (caller must hold topo_cache_lock)
+static int init_local_cpus(raplcap_msr_sys_ctx* ctx, const msr_topology_cache* tc) {
+  uint32_t idx;
+  uint32_t i;
+  if ((ctx->cpu_dies = malloc(tc->n_cpu_ids * sizeof(*ctx->cpu_dies))) == NULL ||
+      (ctx->cpu_fds = malloc(tc->n_cpu_ids * sizeof(*ctx->cpu_fds))) == NULL) {
+    free(ctx->cpu_dies);
+    ctx->cpu_dies = NULL;
     return -1;
   }
-  qsort(topo, ncpus, sizeof(*topo), cmp_msr_topology_pkg_die);
-  *n_pkg = topo[ncpus - 1].pkg + 1;
-  // assumes homogeneous die configurations across packages
-  *n_die = topo[ncpus - 1].die + 1;
-  raplcap_log(DEBUG, "msr_sys_get_num_pkg_die: n_cpus=%"PRIu32", n_pkg=%"PRIu32", n_die=%"PRIu32"\n",
-              ncpus, *n_pkg, *n_die);
-  free(topo);
+  ctx->n_cpu_ids = tc->n_cpu_ids;
+  for (i = 0; i < tc->n_cpu_ids; i++) {
+    ctx->cpu_dies[i] = UINT32_MAX;
+    ctx->cpu_fds[i] = -1;
+  }
+  // topology is sorted by pkg and die, so die indexes increase with each new combination
+  for (i = 0, idx = 0; i < tc->n_cpus; i++) {
+    if (i > 0 && cmp_msr_topology_pkg_die(&tc->topo[i], &tc->topo[i - 1])) {
+      idx++;
+    }
+    ctx->cpu_dies[tc->topo[i].cpu] = idx;
+  }
+  raplcap_log(DEBUG, "init_local_cpus: n_cpu_ids=%"PRIu32"\n", ctx->n_cpu_ids);
   return 0;
 }
 
-raplcap_msr_sys_ctx* msr_sys_init(uint32_t* n_pkg, uint32_t* n_die) {
-  msr_topology* topo;
+raplcap_msr_sys_ctx* msr_sys_init(uint32_t* n_pkg, uint32_t* n_pkg_die) {
+  const msr_topology_cache* tc;
   raplcap_msr_sys_ctx* ctx;
   uint32_t* cpus_to_open;
-  uint32_t ncpus;
+  uint32_t i;
   int err_save;
   assert(n_pkg);
-  assert(n_die);
-  // need to decide which CPU MSRs to open to cover all RAPL zones
-  if ((ncpus = get_cpu_count()) == 0) {
-    raplcap_perror(ERROR, "msr_sys_init: get_cpu_count");
-    return NULL;
-  }
-  if ((topo = malloc(ncpus * sizeof(*topo))) == NULL) {
+  assert(n_pkg_die);
+  if ((ctx = malloc(sizeof(*ctx))) == NULL) {
     raplcap_perror(ERROR, "msr_sys_init: malloc");
     return NULL;
   }
-  // get topology for all CPUs, sort by pkg and die, then count unique combinations to determine how many MSRs to open
-  if (get_topology(topo, ncpus)) {
-    free(topo);
+  pthread_mutex_lock(&topo_cache_lock);
+  if ((tc = get_topology_cache()) == NULL) {
+    err_save = errno;
+    pthread_mutex_unlock(&topo_cache_lock);
+    free(ctx);
+    errno = err_save;
     return NULL;
   }
-  qsort(topo, ncpus, sizeof(*topo), cmp_msr_topology_pkg_die);
-  if ((ctx = malloc(sizeof(*ctx))) == NULL) {
+  ctx->n_pkg = tc->n_pkg;
+  ctx->n_fds = tc->n_pkg_die;
+  raplcap_log(DEBUG, "msr_sys_init: n_cpus=%"PRIu32", n_pkg=%"PRIu32", n_fds=%"PRIu32"\n",
+              tc->n_cpus, ctx->n_pkg, ctx->n_fds);
+  if ((ctx->die_offsets = malloc((ctx->n_pkg + 1) * sizeof(*ctx->die_offsets))) == NULL) {
     raplcap_perror(ERROR, "msr_sys_init: malloc");
-    free(topo);
+    pthread_mutex_unlock(&topo_cache_lock);
+    free(ctx);
     return NULL;
   }
-  // assumes homogeneous die configurations across packages
-  ctx->n_pkg = topo[ncpus - 1].pkg + 1;
-  ctx->n_die = topo[ncpus - 1].die + 1;
-  ctx->n_fds = count_unique_pkg_die(topo, ncpus);
-  raplcap_log(DEBUG, "msr_sys_init: n_cpus=%"PRIu32", n_pkg=%"PRIu32", n_die=%"PRIu32", n_fds=%"PRIu32"\n",
-              ncpus, ctx->n_pkg, ctx->n_die, ctx->n_fds);
+  memcpy(ctx->die_offsets, tc->die_offsets, (ctx->n_pkg + 1) * sizeof(*ctx->die_offsets));
   // now determine which CPUs to open MSRs for and do it
   if ((cpus_to_open = malloc(ctx->n_fds * sizeof(uint32_t))) == NULL) {
     raplcap_perror(ERROR, "msr_sys_init: malloc");
+    pthread_mutex_unlock(&topo_cache_lock);
+    free(ctx->die_offsets);
     free(ctx);
-    free(topo);
     return NULL;
   }
-  get_cpus_to_open(cpus_to_open, ctx->n_fds, topo, ncpus);
-  if ((ctx->fds = calloc(ctx->n_fds, sizeof(int))) == NULL) {
+  get_cpus_to_open(cpus_to_open, ctx->n_fds, tc->topo, tc->n_cpus);
+  ctx->cpu_dies = NULL;
+  ctx->cpu_fds = NULL;
+  ctx->uring = NULL;
+  if (is_local_cpu_enabled() && init_local_cpus(ctx, tc)) {
+    // not fatal - reads just go to the die's CPU
+    raplcap_perror(WARN, "msr_sys_init: Failed to enable local CPU reads");
+  }
+  pthread_mutex_unlock(&topo_cache_lock);
+  ctx->batch_fd = -1;
+  if ((ctx->dies = calloc(ctx->n_fds, sizeof(*ctx->dies))) == NULL) {
     raplcap_perror(ERROR, "msr_sys_init: calloc");
     free(cpus_to_open);
+    free(ctx->cpu_fds);
+    free(ctx->cpu_dies);
+    free(ctx->die_offsets);
     free(ctx);
-    free(topo);
     return NULL;
   }
-  if (open_msrs(ctx->fds, cpus_to_open, ctx->n_fds)) {
+  for (i = 0; i < ctx->n_fds; i++) {
+    ctx->dies[i].cpu = cpus_to_open[i];
+  }
+  free(cpus_to_open);
+  if (open_msrs(ctx->dies, ctx->n_fds, &ctx->batch_fd)) {
     err_save = errno;
-    free(cpus_to_open);
     msr_sys_destroy(ctx);
-    free(topo);
     errno = err_save;
     return NULL;
   }
-  free(cpus_to_open);
-  free(topo);
   *n_pkg = ctx->n_pkg;
-  *n_die = ctx->n_die;
+  *n_pkg_die = ctx->n_fds;
   return ctx;
 }
 
@@ -282,25 +639,83 @@ int msr_sys_destroy(raplcap_msr_sys_ctx* ctx) {
   assert(ctx);
   uint32_t i;
   int err_save = 0;
-  for (i = 0; ctx->fds != NULL && i < ctx->n_fds; i++) {
-    raplcap_log(DEBUG, "msr_sys_destroy: i=%"PRIu32", fd=%d\n", i, ctx->fds[i]);
-    if (ctx->fds[i] > 0 && close(ctx->fds[i])) {
+  if (ctx->uring != NULL) {
+    // before closing the registered files
+    raplcap_uring_destroy(ctx->uring);
+  }
+  for (i = 0; ctx->dies != NULL && i < ctx->n_fds; i++) {
+    raplcap_log(DEBUG, "msr_sys_destroy: i=%"PRIu32", fd=%d\n", i, ctx->dies[i].fd);
+    if (ctx->dies[i].fd > 0 && close(ctx->dies[i].fd)) {
+      err_save = errno;
+      raplcap_perror(ERROR, "msr_sys_destroy: close");
+    }
+  }
+  if (ctx->batch_fd >= 0 && close(ctx->batch_fd)) {
+    err_save = errno;
+    raplcap_perror(ERROR, "msr_sys_destroy: close");
+  }
+  for (i = 0; ctx->cpu_fds != NULL && i < ctx->n_cpu_ids; i++) {
+    if (ctx->cpu_fds[i] >= 0 && close(ctx->cpu_fds[i])) {
       err_save = errno;
       raplcap_perror(ERROR, "msr_sys_destroy: close");
     }
   }
-  free(ctx->fds);
+  free(ctx->cpu_fds);
+  free(ctx->cpu_dies);
+  free(ctx->dies);
+  free(ctx->die_offsets);
   free(ctx);
   errno = err_save;
   return err_save ? -1 : 0;
 }
 
+static const msr_sys_die* get_die(const raplcap_msr_sys_ctx* ctx, uint32_t pkg, uint32_t die) {
+  assert(pkg < ctx->n_pkg);
+  assert(ctx->die_offsets[pkg] + die < ctx->die_offsets[pkg + 1]);
+  return &ctx->dies[ctx->die_offsets[pkg] + die];
+}
+
+// Get the calling thread's current CPU if it's in the die (and isn't the die's own CPU), otherwise -1
+static int get_local_cpu(const raplcap_msr_sys_ctx* ctx, uint32_t pkg, uint32_t die) {
+  const uint32_t idx = ctx->die_offsets[pkg] + die;
+  int cpu;
+  // sched_getcpu is served by the vDSO, so it doesn't need a syscall
+  if (ctx->cpu_dies == NULL || (cpu = sched_getcpu()) < 0 || (uint32_t) cpu >= ctx->n_cpu_ids ||
+      ctx->cpu_dies[cpu] != idx || (uint32_t) cpu == ctx->dies[idx].cpu) {
+    return -1;
+  }
+  return cpu;
+}
+
+// Get an fd for reading, preferring the current CPU to avoid an IPI to the die's CPU
+static int get_read_fd(const raplcap_msr_sys_ctx* ctx, uint32_t pkg, uint32_t die) {
+  const int cpu = get_local_cpu(ctx, pkg, die);
+  int expected = -1;
+  int is_msr_safe;
+  int fd;
+  if (cpu < 0) {
+    return get_die(ctx, pkg, die)->fd;
+  }
+  if ((fd = __atomic_load_n(&ctx->cpu_fds[cpu], __ATOMIC_ACQUIRE)) == -1) {
+    // concurrent readers may race to open, but only one fd is kept
+    if ((fd = open_msr((uint32_t) cpu, O_RDONLY, &is_msr_safe)) < 0) {
+      fd = LOCAL_FD_FAILED;
+    }
+    if (!__atomic_compare_exchange_n(&ctx->cpu_fds[cpu], &expected, fd, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      fd = expected;
+    }
+  }
+  return fd >= 0 ? fd : get_die(ctx, pkg, die)->fd;
+}
+
 int msr_sys_read(const raplcap_msr_sys_ctx* ctx, uint64_t* msrval, uint32_t pkg, uint32_t die, off_t msr) {
   assert(ctx);
   assert(msr >= 0);
   assert(msrval != NULL);
-  assert((pkg * ctx->n_die) + die < ctx->n_fds);
-  if (pread(ctx->fds[(pkg * ctx->n_die) + die], msrval, sizeof(uint64_t), msr) == sizeof(uint64_t)) {
+  if (pread(get_read_fd(ctx, pkg, die), msrval, sizeof(uint64_t), msr) == sizeof(uint64_t)) {
     raplcap_log(DEBUG, "msr_sys_read: msr=0x%lX, msrval=0x%016lX\n", msr, *msrval);
     return 0;
   }
@@ -311,11 +726,141 @@ int msr_sys_read(const raplcap_msr_sys_ctx* ctx, uint64_t* msrval, uint32_t pkg,
 int msr_sys_write(const raplcap_msr_sys_ctx* ctx, uint64_t msrval, uint32_t pkg, uint32_t die, off_t msr) {
   assert(ctx);
   assert(msr >= 0);
-  assert((pkg * ctx->n_die) + die < ctx->n_fds);
   raplcap_log(DEBUG, "msr_sys_write: msr=0x%lX, msrval=0x%016lX\n", msr, msrval);
-  if (pwrite(ctx->fds[(pkg * ctx->n_die) + die], &msrval, sizeof(uint64_t), msr) == sizeof(uint64_t)) {
+  if (pwrite(get_die(ctx, pkg, die)->fd, &msrval, sizeof(uint64_t), msr) == sizeof(uint64_t)) {
     return 0;
   }
   raplcap_log(DEBUG, "msr_sys_write(0x%lX): pwrite: %s\n", msr, strerror(errno));
   return -1;
 }
+
+static int msr_sys_read_batch(const raplcap_msr_sys_ctx* ctx, uint64_t* msrvals, int* errs, uint32_t cpu,
+                              const off_t* msrs, uint32_t n) {
+  struct msr_batch_op ops[MSR_BATCH_MAX_OPS];
+  struct msr_batch_array batch = { .numops = n, .ops = ops };
+  uint32_t i;
+  int ret = 0;
+  assert(n <= MSR_BATCH_MAX_OPS);
+  memset(ops, 0, n * sizeof(ops[0]));
+  for (i = 0; i < n; i++) {
+    ops[i].cpu = (uint16_t) cpu;
+    ops[i].isrdmsr = 1;
+    ops[i].msr = (uint32_t) msrs[i];
+  }
+  // the ioctl fails if any operation fails, but errors are still reported per-operation
+  if (ioctl(ctx->batch_fd, X86_IOC_MSR_BATCH, &batch) < 0) {
+    raplcap_log(DEBUG, "msr_sys_read_batch: ioctl: %s\n", strerror(errno));
+    for (i = 0; i < n && ops[i].err == 0; i++);
+    if (i == n) {
+      // no operation reported an error, so the batch itself failed
+      return 1;
+    }
+  }
+  for (i = 0; i < n; i++) {
+    if (ops[i].err) {
+      raplcap_log(DEBUG, "msr_sys_read_batch(0x%lX): %s\n", msrs[i], strerror(-ops[i].err));
+      ret = -1;
+    } else {
+      msrvals[i] = ops[i].msrdata;
+      raplcap_log(DEBUG, "msr_sys_read_batch: msr=0x%lX, msrval=0x%016lX\n", msrs[i], msrvals[i]);
+    }
+    if (errs != NULL) {
+      errs[i] = ops[i].err ? -1 : 0;
+    }
+  }
+  return ret;
+}
+
+int msr_sys_read_many(const raplcap_msr_sys_ctx* ctx, uint64_t* msrvals, int* errs, uint32_t pkg, uint32_t die,
+                      const off_t* msrs, uint32_t n) {
+  assert(ctx);
+  assert(msrvals != NULL);
+  assert(msrs != NULL);
+  uint32_t i;
+  uint32_t len;
+  uint32_t cpu;
+  int local_cpu;
+  int ret = 0;
+  int bret;
+  if (ctx->batch_fd >= 0) {
+    cpu = (local_cpu = get_local_cpu(ctx, pkg, die)) < 0 ? get_die(ctx, pkg, die)->cpu : (uint32_t) local_cpu;
+  }
+  for (i = 0; ctx->batch_fd >= 0 && i < n; i += len) {
+    len = n - i < MSR_BATCH_MAX_OPS ? n - i : MSR_BATCH_MAX_OPS;
+    if ((bret = msr_sys_read_batch(ctx, &msrvals[i], errs == NULL ? NULL : &errs[i],
+                                   cpu, &msrs[i], len)) > 0) {
+      break;
+    }
+    ret |= bret;
+  }
+  // read anything that couldn't be batched individually
+  for (; i < n; i++) {
+    if (msr_sys_read(ctx, &msrvals[i], pkg, die, msrs[i])) {
+      ret = -1;
+      if (errs != NULL) {
+        errs[i] = -1;
+      }
+    } else if (errs != NULL) {
+      errs[i] = 0;
+    }
+  }
+  return ret;
+}
+
+int msr_sys_read_set_init(raplcap_msr_sys_ctx* ctx, const uint32_t* die_idxs, const off_t* msrs, uint32_t n) {
+  assert(ctx);
+  assert(die_idxs != NULL);
+  assert(msrs != NULL);
+  raplcap_uring_read* reads;
+  int* fds;
+  uint32_t i;
+  if (ctx->uring != NULL) {
+    errno = EEXIST;
+    return -1;
+  }
+  if ((fds = malloc(ctx->n_fds * sizeof(*fds))) == NULL) {
+    return -1;
+  }
+  if ((reads = malloc(n * sizeof(*reads))) == NULL) {
+    free(fds);
+    return -1;
+  }
+  // local CPU reads don't apply, since a batch's reads are performed by the kernel, not on the calling thread's CPU
+  for (i = 0; i < ctx->n_fds; i++) {
+    fds[i] = ctx->dies[i].fd;
+  }
+  for (i = 0; i < n; i++) {
+    assert(die_idxs[i] < ctx->n_fds);
+    reads[i].file = die_idxs[i];
+    reads[i].len = sizeof(uint64_t);
+    reads[i].offset = (uint64_t) msrs[i];
+  }
+  ctx->uring = raplcap_uring_init(fds, ctx->n_fds, reads, n);
+  free(reads);
+  free(fds);
+  return ctx->uring == NULL ? -1 : 0;
+}
+
+int msr_sys_read_set(const raplcap_msr_sys_ctx* ctx) {
+  assert(ctx);
+  return ctx->uring == NULL ? 1 : raplcap_uring_submit(ctx->uring);
+}
+
+int msr_sys_read_set_get(const raplcap_msr_sys_ctx* ctx, uint32_t i, uint64_t* msrval) {
+  assert(ctx);
+  assert(msrval != NULL);
+  const void* buf;
+  ssize_t ret;
+  if ((ret = raplcap_uring_get_result(ctx->uring, i, &buf)) != sizeof(uint64_t)) {
+    errno = ret < 0 ? (int) -ret : EIO;
+    raplcap_log(DEBUG, "msr_sys_read_set_get(%"PRIu32"): %s\n", i, strerror(errno));
+    return -1;
+  }
+  memcpy(msrval, buf, sizeof(uint64_t));
+  return 0;
+}
+
+void msr_sys_read_set_release(const raplcap_msr_sys_ctx* ctx) {
+  assert(ctx);
+  raplcap_uring_release(ctx->uring);
+}
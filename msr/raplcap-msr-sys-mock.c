@@ -0,0 +1,608 @@
+/**
+ * In-memory MSR access, for measuring and testing the MSR implementation without hardware.
+ * Registers are initialized with plausible values; energy counters advance on every read.
+ * Reading or writing a register that isn't modeled fails with EIO, like the msr kernel module.
+ * The number of packages and die can be overridden at runtime with environment variables of the same names as the
+ * RAPLCAP_MSR_MOCK_NUM_PKG and RAPLCAP_MSR_MOCK_NUM_DIE compile-time defaults.
+ * The die count may be a comma-separated list of per-package counts, the last of which applies to remaining packages.
+ * Setting RAPLCAP_MSR_MOCK_YIELD to a nonzero value yields the CPU a varying number of times after every access, like
+ * a preempted system call, which widens race windows and reorders threads even on a single CPU.
+ * Read sets are always available, and are read like a batch would be - entries in order, without yielding between them.
+ *
+ * Energy counters advance by RAPLCAP_MSR_MOCK_ENERGY_INCREMENT units per read, which sets how often they wrap.
+ * Alternatively, RAPLCAP_MSR_MOCK_TRACE is the path of a binary trace (see raplcap-trace.h) to replay: each read of a
+ * recorded zone's counter returns its next record, looping back to the start without losing energy.
+ * Zones that aren't in the trace (or in the mock's topology) don't consume energy.
+ * Like the topology, both can be overridden at runtime with environment variables of the same names.
+ *
+ * RAPLCAP_MSR_MOCK_DENY is a comma-separated list of modeled registers that fail with EIO anyway, like registers
+ * missing from an msr-safe allowlist.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for posix_memalign, pthread, sched_yield
+#define _POSIX_C_SOURCE 200112L
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "raplcap-common.h"
+#include "raplcap-msr-common.h"
+#include "raplcap-msr-sys.h"
+#include "raplcap-trace.h"
+
+#define ENV_RAPLCAP_MSR_MOCK_NUM_PKG "RAPLCAP_MSR_MOCK_NUM_PKG"
+#define ENV_RAPLCAP_MSR_MOCK_NUM_DIE "RAPLCAP_MSR_MOCK_NUM_DIE"
+#define ENV_RAPLCAP_MSR_MOCK_YIELD "RAPLCAP_MSR_MOCK_YIELD"
+#define ENV_RAPLCAP_MSR_MOCK_ENERGY_INCREMENT "RAPLCAP_MSR_MOCK_ENERGY_INCREMENT"
+#define ENV_RAPLCAP_MSR_MOCK_TRACE "RAPLCAP_MSR_MOCK_TRACE"
+#define ENV_RAPLCAP_MSR_MOCK_DENY "RAPLCAP_MSR_MOCK_DENY"
+
+#ifndef RAPLCAP_MSR_MOCK_NUM_PKG
+  #define RAPLCAP_MSR_MOCK_NUM_PKG 1
+#endif
+
+#ifndef RAPLCAP_MSR_MOCK_NUM_DIE
+  #define RAPLCAP_MSR_MOCK_NUM_DIE 1
+#endif
+
+// energy counter increment per read (in energy status units)
+#ifndef RAPLCAP_MSR_MOCK_ENERGY_INCREMENT
+  #define RAPLCAP_MSR_MOCK_ENERGY_INCREMENT 0x1000
+#endif
+
+// Joules per energy status unit, as configured in MSR_RAPL_POWER_UNIT
+#define MOCK_ENERGY_UNIT (1.0 / 16384)
+
+typedef struct msr_mock_reg {
+  off_t msr;
+  uint64_t val;
+  int is_energy;
+} msr_mock_reg;
+
+// power unit 1/8 W, energy unit 2^-14 J, time unit 2^-10 s
+// PKG: PL1 = 15 W and PL2 = 25 W, both enabled and clamped
+static const msr_mock_reg MOCK_REGS[] = {
+  { MSR_RAPL_POWER_UNIT,         0x00000000000A0E03, 0 },
+  { MSR_PKG_POWER_LIMIT,         0x0042816800DD8078, 0 },
+  { MSR_PKG_ENERGY_STATUS,       0x0000000000000000, 1 },
+  { MSR_PP0_POWER_LIMIT,         0x0000000000000000, 0 },
+  { MSR_PP0_ENERGY_STATUS,       0x0000000000000000, 1 },
+  { MSR_PP1_POWER_LIMIT,         0x0000000000000000, 0 },
+  { MSR_PP1_ENERGY_STATUS,       0x0000000000000000, 1 },
+  { MSR_DRAM_POWER_LIMIT,        0x0000000000000000, 0 },
+  { MSR_DRAM_ENERGY_STATUS,      0x0000000000000000, 1 },
+  { MSR_PLATFORM_POWER_LIMIT,    0x0000000000000000, 0 },
+  { MSR_PLATFORM_ENERGY_COUNTER, 0x0000000000000000, 1 },
+  { MSR_VR_CURRENT_CONFIG,       0x0000000000000000, 0 },
+};
+
+#define MOCK_NREGS (sizeof(MOCK_REGS) / sizeof(MOCK_REGS[0]))
+
+// indexed by zone
+static const off_t MOCK_ENERGY_MSRS[RAPLCAP_NZONES] = {
+  MSR_PKG_ENERGY_STATUS,
+  MSR_PP0_ENERGY_STATUS,
+  MSR_PP1_ENERGY_STATUS,
+  MSR_DRAM_ENERGY_STATUS,
+  MSR_PLATFORM_ENERGY_COUNTER
+};
+
+// A recorded energy counter, replayed one record per read
+typedef struct msr_mock_stream {
+  // counter values in energy status units, wrapping modulo 2^32
+  uint32_t* counters;
+  uint64_t n;
+  // advanced atomically on every read
+  uint64_t pos;
+} msr_mock_stream;
+
+// energy counters are written on every read, so each die's registers are in their own cache line(s)
+typedef struct msr_mock_die {
+  uint64_t regs[MOCK_NREGS];
+} RAPLCAP_CACHE_ALIGNED msr_mock_die;
+
+typedef struct msr_mock_set {
+  pthread_mutex_t lock;
+  uint32_t* die_idxs;
+  int* reg_idxs;
+  uint64_t* msrvals;
+  uint32_t n;
+} msr_mock_set;
+
+struct raplcap_msr_sys_ctx {
+  // indexed by die_offsets[pkg] + die
+  msr_mock_die* dies;
+  // die of package pkg are in range [die_offsets[pkg], die_offsets[pkg + 1])
+  uint32_t* die_offsets;
+  uint32_t n_pkg;
+  int yield;
+  uint64_t energy_increment;
+  // bit i is set if MOCK_REGS[i] is denied
+  uint32_t denied;
+  // indexed by die index * MOCK_NREGS + register index, or NULL if not replaying a trace
+  msr_mock_stream* streams;
+  // NULL if not prepared
+  msr_mock_set* set;
+};
+
+static uint32_t get_env_num_pkg(void) {
+  const char* env = getenv(ENV_RAPLCAP_MSR_MOCK_NUM_PKG);
+  unsigned long val;
+  if (env == NULL || (val = strtoul(env, NULL, 0)) == 0 || val > UINT32_MAX) {
+    return RAPLCAP_MSR_MOCK_NUM_PKG;
+  }
+  return (uint32_t) val;
+}
+
+static uint32_t get_env_num_die(uint32_t pkg) {
+  const char* env = getenv(ENV_RAPLCAP_MSR_MOCK_NUM_DIE);
+  char* end;
+  unsigned long val = RAPLCAP_MSR_MOCK_NUM_DIE;
+  uint32_t i;
+  for (i = 0; env != NULL && *env != '\0' && i <= pkg; i++) {
+    val = strtoul(env, &end, 0);
+    if (end == env || val == 0 || val > UINT32_MAX) {
+      return RAPLCAP_MSR_MOCK_NUM_DIE;
+    }
+    env = *end == ',' ? end + 1 : end;
+  }
+  return (uint32_t) val;
+}
+
+// varies the number of yields between accesses, so threads overtake each other
+static uint32_t yield_seq = 0;
+
+static int get_env_yield(void) {
+  const char* env = getenv(ENV_RAPLCAP_MSR_MOCK_YIELD);
+  return env != NULL && strtol(env, NULL, 0) != 0;
+}
+
+static uint64_t get_env_energy_increment(void) {
+  const char* env = getenv(ENV_RAPLCAP_MSR_MOCK_ENERGY_INCREMENT);
+  unsigned long long val;
+  if (env == NULL || (val = strtoull(env, NULL, 0)) == 0 || val > UINT32_MAX) {
+    return RAPLCAP_MSR_MOCK_ENERGY_INCREMENT;
+  }
+  return val;
+}
+
+static const char* get_env_trace(void) {
+  const char* env = getenv(ENV_RAPLCAP_MSR_MOCK_TRACE);
+#ifdef RAPLCAP_MSR_MOCK_TRACE
+  return env != NULL ? env : RAPLCAP_MSR_MOCK_TRACE;
+#else
+  return env;
+#endif
+}
+
+static void mock_yield(void) {
+  uint32_t n = __atomic_fetch_add(&yield_seq, 1, __ATOMIC_RELAXED) % 3;
+  while (n-- > 0) {
+    sched_yield();
+  }
+}
+
+static msr_mock_die* get_die(const raplcap_msr_sys_ctx* ctx, uint32_t pkg, uint32_t die) {
+  assert(pkg < ctx->n_pkg);
+  assert(ctx->die_offsets[pkg] + die < ctx->die_offsets[pkg + 1]);
+  return &ctx->dies[ctx->die_offsets[pkg] + die];
+}
+
+static int get_reg_index(off_t msr) {
+  size_t i;
+  for (i = 0; i < MOCK_NREGS; i++) {
+    if (MOCK_REGS[i].msr == msr) {
+      return (int) i;
+    }
+  }
+  errno = EIO;
+  return -1;
+}
+
+static uint32_t get_env_denied(void) {
+  const char* env = getenv(ENV_RAPLCAP_MSR_MOCK_DENY);
+  char* end;
+  uint32_t denied = 0;
+  int idx;
+  while (env != NULL && *env != '\0') {
+    if ((idx = get_reg_index((off_t) strtoul(env, &end, 0))) >= 0) {
+      denied |= 1u << idx;
+    }
+    if (end == env) {
+      break;
+    }
+    env = *end == ',' ? end + 1 : end;
+  }
+  return denied;
+}
+
+// like get_reg_index, but denied registers aren't accessible either
+static int get_accessible_reg_index(const raplcap_msr_sys_ctx* ctx, off_t msr) {
+  const int idx = get_reg_index(msr);
+  if (idx >= 0 && (ctx->denied & (1u << idx))) {
+    errno = EIO;
+    return -1;
+  }
+  return idx;
+}
+
+int msr_sys_get_num_pkg(const raplcap_msr_sys_ctx* ctx, uint32_t* n_pkg) {
+  assert(n_pkg != NULL);
+  *n_pkg = ctx != NULL ? ctx->n_pkg : get_env_num_pkg();
+  return 0;
+}
+
+int msr_sys_get_num_die(const raplcap_msr_sys_ctx* ctx, uint32_t pkg, uint32_t* n_die) {
+  uint32_t n_pkg;
+  assert(n_die != NULL);
+  msr_sys_get_num_pkg(ctx, &n_pkg);
+  if (pkg >= n_pkg) {
+    raplcap_log(ERROR, "Package %"PRIu32" not in range [0, %"PRIu32")\n", pkg, n_pkg);
+    errno = EINVAL;
+    return -1;
+  }
+  *n_die = ctx != NULL ? ctx->die_offsets[pkg + 1] - ctx->die_offsets[pkg] : get_env_num_die(pkg);
+  return 0;
+}
+
+uint32_t msr_sys_get_die_index(const raplcap_msr_sys_ctx* ctx, uint32_t pkg, uint32_t die) {
+  assert(ctx != NULL);
+  assert(pkg <= ctx->n_pkg);
+  return ctx->die_offsets[pkg] + die;
+}
+
+int msr_sys_refresh_topology(void) {
+  return 0;
+}
+
+static void streams_destroy(msr_mock_stream* streams, size_t n) {
+  size_t i;
+  if (streams != NULL) {
+    for (i = 0; i < n; i++) {
+      free(streams[i].counters);
+    }
+    free(streams);
+  }
+}
+
+// Get the streams of the columns that are in the topology, converting counters to the mock's energy unit
+static int read_trace_columns(const raplcap_msr_sys_ctx* ctx, FILE* f, const raplcap_trace_header* hdr,
+                              raplcap_trace_column* cols, msr_mock_stream** col_streams, uint64_t n_records) {
+  const raplcap_trace_column* c;
+  uint32_t i;
+  int reg;
+  if (fread(cols, sizeof(*cols), hdr->n_columns, f) != hdr->n_columns) {
+    errno = ENODATA;
+    return -1;
+  }
+  for (i = 0; i < hdr->n_columns; i++) {
+    c = &cols[i];
+    col_streams[i] = NULL;
+    if (c->pkg >= ctx->n_pkg || c->die >= ctx->die_offsets[c->pkg + 1] - ctx->die_offsets[c->pkg] ||
+        c->zone >= RAPLCAP_NZONES || !(c->energy_unit > 0)) {
+      raplcap_log(WARN, "Ignoring trace column %"PRIu32" with pkg=%"PRIu32", die=%"PRIu32", zone=%"PRIu32"\n",
+                  i, c->pkg, c->die, c->zone);
+      continue;
+    }
+    reg = get_reg_index(MOCK_ENERGY_MSRS[c->zone]);
+    col_streams[i] = &ctx->streams[(ctx->die_offsets[c->pkg] + c->die) * MOCK_NREGS + (size_t) reg];
+    if (col_streams[i]->counters != NULL ||
+        (col_streams[i]->counters = malloc(n_records * sizeof(*col_streams[i]->counters))) == NULL) {
+      if (col_streams[i]->counters != NULL) {
+        raplcap_log(ERROR, "Duplicate trace column %"PRIu32"\n", i);
+        errno = EINVAL;
+      }
+      return -1;
+    }
+    col_streams[i]->n = n_records;
+  }
+  return 0;
+}
+
+// Convert each record to counter values - the trace's units may differ, so cumulative energy is converted
+static int read_trace_records(FILE* f, const raplcap_trace_header* hdr, const raplcap_trace_column* cols,
+                              msr_mock_stream* const* col_streams, uint64_t n_records, uint32_t* rec) {
+  double* joules;
+  uint32_t* prev;
+  uint64_t r;
+  uint32_t i;
+  if ((joules = calloc(hdr->n_columns, sizeof(*joules))) == NULL) {
+    return -1;
+  }
+  if ((prev = malloc(hdr->n_columns * sizeof(*prev))) == NULL) {
+    free(joules);
+    return -1;
+  }
+  for (r = 0; r < n_records; r++) {
+    if (fread(rec, hdr->record_size, 1, f) != 1) {
+      free(prev);
+      free(joules);
+      errno = ENODATA;
+      return -1;
+    }
+    for (i = 0; i < hdr->n_columns; i++) {
+      if (col_streams[i] == NULL) {
+        continue;
+      }
+      if (r > 0) {
+        // counters wrap modulo 2^32
+        joules[i] += (uint32_t) (rec[i + 1] - prev[i]) * cols[i].energy_unit;
+      }
+      prev[i] = rec[i + 1];
+      col_streams[i]->counters[r] = (uint32_t) (uint64_t) (joules[i] / MOCK_ENERGY_UNIT + 0.5);
+    }
+  }
+  free(prev);
+  free(joules);
+  return 0;
+}
+
+// Load a trace's energy counter streams - the trace is read once, so replaying doesn't perform I/O
+static int load_trace(raplcap_msr_sys_ctx* ctx, const char* path) {
+  // the byte array gets the caller stack protection, which the header's small magic array alone wouldn't
+  union {
+    raplcap_trace_header h;
+    unsigned char bytes[sizeof(raplcap_trace_header)];
+  } buf;
+  const raplcap_trace_header* hdr = &buf.h;
+  raplcap_trace_column* cols = NULL;
+  msr_mock_stream** col_streams = NULL;
+  uint32_t* rec = NULL;
+  uint64_t n_records;
+  long size;
+  int ret = -1;
+  FILE* f;
+  if ((f = fopen(path, "rb")) == NULL) {
+    raplcap_perror(ERROR, path);
+    return -1;
+  }
+  if (fread(buf.bytes, sizeof(buf.bytes), 1, f) != 1 || memcmp(hdr->magic, RAPLCAP_TRACE_MAGIC, sizeof(hdr->magic)) ||
+      hdr->version != RAPLCAP_TRACE_VERSION || hdr->n_columns == 0 ||
+      hdr->record_size != sizeof(uint32_t) * (hdr->n_columns + 1) ||
+      hdr->header_size != sizeof(*hdr) + hdr->n_columns * sizeof(raplcap_trace_column) ||
+      fseek(f, 0, SEEK_END) || (size = ftell(f)) < (long) hdr->header_size ||
+      (n_records = ((uint64_t) size - hdr->header_size) / hdr->record_size) == 0 ||
+      fseek(f, (long) sizeof(*hdr), SEEK_SET)) {
+    raplcap_log(ERROR, "%s: Not a valid trace with at least one record\n", path);
+    fclose(f);
+    errno = EINVAL;
+    return -1;
+  }
+  if ((ctx->streams = calloc(ctx->die_offsets[ctx->n_pkg] * MOCK_NREGS, sizeof(*ctx->streams))) != NULL &&
+      (cols = malloc(hdr->n_columns * sizeof(*cols))) != NULL &&
+      (col_streams = malloc(hdr->n_columns * sizeof(*col_streams))) != NULL &&
+      (rec = malloc(hdr->record_size)) != NULL &&
+      read_trace_columns(ctx, f, hdr, cols, col_streams, n_records) == 0 &&
+      read_trace_records(f, hdr, cols, col_streams, n_records, rec) == 0) {
+    raplcap_log(DEBUG, "load_trace: Replaying %"PRIu64" records from %s\n", n_records, path);
+    ret = 0;
+  } else {
+    raplcap_perror(ERROR, "load_trace");
+  }
+  free(rec);
+  free(col_streams);
+  free(cols);
+  fclose(f);
+  return ret;
+}
+
+raplcap_msr_sys_ctx* msr_sys_init(uint32_t* n_pkg, uint32_t* n_pkg_die) {
+  raplcap_msr_sys_ctx* ctx;
+  const char* trace;
+  void* dies;
+  uint32_t i;
+  size_t j;
+  int err_save;
+  if ((ctx = malloc(sizeof(*ctx))) == NULL) {
+    raplcap_perror(ERROR, "msr_sys_init: malloc");
+    return NULL;
+  }
+  ctx->n_pkg = get_env_num_pkg();
+  ctx->yield = get_env_yield();
+  ctx->energy_increment = get_env_energy_increment();
+  ctx->denied = get_env_denied();
+  ctx->streams = NULL;
+  ctx->set = NULL;
+  if ((ctx->die_offsets = malloc((ctx->n_pkg + 1) * sizeof(*ctx->die_offsets))) == NULL) {
+    raplcap_perror(ERROR, "msr_sys_init: malloc");
+    free(ctx);
+    return NULL;
+  }
+  for (i = 0, ctx->die_offsets[0] = 0; i < ctx->n_pkg; i++) {
+    ctx->die_offsets[i + 1] = ctx->die_offsets[i] + get_env_num_die(i);
+  }
+  if ((errno = posix_memalign(&dies, RAPLCAP_CACHE_LINE_SIZE,
+                              ctx->die_offsets[ctx->n_pkg] * sizeof(*ctx->dies))) != 0) {
+    raplcap_perror(ERROR, "msr_sys_init: posix_memalign");
+    free(ctx->die_offsets);
+    free(ctx);
+    return NULL;
+  }
+  ctx->dies = dies;
+  for (i = 0; i < ctx->die_offsets[ctx->n_pkg]; i++) {
+    for (j = 0; j < MOCK_NREGS; j++) {
+      ctx->dies[i].regs[j] = MOCK_REGS[j].val;
+    }
+  }
+  if ((trace = get_env_trace()) != NULL && load_trace(ctx, trace)) {
+    err_save = errno;
+    msr_sys_destroy(ctx);
+    errno = err_save;
+    return NULL;
+  }
+  *n_pkg = ctx->n_pkg;
+  *n_pkg_die = ctx->die_offsets[ctx->n_pkg];
+  raplcap_log(DEBUG, "msr_sys_init: Initialized mock with n_pkg=%"PRIu32", n_pkg_die=%"PRIu32"\n",
+              *n_pkg, *n_pkg_die);
+  return ctx;
+}
+
+int msr_sys_destroy(raplcap_msr_sys_ctx* ctx) {
+  if (ctx != NULL) {
+    if (ctx->set != NULL) {
+      pthread_mutex_destroy(&ctx->set->lock);
+      free(ctx->set->msrvals);
+      free(ctx->set->reg_idxs);
+      free(ctx->set->die_idxs);
+      free(ctx->set);
+    }
+    streams_destroy(ctx->streams, ctx->die_offsets[ctx->n_pkg] * MOCK_NREGS);
+    free(ctx->dies);
+    free(ctx->die_offsets);
+    free(ctx);
+  }
+  return 0;
+}
+
+static uint64_t read_stream(msr_mock_stream* s) {
+  const uint64_t pos = __atomic_fetch_add(&s->pos, 1, __ATOMIC_RELAXED);
+  // each loop continues from the energy at the end of the previous one
+  return (uint32_t) ((pos / s->n) * s->counters[s->n - 1] + s->counters[pos % s->n]);
+}
+
+static uint64_t read_reg(const raplcap_msr_sys_ctx* ctx, uint32_t die_idx, int idx) {
+  msr_mock_stream* s;
+  if (!MOCK_REGS[idx].is_energy) {
+    return __atomic_load_n(&ctx->dies[die_idx].regs[idx], __ATOMIC_RELAXED);
+  }
+  if (ctx->streams != NULL) {
+    s = &ctx->streams[die_idx * MOCK_NREGS + (size_t) idx];
+    // zones that aren't in the trace stay at their initial values
+    return s->counters != NULL ? read_stream(s) : __atomic_load_n(&ctx->dies[die_idx].regs[idx], __ATOMIC_RELAXED);
+  }
+  // energy status counters are 32 bits
+  return __atomic_add_fetch(&ctx->dies[die_idx].regs[idx], ctx->energy_increment, __ATOMIC_RELAXED) & 0xFFFFFFFF;
+}
+
+int msr_sys_read(const raplcap_msr_sys_ctx* ctx, uint64_t* msrval, uint32_t pkg, uint32_t die, off_t msr) {
+  assert(ctx);
+  assert(msr >= 0);
+  assert(msrval != NULL);
+  int idx;
+  if ((idx = get_accessible_reg_index(ctx, msr)) < 0) {
+    raplcap_log(DEBUG, "msr_sys_read(0x%lX): %s\n", msr, strerror(errno));
+    return -1;
+  }
+  assert(pkg < ctx->n_pkg);
+  assert(ctx->die_offsets[pkg] + die < ctx->die_offsets[pkg + 1]);
+  *msrval = read_reg(ctx, ctx->die_offsets[pkg] + die, idx);
+  if (ctx->yield) {
+    mock_yield();
+  }
+  raplcap_log(DEBUG, "msr_sys_read: msr=0x%lX, msrval=0x%016lX\n", msr, *msrval);
+  return 0;
+}
+
+int msr_sys_read_many(const raplcap_msr_sys_ctx* ctx, uint64_t* msrvals, int* errs, uint32_t pkg, uint32_t die,
+                      const off_t* msrs, uint32_t n) {
+  assert(msrvals != NULL);
+  assert(msrs != NULL);
+  uint32_t i;
+  int ret = 0;
+  int err;
+  for (i = 0; i < n; i++) {
+    err = msr_sys_read(ctx, &msrvals[i], pkg, die, msrs[i]) ? -1 : 0;
+    ret |= err;
+    if (errs != NULL) {
+      errs[i] = err;
+    }
+  }
+  return ret;
+}
+
+int msr_sys_write(const raplcap_msr_sys_ctx* ctx, uint64_t msrval, uint32_t pkg, uint32_t die, off_t msr) {
+  assert(ctx);
+  assert(msr >= 0);
+  int idx;
+  raplcap_log(DEBUG, "msr_sys_write: msr=0x%lX, msrval=0x%016lX\n", msr, msrval);
+  if ((idx = get_accessible_reg_index(ctx, msr)) >= 0 && MOCK_REGS[idx].is_energy) {
+    // energy status counters are read-only
+    errno = EIO;
+    idx = -1;
+  }
+  if (idx < 0) {
+    raplcap_log(DEBUG, "msr_sys_write(0x%lX): %s\n", msr, strerror(errno));
+    return -1;
+  }
+  __atomic_store_n(&get_die(ctx, pkg, die)->regs[idx], msrval, __ATOMIC_RELAXED);
+  if (ctx->yield) {
+    mock_yield();
+  }
+  return 0;
+}
+
+int msr_sys_read_set_init(raplcap_msr_sys_ctx* ctx, const uint32_t* die_idxs, const off_t* msrs, uint32_t n) {
+  assert(ctx);
+  assert(die_idxs != NULL);
+  assert(msrs != NULL);
+  msr_mock_set* set;
+  uint32_t i;
+  if (ctx->set != NULL) {
+    errno = EEXIST;
+    return -1;
+  }
+  if ((set = calloc(1, sizeof(*set))) == NULL) {
+    return -1;
+  }
+  if ((set->die_idxs = malloc(n * sizeof(*set->die_idxs))) == NULL ||
+      (set->reg_idxs = malloc(n * sizeof(*set->reg_idxs))) == NULL ||
+      (set->msrvals = malloc(n * sizeof(*set->msrvals))) == NULL) {
+    free(set->reg_idxs);
+    free(set->die_idxs);
+    free(set);
+    return -1;
+  }
+  memcpy(set->die_idxs, die_idxs, n * sizeof(*set->die_idxs));
+  // unmodeled and denied registers fail when read, like they would in a real batch
+  for (i = 0; i < n; i++) {
+    assert(die_idxs[i] < ctx->die_offsets[ctx->n_pkg]);
+    set->reg_idxs[i] = get_accessible_reg_index(ctx, msrs[i]);
+  }
+  set->n = n;
+  pthread_mutex_init(&set->lock, NULL);
+  ctx->set = set;
+  return 0;
+}
+
+int msr_sys_read_set(const raplcap_msr_sys_ctx* ctx) {
+  assert(ctx);
+  msr_mock_set* set = ctx->set;
+  uint32_t i;
+  if (set == NULL || pthread_mutex_trylock(&set->lock)) {
+    return 1;
+  }
+  for (i = 0; i < set->n; i++) {
+    if (set->reg_idxs[i] >= 0) {
+      set->msrvals[i] = read_reg(ctx, set->die_idxs[i], set->reg_idxs[i]);
+    }
+  }
+  if (ctx->yield) {
+    mock_yield();
+  }
+  return 0;
+}
+
+int msr_sys_read_set_get(const raplcap_msr_sys_ctx* ctx, uint32_t i, uint64_t* msrval) {
+  assert(ctx);
+  assert(ctx->set != NULL);
+  assert(msrval != NULL);
+  if (i >= ctx->set->n || ctx->set->reg_idxs[i] < 0) {
+    errno = EIO;
+    return -1;
+  }
+  *msrval = ctx->set->msrvals[i];
+  return 0;
+}
+
+void msr_sys_read_set_release(const raplcap_msr_sys_ctx* ctx) {
+  assert(ctx);
+  assert(ctx->set != NULL);
+  pthread_mutex_unlock(&ctx->set->lock);
+}
@@ -18,16 +18,76 @@ extern "C" {
 
 typedef struct raplcap_msr_sys_ctx raplcap_msr_sys_ctx;
 
-int msr_sys_get_num_pkg_die(const raplcap_msr_sys_ctx* ctx, uint32_t *n_pkg, uint32_t* n_die);
+/**
+ * Get the number of packages.
+ * If ctx is NULL, the process-wide topology is used.
+ */
+int msr_sys_get_num_pkg(const raplcap_msr_sys_ctx* ctx, uint32_t* n_pkg);
 
-raplcap_msr_sys_ctx* msr_sys_init(uint32_t* n_pkg, uint32_t* n_die);
+/**
+ * Get the number of die in a package, which may differ between packages.
+ * If ctx is NULL, the process-wide topology is used.
+ * Fails with EINVAL if pkg is out of range.
+ */
+int msr_sys_get_num_die(const raplcap_msr_sys_ctx* ctx, uint32_t pkg, uint32_t* n_die);
+
+/**
+ * Die of all packages are indexed consecutively, ordered by package then die.
+ * The total number of die is the index of die 0 in package n_pkg.
+ * Parameters are not validated.
+ */
+uint32_t msr_sys_get_die_index(const raplcap_msr_sys_ctx* ctx, uint32_t pkg, uint32_t die);
+
+/**
+ * Discard and rediscover the process-wide topology cache.
+ */
+int msr_sys_refresh_topology(void);
+
+/**
+ * Returns the number of packages in n_pkg and the total number of die in n_pkg_die.
+ */
+raplcap_msr_sys_ctx* msr_sys_init(uint32_t* n_pkg, uint32_t* n_pkg_die);
 
 int msr_sys_destroy(raplcap_msr_sys_ctx* ctx);
 
 int msr_sys_read(const raplcap_msr_sys_ctx* ctx, uint64_t* msrval, uint32_t pkg, uint32_t die, off_t msr);
 
+/**
+ * Read multiple MSRs for a package/die, using batch operations if possible.
+ * If errs is not NULL, each of its elements is set to 0 if the corresponding MSR was read, or a negative value if not.
+ * Returns 0 if all MSRs were read, a negative value otherwise.
+ */
+int msr_sys_read_many(const raplcap_msr_sys_ctx* ctx, uint64_t* msrvals, int* errs, uint32_t pkg, uint32_t die,
+                      const off_t* msrs, uint32_t n);
+
 int msr_sys_write(const raplcap_msr_sys_ctx* ctx, uint64_t msrval, uint32_t pkg, uint32_t die, off_t msr);
 
+/**
+ * Prepare a set of MSRs across any number of package/die to be read together by msr_sys_read_set.
+ * Entry i is MSR msrs[i] of the package/die at index die_idxs[i] (see msr_sys_get_die_index).
+ * Returns 0 if the set is prepared, or a non-zero value if batched reads aren't available, in which case callers should
+ * use msr_sys_read_many instead.
+ * A context has at most one set, which can't be replaced.
+ */
+int msr_sys_read_set_init(raplcap_msr_sys_ctx* ctx, const uint32_t* die_idxs, const off_t* msrs, uint32_t n);
+
+/**
+ * Read all MSRs in the prepared set in a single batch.
+ * Returns 0 if results are available from msr_sys_read_set_get, in which case the caller must then call
+ * msr_sys_read_set_release.
+ * Returns a non-zero value without holding the set if there's no set, another thread is reading it, or the batch
+ * failed, in which case callers should use msr_sys_read_many instead.
+ */
+int msr_sys_read_set(const raplcap_msr_sys_ctx* ctx);
+
+/**
+ * Get an entry's value from the most recent msr_sys_read_set.
+ * Returns 0 on success, a negative value if the entry couldn't be read.
+ */
+int msr_sys_read_set_get(const raplcap_msr_sys_ctx* ctx, uint32_t i, uint64_t* msrval);
+
+void msr_sys_read_set_release(const raplcap_msr_sys_ctx* ctx);
+
 #pragma GCC visibility pop
 
 #ifdef __cplusplus
@@ -7,11 +7,15 @@
  * @author Connor Imes
  * @date 2016-10-19
  */
+// for posix_memalign, pthread
+#define _POSIX_C_SOURCE 200112L
 #include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include "raplcap.h"
@@ -19,12 +23,44 @@
 #include "raplcap-msr.h"
 #include "raplcap-msr-common.h"
 #include "raplcap-msr-sys.h"
+#include "raplcap-set-all.h"
+#include "raplcap-uring.h"
 #include "raplcap-wrappers.h"
 
+// State that's written at runtime for a package/die, in its own cache line(s)
+typedef struct raplcap_msr_die {
+  // indexed by zone; only used while energy accumulation is enabled
+  raplcap_energy_acc acc[RAPLCAP_NZONES];
+  // serializes read-modify-write sequences, and energy reads while accumulating - other reads don't take it
+  pthread_mutex_t lock;
+} RAPLCAP_CACHE_ALIGNED raplcap_msr_die;
+
+// Zone and constraint support for a package/die, discovered at initialization
+typedef struct raplcap_msr_support {
+  // bit zone is set if the zone's power limit MSR is readable, which gates limit, enable, clamp, and lock operations
+  uint8_t zones;
+  // bit zone is set if the zone's energy MSR is readable, which gates energy operations
+  uint8_t energy_zones;
+  // indexed by zone, bit constraint is set if the constraint is supported
+  uint8_t constraints[RAPLCAP_NZONES];
+} raplcap_msr_support;
+
 typedef struct raplcap_msr {
   // assuming consistent unit values between packages
   raplcap_msr_ctx ctx;
   raplcap_msr_sys_ctx* sys;
+  // indexed by msr_sys_get_die_index, allocated contiguously
+  raplcap_msr_die* dies;
+  // indexed by msr_sys_get_die_index, read-only after initialization
+  raplcap_msr_support* support;
+  uint32_t n_dies;
+  int acc_enabled;
+  // the die index and zone of each energy MSR in the sys layer's read set, or NULL if there's no read set
+  uint32_t* set_dies;
+  raplcap_zone* set_zones;
+  uint32_t n_set;
+  // created by the first raplcap_set_limits_all call that needs it
+  raplcap_set_all_pool* set_all_pool;
 } raplcap_msr;
 
 static raplcap rc_default;
@@ -54,6 +90,97 @@ static off_t zone_to_msr_offset(raplcap_zone zone, const off_t* offsets) {
   return offsets[zone];
 }
 
+// Probe each zone's power limit and energy MSRs once, so later operations on unsupported zones don't need syscalls
+// Zones may have an energy counter without a power limit, e.g., with an msr-safe allowlist for monitoring only
+static int probe_support(raplcap_msr* state, uint32_t n_pkg, uint32_t n_pkg_die) {
+  off_t msrs[2 * RAPLCAP_NZONES];
+  uint64_t msrvals[2 * RAPLCAP_NZONES];
+  int errs[2 * RAPLCAP_NZONES];
+  raplcap_msr_support* sup;
+  uint32_t n_die;
+  uint32_t pkg;
+  uint32_t die;
+  int zone;
+  int c;
+  if ((state->support = calloc(n_pkg_die, sizeof(*state->support))) == NULL) {
+    return -1;
+  }
+  memcpy(msrs, ZONE_OFFSETS_PL, sizeof(ZONE_OFFSETS_PL));
+  memcpy(&msrs[RAPLCAP_NZONES], ZONE_OFFSETS_ENERGY, sizeof(ZONE_OFFSETS_ENERGY));
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    if (msr_sys_get_num_die(state->sys, pkg, &n_die)) {
+      return -1;
+    }
+    for (die = 0; die < n_die; die++) {
+      sup = &state->support[msr_sys_get_die_index(state->sys, pkg, die)];
+      msr_sys_read_many(state->sys, msrvals, errs, pkg, die, msrs, 2 * RAPLCAP_NZONES);
+      for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+        if (!errs[RAPLCAP_NZONES + zone]) {
+          sup->energy_zones |= (uint8_t) (1 << zone);
+        }
+        if (errs[zone]) {
+          continue;
+        }
+        sup->zones |= (uint8_t) (1 << zone);
+        for (c = 0; c < RAPLCAP_NCONSTRAINTS; c++) {
+          if (msr_is_constraint_supported(&state->ctx, (raplcap_zone) zone, (raplcap_constraint) c) > 0) {
+            sup->constraints[zone] |= (uint8_t) (1 << c);
+          }
+        }
+      }
+      raplcap_log(DEBUG, "probe_support: pkg=%"PRIu32", die=%"PRIu32", zones=0x%02"PRIx8", energy=0x%02"PRIx8"\n",
+                  pkg, die, sup->zones, sup->energy_zones);
+    }
+  }
+  return 0;
+}
+
+// Get a package/die's readable energy MSRs, so unsupported zones aren't read
+static uint32_t get_supported_energy_msrs(const raplcap_msr_support* sup, off_t* msrs, raplcap_zone* zones) {
+  uint32_t n = 0;
+  int zone;
+  for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+    if (sup->energy_zones & (1 << zone)) {
+      msrs[n] = ZONE_OFFSETS_ENERGY[zone];
+      zones[n++] = (raplcap_zone) zone;
+    }
+  }
+  return n;
+}
+
+// Prepare a read set of every supported energy MSR for snapshots - not fatal, since snapshots can read each die
+static void init_read_set(raplcap_msr* state) {
+  off_t* msrs;
+  uint32_t n;
+  uint32_t d;
+  uint32_t j;
+  if ((state->set_dies = malloc(state->n_dies * RAPLCAP_NZONES * sizeof(*state->set_dies))) == NULL ||
+      (state->set_zones = malloc(state->n_dies * RAPLCAP_NZONES * sizeof(*state->set_zones))) == NULL ||
+      (msrs = malloc(state->n_dies * RAPLCAP_NZONES * sizeof(*msrs))) == NULL) {
+    raplcap_perror(INFO, "init_read_set");
+    free(state->set_zones);
+    free(state->set_dies);
+    state->set_zones = NULL;
+    state->set_dies = NULL;
+    return;
+  }
+  for (d = 0; d < state->n_dies; d++) {
+    n = get_supported_energy_msrs(&state->support[d], &msrs[state->n_set], &state->set_zones[state->n_set]);
+    for (j = 0; j < n; j++) {
+      state->set_dies[state->n_set++] = d;
+    }
+  }
+  if (state->n_set == 0 || msr_sys_read_set_init(state->sys, state->set_dies, msrs, state->n_set)) {
+    raplcap_log(INFO, "init_read_set: Snapshots will read each package/die separately\n");
+    free(state->set_zones);
+    free(state->set_dies);
+    state->set_zones = NULL;
+    state->set_dies = NULL;
+    state->n_set = 0;
+  }
+  free(msrs);
+}
+
 int raplcap_init(raplcap* rc) {
   if (rc == NULL) {
     rc = &rc_default;
@@ -62,7 +189,9 @@ int raplcap_init(raplcap* rc) {
   uint64_t msrval;
   uint32_t cpu_model;
   uint32_t n_pkg;
-  uint32_t n_die;
+  uint32_t n_pkg_die;
+  void* dies;
+  uint32_t i;
   int err_save;
   // check that we recognize the CPU
   if ((cpu_model = msr_get_supported_cpu_model()) == 0) {
@@ -72,10 +201,29 @@ int raplcap_init(raplcap* rc) {
   if ((state = malloc(sizeof(*state))) == NULL) {
     return -1;
   }
-  if ((state->sys = msr_sys_init(&n_pkg, &n_die)) == NULL) {
+  if ((state->sys = msr_sys_init(&n_pkg, &n_pkg_die)) == NULL) {
     free(state);
     return -1;
   }
+  if ((errno = posix_memalign(&dies, RAPLCAP_CACHE_LINE_SIZE, n_pkg_die * sizeof(*state->dies))) != 0) {
+    err_save = errno;
+    msr_sys_destroy(state->sys);
+    free(state);
+    errno = err_save;
+    return -1;
+  }
+  state->dies = dies;
+  memset(state->dies, 0, n_pkg_die * sizeof(*state->dies));
+  for (i = 0; i < n_pkg_die; i++) {
+    pthread_mutex_init(&state->dies[i].lock, NULL);
+  }
+  state->n_dies = n_pkg_die;
+  state->support = NULL;
+  state->acc_enabled = 0;
+  state->set_dies = NULL;
+  state->set_zones = NULL;
+  state->n_set = 0;
+  state->set_all_pool = NULL;
   rc->nsockets = n_pkg;
   rc->state = state;
   if (msr_sys_read(state->sys, &msrval, 0, 0, MSR_RAPL_POWER_UNIT)) {
@@ -86,18 +234,37 @@ int raplcap_init(raplcap* rc) {
   }
   // now populate context with unit conversions and function pointers
   msr_get_context(&state->ctx, cpu_model, msrval);
+  if (probe_support(state, n_pkg, n_pkg_die)) {
+    err_save = errno;
+    raplcap_destroy(rc);
+    errno = err_save;
+    return -1;
+  }
+  if (raplcap_uring_is_enabled()) {
+    init_read_set(state);
+  }
   raplcap_log(DEBUG, "raplcap_init: Initialized\n");
   return 0;
 }
 
 int raplcap_destroy(raplcap* rc) {
   raplcap_msr* state;
+  uint32_t i;
   int ret = 0;
   if (rc == NULL) {
     rc = &rc_default;
   }
   if ((state = (raplcap_msr*) rc->state) != NULL) {
+    // before the state its workers use is freed
+    raplcap_set_all_pool_destroy(state->set_all_pool);
     ret = msr_sys_destroy(state->sys);
+    for (i = 0; i < state->n_dies; i++) {
+      pthread_mutex_destroy(&state->dies[i].lock);
+    }
+    free(state->set_zones);
+    free(state->set_dies);
+    free(state->support);
+    free(state->dies);
     free(state);
     rc->state = NULL;
   }
@@ -106,11 +273,18 @@ int raplcap_destroy(raplcap* rc) {
   return ret;
 }
 
+raplcap_set_all_pool** raplcap_get_set_all_pool(const raplcap* rc) {
+  raplcap_msr* state;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  return (state = (raplcap_msr*) rc->state) == NULL ? NULL : &state->set_all_pool;
+}
+
 uint32_t raplcap_get_num_packages(const raplcap* rc) {
   const raplcap_msr* state;
   const raplcap_msr_sys_ctx* sys;
   uint32_t n_pkg;
-  uint32_t n_die;
   if (rc == NULL) {
     rc = &rc_default;
   }
@@ -119,13 +293,12 @@ uint32_t raplcap_get_num_packages(const raplcap* rc) {
   } else {
     sys = NULL;
   }
-  return msr_sys_get_num_pkg_die(sys, &n_pkg, &n_die) ? 0 : n_pkg;
+  return msr_sys_get_num_pkg(sys, &n_pkg) ? 0 : n_pkg;
 }
 
 uint32_t raplcap_get_num_die(const raplcap* rc, uint32_t pkg) {
   const raplcap_msr* state;
   const raplcap_msr_sys_ctx* sys;
-  uint32_t n_pkg;
   uint32_t n_die;
   if (rc == NULL) {
     rc = &rc_default;
@@ -135,20 +308,16 @@ uint32_t raplcap_get_num_die(const raplcap* rc, uint32_t pkg) {
   } else {
     sys = NULL;
   }
-  if (msr_sys_get_num_pkg_die(sys, &n_pkg, &n_die)) {
-    return 0;
-  }
-  if (pkg >= n_pkg) {
-    raplcap_log(ERROR, "Package %"PRIu32" not in range [0, %"PRIu32")\n", pkg, n_pkg);
-    errno = EINVAL;
-    return 0;
-  }
-  return n_die;
+  return msr_sys_get_num_die(sys, pkg, &n_die) ? 0 : n_die;
+}
+
+int raplcap_msr_refresh_topology(void) {
+  raplcap_log(DEBUG, "raplcap_msr_refresh_topology\n");
+  return msr_sys_refresh_topology();
 }
 
 static raplcap_msr* get_state(const raplcap* rc, uint32_t pkg, uint32_t die) {
   raplcap_msr* state;
-  uint32_t n_pkg;
   uint32_t n_die;
   if (rc == NULL) {
     rc = &rc_default;
@@ -159,12 +328,7 @@ static raplcap_msr* get_state(const raplcap* rc, uint32_t pkg, uint32_t die) {
     errno = EINVAL;
     return NULL;
   }
-  if (msr_sys_get_num_pkg_die(state->sys, &n_pkg, &n_die)) {
-    return NULL;
-  }
-  if (pkg >= n_pkg) {
-    raplcap_log(ERROR, "Package %"PRIu32" not in range [0, %"PRIu32")\n", pkg, n_pkg);
-    errno = EINVAL;
+  if (msr_sys_get_num_die(state->sys, pkg, &n_die)) {
     return NULL;
   }
   if (die >= n_die) {
@@ -175,15 +339,68 @@ static raplcap_msr* get_state(const raplcap* rc, uint32_t pkg, uint32_t die) {
   return state;
 }
 
+static const raplcap_msr_support* get_support(const raplcap_msr* state, uint32_t pkg, uint32_t die) {
+  return &state->support[msr_sys_get_die_index(state->sys, pkg, die)];
+}
+
+// Returns 0 if the zone is supported, otherwise sets errno and returns -1 without a syscall
+static int check_zone_supported(const raplcap_msr* state, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  if (!(get_support(state, pkg, die)->zones & (1 << zone))) {
+    raplcap_log(DEBUG, "Zone %d is not supported for pkg=%"PRIu32", die=%"PRIu32"\n", zone, pkg, die);
+    errno = ENOTSUP;
+    return -1;
+  }
+  return 0;
+}
+
+// Returns 0 if the zone's energy counter is readable, otherwise sets errno and returns -1 without a syscall
+static int check_energy_supported(const raplcap_msr* state, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  if (!(get_support(state, pkg, die)->energy_zones & (1 << zone))) {
+    raplcap_log(DEBUG, "Zone %d energy is not supported for pkg=%"PRIu32", die=%"PRIu32"\n", zone, pkg, die);
+    errno = ENOTSUP;
+    return -1;
+  }
+  return 0;
+}
+
+// Lock a package/die for a read-modify-write sequence, so concurrent writers don't lose each other's changes
+static pthread_mutex_t* lock_die(const raplcap_msr* state, uint32_t pkg, uint32_t die) {
+  pthread_mutex_t* lock = &state->dies[msr_sys_get_die_index(state->sys, pkg, die)].lock;
+  pthread_mutex_lock(lock);
+  return lock;
+}
+
+// Accumulator updates must be in the same order as counter reads, so lock the package/die only while accumulating
+static pthread_mutex_t* lock_die_acc(const raplcap_msr* state, uint32_t pkg, uint32_t die) {
+  return state->acc_enabled ? lock_die(state, pkg, die) : NULL;
+}
+
+static void unlock_die(pthread_mutex_t* lock) {
+  if (lock != NULL) {
+    pthread_mutex_unlock(lock);
+  }
+}
+
+// Returns the updated accumulator, or NULL if energy accumulation is not enabled
+static const raplcap_energy_acc* energy_acc_update(const raplcap_msr* state, uint32_t pkg, uint32_t die,
+                                                   raplcap_zone zone, uint64_t msrval) {
+  raplcap_energy_acc* acc;
+  if (!state->acc_enabled) {
+    return NULL;
+  }
+  acc = &state->dies[msr_sys_get_die_index(state->sys, pkg, die)].acc[zone];
+  raplcap_energy_acc_update(acc, msr_get_energy_counter_raw(msrval));
+  return acc;
+}
+
 int raplcap_pd_is_zone_supported(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
-  uint64_t msrval;
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
   int ret;
   if (state == NULL || msr < 0) {
     return -1;
   }
-  ret = msr_sys_read(state->sys, &msrval, pkg, die, msr) ? 0 : 1;
+  ret = (get_support(state, pkg, die)->zones >> zone) & 1;
   raplcap_log(DEBUG, "raplcap_pd_is_zone_supported: pkg=%"PRIu32", die=%"PRIu32", zone=%d, supported=%d\n",
               pkg, die, zone, ret);
   return ret;
@@ -196,11 +413,12 @@ int raplcap_pd_is_constraint_supported(const raplcap* rc, uint32_t pkg, uint32_t
   if (state == NULL) {
     return -1;
   }
-  if ((int) constraint < 0 || (int) constraint >= RAPLCAP_NCONSTRAINTS) {
+  if ((int) zone < 0 || (int) zone >= RAPLCAP_NZONES || (int) constraint < 0 ||
+      (int) constraint >= RAPLCAP_NCONSTRAINTS) {
     errno = EINVAL;
     return -1;
   }
-  ret = msr_is_constraint_supported(&state->ctx, zone, constraint);
+  ret = (get_support(state, pkg, die)->constraints[zone] >> constraint) & 1;
   raplcap_log(DEBUG,
               "raplcap_pd_is_constraint_supported: pkg=%"PRIu32", die=%"PRIu32", zone=%d, constraint=%d, supported=%d\n",
               pkg, die, zone, constraint, ret);
@@ -210,15 +428,19 @@ int raplcap_pd_is_constraint_supported(const raplcap* rc, uint32_t pkg, uint32_t
 int raplcap_pd_is_zone_enabled(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
   uint64_t msrval;
   int en[2] = { 1, 1 };
+  int cl[2] = { 1, 1 };
   int ret;
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
-  if (state == NULL || msr < 0 || msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone) ||
+      msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
     return -1;
   }
   msr_is_zone_enabled(&state->ctx, zone, msrval, &en[0], &en[1]);
   ret = en[0] && en[1];
-  if (ret && !raplcap_msr_is_zone_clamped(rc, pkg, zone)) {
+  // clamping bits are in the same register, no need to read it again
+  msr_is_zone_clamped(&state->ctx, zone, msrval, &cl[0], &cl[1]);
+  if (ret && !(cl[0] && cl[1])) {
     raplcap_log(INFO, "Zone is enabled but clamping is not\n");
   }
   raplcap_log(DEBUG, "raplcap_pd_is_zone_enabled: pkg=%"PRIu32", die=%"PRIu32", zone=%d, enabled=%d\n",
@@ -229,21 +451,26 @@ int raplcap_pd_is_zone_enabled(const raplcap* rc, uint32_t pkg, uint32_t die, ra
 // Enables or disables both the "enabled" and "clamped" bits for all constraints
 int raplcap_pd_set_zone_enabled(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone, int enabled) {
   uint64_t msrval;
+  pthread_mutex_t* lock;
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
   int ret;
   raplcap_log(DEBUG, "raplcap_pd_set_zone_enabled: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
-  if (state == NULL || msr < 0 || msr_sys_read(state->sys, &msrval, pkg, 0, msr)) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone)) {
     return -1;
   }
-  msrval = msr_set_zone_enabled(&state->ctx, zone, msrval, &enabled, &enabled);
-  if ((ret = msr_sys_write(state->sys, msrval, pkg, die, msr)) == 0) {
-    // try to clamp (not supported by all zones or all CPUs)
-    msrval = msr_set_zone_clamped(&state->ctx, zone, msrval, &enabled, &enabled);
-    if (msr_sys_write(state->sys, msrval, pkg, die, msr)) {
-      raplcap_log(INFO, "Clamping not available for this zone or platform\n");
+  lock = lock_die(state, pkg, die);
+  if ((ret = msr_sys_read(state->sys, &msrval, pkg, die, msr)) == 0) {
+    msrval = msr_set_zone_enabled(&state->ctx, zone, msrval, &enabled, &enabled);
+    if ((ret = msr_sys_write(state->sys, msrval, pkg, die, msr)) == 0) {
+      // try to clamp (not supported by all zones or all CPUs)
+      msrval = msr_set_zone_clamped(&state->ctx, zone, msrval, &enabled, &enabled);
+      if (msr_sys_write(state->sys, msrval, pkg, die, msr)) {
+        raplcap_log(INFO, "Clamping not available for this zone or platform\n");
+      }
     }
   }
+  unlock_die(lock);
   return ret;
 }
 
@@ -253,7 +480,8 @@ int raplcap_pd_get_limits(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
   raplcap_log(DEBUG, "raplcap_pd_get_limits: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
-  if (state == NULL || msr < 0 || msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone) ||
+      msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
     return -1;
   }
   msr_get_limits(&state->ctx, zone, msrval, limit_long, limit_short);
@@ -263,14 +491,21 @@ int raplcap_pd_get_limits(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap
 int raplcap_pd_set_limits(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
                           const raplcap_limit* limit_long, const raplcap_limit* limit_short) {
   uint64_t msrval;
+  pthread_mutex_t* lock;
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
+  int ret;
   raplcap_log(DEBUG, "raplcap_pd_set_limits: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
-  if (state == NULL || msr < 0 || msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone)) {
     return -1;
   }
-  msrval = msr_set_limits(&state->ctx, zone, msrval, limit_long, limit_short);
-  return msr_sys_write(state->sys, msrval, pkg, die, msr);
+  lock = lock_die(state, pkg, die);
+  if ((ret = msr_sys_read(state->sys, &msrval, pkg, die, msr)) == 0) {
+    msrval = msr_set_limits(&state->ctx, zone, msrval, limit_long, limit_short);
+    ret = msr_sys_write(state->sys, msrval, pkg, die, msr);
+  }
+  unlock_die(lock);
+  return ret;
 }
 
 int raplcap_pd_get_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
@@ -281,7 +516,7 @@ int raplcap_pd_get_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_
   int ret = 0;
   raplcap_log(DEBUG, "raplcap_pd_get_limit: pkg=%"PRIu32", die=%"PRIu32", zone=%d, constraint=%d\n",
               pkg, die, zone, constraint);
-  if (state == NULL || msr < 0) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone)) {
     return -1;
   }
   if ((int) constraint < 0 || (int) constraint >= RAPLCAP_NCONSTRAINTS) {
@@ -322,38 +557,35 @@ int raplcap_pd_get_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_
 int raplcap_pd_set_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
                          raplcap_constraint constraint, const raplcap_limit* limit) {
   uint64_t msrval;
+  pthread_mutex_t* lock;
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
   int ret = 0;
   raplcap_log(DEBUG, "raplcap_pd_set_limit: pkg=%"PRIu32", die=%"PRIu32", zone=%d, constraint=%d\n",
               pkg, die, zone, constraint);
-  if (state == NULL || msr < 0) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone)) {
     return -1;
   }
   if ((int) constraint < 0 || (int) constraint >= RAPLCAP_NCONSTRAINTS) {
     errno = EINVAL;
     return -1;
   }
+  lock = lock_die(state, pkg, die);
   switch (constraint) {
     case RAPLCAP_CONSTRAINT_LONG_TERM:
-      if (msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
-        return -1;
+      if ((ret = msr_sys_read(state->sys, &msrval, pkg, die, msr)) == 0) {
+        msrval = msr_set_limits(&state->ctx, zone, msrval, limit, NULL);
+        ret = msr_sys_write(state->sys, msrval, pkg, die, msr);
       }
-      msrval = msr_set_limits(&state->ctx, zone, msrval, limit, NULL);
-      ret = msr_sys_write(state->sys, msrval, pkg, die, msr);
       break;
     case RAPLCAP_CONSTRAINT_SHORT_TERM:
-      if (msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
-        return -1;
+      if ((ret = msr_sys_read(state->sys, &msrval, pkg, die, msr)) == 0) {
+        msrval = msr_set_limits(&state->ctx, zone, msrval, NULL, limit);
+        ret = msr_sys_write(state->sys, msrval, pkg, die, msr);
       }
-      msrval = msr_set_limits(&state->ctx, zone, msrval, NULL, limit);
-      ret = msr_sys_write(state->sys, msrval, pkg, die, msr);
       break;
     case RAPLCAP_CONSTRAINT_PEAK_POWER:
-      if (msr_sys_read(state->sys, &msrval, pkg, die, MSR_VR_CURRENT_CONFIG)) {
-        return -1;
-      }
-      if (limit) {
+      if ((ret = msr_sys_read(state->sys, &msrval, pkg, die, MSR_VR_CURRENT_CONFIG)) == 0 && limit) {
         msrval = msr_set_pl4_limit(&state->ctx, zone, msrval, limit->watts);
         ret = msr_sys_write(state->sys, msrval, pkg, die, MSR_VR_CURRENT_CONFIG);
       }
@@ -364,18 +596,182 @@ int raplcap_pd_set_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_
       ret = -1;
       break;
   }
+  unlock_die(lock);
+  return ret;
+}
+
+static void zone_state_decode(const raplcap_msr_ctx* ctx, raplcap_zone zone, uint64_t msrval, raplcap_zone_state* s) {
+  int en[2] = { 1, 1 };
+  int cl[2] = { 1, 1 };
+  msr_is_zone_enabled(ctx, zone, msrval, &en[0], &en[1]);
+  msr_is_zone_clamped(ctx, zone, msrval, &cl[0], &cl[1]);
+  s->enabled = en[0] && en[1];
+  s->clamped = cl[0] && cl[1];
+  s->locked = msr_is_zone_locked(ctx, zone, msrval);
+  msr_get_limits(ctx, zone, msrval, &s->limits[RAPLCAP_CONSTRAINT_LONG_TERM],
+                 &s->limits[RAPLCAP_CONSTRAINT_SHORT_TERM]);
+}
+
+int raplcap_pd_get_zone_states(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone_state* states,
+                               uint32_t len) {
+  // a power limit MSR per zone, then MSR_VR_CURRENT_CONFIG if any zone has a peak power limit
+  uint64_t msrvals[RAPLCAP_NZONES + 1];
+  int errs[RAPLCAP_NZONES + 1];
+  off_t msrs[RAPLCAP_NZONES + 1];
+  raplcap_zone zones[RAPLCAP_NZONES];
+  const raplcap_msr_support* sup;
+  uint32_t n_pl = 0;
+  uint32_t n;
+  uint32_t i;
+  int has_peak = 0;
+  int zone;
+  const raplcap_msr* state = get_state(rc, pkg, die);
+  raplcap_log(DEBUG, "raplcap_pd_get_zone_states: pkg=%"PRIu32", die=%"PRIu32", len=%"PRIu32"\n", pkg, die, len);
+  if (state == NULL) {
+    return -1;
+  }
+  if (states == NULL || len < RAPLCAP_NZONES) {
+    errno = EINVAL;
+    return -1;
+  }
+  sup = get_support(state, pkg, die);
+  memset(states, 0, RAPLCAP_NZONES * sizeof(*states));
+  for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+    states[zone].enabled = states[zone].clamped = states[zone].locked = -1;
+    if (sup->zones & (1 << zone)) {
+      msrs[n_pl] = ZONE_OFFSETS_PL[zone];
+      zones[n_pl++] = (raplcap_zone) zone;
+      has_peak |= (sup->constraints[zone] >> RAPLCAP_CONSTRAINT_PEAK_POWER) & 1;
+    }
+  }
+  n = n_pl;
+  if (has_peak) {
+    msrs[n++] = MSR_VR_CURRENT_CONFIG;
+  }
+  if (n == 0) {
+    return RAPLCAP_NZONES;
+  }
+  // only reads, so like the other getters, no lock is needed
+  msr_sys_read_many(state->sys, msrvals, errs, pkg, die, msrs, n);
+  for (i = 0; i < n_pl; i++) {
+    if (errs[i]) {
+      continue;
+    }
+    zone_state_decode(&state->ctx, zones[i], msrvals[i], &states[zones[i]]);
+    if (has_peak && !errs[n_pl] && ((sup->constraints[zones[i]] >> RAPLCAP_CONSTRAINT_PEAK_POWER) & 1)) {
+      states[zones[i]].limits[RAPLCAP_CONSTRAINT_PEAK_POWER].watts =
+        msr_get_pl4_limit(&state->ctx, zones[i], msrvals[n_pl]);
+    }
+  }
+  return RAPLCAP_NZONES;
+}
+
+// Staged changes to the power limit MSR
+#define TXN_PL_STAGED (RAPLCAP_TXN_ENABLED | RAPLCAP_TXN_CLAMPED | \
+                       RAPLCAP_TXN_LIMIT(RAPLCAP_CONSTRAINT_LONG_TERM) | \
+                       RAPLCAP_TXN_LIMIT(RAPLCAP_CONSTRAINT_SHORT_TERM) | \
+                       RAPLCAP_TXN_LOCKED(RAPLCAP_CONSTRAINT_LONG_TERM) | \
+                       RAPLCAP_TXN_LOCKED(RAPLCAP_CONSTRAINT_SHORT_TERM))
+// Staged changes to MSR_VR_CURRENT_CONFIG
+#define TXN_VR_STAGED (RAPLCAP_TXN_LIMIT(RAPLCAP_CONSTRAINT_PEAK_POWER) | \
+                       RAPLCAP_TXN_LOCKED(RAPLCAP_CONSTRAINT_PEAK_POWER))
+
+static int txn_commit_pl(const raplcap_msr* state, const raplcap_txn* txn, off_t msr) {
+  uint64_t msrval;
+  uint64_t msrval_unclamped;
+  const raplcap_msr_ctx* ctx = &state->ctx;
+  const uint32_t staged = txn->staged;
+  if (msr_sys_read(state->sys, &msrval, txn->pkg, txn->die, msr)) {
+    return -1;
+  }
+  msrval = msr_set_limits(ctx, txn->zone, msrval,
+                          (staged & RAPLCAP_TXN_LIMIT(RAPLCAP_CONSTRAINT_LONG_TERM)) ?
+                            &txn->limits[RAPLCAP_CONSTRAINT_LONG_TERM] : NULL,
+                          (staged & RAPLCAP_TXN_LIMIT(RAPLCAP_CONSTRAINT_SHORT_TERM)) ?
+                            &txn->limits[RAPLCAP_CONSTRAINT_SHORT_TERM] : NULL);
+  if (staged & RAPLCAP_TXN_ENABLED) {
+    msrval = msr_set_zone_enabled(ctx, txn->zone, msrval, &txn->enabled, &txn->enabled);
+  }
+  if (staged & (RAPLCAP_TXN_LOCKED(RAPLCAP_CONSTRAINT_LONG_TERM) | RAPLCAP_TXN_LOCKED(RAPLCAP_CONSTRAINT_SHORT_TERM))) {
+    msrval = msr_set_zone_locked(ctx, txn->zone, msrval, 1);
+  }
+  msrval_unclamped = msrval;
+  if (staged & RAPLCAP_TXN_CLAMPED) {
+    msrval = msr_set_zone_clamped(ctx, txn->zone, msrval, &txn->clamped, &txn->clamped);
+  } else if ((staged & RAPLCAP_TXN_ENABLED) &&
+             (msrval = msr_set_zone_clamped(ctx, txn->zone, msrval, &txn->enabled, &txn->enabled)) !=
+               msrval_unclamped) {
+    // like raplcap_pd_set_zone_enabled, try to clamp too (not supported by all zones or all CPUs)
+    if (msr_sys_write(state->sys, msrval, txn->pkg, txn->die, msr) == 0) {
+      return 0;
+    }
+    raplcap_log(INFO, "Clamping not available for this zone or platform\n");
+    msrval = msrval_unclamped;
+  }
+  return msr_sys_write(state->sys, msrval, txn->pkg, txn->die, msr);
+}
+
+static int txn_commit_vr(const raplcap_msr* state, const raplcap_txn* txn) {
+  uint64_t msrval;
+  if (msr_sys_read(state->sys, &msrval, txn->pkg, txn->die, MSR_VR_CURRENT_CONFIG)) {
+    return -1;
+  }
+  if (txn->staged & RAPLCAP_TXN_LIMIT(RAPLCAP_CONSTRAINT_PEAK_POWER)) {
+    msrval = msr_set_pl4_limit(&state->ctx, txn->zone, msrval, txn->limits[RAPLCAP_CONSTRAINT_PEAK_POWER].watts);
+  }
+  if (txn->staged & RAPLCAP_TXN_LOCKED(RAPLCAP_CONSTRAINT_PEAK_POWER)) {
+    msrval = msr_set_pl4_locked(&state->ctx, txn->zone, msrval, 1);
+  }
+  return msr_sys_write(state->sys, msrval, txn->pkg, txn->die, MSR_VR_CURRENT_CONFIG);
+}
+
+int raplcap_txn_commit(raplcap_txn* txn) {
+  const raplcap_msr* state;
+  pthread_mutex_t* lock;
+  off_t msr;
+  int ret = 0;
+  int err_save;
+  if (txn == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  raplcap_log(DEBUG, "raplcap_txn_commit: pkg=%"PRIu32", die=%"PRIu32", zone=%d, staged=0x%"PRIx32"\n",
+              txn->pkg, txn->die, txn->zone, txn->staged);
+  if ((state = get_state(txn->rc, txn->pkg, txn->die)) == NULL ||
+      (msr = zone_to_msr_offset(txn->zone, ZONE_OFFSETS_PL)) < 0 ||
+      check_zone_supported(state, txn->pkg, txn->die, txn->zone)) {
+    ret = -1;
+  } else {
+    // one read and one write for each MSR with staged changes, all under one lock
+    lock = lock_die(state, txn->pkg, txn->die);
+    if (((txn->staged & TXN_PL_STAGED) && txn_commit_pl(state, txn, msr)) ||
+        ((txn->staged & TXN_VR_STAGED) && txn_commit_vr(state, txn))) {
+      ret = -1;
+    }
+    unlock_die(lock);
+  }
+  err_save = errno;
+  raplcap_txn_abort(txn);
+  errno = err_save;
   return ret;
 }
 
 double raplcap_pd_get_energy_counter(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
   uint64_t msrval;
+  pthread_mutex_t* lock;
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_ENERGY);
+  int ret;
   raplcap_log(DEBUG, "raplcap_pd_get_energy_counter: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
-  if (state == NULL || msr < 0 || msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
+  if (state == NULL || msr < 0 || check_energy_supported(state, pkg, die, zone)) {
     return -1;
   }
-  return msr_get_energy_counter(&state->ctx, msrval, zone);
+  lock = lock_die_acc(state, pkg, die);
+  if ((ret = msr_sys_read(state->sys, &msrval, pkg, die, msr)) == 0) {
+    energy_acc_update(state, pkg, die, zone, msrval);
+  }
+  unlock_die(lock);
+  return ret ? -1 : msr_get_energy_counter(&state->ctx, msrval, zone);
 }
 
 double raplcap_pd_get_energy_counter_max(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
@@ -388,13 +784,177 @@ double raplcap_pd_get_energy_counter_max(const raplcap* rc, uint32_t pkg, uint32
   return msr_get_energy_counter_max(&state->ctx, zone);
 }
 
+// Read all energy MSRs in one batch - returns non-zero if the caller should read each package/die instead
+static int snapshot_read_set(const raplcap_msr* state, double* joules) {
+  uint64_t msrval;
+  uint32_t d;
+  uint32_t i;
+  int ret;
+  // accumulating requires all dies to be locked, in index order
+  const int acc_enabled = state->acc_enabled;
+  if (state->set_dies == NULL) {
+    return -1;
+  }
+  for (d = 0; acc_enabled && d < state->n_dies; d++) {
+    pthread_mutex_lock(&state->dies[d].lock);
+  }
+  // non-zero if the set is busy or failed
+  if ((ret = msr_sys_read_set(state->sys)) == 0) {
+    for (i = 0; i < state->n_set; i++) {
+      if (msr_sys_read_set_get(state->sys, i, &msrval) == 0) {
+        d = state->set_dies[i];
+        if (acc_enabled) {
+          raplcap_energy_acc_update(&state->dies[d].acc[state->set_zones[i]], msr_get_energy_counter_raw(msrval));
+        }
+        joules[d * RAPLCAP_NZONES + (uint32_t) state->set_zones[i]] =
+          msr_get_energy_counter(&state->ctx, msrval, state->set_zones[i]);
+      }
+    }
+    msr_sys_read_set_release(state->sys);
+  }
+  for (i = 0; acc_enabled && i < state->n_dies; i++) {
+    pthread_mutex_unlock(&state->dies[i].lock);
+  }
+  return ret;
+}
+
+int raplcap_get_energy_snapshot(const raplcap* rc, double* joules, uint32_t len) {
+  uint64_t msrvals[RAPLCAP_NZONES];
+  int errs[RAPLCAP_NZONES];
+  off_t msrs[RAPLCAP_NZONES];
+  raplcap_zone zones[RAPLCAP_NZONES];
+  uint32_t n;
+  uint32_t j;
+  uint32_t n_pkg;
+  uint32_t n_pkg_die;
+  uint32_t n_die;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t i;
+  pthread_mutex_t* lock;
+  const raplcap_msr* state = get_state(rc, 0, 0);
+  raplcap_log(DEBUG, "raplcap_get_energy_snapshot: len=%"PRIu32"\n", len);
+  if (state == NULL || msr_sys_get_num_pkg(state->sys, &n_pkg)) {
+    return -1;
+  }
+  n_pkg_die = msr_sys_get_die_index(state->sys, n_pkg, 0);
+  if (joules == NULL) {
+    return (int) (n_pkg_die * RAPLCAP_NZONES);
+  }
+  if (len < n_pkg_die * RAPLCAP_NZONES) {
+    raplcap_log(ERROR, "Snapshot length %"PRIu32" is less than required length %"PRIu32"\n",
+                len, n_pkg_die * RAPLCAP_NZONES);
+    errno = EINVAL;
+    return -1;
+  }
+  for (i = 0; i < n_pkg_die * RAPLCAP_NZONES; i++) {
+    joules[i] = -1;
+  }
+  if (snapshot_read_set(state, joules) == 0) {
+    return (int) i;
+  }
+  // validation is done once up front, so read all of a die's zones together directly through the sys layer
+  for (pkg = 0, i = 0; pkg < n_pkg; pkg++) {
+    msr_sys_get_num_die(state->sys, pkg, &n_die);
+    for (die = 0; die < n_die; die++, i += RAPLCAP_NZONES) {
+      if ((n = get_supported_energy_msrs(get_support(state, pkg, die), msrs, zones)) == 0) {
+        continue;
+      }
+      lock = lock_die_acc(state, pkg, die);
+      msr_sys_read_many(state->sys, msrvals, errs, pkg, die, msrs, n);
+      for (j = 0; j < n; j++) {
+        if (!errs[j]) {
+          energy_acc_update(state, pkg, die, zones[j], msrvals[j]);
+          joules[i + (uint32_t) zones[j]] = msr_get_energy_counter(&state->ctx, msrvals[j], zones[j]);
+        }
+      }
+      unlock_die(lock);
+    }
+  }
+  return (int) i;
+}
+
+int raplcap_set_energy_accumulation(const raplcap* rc, int enabled) {
+  uint64_t msrvals[RAPLCAP_NZONES];
+  int errs[RAPLCAP_NZONES];
+  off_t msrs[RAPLCAP_NZONES];
+  raplcap_zone zones[RAPLCAP_NZONES];
+  uint32_t n;
+  uint32_t j;
+  uint32_t n_pkg;
+  uint32_t n_die;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t i;
+  int zone;
+  raplcap_msr* state = get_state(rc, 0, 0);
+  raplcap_log(DEBUG, "raplcap_set_energy_accumulation: enabled=%d\n", enabled);
+  if (state == NULL || msr_sys_get_num_pkg(state->sys, &n_pkg)) {
+    return -1;
+  }
+  if (!enabled) {
+    state->acc_enabled = 0;
+    return 0;
+  }
+  if (state->acc_enabled) {
+    return 0;
+  }
+  state->acc_enabled = 1;
+  // record baselines - zones that can't be read now will get one on their first successful read
+  for (pkg = 0, i = 0; pkg < n_pkg; pkg++) {
+    msr_sys_get_num_die(state->sys, pkg, &n_die);
+    for (die = 0; die < n_die; die++, i++) {
+      memset(state->dies[i].acc, 0, sizeof(state->dies[i].acc));
+      for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+        state->dies[i].acc[zone].max = msr_get_energy_counter_raw_max();
+      }
+      if ((n = get_supported_energy_msrs(get_support(state, pkg, die), msrs, zones)) == 0) {
+        continue;
+      }
+      msr_sys_read_many(state->sys, msrvals, errs, pkg, die, msrs, n);
+      for (j = 0; j < n; j++) {
+        if (!errs[j]) {
+          energy_acc_update(state, pkg, die, zones[j], msrvals[j]);
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+double raplcap_pd_get_energy_accumulated(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  uint64_t msrval;
+  uint64_t total = 0;
+  pthread_mutex_t* lock;
+  const raplcap_energy_acc* acc = NULL;
+  const raplcap_msr* state = get_state(rc, pkg, die);
+  const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_ENERGY);
+  raplcap_log(DEBUG, "raplcap_pd_get_energy_accumulated: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
+  if (state == NULL || msr < 0 || check_energy_supported(state, pkg, die, zone)) {
+    return -1;
+  }
+  if (!state->acc_enabled) {
+    raplcap_log(ERROR, "Energy accumulation is not enabled\n");
+    errno = EINVAL;
+    return -1;
+  }
+  lock = lock_die(state, pkg, die);
+  if (msr_sys_read(state->sys, &msrval, pkg, die, msr) == 0 &&
+      (acc = energy_acc_update(state, pkg, die, zone, msrval)) != NULL) {
+    total = acc->total;
+  }
+  unlock_die(lock);
+  return acc == NULL ? -1 : total * msr_get_energy_units(&state->ctx, zone);
+}
+
 int raplcap_msr_pd_is_zone_clamped(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
   uint64_t msrval;
   int cl[2] = { 1, 1 };
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
   raplcap_log(DEBUG, "raplcap_msr_pd_is_zone_clamped: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
-  if (state == NULL || msr < 0 || msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone) ||
+      msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
     return -1;
   }
   msr_is_zone_clamped(&state->ctx, zone, msrval, &cl[0], &cl[1]);
@@ -407,14 +967,21 @@ int raplcap_msr_is_zone_clamped(const raplcap* rc, uint32_t pkg, raplcap_zone zo
 
 int raplcap_msr_pd_set_zone_clamped(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone, int clamped) {
   uint64_t msrval;
+  pthread_mutex_t* lock;
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
+  int ret;
   raplcap_log(DEBUG, "raplcap_msr_pd_set_zone_clamped: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
-  if (state == NULL || msr < 0 || msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone)) {
     return -1;
   }
-  msrval = msr_set_zone_clamped(&state->ctx, zone, msrval, &clamped, &clamped);
-  return msr_sys_write(state->sys, msrval, pkg, die, msr);
+  lock = lock_die(state, pkg, die);
+  if ((ret = msr_sys_read(state->sys, &msrval, pkg, die, msr)) == 0) {
+    msrval = msr_set_zone_clamped(&state->ctx, zone, msrval, &clamped, &clamped);
+    ret = msr_sys_write(state->sys, msrval, pkg, die, msr);
+  }
+  unlock_die(lock);
+  return ret;
 }
 
 int raplcap_msr_set_zone_clamped(const raplcap* rc, uint32_t pkg, raplcap_zone zone, int clamped) {
@@ -426,7 +993,8 @@ int raplcap_msr_pd_is_zone_locked(const raplcap* rc, uint32_t pkg, uint32_t die,
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
   raplcap_log(DEBUG, "raplcap_msr_pd_is_zone_locked: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
-  if (state == NULL || msr < 0 || msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone) ||
+      msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
     return -1;
   }
   return msr_is_zone_locked(&state->ctx, zone, msrval);
@@ -438,14 +1006,21 @@ int raplcap_msr_is_zone_locked(const raplcap* rc, uint32_t pkg, raplcap_zone zon
 
 int raplcap_msr_pd_set_zone_locked(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
   uint64_t msrval;
+  pthread_mutex_t* lock;
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
+  int ret;
   raplcap_log(DEBUG, "raplcap_msr_pd_set_zone_locked: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
-  if (state == NULL || msr < 0 || msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone)) {
     return -1;
   }
-  msrval = msr_set_zone_locked(&state->ctx, zone, msrval, 1);
-  return msr_sys_write(state->sys, msrval, pkg, die, msr);
+  lock = lock_die(state, pkg, die);
+  if ((ret = msr_sys_read(state->sys, &msrval, pkg, die, msr)) == 0) {
+    msrval = msr_set_zone_locked(&state->ctx, zone, msrval, 1);
+    ret = msr_sys_write(state->sys, msrval, pkg, die, msr);
+  }
+  unlock_die(lock);
+  return ret;
 }
 
 int raplcap_msr_set_zone_locked(const raplcap* rc, uint32_t pkg, raplcap_zone zone) {
@@ -460,7 +1035,7 @@ int raplcap_msr_pd_is_locked(const raplcap* rc, uint32_t pkg, uint32_t die, rapl
   int ret;
   raplcap_log(DEBUG, "raplcap_msr_pd_is_locked: pkg=%"PRIu32", die=%"PRIu32", zone=%d, constraint=%d\n",
               pkg, die, zone, constraint);
-  if (state == NULL || msr < 0) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone)) {
     return -1;
   }
   if ((int) constraint < 0 || (int) constraint >= RAPLCAP_NCONSTRAINTS) {
@@ -493,33 +1068,33 @@ int raplcap_msr_pd_is_locked(const raplcap* rc, uint32_t pkg, uint32_t die, rapl
 int raplcap_msr_pd_set_locked(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
                               raplcap_constraint constraint) {
   uint64_t msrval;
+  pthread_mutex_t* lock;
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_PL);
   int ret;
   raplcap_log(DEBUG, "raplcap_msr_pd_set_locked: pkg=%"PRIu32", die=%"PRIu32", zone=%d, constraint=%d\n",
               pkg, die, zone, constraint);
-  if (state == NULL || msr < 0) {
+  if (state == NULL || msr < 0 || check_zone_supported(state, pkg, die, zone)) {
     return -1;
   }
   if ((int) constraint < 0 || (int) constraint >= RAPLCAP_NCONSTRAINTS) {
     errno = EINVAL;
     return -1;
   }
+  lock = lock_die(state, pkg, die);
   switch (constraint) {
     case RAPLCAP_CONSTRAINT_LONG_TERM:
     case RAPLCAP_CONSTRAINT_SHORT_TERM:
-      if (msr_sys_read(state->sys, &msrval, pkg, die, msr)) {
-        return -1;
+      if ((ret = msr_sys_read(state->sys, &msrval, pkg, die, msr)) == 0) {
+        msrval = msr_set_zone_locked(&state->ctx, zone, msrval, 1);
+        ret = msr_sys_write(state->sys, msrval, pkg, die, msr);
       }
-      msrval = msr_set_zone_locked(&state->ctx, zone, msrval, 1);
-      ret = msr_sys_write(state->sys, msrval, pkg, die, msr);
       break;
     case RAPLCAP_CONSTRAINT_PEAK_POWER:
-      if (msr_sys_read(state->sys, &msrval, pkg, die, MSR_VR_CURRENT_CONFIG)) {
-        return -1;
+      if ((ret = msr_sys_read(state->sys, &msrval, pkg, die, MSR_VR_CURRENT_CONFIG)) == 0) {
+        msrval = msr_set_pl4_locked(&state->ctx, zone, msrval, 1);
+        ret = msr_sys_write(state->sys, msrval, pkg, die, MSR_VR_CURRENT_CONFIG);
       }
-      msrval = msr_set_pl4_locked(&state->ctx, zone, msrval, 1);
-      ret = msr_sys_write(state->sys, msrval, pkg, die, MSR_VR_CURRENT_CONFIG);
       break;
     default:
       // unreachable
@@ -527,9 +1102,29 @@ int raplcap_msr_pd_set_locked(const raplcap* rc, uint32_t pkg, uint32_t die, rap
       ret = -1;
       break;
   }
+  unlock_die(lock);
   return ret;
 }
 
+int raplcap_msr_txn_set_zone_clamped(raplcap_txn* txn, int clamped) {
+  if (txn == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  txn->clamped = clamped;
+  txn->staged |= RAPLCAP_TXN_CLAMPED;
+  return 0;
+}
+
+int raplcap_msr_txn_set_locked(raplcap_txn* txn, raplcap_constraint constraint) {
+  if (txn == NULL || (int) constraint < 0 || (int) constraint >= RAPLCAP_NCONSTRAINTS) {
+    errno = EINVAL;
+    return -1;
+  }
+  txn->staged |= RAPLCAP_TXN_LOCKED(constraint);
+  return 0;
+}
+
 double raplcap_msr_pd_get_time_units(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
   const raplcap_msr* state = get_state(rc, pkg, die);
   const off_t msr = zone_to_msr_offset(zone, ZONE_OFFSETS_ENERGY);
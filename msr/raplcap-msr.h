@@ -121,6 +121,38 @@ double raplcap_msr_pd_get_power_units(const raplcap* rc, uint32_t pkg, uint32_t
  */
 double raplcap_msr_pd_get_energy_units(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone);
 
+/**
+ * Rediscover the CPU topology, e.g., after CPUs are hotplugged.
+ * Topology is discovered when first needed and then cached for the process, to be shared by functions that need it
+ * when called with an uninitialized context, like raplcap_get_num_packages, and by raplcap_init.
+ * Contexts that are already initialized are not affected.
+ *
+ * @return 0 on success, a negative value on error
+ */
+int raplcap_msr_refresh_topology(void);
+
+/**
+ * Stage clamping/unclamping a zone in a transaction.
+ * If not staged, committing a transaction that enables/disables a zone also tries to clamp/unclamp it.
+ *
+ * @param txn
+ * @param clamped
+ * @return 0 on success, a negative value on error
+ * @see raplcap_msr_pd_set_zone_clamped
+ */
+int raplcap_msr_txn_set_zone_clamped(raplcap_txn* txn, int clamped);
+
+/**
+ * Stage locking a constraint in a transaction (affects other constraints that share a MSR).
+ * Locking is applied in the same write as other changes staged for the MSR.
+ *
+ * @param txn
+ * @param constraint
+ * @return 0 on success, a negative value on error
+ * @see raplcap_msr_pd_set_locked
+ */
+int raplcap_msr_txn_set_locked(raplcap_txn* txn, raplcap_constraint constraint);
+
 /**
  * Assumes die=0.
  *
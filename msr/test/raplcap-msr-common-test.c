@@ -7,6 +7,7 @@
 #include <float.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include "raplcap-common.h"
 #include "../raplcap-msr-common.h"
 #include "../raplcap-cpuid.h"
 
@@ -280,15 +281,70 @@ static void test_clamping(void) {
   }
 }
 
+static void test_tw_tables(void) {
+  static const double TU = 0.0009765625; // time unit
+  static const uint64_t TW1_MASK = 0x7FULL << 17;
+  raplcap_msr_ctx ctx;
+  raplcap_limit limit;
+  uint64_t msrval;
+  uint64_t bits;
+  double seconds;
+  msr_get_context(&ctx, CPUID_MODEL_SANDYBRIDGE, 0x00000000000A0E03);
+  // decoding uses the precomputed table
+  for (bits = 0; bits < MSR_TW_NVALS; bits++) {
+    msr_get_limits(&ctx, RAPLCAP_ZONE_PACKAGE, bits << 17, &limit, NULL);
+    assert(equal_dbl(limit.seconds, ctx.cfg[RAPLCAP_ZONE_PACKAGE].from_msr_tw(bits, TU)));
+  }
+  // encoding uses a search of the table, but must match the direct computation
+  limit.watts = 0;
+  for (seconds = TU; seconds < 1000000.0; seconds *= 1.01) {
+    limit.seconds = seconds;
+    msrval = msr_set_limits(&ctx, RAPLCAP_ZONE_PACKAGE, 0, &limit, NULL);
+    assert(((msrval & TW1_MASK) >> 17) == ctx.cfg[RAPLCAP_ZONE_PACKAGE].to_msr_tw(seconds, TU));
+  }
+  // round trip
+  for (bits = 0; bits < MSR_TW_NVALS; bits++) {
+    limit.seconds = ctx.tw[RAPLCAP_ZONE_PACKAGE].seconds[bits];
+    msrval = msr_set_limits(&ctx, RAPLCAP_ZONE_PACKAGE, 0, &limit, NULL);
+    msr_get_limits(&ctx, RAPLCAP_ZONE_PACKAGE, msrval, &limit, NULL);
+    assert(equal_dbl(limit.seconds, ctx.tw[RAPLCAP_ZONE_PACKAGE].seconds[bits]));
+  }
+}
+
+static void test_energy_accumulation(void) {
+  raplcap_energy_acc acc = { 0 };
+  acc.max = msr_get_energy_counter_raw_max();
+  // only the low 32 bits are energy
+  assert(msr_get_energy_counter_raw(0xFFFFFFFF00001000) == 0x1000);
+  // first update is just the baseline
+  raplcap_energy_acc_update(&acc, msr_get_energy_counter_raw(0xFFFFFF00));
+  assert(acc.valid);
+  assert(acc.total == 0);
+  raplcap_energy_acc_update(&acc, msr_get_energy_counter_raw(0xFFFFFFFF));
+  assert(acc.total == 0xFF);
+  // rollover
+  raplcap_energy_acc_update(&acc, msr_get_energy_counter_raw(0x00000010));
+  assert(acc.total == 0x110);
+  // no change
+  raplcap_energy_acc_update(&acc, msr_get_energy_counter_raw(0x00000010));
+  assert(acc.total == 0x110);
+  // total grows beyond 32 bits
+  raplcap_energy_acc_update(&acc, msr_get_energy_counter_raw(0x00000000));
+  assert(acc.total == 0x100000100);
+}
+
 int main(void) {
   // test the private translate functions
   test_translate_default();
   test_translate_atom();
   test_translate_atom_airmont();
+  test_tw_tables();
   // test boolean bit fields
   test_locked();
   test_enabled();
   test_clamping();
+  // test energy counter rollover handling
+  test_energy_accumulation();
   // TODO: Test additional functions (power/time/energy units...)
   return 0;
 }
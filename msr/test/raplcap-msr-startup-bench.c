@@ -0,0 +1,94 @@
+/**
+ * Measures the time to discover CPU topology and initialize the MSR backend.
+ * Initialization requires a supported CPU and appropriate privileges; topology discovery does not.
+ *
+ * Usage: raplcap-msr-startup-bench [iterations]
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "raplcap.h"
+#include "raplcap-msr.h"
+
+#define DEFAULT_ITERATIONS 100
+
+typedef struct bench_stats {
+  uint64_t min;
+  uint64_t max;
+  uint64_t total;
+  uint32_t n;
+} bench_stats;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void stats_add(bench_stats* stats, uint64_t ns) {
+  if (stats->n == 0 || ns < stats->min) {
+    stats->min = ns;
+  }
+  if (ns > stats->max) {
+    stats->max = ns;
+  }
+  stats->total += ns;
+  stats->n++;
+}
+
+static void stats_print(const char* name, const bench_stats* stats) {
+  if (stats->n == 0) {
+    printf("%-20s: no successful iterations\n", name);
+    return;
+  }
+  printf("%-20s: n=%"PRIu32", min=%"PRIu64" us, avg=%"PRIu64" us, max=%"PRIu64" us\n", name, stats->n,
+         stats->min / 1000, stats->total / stats->n / 1000, stats->max / 1000);
+}
+
+int main(int argc, char** argv) {
+  bench_stats topo = { 0 };
+  bench_stats init = { 0 };
+  raplcap rc;
+  uint64_t start;
+  uint64_t end;
+  uint32_t iterations = DEFAULT_ITERATIONS;
+  uint32_t i;
+  if (argc > 1 && (iterations = (uint32_t) strtoul(argv[1], NULL, 0)) == 0) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for (i = 0; i < iterations; i++) {
+    start = now_ns();
+    if (raplcap_msr_refresh_topology()) {
+      perror("raplcap_msr_refresh_topology");
+      return EXIT_FAILURE;
+    }
+    end = now_ns();
+    stats_add(&topo, end - start);
+  }
+  printf("Packages: %"PRIu32", Die: %"PRIu32"\n", raplcap_get_num_packages(NULL), raplcap_get_num_die(NULL, 0));
+  stats_print("topology discovery", &topo);
+
+  // the topology is now cached, so this measures the remaining init cost (opening MSRs, etc.)
+  for (i = 0; i < iterations; i++) {
+    start = now_ns();
+    if (raplcap_init(&rc)) {
+      perror("raplcap_init");
+      break;
+    }
+    end = now_ns();
+    stats_add(&init, end - start);
+    if (raplcap_destroy(&rc)) {
+      perror("raplcap_destroy");
+    }
+  }
+  stats_print("raplcap_init", &init);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+/**
+ * Topology discovery tests against a fake sysfs CPU directory.
+ */
+// for mkdir
+#define _POSIX_C_SOURCE 200809L
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "../raplcap-msr-sys.h"
+
+static void make_dir(const char* path) {
+  assert(mkdir(path, 0755) == 0 || errno == EEXIST);
+}
+
+static void write_file(const char* path, const char* contents) {
+  FILE* f;
+  assert((f = fopen(path, "w")) != NULL);
+  assert(fputs(contents, f) >= 0);
+  assert(fclose(f) == 0);
+}
+
+static void write_cpu(uint32_t cpu, const char* pkg, const char* die, const char* die_cpus) {
+  char path[512];
+  snprintf(path, sizeof(path), SYSFS_CPU_DIR"/cpu%"PRIu32, cpu);
+  make_dir(path);
+  if (pkg == NULL) {
+    // offline CPUs don't have a topology directory
+    return;
+  }
+  snprintf(path, sizeof(path), SYSFS_CPU_DIR"/cpu%"PRIu32"/topology", cpu);
+  make_dir(path);
+  snprintf(path, sizeof(path), SYSFS_CPU_DIR"/cpu%"PRIu32"/topology/physical_package_id", cpu);
+  write_file(path, pkg);
+  if (die != NULL) {
+    snprintf(path, sizeof(path), SYSFS_CPU_DIR"/cpu%"PRIu32"/topology/die_id", cpu);
+    write_file(path, die);
+    snprintf(path, sizeof(path), SYSFS_CPU_DIR"/cpu%"PRIu32"/topology/die_cpus_list", cpu);
+  } else {
+    snprintf(path, sizeof(path), SYSFS_CPU_DIR"/cpu%"PRIu32"/topology/package_cpus_list", cpu);
+  }
+  write_file(path, die_cpus);
+}
+
+static void assert_topology(uint32_t n_pkg, const uint32_t* n_die) {
+  uint32_t n;
+  uint32_t pkg;
+  assert(msr_sys_refresh_topology() == 0);
+  assert(msr_sys_get_num_pkg(NULL, &n) == 0);
+  assert(n == n_pkg);
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    assert(msr_sys_get_num_die(NULL, pkg, &n) == 0);
+    assert(n == n_die[pkg]);
+  }
+}
+
+int main(void) {
+  static const uint32_t N_DIE[] = { 1, 2 };
+  make_dir(SYSFS_CPU_DIR);
+  // CPU 1 is offline, and CPU 5 is online, but higher than the number of online CPUs
+  write_cpu(0, "0\n", NULL, "0\n");
+  write_cpu(1, NULL, NULL, NULL);
+  write_cpu(2, "1\n", "0\n", "2\n");
+  write_cpu(3, NULL, NULL, NULL);
+  write_cpu(4, NULL, NULL, NULL);
+  write_cpu(5, "1\n", "1\n", "5\n");
+  write_file(SYSFS_CPU_DIR"/online", "0,2,5\n");
+  assert_topology(2, N_DIE);
+
+  // a malformed online list fails, rather than guessing which CPUs are online
+  write_file(SYSFS_CPU_DIR"/online", "0,2-\n");
+  assert(msr_sys_refresh_topology() < 0);
+  return 0;
+}
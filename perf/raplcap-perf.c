@@ -0,0 +1,679 @@
+/**
+ * Implementation that reads energy counters with the perf_event "power" PMU and uses powercap for everything else.
+ *
+ * Each package/die's counters are opened as one perf_event group on the CPU the PMU designates for it, so all of its
+ * zones are read with a single read(2), and without the privileges required to access MSRs.
+ * The kernel accumulates the underlying RAPL counters into 64-bit counts, so they don't roll over in practice.
+ * Zones that the PMU doesn't count fall back on powercap, as do all die of a package if the PMU's scope doesn't match
+ * the package's die topology (e.g., a package-scoped PMU on a multi-die package).
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for syscall
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#include "raplcap.h"
+#include "raplcap-wrappers.h"
+#include "raplcap-common.h"
+#include "raplcap-powercap-delegate.h"
+#include "raplcap-set-all.h"
+
+#define PERF_PMU_DIR "/sys/bus/event_source/devices/power"
+#define SYSFS_CPU_TOPOLOGY_DIR "/sys/devices/system/cpu/cpu%"PRIu32"/topology"
+#define SYSFS_BUF_SIZE 256
+
+// indexed by raplcap_zone
+static const char* const PERF_EVENT_NAMES[RAPLCAP_NZONES] = {
+  "energy-pkg",
+  "energy-cores",
+  "energy-gpu",
+  "energy-ram",
+  "energy-psys"
+};
+
+typedef struct raplcap_perf_pmu {
+  uint32_t type;
+  // indexed by zone
+  uint64_t config[RAPLCAP_NZONES];
+  double scale[RAPLCAP_NZONES];
+  int supported[RAPLCAP_NZONES];
+} raplcap_perf_pmu;
+
+// A CPU in the PMU's cpumask, which counts for one package/die
+typedef struct raplcap_perf_cpu {
+  uint32_t cpu;
+  uint32_t pkg_id;
+  uint32_t die_id;
+} raplcap_perf_cpu;
+
+typedef struct raplcap_perf_event {
+  // Joules per count
+  double scale;
+  // count when energy accumulation was enabled
+  uint64_t baseline;
+  int fd;
+  // index of the event's value in a group read, or -1 if the zone isn't counted by perf
+  int idx;
+  int has_baseline;
+} raplcap_perf_event;
+
+// A package/die's perf_event group, in its own cache line(s)
+typedef struct raplcap_perf_die {
+  // indexed by zone
+  raplcap_perf_event events[RAPLCAP_NZONES];
+  // the group leader, or -1 if perf doesn't count this package/die
+  int leader;
+  uint32_t n_events;
+} RAPLCAP_CACHE_ALIGNED raplcap_perf_die;
+
+typedef struct raplcap_perf {
+  // the powercap context, which provides the topology, limits, and zones that perf doesn't count
+  raplcap pc;
+  // indexed by die_offsets[pkg] + die, allocated contiguously
+  raplcap_perf_die* dies;
+  // n_pkg + 1 elements; die of package pkg are in range [die_offsets[pkg], die_offsets[pkg + 1])
+  uint32_t* die_offsets;
+  uint32_t n_pkg;
+  int acc_enabled;
+  // created by the first raplcap_set_limits_all call that needs it
+  raplcap_set_all_pool* set_all_pool;
+} raplcap_perf;
+
+static raplcap rc_default;
+
+static const raplcap* get_powercap(const raplcap* rc) {
+  const raplcap_perf* state;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  // if not initialized, powercap will report the error (or discover topology without a context)
+  return (state = (const raplcap_perf*) rc->state) == NULL ? rc : &state->pc;
+}
+
+static uint32_t get_n_die(const raplcap_perf* state, uint32_t pkg) {
+  return state->die_offsets[pkg + 1] - state->die_offsets[pkg];
+}
+
+static raplcap_perf_die* get_die(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  const raplcap_perf* state;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  if ((state = (const raplcap_perf*) rc->state) == NULL) {
+    // unfortunately can't detect if the context just contains garbage
+    raplcap_log(ERROR, "Context is not initialized\n");
+    errno = EINVAL;
+    return NULL;
+  }
+  if (pkg >= state->n_pkg) {
+    raplcap_log(ERROR, "Package %"PRIu32" not in range [0, %"PRIu32")\n", pkg, state->n_pkg);
+    errno = EINVAL;
+    return NULL;
+  }
+  if (die >= get_n_die(state, pkg)) {
+    raplcap_log(ERROR, "Die %"PRIu32" not in range [0, %"PRIu32")\n", die, get_n_die(state, pkg));
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((int) zone < 0 || (int) zone >= RAPLCAP_NZONES) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return &state->dies[state->die_offsets[pkg] + die];
+}
+
+// Read a whole sysfs file into buf, stripping any trailing newline
+static int read_sysfs(const char* path, char* buf, size_t len) {
+  ssize_t n;
+  int err_save;
+  int fd;
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    return -1;
+  }
+  n = read(fd, buf, len - 1);
+  err_save = errno;
+  close(fd);
+  if (n < 0) {
+    errno = err_save;
+    return -1;
+  }
+  buf[n] = '\0';
+  if (n > 0 && buf[n - 1] == '\n') {
+    buf[n - 1] = '\0';
+  }
+  return 0;
+}
+
+static int read_sysfs_u32(const char* path, uint32_t* val) {
+  char buf[SYSFS_BUF_SIZE];
+  char* end;
+  unsigned long v;
+  if (read_sysfs(path, buf, sizeof(buf))) {
+    return -1;
+  }
+  errno = 0;
+  v = strtoul(buf, &end, 0);
+  if (end == buf || errno || v > UINT32_MAX) {
+    errno = ENODATA;
+    return -1;
+  }
+  *val = (uint32_t) v;
+  return 0;
+}
+
+// Only a single "event=<value>" term is supported, which is all the power PMU uses
+static int parse_event_config(const char* buf, uint64_t* config) {
+  char* end;
+  if (strncmp(buf, "event=", 6)) {
+    return -1;
+  }
+  *config = strtoull(buf + 6, &end, 0);
+  return (end == buf + 6 || *end != '\0') ? -1 : 0;
+}
+
+static int perf_pmu_init(raplcap_perf_pmu* pmu) {
+  char path[SYSFS_BUF_SIZE];
+  char buf[SYSFS_BUF_SIZE];
+  char* end;
+  int zone;
+  memset(pmu, 0, sizeof(*pmu));
+  if (read_sysfs_u32(PERF_PMU_DIR"/type", &pmu->type)) {
+    raplcap_perror(ERROR, "perf power PMU not available: "PERF_PMU_DIR"/type");
+    errno = ENODEV;
+    return -1;
+  }
+  for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+    // the event file contains a config term like "event=0x02"; zones that aren't counted have no event file
+    snprintf(path, sizeof(path), PERF_PMU_DIR"/events/%s", PERF_EVENT_NAMES[zone]);
+    if (read_sysfs(path, buf, sizeof(buf))) {
+      continue;
+    }
+    if (parse_event_config(buf, &pmu->config[zone])) {
+      raplcap_log(WARN, "Unsupported perf event config for %s: %s\n", PERF_EVENT_NAMES[zone], buf);
+      continue;
+    }
+    snprintf(path, sizeof(path), PERF_PMU_DIR"/events/%s.scale", PERF_EVENT_NAMES[zone]);
+    if (read_sysfs(path, buf, sizeof(buf)) || (pmu->scale[zone] = strtod(buf, &end)) <= 0 || end == buf) {
+      raplcap_log(WARN, "Unsupported perf event scale for %s\n", PERF_EVENT_NAMES[zone]);
+      continue;
+    }
+    pmu->supported[zone] = 1;
+    raplcap_log(DEBUG, "perf_pmu_init: %s: config=0x%"PRIx64", scale=%.17g\n",
+                PERF_EVENT_NAMES[zone], pmu->config[zone], pmu->scale[zone]);
+  }
+  return 0;
+}
+
+static int cmp_perf_cpu_pkg_die(const void* a, const void* b) {
+  const raplcap_perf_cpu* x = (const raplcap_perf_cpu*) a;
+  const raplcap_perf_cpu* y = (const raplcap_perf_cpu*) b;
+  if (x->pkg_id != y->pkg_id) {
+    return x->pkg_id < y->pkg_id ? -1 : 1;
+  }
+  return x->die_id < y->die_id ? -1 : (x->die_id > y->die_id ? 1 : 0);
+}
+
+// Get the CPUs in the PMU's cpumask (e.g., "0,8" or "0-1"), sorted by package and die
+static raplcap_perf_cpu* get_pmu_cpus(uint32_t* n_cpus) {
+  char path[SYSFS_BUF_SIZE];
+  char buf[SYSFS_BUF_SIZE];
+  raplcap_perf_cpu* cpus = NULL;
+  raplcap_perf_cpu* tmp;
+  unsigned long first;
+  unsigned long last;
+  char* s;
+  char* end;
+  uint32_t n = 0;
+  if (read_sysfs(PERF_PMU_DIR"/cpumask", buf, sizeof(buf))) {
+    raplcap_perror(ERROR, "read_sysfs: "PERF_PMU_DIR"/cpumask");
+    return NULL;
+  }
+  for (s = buf; *s != '\0'; s = *end == ',' ? end + 1 : end) {
+    first = strtoul(s, &end, 10);
+    last = *end == '-' ? strtoul(end + 1, &end, 10) : first;
+    if (end == s || last < first || last > UINT32_MAX || (*end != ',' && *end != '\0')) {
+      raplcap_log(ERROR, "Failed to parse perf power PMU cpumask: %s\n", buf);
+      free(cpus);
+      errno = ENODATA;
+      return NULL;
+    }
+    for (; first <= last; first++, n++) {
+      if ((tmp = realloc(cpus, (n + 1) * sizeof(*cpus))) == NULL) {
+        raplcap_perror(ERROR, "get_pmu_cpus: realloc");
+        free(cpus);
+        return NULL;
+      }
+      cpus = tmp;
+      cpus[n].cpu = (uint32_t) first;
+      snprintf(path, sizeof(path), SYSFS_CPU_TOPOLOGY_DIR"/physical_package_id", cpus[n].cpu);
+      if (read_sysfs_u32(path, &cpus[n].pkg_id)) {
+        raplcap_perror(ERROR, path);
+        free(cpus);
+        return NULL;
+      }
+      // die_id doesn't exist on older kernels
+      snprintf(path, sizeof(path), SYSFS_CPU_TOPOLOGY_DIR"/die_id", cpus[n].cpu);
+      if (read_sysfs_u32(path, &cpus[n].die_id)) {
+        cpus[n].die_id = 0;
+      }
+    }
+  }
+  if (n == 0) {
+    raplcap_log(ERROR, "Perf power PMU cpumask is empty\n");
+    errno = ENODEV;
+    return NULL;
+  }
+  qsort(cpus, n, sizeof(*cpus), cmp_perf_cpu_pkg_die);
+  *n_cpus = n;
+  return cpus;
+}
+
+static int perf_event_open_cpu(const raplcap_perf_pmu* pmu, raplcap_zone zone, uint32_t cpu, int group_fd) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = pmu->type;
+  attr.config = pmu->config[zone];
+  attr.read_format = PERF_FORMAT_GROUP;
+  // counting, not sampling, so no need for per-task or privileged options
+  return (int) syscall(SYS_perf_event_open, &attr, -1, (int) cpu, group_fd, 0);
+}
+
+// Open a group on cpu for every zone that both powercap and perf support
+static int perf_die_open(raplcap_perf* state, const raplcap_perf_pmu* pmu, uint32_t pkg, uint32_t die, uint32_t cpu) {
+  raplcap_perf_die* d = &state->dies[state->die_offsets[pkg] + die];
+  raplcap_perf_event* e;
+  int zone;
+  for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+    if (!pmu->supported[zone] ||
+        raplcap_powercap_pd_is_zone_supported(&state->pc, pkg, die, (raplcap_zone) zone) <= 0) {
+      continue;
+    }
+    e = &d->events[zone];
+    if ((e->fd = perf_event_open_cpu(pmu, (raplcap_zone) zone, cpu, d->leader)) < 0) {
+      raplcap_perror(ERROR, "perf_event_open");
+      return -1;
+    }
+    if (d->leader < 0) {
+      d->leader = e->fd;
+    }
+    e->scale = pmu->scale[zone];
+    e->idx = (int) d->n_events++;
+  }
+  raplcap_log(DEBUG, "perf_die_open: pkg=%"PRIu32", die=%"PRIu32", cpu=%"PRIu32", n_events=%"PRIu32"\n",
+              pkg, die, cpu, d->n_events);
+  return 0;
+}
+
+static int perf_open_all(raplcap_perf* state) {
+  raplcap_perf_pmu pmu;
+  raplcap_perf_cpu* cpus;
+  uint32_t n_cpus;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t i;
+  uint32_t j;
+  int ret = 0;
+  if (perf_pmu_init(&pmu) || (cpus = get_pmu_cpus(&n_cpus)) == NULL) {
+    return -1;
+  }
+  // packages are indexed in order of their physical IDs, and die in order of their IDs within a package
+  for (pkg = 0, i = 0; i < n_cpus && !ret; pkg++, i = j) {
+    for (j = i + 1; j < n_cpus && cpus[j].pkg_id == cpus[i].pkg_id; j++) {
+      // j is the first CPU of the next package
+    }
+    if (pkg >= state->n_pkg) {
+      raplcap_log(ERROR, "Perf power PMU has more packages than powercap: %"PRIu32"\n", state->n_pkg);
+      errno = ENODEV;
+      ret = -1;
+    } else if (j - i != get_n_die(state, pkg)) {
+      raplcap_log(WARN, "Perf power PMU counts %"PRIu32" domain(s) for package %"PRIu32" with %"PRIu32
+                  " die, using powercap for its energy counters\n", j - i, pkg, get_n_die(state, pkg));
+    } else {
+      for (die = 0; die < j - i && !ret; die++) {
+        ret = perf_die_open(state, &pmu, pkg, die, cpus[i + die].cpu);
+      }
+    }
+  }
+  free(cpus);
+  return ret;
+}
+
+// PERF_FORMAT_GROUP without other read_format flags is: { u64 nr; u64 values[nr]; }
+static int perf_die_read(const raplcap_perf_die* d, uint64_t* counts) {
+  uint64_t buf[RAPLCAP_NZONES + 1];
+  ssize_t n;
+  if ((n = read(d->leader, buf, sizeof(buf))) < 0) {
+    raplcap_perror(ERROR, "perf_die_read: read");
+    return -1;
+  }
+  if ((size_t) n < (d->n_events + 1) * sizeof(uint64_t) || buf[0] != d->n_events) {
+    raplcap_log(ERROR, "perf_die_read: Unexpected group read size: %zd\n", n);
+    errno = EIO;
+    return -1;
+  }
+  memcpy(counts, &buf[1], d->n_events * sizeof(*counts));
+  return 0;
+}
+
+int raplcap_init(raplcap* rc) {
+  raplcap_perf* state;
+  void* dies;
+  uint32_t pkg;
+  uint32_t i;
+  int zone;
+  int err_save;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  if ((state = calloc(1, sizeof(*state))) == NULL) {
+    return -1;
+  }
+  if (raplcap_powercap_init(&state->pc)) {
+    err_save = errno;
+    free(state);
+    errno = err_save;
+    return -1;
+  }
+  state->n_pkg = raplcap_powercap_get_num_packages(&state->pc);
+  if ((state->die_offsets = malloc((state->n_pkg + 1) * sizeof(*state->die_offsets))) == NULL) {
+    err_save = errno;
+    raplcap_powercap_destroy(&state->pc);
+    free(state);
+    errno = err_save;
+    return -1;
+  }
+  for (pkg = 0, state->die_offsets[0] = 0; pkg < state->n_pkg; pkg++) {
+    state->die_offsets[pkg + 1] = state->die_offsets[pkg] + raplcap_powercap_get_num_die(&state->pc, pkg);
+  }
+  if ((errno = posix_memalign(&dies, RAPLCAP_CACHE_LINE_SIZE,
+                              state->die_offsets[state->n_pkg] * sizeof(*state->dies))) != 0) {
+    err_save = errno;
+    raplcap_powercap_destroy(&state->pc);
+    free(state->die_offsets);
+    free(state);
+    errno = err_save;
+    return -1;
+  }
+  state->dies = dies;
+  memset(state->dies, 0, state->die_offsets[state->n_pkg] * sizeof(*state->dies));
+  for (i = 0; i < state->die_offsets[state->n_pkg]; i++) {
+    state->dies[i].leader = -1;
+    for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+      state->dies[i].events[zone].fd = -1;
+      state->dies[i].events[zone].idx = -1;
+    }
+  }
+  rc->state = state;
+  rc->nsockets = state->n_pkg;
+  if (perf_open_all(state)) {
+    err_save = errno;
+    raplcap_destroy(rc);
+    errno = err_save;
+    return -1;
+  }
+  raplcap_log(DEBUG, "raplcap_init: Initialized\n");
+  return 0;
+}
+
+int raplcap_destroy(raplcap* rc) {
+  raplcap_perf* state;
+  uint32_t i;
+  int zone;
+  int err_save = 0;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  if ((state = (raplcap_perf*) rc->state) != NULL) {
+    // before the state its workers use is freed
+    raplcap_set_all_pool_destroy(state->set_all_pool);
+    for (i = 0; i < state->die_offsets[state->n_pkg]; i++) {
+      // close group members before their leader
+      for (zone = RAPLCAP_NZONES - 1; zone >= 0; zone--) {
+        if (state->dies[i].events[zone].fd >= 0 && close(state->dies[i].events[zone].fd)) {
+          raplcap_perror(WARN, "raplcap_destroy: close");
+          err_save = errno;
+        }
+      }
+    }
+    if (raplcap_powercap_destroy(&state->pc)) {
+      err_save = errno;
+    }
+    free(state->dies);
+    free(state->die_offsets);
+    free(state);
+    rc->state = NULL;
+  }
+  rc->nsockets = 0;
+  raplcap_log(DEBUG, "raplcap_destroy: Destroyed\n");
+  errno = err_save;
+  return err_save ? -1 : 0;
+}
+
+raplcap_set_all_pool** raplcap_get_set_all_pool(const raplcap* rc) {
+  raplcap_perf* state;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  return (state = (raplcap_perf*) rc->state) == NULL ? NULL : &state->set_all_pool;
+}
+
+uint32_t raplcap_get_num_packages(const raplcap* rc) {
+  return raplcap_powercap_get_num_packages(get_powercap(rc));
+}
+
+uint32_t raplcap_get_num_die(const raplcap* rc, uint32_t pkg) {
+  return raplcap_powercap_get_num_die(get_powercap(rc), pkg);
+}
+
+int raplcap_pd_is_zone_supported(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  return raplcap_powercap_pd_is_zone_supported(get_powercap(rc), pkg, die, zone);
+}
+
+int raplcap_pd_is_constraint_supported(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                       raplcap_constraint constraint) {
+  return raplcap_powercap_pd_is_constraint_supported(get_powercap(rc), pkg, die, zone, constraint);
+}
+
+int raplcap_pd_is_zone_enabled(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  return raplcap_powercap_pd_is_zone_enabled(get_powercap(rc), pkg, die, zone);
+}
+
+int raplcap_pd_set_zone_enabled(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone, int enabled) {
+  return raplcap_powercap_pd_set_zone_enabled(get_powercap(rc), pkg, die, zone, enabled);
+}
+
+int raplcap_pd_get_limits(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                          raplcap_limit* limit_long, raplcap_limit* limit_short) {
+  return raplcap_powercap_pd_get_limits(get_powercap(rc), pkg, die, zone, limit_long, limit_short);
+}
+
+int raplcap_pd_set_limits(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                          const raplcap_limit* limit_long, const raplcap_limit* limit_short) {
+  return raplcap_powercap_pd_set_limits(get_powercap(rc), pkg, die, zone, limit_long, limit_short);
+}
+
+int raplcap_pd_get_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                         raplcap_constraint constraint, raplcap_limit* limit) {
+  return raplcap_powercap_pd_get_limit(get_powercap(rc), pkg, die, zone, constraint, limit);
+}
+
+int raplcap_pd_set_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                         raplcap_constraint constraint, const raplcap_limit* limit) {
+  return raplcap_powercap_pd_set_limit(get_powercap(rc), pkg, die, zone, constraint, limit);
+}
+
+int raplcap_pd_get_zone_states(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone_state* states,
+                               uint32_t len) {
+  return raplcap_powercap_pd_get_zone_states(get_powercap(rc), pkg, die, states, len);
+}
+
+double raplcap_pd_get_energy_counter(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  uint64_t counts[RAPLCAP_NZONES];
+  const raplcap_perf_die* d;
+  const raplcap_perf_event* e;
+  if ((d = get_die(rc, pkg, die, zone)) == NULL) {
+    return -1;
+  }
+  e = &d->events[zone];
+  if (e->idx < 0) {
+    return raplcap_powercap_pd_get_energy_counter(get_powercap(rc), pkg, die, zone);
+  }
+  if (perf_die_read(d, counts)) {
+    return -1;
+  }
+  raplcap_log(DEBUG, "raplcap_pd_get_energy_counter: pkg=%"PRIu32", die=%"PRIu32", zone=%d, count=%"PRIu64"\n",
+              pkg, die, zone, counts[e->idx]);
+  return (double) counts[e->idx] * e->scale;
+}
+
+double raplcap_pd_get_energy_counter_max(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  const raplcap_perf_die* d;
+  const raplcap_perf_event* e;
+  if ((d = get_die(rc, pkg, die, zone)) == NULL) {
+    return -1;
+  }
+  e = &d->events[zone];
+  if (e->idx < 0) {
+    return raplcap_powercap_pd_get_energy_counter_max(get_powercap(rc), pkg, die, zone);
+  }
+  // perf counts are 64 bits
+  return (double) UINT64_MAX * e->scale;
+}
+
+int raplcap_get_energy_snapshot(const raplcap* rc, double* joules, uint32_t len) {
+  uint64_t counts[RAPLCAP_NZONES];
+  const raplcap_perf* state;
+  const raplcap_perf_die* d;
+  const raplcap_perf_event* e;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t i;
+  int zone;
+  int err;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  raplcap_log(DEBUG, "raplcap_get_energy_snapshot: len=%"PRIu32"\n", len);
+  if ((state = (const raplcap_perf*) rc->state) == NULL) {
+    raplcap_log(ERROR, "Context is not initialized\n");
+    errno = EINVAL;
+    return -1;
+  }
+  if (joules == NULL) {
+    return (int) (state->die_offsets[state->n_pkg] * RAPLCAP_NZONES);
+  }
+  if (len < state->die_offsets[state->n_pkg] * RAPLCAP_NZONES) {
+    raplcap_log(ERROR, "Snapshot length %"PRIu32" is less than required length %"PRIu32"\n",
+                len, state->die_offsets[state->n_pkg] * RAPLCAP_NZONES);
+    errno = EINVAL;
+    return -1;
+  }
+  // one group read per package/die, falling back on powercap only for zones that perf doesn't count
+  for (pkg = 0, i = 0; pkg < state->n_pkg; pkg++) {
+    for (die = 0; die < get_n_die(state, pkg); die++) {
+      d = &state->dies[state->die_offsets[pkg] + die];
+      err = d->leader < 0 || perf_die_read(d, counts);
+      for (zone = 0; zone < RAPLCAP_NZONES; zone++, i++) {
+        e = &d->events[zone];
+        if (e->idx < 0) {
+          if ((joules[i] = raplcap_powercap_pd_get_energy_counter(&state->pc, pkg, die, (raplcap_zone) zone)) < 0) {
+            joules[i] = -1;
+          }
+        } else {
+          joules[i] = err ? -1 : (double) counts[e->idx] * e->scale;
+        }
+      }
+    }
+  }
+  return (int) i;
+}
+
+int raplcap_set_energy_accumulation(const raplcap* rc, int enabled) {
+  uint64_t counts[RAPLCAP_NZONES];
+  raplcap_perf* state;
+  raplcap_perf_die* d;
+  uint32_t i;
+  int zone;
+  int err;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  raplcap_log(DEBUG, "raplcap_set_energy_accumulation: enabled=%d\n", enabled);
+  if ((state = (raplcap_perf*) rc->state) == NULL) {
+    raplcap_log(ERROR, "Context is not initialized\n");
+    errno = EINVAL;
+    return -1;
+  }
+  // zones that perf doesn't count are accumulated by powercap
+  if (raplcap_powercap_set_energy_accumulation(&state->pc, enabled)) {
+    return -1;
+  }
+  if (!enabled || state->acc_enabled) {
+    state->acc_enabled = enabled;
+    return 0;
+  }
+  state->acc_enabled = 1;
+  // record baselines - perf counts don't roll over, so there's nothing to update until they're read
+  for (i = 0; i < state->die_offsets[state->n_pkg]; i++) {
+    d = &state->dies[i];
+    err = d->leader < 0 || perf_die_read(d, counts);
+    for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+      if (d->events[zone].idx >= 0) {
+        d->events[zone].has_baseline = !err;
+        d->events[zone].baseline = err ? 0 : counts[d->events[zone].idx];
+      }
+    }
+  }
+  return 0;
+}
+
+double raplcap_pd_get_energy_accumulated(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  uint64_t counts[RAPLCAP_NZONES];
+  const raplcap_perf* state;
+  const raplcap_perf_die* d;
+  const raplcap_perf_event* e;
+  raplcap_log(DEBUG, "raplcap_pd_get_energy_accumulated: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
+  if ((d = get_die(rc, pkg, die, zone)) == NULL) {
+    return -1;
+  }
+  e = &d->events[zone];
+  if (e->idx < 0) {
+    return raplcap_powercap_pd_get_energy_accumulated(get_powercap(rc), pkg, die, zone);
+  }
+  state = (const raplcap_perf*) (rc == NULL ? &rc_default : rc)->state;
+  if (!state->acc_enabled) {
+    raplcap_log(ERROR, "Energy accumulation is not enabled\n");
+    errno = EINVAL;
+    return -1;
+  }
+  if (!e->has_baseline) {
+    // counter wasn't available when accumulation was enabled
+    errno = ENODATA;
+    return -1;
+  }
+  if (perf_die_read(d, counts)) {
+    return -1;
+  }
+  return (double) (counts[e->idx] - e->baseline) * e->scale;
+}
+
+int raplcap_txn_commit(raplcap_txn* txn) {
+  if (txn == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  // committing releases the txn, so it's safe to retarget it
+  txn->rc = get_powercap(txn->rc);
+  return raplcap_powercap_txn_commit(txn);
+}
@@ -6,6 +6,8 @@
  * @author Connor Imes
  * @date 2016-05-12
  */
+// for pread
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -37,6 +39,8 @@
 // psys can be both a complete name or a prefix
 #define ZONE_NAME_PSYS "psys"
 
+#define U64_BUF_SIZE POWERCAP_INTEL_RAPL_U64_BUF_SIZE
+
 
 // like open(2), but returns 0 on ENOENT (No such file or directory)
 static int maybe_open_zone_file(powercap_zone* pz, const char* ct_name, const uint32_t* zones, uint32_t depth,
@@ -52,16 +56,26 @@ static int maybe_open_constraint_file(powercap_constraint* pc, const char* ct_na
   return (fd < 0 && errno == ENOENT) ? 0 : fd;
 }
 
+// special case for energy_uj - it's allowed to be either RW or RO
+static int energy_uj_open(powercap_zone* pz, const char* ct_name, const uint32_t* zones, uint32_t depth, int ro) {
+  if (maybe_open_zone_file(pz, ct_name, zones, depth, POWERCAP_ZONE_FILE_ENERGY_UJ, ro ? O_RDONLY : O_RDWR) >= 0 ||
+      (!ro && maybe_open_zone_file(pz, ct_name, zones, depth, POWERCAP_ZONE_FILE_ENERGY_UJ, O_RDONLY) >= 0)) {
+    return 0;
+  }
+#ifdef RAPLCAP_POWERCAP_DELEGATE
+  // energy counters are read by another implementation, so tolerate energy_uj being restricted to privileged users
+  if (errno == EACCES) {
+    raplcap_log(DEBUG, "energy_uj is not accessible, continuing without it\n");
+    return 0;
+  }
+#endif
+  return -1;
+}
+
 static int powercap_zone_open(powercap_zone* pz, const char* ct_name, const uint32_t* zones, uint32_t depth, int ro) {
   return maybe_open_zone_file(pz, ct_name, zones, depth,
                               POWERCAP_ZONE_FILE_MAX_ENERGY_RANGE_UJ, O_RDONLY) < 0 ||
-         // special case for energy_uj - it's allowed to be either RW or RO
-         (
-          maybe_open_zone_file(pz, ct_name, zones, depth,
-                               POWERCAP_ZONE_FILE_ENERGY_UJ, ro ? O_RDONLY : O_RDWR) < 0 &&
-          (ro || maybe_open_zone_file(pz, ct_name, zones, depth,
-                                      POWERCAP_ZONE_FILE_ENERGY_UJ, O_RDONLY) < 0)
-         ) ||
+         energy_uj_open(pz, ct_name, zones, depth, ro) ||
          maybe_open_zone_file(pz, ct_name, zones, depth,
                               POWERCAP_ZONE_FILE_MAX_POWER_RANGE_UW, O_RDONLY) < 0 ||
          maybe_open_zone_file(pz, ct_name, zones, depth,
@@ -92,6 +106,42 @@ static int powercap_constraint_open(powercap_constraint* pc, const char* ct_name
          ? -1 : 0;
 }
 
+// Parse without stdio or locale overhead
+int powercap_intel_rapl_parse_u64(const char* buf, size_t len, uint64_t* val) {
+  size_t i;
+  uint64_t v = 0;
+  uint64_t d;
+  for (i = 0; i < len && buf[i] >= '0' && buf[i] <= '9'; i++) {
+    d = (uint64_t) (buf[i] - '0');
+    if (v > (UINT64_MAX - d) / 10) {
+      errno = ERANGE;
+      return -1;
+    }
+    v = (v * 10) + d;
+  }
+  // require at least one digit, and that the value isn't truncated
+  if (i == 0 || i == U64_BUF_SIZE) {
+    errno = ENODATA;
+    return -1;
+  }
+  *val = v;
+  return 0;
+}
+
+// Read a uint64_t from the start of an open sysfs file with a single pread
+static int read_u64(int fd, uint64_t* val) {
+  char buf[U64_BUF_SIZE];
+  ssize_t n;
+  if (fd <= 0) {
+    errno = ENOSYS;
+    return -1;
+  }
+  if ((n = pread(fd, buf, sizeof(buf), 0)) < 0) {
+    return -1;
+  }
+  return powercap_intel_rapl_parse_u64(buf, (size_t) n, val);
+}
+
 static int powercap_close(int fd) {
   return (fd > 0 && close(fd)) ? -1 : 0;
 }
@@ -377,20 +427,26 @@ int powercap_intel_rapl_set_enabled(const powercap_intel_rapl_parent* parent, ra
 int powercap_intel_rapl_get_max_energy_range_uj(const powercap_intel_rapl_parent* parent, raplcap_zone zone, uint64_t* val) {
   assert(parent);
   assert((int) zone >= 0 && (int) zone < RAPLCAP_NZONES);
-  return powercap_zone_get_max_energy_range_uj(&parent->zones[zone].zone, val);
+  return read_u64(parent->zones[zone].zone.max_energy_range_uj, val);
 }
 
 int powercap_intel_rapl_get_energy_uj(const powercap_intel_rapl_parent* parent, raplcap_zone zone, uint64_t* val) {
   assert(parent);
   assert((int) zone >= 0 && (int) zone < RAPLCAP_NZONES);
-  return powercap_zone_get_energy_uj(&parent->zones[zone].zone, val);
+  return read_u64(parent->zones[zone].zone.energy_uj, val);
+}
+
+int powercap_intel_rapl_get_energy_uj_fd(const powercap_intel_rapl_parent* parent, raplcap_zone zone) {
+  assert(parent);
+  assert((int) zone >= 0 && (int) zone < RAPLCAP_NZONES);
+  return parent->zones[zone].zone.energy_uj > 0 ? parent->zones[zone].zone.energy_uj : -1;
 }
 
 int powercap_intel_rapl_get_power_limit_uw(const powercap_intel_rapl_parent* parent, raplcap_zone zone, raplcap_constraint constraint, uint64_t* val) {
   assert(parent);
   assert((int) zone >= 0 && (int) zone < RAPLCAP_NZONES);
   assert((int) constraint >= 0 && (int) constraint < RAPLCAP_NCONSTRAINTS);
-  return powercap_constraint_get_power_limit_uw(&parent->zones[zone].constraints[constraint], val);
+  return read_u64(parent->zones[zone].constraints[constraint].power_limit_uw, val);
 }
 
 int powercap_intel_rapl_set_power_limit_uw(const powercap_intel_rapl_parent* parent, raplcap_zone zone, raplcap_constraint constraint, uint64_t val) {
@@ -404,7 +460,7 @@ int powercap_intel_rapl_get_time_window_us(const powercap_intel_rapl_parent* par
   assert(parent);
   assert((int) zone >= 0 && (int) zone < RAPLCAP_NZONES);
   assert((int) constraint >= 0 && (int) constraint < RAPLCAP_NCONSTRAINTS);
-  return powercap_constraint_get_time_window_us(&parent->zones[zone].constraints[constraint], val);
+  return read_u64(parent->zones[zone].constraints[constraint].time_window_us, val);
 }
 
 int powercap_intel_rapl_set_time_window_us(const powercap_intel_rapl_parent* parent, raplcap_zone zone, raplcap_constraint constraint, uint64_t val) {
@@ -5,6 +5,7 @@
  * Note that not all RAPL zones support all constraints.
  * Unless otherwise stated, all functions return 0 on success or a negative value on error.
  *
+ * Getters for numeric values use the file descriptors opened at initialization and read with a single pread(2).
  * Setter functions do not verify that written values are accepted by RAPL.
  * These operations do basic I/O - it may reasonably be expected that callers need to handle I/O errors.
  *
@@ -29,6 +30,9 @@ extern "C" {
 
 #pragma GCC visibility push(hidden)
 
+// enough for UINT64_MAX and a newline
+#define POWERCAP_INTEL_RAPL_U64_BUF_SIZE 24
+
 /**
  * Files for each zone.
  */
@@ -104,6 +108,17 @@ int powercap_intel_rapl_get_max_energy_range_uj(const powercap_intel_rapl_parent
  */
 int powercap_intel_rapl_get_energy_uj(const powercap_intel_rapl_parent* parent, raplcap_zone zone, uint64_t* val);
 
+/**
+ * Get the file descriptor of the current energy, for callers that batch reads, or -1 if it isn't open.
+ * Values read from it must be parsed with powercap_intel_rapl_parse_u64.
+ */
+int powercap_intel_rapl_get_energy_uj_fd(const powercap_intel_rapl_parent* parent, raplcap_zone zone);
+
+/**
+ * Parse a value read from the start of a numeric file, using a buffer of POWERCAP_INTEL_RAPL_U64_BUF_SIZE bytes.
+ */
+int powercap_intel_rapl_parse_u64(const char* buf, size_t len, uint64_t* val);
+
 /**
  * Get the power limit in microwatts.
  */
@@ -0,0 +1,76 @@
+/**
+ * The powercap implementation built for use inside another implementation.
+ * When compiled with RAPLCAP_POWERCAP_DELEGATE defined, raplcap-powercap.c defines these prefixed functions instead of
+ * the public raplcap.h API, so that the other implementation can own the public API and forward to them.
+ * Contexts passed to these functions are powercap contexts, not the other implementation's.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#ifndef _RAPLCAP_POWERCAP_DELEGATE_H_
+#define _RAPLCAP_POWERCAP_DELEGATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "raplcap.h"
+
+#pragma GCC visibility push(hidden)
+
+int raplcap_powercap_init(raplcap* rc);
+
+int raplcap_powercap_destroy(raplcap* rc);
+
+uint32_t raplcap_powercap_get_num_packages(const raplcap* rc);
+
+uint32_t raplcap_powercap_get_num_die(const raplcap* rc, uint32_t pkg);
+
+int raplcap_powercap_pd_is_zone_supported(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone);
+
+int raplcap_powercap_pd_is_constraint_supported(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                                raplcap_constraint constraint);
+
+int raplcap_powercap_pd_is_zone_enabled(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone);
+
+int raplcap_powercap_pd_set_zone_enabled(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                         int enabled);
+
+int raplcap_powercap_pd_get_limits(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                   raplcap_limit* limit_long, raplcap_limit* limit_short);
+
+int raplcap_powercap_pd_set_limits(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                   const raplcap_limit* limit_long, const raplcap_limit* limit_short);
+
+int raplcap_powercap_pd_get_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                  raplcap_constraint constraint, raplcap_limit* limit);
+
+int raplcap_powercap_pd_set_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                  raplcap_constraint constraint, const raplcap_limit* limit);
+
+int raplcap_powercap_pd_get_zone_states(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone_state* states,
+                                        uint32_t len);
+
+double raplcap_powercap_pd_get_energy_counter(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone);
+
+double raplcap_powercap_pd_get_energy_counter_max(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone);
+
+int raplcap_powercap_get_energy_snapshot(const raplcap* rc, double* joules, uint32_t len);
+
+int raplcap_powercap_set_energy_accumulation(const raplcap* rc, int enabled);
+
+double raplcap_powercap_pd_get_energy_accumulated(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone);
+
+/**
+ * The txn's context must be a powercap context.
+ */
+int raplcap_powercap_txn_commit(raplcap_txn* txn);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,10 +4,13 @@
  * @author Connor Imes
  * @date 2016-05-13
  */
+// for posix_memalign, pthread
+#define _POSIX_C_SOURCE 200112L
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 // powercap headers
@@ -15,10 +18,37 @@
 #include <powercap-sysfs.h>
 
 #include "raplcap.h"
-#include "raplcap-wrappers.h"
 #include "raplcap-common.h"
+#include "raplcap-set-all.h"
+#include "raplcap-uring.h"
 #include "powercap-intel-rapl.h"
 
+#ifdef RAPLCAP_POWERCAP_DELEGATE
+// another implementation owns the public API
+#include "raplcap-powercap-delegate.h"
+#define raplcap_init raplcap_powercap_init
+#define raplcap_destroy raplcap_powercap_destroy
+#define raplcap_get_num_packages raplcap_powercap_get_num_packages
+#define raplcap_get_num_die raplcap_powercap_get_num_die
+#define raplcap_pd_is_zone_supported raplcap_powercap_pd_is_zone_supported
+#define raplcap_pd_is_constraint_supported raplcap_powercap_pd_is_constraint_supported
+#define raplcap_pd_is_zone_enabled raplcap_powercap_pd_is_zone_enabled
+#define raplcap_pd_set_zone_enabled raplcap_powercap_pd_set_zone_enabled
+#define raplcap_pd_get_limits raplcap_powercap_pd_get_limits
+#define raplcap_pd_set_limits raplcap_powercap_pd_set_limits
+#define raplcap_pd_get_limit raplcap_powercap_pd_get_limit
+#define raplcap_pd_set_limit raplcap_powercap_pd_set_limit
+#define raplcap_pd_get_zone_states raplcap_powercap_pd_get_zone_states
+#define raplcap_pd_get_energy_counter raplcap_powercap_pd_get_energy_counter
+#define raplcap_pd_get_energy_counter_max raplcap_powercap_pd_get_energy_counter_max
+#define raplcap_get_energy_snapshot raplcap_powercap_get_energy_snapshot
+#define raplcap_set_energy_accumulation raplcap_powercap_set_energy_accumulation
+#define raplcap_pd_get_energy_accumulated raplcap_powercap_pd_get_energy_accumulated
+#define raplcap_txn_commit raplcap_powercap_txn_commit
+#else
+#include "raplcap-wrappers.h"
+#endif
+
 #define CONTROL_TYPE "intel-rapl"
 #define ZONE_NAME_MAX_SIZE 64
 #define ZONE_NAME_PREFIX_PACKAGE "package-"
@@ -32,18 +62,42 @@ typedef struct raplcap_powercap_parent {
   uint32_t die;
 } raplcap_powercap_parent;
 
+// Parent zones and state that's written at runtime for a package/die, in its own cache line(s)
+typedef struct raplcap_powercap_die {
+  raplcap_powercap_parent* pkg_zone;
+  // only set for die 0
+  raplcap_powercap_parent* psys_zone;
+  // indexed by zone; only used while energy accumulation is enabled
+  raplcap_energy_acc acc[RAPLCAP_NZONES];
+  // serializes energy reads while accumulating, so accumulators are updated in the order counters are read
+  pthread_mutex_t acc_lock;
+} RAPLCAP_CACHE_ALIGNED raplcap_powercap_die;
+
 typedef struct raplcap_powercap {
   raplcap_powercap_parent* parent_zones;
-  raplcap_powercap_parent** pkg_zones;
-  raplcap_powercap_parent** psys_zones;
+  // indexed by die_offsets[pkg] + die, allocated contiguously
+  raplcap_powercap_die* dies;
+  // n_pkg + 1 elements; die counts may differ between packages, so die of package pkg are in range
+  // [die_offsets[pkg], die_offsets[pkg + 1])
+  uint32_t* die_offsets;
   uint32_t n_parent_zones;
   uint32_t n_pkg;
-  // currently only support homogeneous die count per package
-  uint32_t n_die;
+  int acc_enabled;
+  // reads every supported energy_uj file in one batch, or NULL to read them one at a time
+  raplcap_uring* uring;
+  // the snapshot index of each read in the batch
+  uint32_t* uring_idxs;
+  uint32_t n_uring;
+  // created by the first raplcap_set_limits_all call that needs it
+  raplcap_set_all_pool* set_all_pool;
 } raplcap_powercap;
 
 static raplcap rc_default;
 
+static uint32_t get_n_die(const raplcap_powercap* state, uint32_t pkg) {
+  return state->die_offsets[pkg + 1] - state->die_offsets[pkg];
+}
+
 static powercap_intel_rapl_parent* get_parent_zone(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
   raplcap_powercap* state;
   raplcap_powercap_parent* p = NULL;
@@ -61,8 +115,8 @@ static powercap_intel_rapl_parent* get_parent_zone(const raplcap* rc, uint32_t p
     errno = EINVAL;
     return NULL;
   }
-  if (die >= state->n_die) {
-    raplcap_log(ERROR, "Die %"PRIu32" not in range [0, %"PRIu32")\n", die, state->n_die);
+  if (die >= get_n_die(state, pkg)) {
+    raplcap_log(ERROR, "Die %"PRIu32" not in range [0, %"PRIu32")\n", die, get_n_die(state, pkg));
     errno = EINVAL;
     return NULL;
   }
@@ -72,13 +126,11 @@ static powercap_intel_rapl_parent* get_parent_zone(const raplcap* rc, uint32_t p
   }
   if (zone == RAPLCAP_ZONE_PSYS) {
     // powercap control type doesn't specify die values for PSYS zones, so we assume die must be 0
-    if (die == 0) {
-      p = state->psys_zones[pkg];
-    }
+    p = state->dies[state->die_offsets[pkg] + die].psys_zone;
     // if p is still NULL, fall through and later code will (correctly) fail to find PSYS within the regular parent zone
   }
   if (p == NULL) {
-    p = state->pkg_zones[(pkg * state->n_die) + die];
+    p = state->dies[state->die_offsets[pkg] + die].pkg_zone;
   }
   if (p == NULL) {
     // the requested package/die was in range, but the zone was not detected in sysfs
@@ -88,14 +140,52 @@ static powercap_intel_rapl_parent* get_parent_zone(const raplcap* rc, uint32_t p
   return &p->p;
 }
 
-static int get_topology(uint32_t *n_parent_zones, uint32_t* n_pkg, uint32_t* n_die) {
+// Returns the updated accumulator, or NULL if energy accumulation is not enabled
+static const raplcap_energy_acc* energy_acc_update(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                                                   uint64_t uj) {
+  const raplcap_powercap* state;
+  raplcap_energy_acc* acc;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  if ((state = (raplcap_powercap*) rc->state) == NULL || !state->acc_enabled) {
+    return NULL;
+  }
+  acc = &state->dies[state->die_offsets[pkg] + die].acc[zone];
+  raplcap_energy_acc_update(acc, uj);
+  return acc;
+}
+
+// Returns the locked mutex, or NULL if energy accumulation is not enabled (and no lock is needed)
+static pthread_mutex_t* lock_die_acc(const raplcap* rc, uint32_t pkg, uint32_t die) {
+  raplcap_powercap* state;
+  pthread_mutex_t* lock;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  if ((state = (raplcap_powercap*) rc->state) == NULL || !state->acc_enabled) {
+    return NULL;
+  }
+  lock = &state->dies[state->die_offsets[pkg] + die].acc_lock;
+  pthread_mutex_lock(lock);
+  return lock;
+}
+
+static void unlock_die_acc(pthread_mutex_t* lock) {
+  if (lock != NULL) {
+    pthread_mutex_unlock(lock);
+  }
+}
+
+// Also counts the die in package pkg_die, since die counts may differ between packages
+static int get_topology(uint32_t *n_parent_zones, uint32_t* n_pkg, uint32_t pkg_die, uint32_t* n_die) {
   char name[ZONE_NAME_MAX_SIZE];
   char* endptr;
   char* endptr2;
   uint32_t pkg;
   uint32_t die;
   uint32_t max_pkg_id = 0;
-  uint32_t max_die_id = 0;
+  *n_die = 0;
   // package and die IDs can appear in any order
   for (*n_parent_zones = 0; !powercap_sysfs_zone_exists(CONTROL_TYPE, n_parent_zones, 1); (*n_parent_zones)++) {
     if (powercap_sysfs_zone_get_name(CONTROL_TYPE, n_parent_zones, 1, name, sizeof(name)) < 0) {
@@ -116,6 +206,10 @@ static int get_topology(uint32_t *n_parent_zones, uint32_t* n_pkg, uint32_t* n_d
     if (max_pkg_id < pkg) {
       max_pkg_id = pkg;
     }
+    if (pkg == pkg_die) {
+      // zone names are unique, so each is a different die
+      (*n_die)++;
+    }
     if (*endptr == '\0') {
       // the string format is package-X, which implies die = 0
       continue;
@@ -129,9 +223,6 @@ static int get_topology(uint32_t *n_parent_zones, uint32_t* n_pkg, uint32_t* n_d
         errno = EINVAL;
         return -1;
       }
-      if (max_die_id < die) {
-        max_die_id = die;
-      }
     } else {
       raplcap_log(ERROR, "Unsupported zone name format: %s\n", name);
       errno = EINVAL;
@@ -143,9 +234,8 @@ static int get_topology(uint32_t *n_parent_zones, uint32_t* n_pkg, uint32_t* n_d
     return -1;
   }
   *n_pkg = max_pkg_id + 1;
-  *n_die = max_die_id + 1;
-  raplcap_log(DEBUG, "get_topology: n_parent_zones=%"PRIu32", n_pkg=%"PRIu32", n_die=%"PRIu32"\n",
-              *n_parent_zones, *n_pkg, *n_die);
+  raplcap_log(DEBUG, "get_topology: n_parent_zones=%"PRIu32", n_pkg=%"PRIu32", pkg=%"PRIu32", n_die=%"PRIu32"\n",
+              *n_parent_zones, *n_pkg, pkg_die, *n_die);
   return 0;
 }
 
@@ -221,21 +311,154 @@ static int raplcap_powercap_parent_init(raplcap_powercap_parent* rp, uint32_t id
   return 0;
 }
 
+static int cmp_parent_zone_pkg_die(const void* a, const void* b) {
+  const raplcap_powercap_parent* pa = *((raplcap_powercap_parent* const*) a);
+  const raplcap_powercap_parent* pb = *((raplcap_powercap_parent* const*) b);
+  if (pa->pkg != pb->pkg) {
+    return pa->pkg > pb->pkg ? 1 : -1;
+  }
+  return pa->die > pb->die ? 1 : (pa->die < pb->die ? -1 : 0);
+}
+
+// Parent zones in sysfs may be out of order - index by type, package, and die
+// Die IDs may not be contiguous within a package, or the same across packages, so die are indexed compactly
+static int index_parent_zones(raplcap_powercap* state) {
+  raplcap_powercap_parent** pkg_zones;
+  raplcap_powercap_parent* rp;
+  void* dies;
+  uint32_t n_pkg_zones = 0;
+  uint32_t n_dies = 0;
+  uint32_t pkg;
+  uint32_t i;
+  if ((pkg_zones = malloc(state->n_parent_zones * sizeof(*pkg_zones))) == NULL) {
+    return -1;
+  }
+  for (i = 0; i < state->n_parent_zones; i++) {
+    rp = &state->parent_zones[i];
+    if (rp->pkg >= state->n_pkg) {
+      // this should only arise if sysfs has changed since we initially parsed topology - unlikely, but possible...
+      raplcap_log(ERROR, "Package out of range for parent zone id=%"PRIu32"\n", i);
+      free(pkg_zones);
+      errno = EINVAL;
+      return -1;
+    }
+    if (rp->type == RAPLCAP_ZONE_PACKAGE) {
+      pkg_zones[n_pkg_zones++] = rp;
+    } else if (rp->type != RAPLCAP_ZONE_PSYS) {
+      raplcap_log(WARN, "Ignoring unknown type at parent zone id=%"PRIu32"\n", i);
+    }
+  }
+  // sorted package zones are the die entries, less any duplicates
+  qsort(pkg_zones, n_pkg_zones, sizeof(*pkg_zones), cmp_parent_zone_pkg_die);
+  for (i = 0; i < n_pkg_zones; i++) {
+    if (n_dies > 0 && !cmp_parent_zone_pkg_die(&pkg_zones[i], &pkg_zones[n_dies - 1])) {
+      raplcap_log(WARN, "Ignoring duplicate package entry for pkg=%"PRIu32", die=%"PRIu32"\n",
+                  pkg_zones[i]->pkg, pkg_zones[i]->die);
+      continue;
+    }
+    pkg_zones[n_dies++] = pkg_zones[i];
+    state->die_offsets[pkg_zones[i]->pkg + 1]++;
+  }
+  if (n_dies == 0) {
+    raplcap_log(ERROR, "No package zones found\n");
+    free(pkg_zones);
+    errno = ENODEV;
+    return -1;
+  }
+  for (pkg = 0; pkg < state->n_pkg; pkg++) {
+    raplcap_log(DEBUG, "index_parent_zones: pkg=%"PRIu32", n_die=%"PRIu32"\n", pkg, state->die_offsets[pkg + 1]);
+    state->die_offsets[pkg + 1] += state->die_offsets[pkg];
+  }
+  if ((errno = posix_memalign(&dies, RAPLCAP_CACHE_LINE_SIZE, n_dies * sizeof(*state->dies))) != 0) {
+    free(pkg_zones);
+    return -1;
+  }
+  state->dies = dies;
+  memset(state->dies, 0, n_dies * sizeof(*state->dies));
+  for (i = 0; i < n_dies; i++) {
+    state->dies[i].pkg_zone = pkg_zones[i];
+    pthread_mutex_init(&state->dies[i].acc_lock, NULL);
+  }
+  free(pkg_zones);
+  // PSYS zones are associated with die 0 of their package
+  for (i = 0; i < state->n_parent_zones; i++) {
+    rp = &state->parent_zones[i];
+    if (rp->type != RAPLCAP_ZONE_PSYS) {
+      continue;
+    }
+    if (state->die_offsets[rp->pkg] == state->die_offsets[rp->pkg + 1]) {
+      raplcap_log(WARN, "Ignoring psys entry for package without die at parent zone id=%"PRIu32"\n", i);
+    } else if (state->dies[state->die_offsets[rp->pkg]].psys_zone == NULL) {
+      state->dies[state->die_offsets[rp->pkg]].psys_zone = rp;
+    } else {
+      raplcap_log(WARN, "Ignoring duplicate psys entry at parent zone id=%"PRIu32"\n", i);
+    }
+  }
+  return 0;
+}
+
+#ifndef RAPLCAP_POWERCAP_DELEGATE
+// Not fatal, since snapshots can read each file separately - the powercap library still owns the file descriptors
+static void init_uring(raplcap_powercap* state) {
+  const uint32_t n_snapshot = state->die_offsets[state->n_pkg] * RAPLCAP_NZONES;
+  const raplcap_powercap_die* d;
+  const raplcap_powercap_parent* p;
+  raplcap_uring_read* reads;
+  int* fds;
+  uint32_t i;
+  int fd;
+  if ((state->uring_idxs = malloc(n_snapshot * sizeof(*state->uring_idxs))) == NULL ||
+      (reads = malloc(n_snapshot * sizeof(*reads))) == NULL) {
+    raplcap_perror(INFO, "init_uring");
+    free(state->uring_idxs);
+    state->uring_idxs = NULL;
+    return;
+  }
+  if ((fds = malloc(n_snapshot * sizeof(*fds))) == NULL) {
+    raplcap_perror(INFO, "init_uring");
+    free(reads);
+    free(state->uring_idxs);
+    state->uring_idxs = NULL;
+    return;
+  }
+  // same parent zone mapping as the snapshot
+  for (i = 0; i < n_snapshot; i++) {
+    d = &state->dies[i / RAPLCAP_NZONES];
+    p = (i % RAPLCAP_NZONES == RAPLCAP_ZONE_PSYS && d->psys_zone != NULL) ? d->psys_zone : d->pkg_zone;
+    if (p == NULL || !powercap_intel_rapl_is_zone_supported(&p->p, (raplcap_zone) (i % RAPLCAP_NZONES)) ||
+        (fd = powercap_intel_rapl_get_energy_uj_fd(&p->p, (raplcap_zone) (i % RAPLCAP_NZONES))) < 0) {
+      continue;
+    }
+    fds[state->n_uring] = fd;
+    reads[state->n_uring].file = state->n_uring;
+    reads[state->n_uring].len = POWERCAP_INTEL_RAPL_U64_BUF_SIZE;
+    reads[state->n_uring].offset = 0;
+    state->uring_idxs[state->n_uring++] = i;
+  }
+  if (state->n_uring == 0 || (state->uring = raplcap_uring_init(fds, state->n_uring, reads, state->n_uring)) == NULL) {
+    raplcap_log(INFO, "init_uring: Snapshots will read each energy counter separately\n");
+    free(state->uring_idxs);
+    state->uring_idxs = NULL;
+    state->n_uring = 0;
+  }
+  free(fds);
+  free(reads);
+}
+#endif
+
 int raplcap_init(raplcap* rc) {
   raplcap_powercap* state;
   uint32_t n_parent_zones = 0;
   uint32_t n_pkg;
   uint32_t n_die;
   uint32_t i;
-  uint32_t pkg;
-  uint32_t die;
   int err_save;
   const char* env_ro = getenv(ENV_RAPLCAP_READ_ONLY);
   int ro = env_ro == NULL ? 0 : atoi(env_ro);
   if (rc == NULL) {
     rc = &rc_default;
   }
-  if (get_topology(&n_parent_zones, &n_pkg, &n_die) < 0) {
+  if (get_topology(&n_parent_zones, &n_pkg, 0, &n_die) < 0) {
     if (n_parent_zones == 0) {
       raplcap_perror(ERROR, "No RAPL zones found");
     }
@@ -248,20 +471,19 @@ int raplcap_init(raplcap* rc) {
     free(state);
     return -1;
   }
-  if ((state->pkg_zones = calloc(n_pkg * n_die, sizeof(*state->pkg_zones))) == NULL) {
-    free(state->parent_zones);
-    free(state);
-    return -1;
-  }
-  if ((state->psys_zones = calloc(n_pkg, sizeof(*state->psys_zones))) == NULL) {
-    free(state->pkg_zones);
+  if ((state->die_offsets = calloc(n_pkg + 1, sizeof(*state->die_offsets))) == NULL) {
     free(state->parent_zones);
     free(state);
     return -1;
   }
+  state->dies = NULL;
   state->n_parent_zones = n_parent_zones;
   state->n_pkg = n_pkg;
-  state->n_die = n_die;
+  state->acc_enabled = 0;
+  state->uring = NULL;
+  state->uring_idxs = NULL;
+  state->n_uring = 0;
+  state->set_all_pool = NULL;
   rc->state = state;
   for (i = 0; i < state->n_parent_zones; i++) {
     if (raplcap_powercap_parent_init(&state->parent_zones[i], i, ro)) {
@@ -272,38 +494,18 @@ int raplcap_init(raplcap* rc) {
       return -1;
     }
   }
-  // Parent zones in sysfs may be out of order - index by type, package, and die
-  for (i = 0; i < state->n_parent_zones; i++) {
-    pkg = state->parent_zones[i].pkg;
-    die = state->parent_zones[i].die;
-    if (pkg >= n_pkg || die >= n_die) {
-      // this should only arise if sysfs has changed since we initially parsed topology - unlikely, but possible...
-      raplcap_log(ERROR, "Package or die out of range for parent zone id=%"PRIu32"\n", i);
-      err_save = errno;
-      raplcap_destroy(rc);
-      errno = err_save;
-      return -1;
-    }
-    switch (state->parent_zones[i].type) {
-      case RAPLCAP_ZONE_PACKAGE:
-        if (state->pkg_zones[(pkg * n_die) + die] == NULL) {
-          state->pkg_zones[(pkg * n_die) + die] = &state->parent_zones[i];
-        } else {
-          raplcap_log(WARN, "Ignoring duplicate package entry at parent zone id=%"PRIu32"\n", i);
-        }
-        break;
-      case RAPLCAP_ZONE_PSYS:
-        if (state->psys_zones[pkg] == NULL) {
-          state->psys_zones[pkg] = &state->parent_zones[i];
-        } else {
-          raplcap_log(WARN, "Ignoring duplicate psys entry at parent zone id=%"PRIu32"\n", i);
-        }
-        break;
-      default:
-        raplcap_log(WARN, "Ignoring unknown type at parent zone id=%"PRIu32"\n", i);
-        break;
-    }
+  if (index_parent_zones(state)) {
+    err_save = errno;
+    raplcap_destroy(rc);
+    errno = err_save;
+    return -1;
+  }
+#ifndef RAPLCAP_POWERCAP_DELEGATE
+  // a delegating implementation reads energy counters itself
+  if (raplcap_uring_is_enabled()) {
+    init_uring(state);
   }
+#endif
   rc->nsockets = n_pkg;
   raplcap_log(DEBUG, "raplcap_init: Initialized\n");
   return 0;
@@ -317,6 +519,13 @@ int raplcap_destroy(raplcap* rc) {
     rc = &rc_default;
   }
   if ((state = (raplcap_powercap*) rc->state) != NULL) {
+    // before the state its workers use is freed
+    raplcap_set_all_pool_destroy(state->set_all_pool);
+    // before the files it reads are closed
+    if (state->uring != NULL) {
+      raplcap_uring_destroy(state->uring);
+    }
+    free(state->uring_idxs);
     for (i = 0; i < state->n_parent_zones; i++) {
       raplcap_log(DEBUG, "raplcap_destroy: zone=%"PRIu32"\n", i);
       if (powercap_intel_rapl_destroy(&state->parent_zones[i].p)) {
@@ -324,8 +533,13 @@ int raplcap_destroy(raplcap* rc) {
         err_save = errno;
       }
     }
-    free(state->psys_zones);
-    free(state->pkg_zones);
+    if (state->dies != NULL) {
+      for (i = 0; i < state->die_offsets[state->n_pkg]; i++) {
+        pthread_mutex_destroy(&state->dies[i].acc_lock);
+      }
+    }
+    free(state->dies);
+    free(state->die_offsets);
     free(state->parent_zones);
     free(state);
     rc->state = NULL;
@@ -336,6 +550,17 @@ int raplcap_destroy(raplcap* rc) {
   return err_save ? -1 : 0;
 }
 
+#ifndef RAPLCAP_POWERCAP_DELEGATE
+// a delegating implementation keeps its own pool
+raplcap_set_all_pool** raplcap_get_set_all_pool(const raplcap* rc) {
+  raplcap_powercap* state;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  return (state = (raplcap_powercap*) rc->state) == NULL ? NULL : &state->set_all_pool;
+}
+#endif
+
 uint32_t raplcap_get_num_packages(const raplcap* rc) {
   const raplcap_powercap* state;
   uint32_t n_parent_zones;
@@ -347,7 +572,7 @@ uint32_t raplcap_get_num_packages(const raplcap* rc) {
   if ((state = (raplcap_powercap*) rc->state) != NULL) {
     return state->n_pkg;
   }
-  return get_topology(&n_parent_zones, &n_pkg, &n_die) ? 0 : n_pkg;
+  return get_topology(&n_parent_zones, &n_pkg, 0, &n_die) ? 0 : n_pkg;
 }
 
 uint32_t raplcap_get_num_die(const raplcap* rc, uint32_t pkg) {
@@ -364,9 +589,9 @@ uint32_t raplcap_get_num_die(const raplcap* rc, uint32_t pkg) {
       errno = EINVAL;
       return 0;
     }
-    return state->n_die;
+    return get_n_die(state, pkg);
   }
-  if (get_topology(&n_parent_zones, &n_pkg, &n_die)) {
+  if (get_topology(&n_parent_zones, &n_pkg, pkg, &n_die)) {
     return 0;
   }
   if (pkg >= n_pkg) {
@@ -549,13 +774,59 @@ int raplcap_pd_set_limit(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_
   return 0;
 }
 
+int raplcap_pd_get_zone_states(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone_state* states,
+                               uint32_t len) {
+  const powercap_intel_rapl_parent* p;
+  raplcap_zone_state* s;
+  int zone;
+  int c;
+  raplcap_log(DEBUG, "raplcap_pd_get_zone_states: pkg=%"PRIu32", die=%"PRIu32", len=%"PRIu32"\n", pkg, die, len);
+  if (states == NULL || len < RAPLCAP_NZONES) {
+    errno = EINVAL;
+    return -1;
+  }
+  memset(states, 0, RAPLCAP_NZONES * sizeof(*states));
+  // sysfs has a file per value, so there's no batch to read - clamping and locking aren't exposed
+  for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+    s = &states[zone];
+    s->enabled = s->clamped = s->locked = -1;
+    if ((p = get_parent_zone(rc, pkg, die, (raplcap_zone) zone)) == NULL) {
+      if (errno != ENODEV) {
+        // the context, package, or die is invalid
+        return -1;
+      }
+      continue;
+    }
+    if (!powercap_intel_rapl_is_zone_supported(p, (raplcap_zone) zone)) {
+      continue;
+    }
+    if ((s->enabled = powercap_intel_rapl_is_enabled(p, (raplcap_zone) zone)) < 0) {
+      raplcap_perror(ERROR, "powercap_intel_rapl_is_enabled");
+    }
+    for (c = 0; c < RAPLCAP_NCONSTRAINTS; c++) {
+      if (powercap_intel_rapl_is_constraint_supported(p, (raplcap_zone) zone, (raplcap_constraint) c) > 0 &&
+          get_constraint(p, (raplcap_zone) zone, (raplcap_constraint) c, &s->limits[c])) {
+        memset(&s->limits[c], 0, sizeof(s->limits[c]));
+      }
+    }
+  }
+  return RAPLCAP_NZONES;
+}
+
 double raplcap_pd_get_energy_counter(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
   uint64_t uj;
+  pthread_mutex_t* lock;
+  int ret;
   const powercap_intel_rapl_parent* p = get_parent_zone(rc, pkg, die, zone);
   if (p == NULL) {
     return -1;
   }
-  if (powercap_intel_rapl_get_energy_uj(p, zone, &uj)) {
+  lock = lock_die_acc(rc, pkg, die);
+  if ((ret = powercap_intel_rapl_get_energy_uj(p, zone, &uj)) == 0) {
+    energy_acc_update(rc, pkg, die, zone, uj);
+  }
+  unlock_die_acc(lock);
+  if (ret) {
     return -1;
   }
   raplcap_log(DEBUG, "raplcap_pd_get_energy_counter: pkg=%"PRIu32", die=%"PRIu32", zone=%d, uj=%"PRIu64"\n",
@@ -576,3 +847,217 @@ double raplcap_pd_get_energy_counter_max(const raplcap* rc, uint32_t pkg, uint32
               pkg, die, zone, uj);
   return uj / 1000000.0;
 }
+
+// Read all energy counters in one batch - returns non-zero if the caller should read each die instead
+static int snapshot_uring(raplcap_powercap* state, double* joules) {
+  const void* buf;
+  uint64_t uj;
+  ssize_t n;
+  uint32_t i;
+  uint32_t idx;
+  int ret;
+  // accumulating requires all dies to be locked, in index order
+  const int acc_enabled = state->acc_enabled;
+  if (state->uring == NULL) {
+    return -1;
+  }
+  for (i = 0; acc_enabled && i < state->die_offsets[state->n_pkg]; i++) {
+    pthread_mutex_lock(&state->dies[i].acc_lock);
+  }
+  // non-zero if the engine is busy or failed
+  if ((ret = raplcap_uring_submit(state->uring)) == 0) {
+    for (i = 0; i < state->die_offsets[state->n_pkg] * RAPLCAP_NZONES; i++) {
+      joules[i] = -1;
+    }
+    for (i = 0; i < state->n_uring; i++) {
+      idx = state->uring_idxs[i];
+      if ((n = raplcap_uring_get_result(state->uring, i, &buf)) < 0 ||
+          powercap_intel_rapl_parse_u64(buf, (size_t) n, &uj)) {
+        continue;
+      }
+      if (acc_enabled) {
+        raplcap_energy_acc_update(&state->dies[idx / RAPLCAP_NZONES].acc[idx % RAPLCAP_NZONES], uj);
+      }
+      joules[idx] = uj / 1000000.0;
+    }
+    raplcap_uring_release(state->uring);
+  }
+  for (i = 0; acc_enabled && i < state->die_offsets[state->n_pkg]; i++) {
+    pthread_mutex_unlock(&state->dies[i].acc_lock);
+  }
+  return ret;
+}
+
+int raplcap_get_energy_snapshot(const raplcap* rc, double* joules, uint32_t len) {
+  raplcap_powercap* state;
+  const raplcap_powercap_die* d;
+  const raplcap_powercap_parent* p;
+  pthread_mutex_t* lock;
+  uint64_t uj;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t i;
+  int zone;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  raplcap_log(DEBUG, "raplcap_get_energy_snapshot: len=%"PRIu32"\n", len);
+  if ((state = (raplcap_powercap*) rc->state) == NULL) {
+    raplcap_log(ERROR, "Context is not initialized\n");
+    errno = EINVAL;
+    return -1;
+  }
+  if (joules == NULL) {
+    return (int) (state->die_offsets[state->n_pkg] * RAPLCAP_NZONES);
+  }
+  if (len < state->die_offsets[state->n_pkg] * RAPLCAP_NZONES) {
+    raplcap_log(ERROR, "Snapshot length %"PRIu32" is less than required length %"PRIu32"\n",
+                len, state->die_offsets[state->n_pkg] * RAPLCAP_NZONES);
+    errno = EINVAL;
+    return -1;
+  }
+  if (snapshot_uring(state, joules) == 0) {
+    return (int) (state->die_offsets[state->n_pkg] * RAPLCAP_NZONES);
+  }
+  // same parent zone mapping as get_parent_zone, but without repeating validation for every entry
+  for (pkg = 0, i = 0; pkg < state->n_pkg; pkg++) {
+    for (die = 0; die < get_n_die(state, pkg); die++) {
+      d = &state->dies[state->die_offsets[pkg] + die];
+      lock = lock_die_acc(rc, pkg, die);
+      for (zone = 0; zone < RAPLCAP_NZONES; zone++, i++) {
+        p = (zone == RAPLCAP_ZONE_PSYS && d->psys_zone != NULL) ? d->psys_zone : d->pkg_zone;
+        if (p == NULL || !powercap_intel_rapl_is_zone_supported(&p->p, (raplcap_zone) zone) ||
+            powercap_intel_rapl_get_energy_uj(&p->p, (raplcap_zone) zone, &uj)) {
+          joules[i] = -1;
+        } else {
+          energy_acc_update(rc, pkg, die, (raplcap_zone) zone, uj);
+          joules[i] = uj / 1000000.0;
+        }
+      }
+      unlock_die_acc(lock);
+    }
+  }
+  return (int) i;
+}
+
+int raplcap_set_energy_accumulation(const raplcap* rc, int enabled) {
+  raplcap_powercap* state;
+  const powercap_intel_rapl_parent* p;
+  raplcap_energy_acc* acc;
+  uint64_t uj;
+  uint32_t pkg;
+  uint32_t die;
+  int zone;
+  if (rc == NULL) {
+    rc = &rc_default;
+  }
+  raplcap_log(DEBUG, "raplcap_set_energy_accumulation: enabled=%d\n", enabled);
+  if ((state = (raplcap_powercap*) rc->state) == NULL) {
+    raplcap_log(ERROR, "Context is not initialized\n");
+    errno = EINVAL;
+    return -1;
+  }
+  if (!enabled) {
+    state->acc_enabled = 0;
+    return 0;
+  }
+  if (state->acc_enabled) {
+    return 0;
+  }
+  state->acc_enabled = 1;
+  // record rollover values and baselines - zones that don't exist are left invalid
+  for (pkg = 0; pkg < state->n_pkg; pkg++) {
+    for (die = 0; die < get_n_die(state, pkg); die++) {
+      for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+        acc = &state->dies[state->die_offsets[pkg] + die].acc[zone];
+        memset(acc, 0, sizeof(*acc));
+        if ((p = get_parent_zone(rc, pkg, die, (raplcap_zone) zone)) == NULL ||
+            !powercap_intel_rapl_is_zone_supported(p, (raplcap_zone) zone)) {
+          continue;
+        }
+        // max_energy_range_uj is the largest value that can be read, so the counter rolls over just after it
+        if (powercap_intel_rapl_get_max_energy_range_uj(p, (raplcap_zone) zone, &acc->max)) {
+          raplcap_perror(WARN, "powercap_intel_rapl_get_max_energy_range_uj");
+          continue;
+        }
+        acc->max++;
+        if (!powercap_intel_rapl_get_energy_uj(p, (raplcap_zone) zone, &uj)) {
+          raplcap_energy_acc_update(acc, uj);
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+double raplcap_pd_get_energy_accumulated(const raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  uint64_t uj;
+  uint64_t max = 0;
+  uint64_t total = 0;
+  pthread_mutex_t* lock;
+  const raplcap_energy_acc* acc = NULL;
+  const powercap_intel_rapl_parent* p = get_parent_zone(rc, pkg, die, zone);
+  int ret;
+  raplcap_log(DEBUG, "raplcap_pd_get_energy_accumulated: pkg=%"PRIu32", die=%"PRIu32", zone=%d\n", pkg, die, zone);
+  if (p == NULL) {
+    return -1;
+  }
+  lock = lock_die_acc(rc, pkg, die);
+  if ((ret = powercap_intel_rapl_get_energy_uj(p, zone, &uj)) == 0 &&
+      (acc = energy_acc_update(rc, pkg, die, zone, uj)) != NULL) {
+    max = acc->max;
+    total = acc->total;
+  }
+  unlock_die_acc(lock);
+  if (ret) {
+    return -1;
+  }
+  if (acc == NULL) {
+    raplcap_log(ERROR, "Energy accumulation is not enabled\n");
+    errno = EINVAL;
+    return -1;
+  }
+  if (max == 0) {
+    // rollover value wasn't available when accumulation was enabled
+    errno = ENODATA;
+    return -1;
+  }
+  return total / 1000000.0;
+}
+
+int raplcap_txn_commit(raplcap_txn* txn) {
+  const powercap_intel_rapl_parent* p;
+  int ret = 0;
+  int err_save;
+  int c;
+  if (txn == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  raplcap_log(DEBUG, "raplcap_txn_commit: pkg=%"PRIu32", die=%"PRIu32", zone=%d, staged=0x%"PRIx32"\n",
+              txn->pkg, txn->die, txn->zone, txn->staged);
+  if ((p = get_parent_zone(txn->rc, txn->pkg, txn->die, txn->zone)) == NULL) {
+    ret = -1;
+  } else if (txn->staged & (RAPLCAP_TXN_CLAMPED | RAPLCAP_TXN_LOCKED_ANY)) {
+    raplcap_log(ERROR, "Clamping and locking are not supported by powercap\n");
+    errno = ENOTSUP;
+    ret = -1;
+  } else {
+    // each value is its own file, but set limits before enabling so the zone isn't enabled with stale limits
+    for (c = 0; c < RAPLCAP_NCONSTRAINTS && !ret; c++) {
+      if ((txn->staged & RAPLCAP_TXN_LIMIT(c)) &&
+          (c != RAPLCAP_CONSTRAINT_SHORT_TERM ||
+           powercap_intel_rapl_is_constraint_supported(p, txn->zone, RAPLCAP_CONSTRAINT_SHORT_TERM) > 0)) {
+        ret = set_constraint(p, txn->zone, (raplcap_constraint) c, &txn->limits[c]);
+      }
+    }
+    if (!ret && (txn->staged & RAPLCAP_TXN_ENABLED) &&
+        (ret = powercap_intel_rapl_set_enabled(p, txn->zone, txn->enabled)) != 0) {
+      raplcap_perror(ERROR, "powercap_intel_rapl_set_enabled");
+    }
+  }
+  err_save = errno;
+  raplcap_txn_abort(txn);
+  errno = err_save;
+  return ret;
+}
@@ -0,0 +1,86 @@
+/**
+ * Compares reading energy counters with a pread on the persistent file descriptors against libpowercap's read path.
+ * Requires an intel-rapl powercap control type with read access to energy_uj.
+ *
+ * Usage: powercap-intel-rapl-read-bench [iterations]
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <powercap.h>
+#include "powercap-intel-rapl.h"
+
+#define DEFAULT_ITERATIONS 100000
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int bench_pread(const powercap_intel_rapl_parent* parent, uint32_t iterations, uint64_t* ns) {
+  uint64_t uj;
+  uint64_t start;
+  uint32_t i;
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    if (powercap_intel_rapl_get_energy_uj(parent, RAPLCAP_ZONE_PACKAGE, &uj)) {
+      perror("powercap_intel_rapl_get_energy_uj");
+      return -1;
+    }
+  }
+  *ns = now_ns() - start;
+  return 0;
+}
+
+static int bench_libpowercap(const powercap_intel_rapl_parent* parent, uint32_t iterations, uint64_t* ns) {
+  uint64_t uj;
+  uint64_t start;
+  uint32_t i;
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    if (powercap_zone_get_energy_uj(&parent->zones[RAPLCAP_ZONE_PACKAGE].zone, &uj)) {
+      perror("powercap_zone_get_energy_uj");
+      return -1;
+    }
+  }
+  *ns = now_ns() - start;
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  powercap_intel_rapl_parent parent;
+  uint64_t ns_pread;
+  uint64_t ns_libpowercap;
+  uint32_t iterations = DEFAULT_ITERATIONS;
+  int ret = EXIT_SUCCESS;
+  if (argc > 1 && (iterations = (uint32_t) strtoul(argv[1], NULL, 0)) == 0) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (powercap_intel_rapl_get_num_instances() == 0) {
+    perror("powercap_intel_rapl_get_num_instances");
+    return EXIT_FAILURE;
+  }
+  if (powercap_intel_rapl_init(0, &parent, 1)) {
+    perror("powercap_intel_rapl_init");
+    return EXIT_FAILURE;
+  }
+  if (bench_pread(&parent, iterations, &ns_pread) || bench_libpowercap(&parent, iterations, &ns_libpowercap)) {
+    ret = EXIT_FAILURE;
+  } else {
+    printf("iterations: %"PRIu32"\n", iterations);
+    printf("pread:       %"PRIu64" ns/read\n", ns_pread / iterations);
+    printf("libpowercap: %"PRIu64" ns/read\n", ns_libpowercap / iterations);
+  }
+  if (powercap_intel_rapl_destroy(&parent)) {
+    perror("powercap_intel_rapl_destroy");
+  }
+  return ret;
+}
@@ -4,20 +4,30 @@
  * @author Connor Imes
  * @date 2016-05-13
  */
-// for setenv
+// for setenv, clock_nanosleep, sigaction
 #define _POSIX_C_SOURCE 200112L
 #include <assert.h>
 #include <errno.h>
+#include <math.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <getopt.h>
 #include "raplcap.h"
 #include "raplcap-common.h"
+#include "raplcap-trace.h"
 #ifdef RAPLCAP_msr
 #include "raplcap-msr.h"
 #endif // RAPLCAP_msr
 
+typedef enum monitor_format {
+  MONITOR_FORMAT_CSV,
+  MONITOR_FORMAT_BINARY,
+  MONITOR_FORMAT_TRACE,
+} monitor_format;
+
 typedef struct rapl_configure_ctx {
   int get_packages;
   int get_die;
@@ -25,6 +35,15 @@ typedef struct rapl_configure_ctx {
   raplcap_constraint constraint;
   unsigned int pkg;
   unsigned int die;
+  // monitoring is restricted to the package, die, and/or zone only if they're specified
+  int has_pkg;
+  int has_die;
+  int has_zone;
+  double monitor_interval;
+  unsigned long monitor_iterations;
+  monitor_format monitor_format;
+  const char* monitor_output;
+  double watch_interval;
   int enabled;
   int set_enabled;
   int set_long;
@@ -41,7 +60,7 @@ typedef struct rapl_configure_ctx {
 } rapl_configure_ctx;
 
 static const char* prog;
-static const char short_options[] = "nNc:d:z:l:t:p:e:s:w:S:W:C:Lh";
+static const char short_options[] = "nNc:d:z:l:t:p:e:s:w:S:W:C:Lm:i:f:o:r:h";
 static const struct option long_options[] = {
   {"npackages",no_argument,       NULL, 'n'},
   {"nsockets", no_argument,       NULL, 'n'}, // deprecated, no longer documented
@@ -62,6 +81,11 @@ static const struct option long_options[] = {
   {"clamped",  required_argument, NULL, 'C'},
   {"locked",   no_argument,       NULL, 'L'},
 #endif // RAPLCAP_msr
+  {"monitor",  required_argument, NULL, 'm'},
+  {"iterations", required_argument, NULL, 'i'},
+  {"format",   required_argument, NULL, 'f'},
+  {"output",   required_argument, NULL, 'o'},
+  {"watch",    required_argument, NULL, 'r'},
   {"help",     no_argument,       NULL, 'h'},
   {0, 0, 0, 0}
 };
@@ -106,6 +130,19 @@ static void print_usage(int exit_code) {
           "  -w, --watts0=WATTS       Long term power limit\n"
           "  -S, --seconds1=SECONDS   Short term time window\n"
           "  -W, --watts1=WATTS       Short term power limit\n"
+          "The following stream power measurements instead of getting or setting values:\n"
+          "  -m, --monitor=SECONDS    Print the average power of zones every SECONDS until\n"
+          "                           interrupted; zones are restricted only by the\n"
+          "                           package, die, and/or zone flags that are specified\n"
+          "  -i, --iterations=COUNT   Stop monitoring or watching after COUNT intervals\n"
+          "  -f, --format=FORMAT      Monitor output format. Allowable values:\n"
+          "                           CSV - comma-separated values (default)\n"
+          "                           BINARY - compact binary records\n"
+          "                           TRACE - raw energy counters (see raplcap-trace.h)\n"
+          "  -o, --output=FILE        Write monitor output to FILE instead of stdout\n"
+          "  -r, --watch=SECONDS      Show a live table of every zone's power, limits, and\n"
+          "                           state, refreshed every SECONDS until interrupted;\n"
+          "                           zones are restricted like monitoring\n"
           "\nCurrent values are printed if no flags, or only package, die, and/or zone flags are specified.\n"
           "Otherwise, specified values are set while other values remain unmodified.\n"
           "\nRAPL is available on Intel CPUs starting with Sandy Bridge (2011).\n"
@@ -327,6 +364,565 @@ static int check_constraint_supported(const rapl_configure_ctx* c) {
   return 0;
 }
 
+static const char* const ZONE_NAMES[RAPLCAP_NZONES] = {
+  "PACKAGE",
+  "CORE",
+  "UNCORE",
+  "DRAM",
+  "PSYS"
+};
+
+// binary header: magic, version, n_columns, then pkg, die, and zone for each column
+// binary record: nanoseconds since monitoring started, then watts for each column (NaN if unavailable)
+static const char MONITOR_BINARY_MAGIC[4] = { 'R', 'C', 'M', 'N' };
+#define MONITOR_BINARY_VERSION 1
+
+typedef struct monitor_column {
+  uint32_t pkg;
+  uint32_t die;
+  raplcap_zone zone;
+  double joules_max;
+  // the last counter value, or < 0 if unavailable
+  double joules;
+} monitor_column;
+
+static volatile sig_atomic_t monitor_stop = 0;
+
+static void monitor_handle_signal(int sig) {
+  (void) sig;
+  monitor_stop = 1;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Stop cleanly when interrupted, without restarting clock_nanosleep
+static void monitor_handle_signals(void) {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = monitor_handle_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+}
+
+// Sleep until an absolute deadline - returns 1 if stopped by a signal, -1 on error, 0 otherwise
+static int monitor_sleep_until(uint64_t deadline_ns) {
+  struct timespec deadline_ts;
+  int err;
+  deadline_ts.tv_sec = (time_t) (deadline_ns / 1000000000ULL);
+  deadline_ts.tv_nsec = (long) (deadline_ns % 1000000000ULL);
+  do {
+    err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline_ts, NULL);
+  } while (err == EINTR && !monitor_stop);
+  if (monitor_stop) {
+    return 1;
+  }
+  if (err) {
+    errno = err;
+    perror("clock_nanosleep");
+    return -1;
+  }
+  return 0;
+}
+
+static monitor_column* get_monitor_columns(const rapl_configure_ctx* c, uint32_t* n_cols) {
+  assert(c != NULL);
+  monitor_column* cols = NULL;
+  monitor_column* tmp;
+  uint32_t n_pkg;
+  uint32_t n_die;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t n = 0;
+  int zone;
+  if ((n_pkg = raplcap_get_num_packages(NULL)) == 0) {
+    perror("Failed to get number of packages");
+    return NULL;
+  }
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    if ((c->has_pkg && pkg != c->pkg) || (n_die = raplcap_get_num_die(NULL, pkg)) == 0) {
+      continue;
+    }
+    for (die = 0; die < n_die; die++) {
+      for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+        if ((c->has_die && die != c->die) || (c->has_zone && zone != (int) c->zone) ||
+            raplcap_pd_is_zone_supported(NULL, pkg, die, (raplcap_zone) zone) <= 0) {
+          continue;
+        }
+        if ((tmp = realloc(cols, (n + 1) * sizeof(*cols))) == NULL) {
+          perror("realloc");
+          free(cols);
+          return NULL;
+        }
+        cols = tmp;
+        cols[n].pkg = pkg;
+        cols[n].die = die;
+        cols[n].zone = (raplcap_zone) zone;
+        cols[n].joules_max = raplcap_pd_get_energy_counter_max(NULL, pkg, die, (raplcap_zone) zone);
+        cols[n].joules = raplcap_pd_get_energy_counter(NULL, pkg, die, (raplcap_zone) zone);
+        n++;
+      }
+    }
+  }
+  if (n == 0) {
+    fprintf(stderr, "No supported zones to monitor\n");
+    return NULL;
+  }
+  *n_cols = n;
+  return cols;
+}
+
+// Compute average watts between two counter values, handling counter wraparound - NaN if unavailable
+static double get_watts(double joules_last, double joules, double joules_max, double seconds) {
+  if (joules < 0 || joules_last < 0) {
+    return NAN;
+  }
+  if (joules >= joules_last) {
+    return (joules - joules_last) / seconds;
+  }
+  if (joules_max > 0) {
+    return ((joules_max - joules_last) + joules) / seconds;
+  }
+  return NAN;
+}
+
+// Compute average watts since the last sample
+static void monitor_sample(monitor_column* cols, uint32_t n_cols, double seconds, double* watts) {
+  double joules;
+  uint32_t i;
+  for (i = 0; i < n_cols; i++) {
+    joules = raplcap_pd_get_energy_counter(NULL, cols[i].pkg, cols[i].die, cols[i].zone);
+    watts[i] = get_watts(cols[i].joules, joules, cols[i].joules_max, seconds);
+    cols[i].joules = joules;
+  }
+}
+
+static int monitor_write_header(FILE* f, monitor_format fmt, const monitor_column* cols, uint32_t n_cols) {
+  const uint32_t version = MONITOR_BINARY_VERSION;
+  uint32_t zone;
+  uint32_t i;
+  if (fmt == MONITOR_FORMAT_BINARY) {
+    if (fwrite(MONITOR_BINARY_MAGIC, sizeof(MONITOR_BINARY_MAGIC), 1, f) != 1 ||
+        fwrite(&version, sizeof(version), 1, f) != 1 || fwrite(&n_cols, sizeof(n_cols), 1, f) != 1) {
+      return -1;
+    }
+    for (i = 0; i < n_cols; i++) {
+      zone = (uint32_t) cols[i].zone;
+      if (fwrite(&cols[i].pkg, sizeof(cols[i].pkg), 1, f) != 1 ||
+          fwrite(&cols[i].die, sizeof(cols[i].die), 1, f) != 1 ||
+          fwrite(&zone, sizeof(zone), 1, f) != 1) {
+        return -1;
+      }
+    }
+  } else {
+    fprintf(f, "seconds");
+    for (i = 0; i < n_cols; i++) {
+      fprintf(f, ",pkg%"PRIu32"_die%"PRIu32"_%s", cols[i].pkg, cols[i].die, ZONE_NAMES[cols[i].zone]);
+    }
+    fprintf(f, "\n");
+  }
+  return fflush(f) ? -1 : 0;
+}
+
+static int monitor_write_record(FILE* f, monitor_format fmt, uint64_t ns, const double* watts, uint32_t n_cols) {
+  float w;
+  uint32_t i;
+  if (fmt == MONITOR_FORMAT_BINARY) {
+    if (fwrite(&ns, sizeof(ns), 1, f) != 1) {
+      return -1;
+    }
+    for (i = 0; i < n_cols; i++) {
+      w = (float) watts[i];
+      if (fwrite(&w, sizeof(w), 1, f) != 1) {
+        return -1;
+      }
+    }
+  } else {
+    fprintf(f, "%.9f", ns / 1000000000.0);
+    for (i = 0; i < n_cols; i++) {
+      if (isnan(watts[i])) {
+        fprintf(f, ",");
+      } else {
+        fprintf(f, ",%.6f", watts[i]);
+      }
+    }
+    fprintf(f, "\n");
+  }
+  // flush every record so consumers see them as they're produced
+  return fflush(f) ? -1 : 0;
+}
+
+// The trace writer records raw counters instead of power, so it handles headers, records, and wraparound itself
+static raplcap_trace_writer* monitor_trace_start(FILE* f, const monitor_column* cols, uint32_t n_cols) {
+  raplcap_trace_writer* w;
+  raplcap_trace_column* tcols;
+  uint32_t i;
+  if ((tcols = calloc(n_cols, sizeof(*tcols))) == NULL) {
+    perror("calloc");
+    return NULL;
+  }
+  for (i = 0; i < n_cols; i++) {
+    tcols[i].pkg = cols[i].pkg;
+    tcols[i].die = cols[i].die;
+    tcols[i].zone = (uint32_t) cols[i].zone;
+  }
+  w = raplcap_trace_writer_start(NULL, f, tcols, n_cols);
+  free(tcols);
+  return w;
+}
+
+static int monitor(const rapl_configure_ctx* c) {
+  assert(c != NULL);
+  monitor_column* cols;
+  raplcap_trace_writer* w = NULL;
+  double* watts = NULL;
+  FILE* f = stdout;
+  uint64_t interval_ns = (uint64_t) (c->monitor_interval * 1000000000.0);
+  uint64_t start_ns;
+  uint64_t last_ns;
+  uint64_t cur_ns;
+  uint64_t k;
+  unsigned long n_records = 0;
+  uint32_t n_cols;
+  int ret = 0;
+  int err;
+  if (interval_ns == 0) {
+    fprintf(stderr, "Monitor interval is too small\n");
+    return -1;
+  }
+  if ((cols = get_monitor_columns(c, &n_cols)) == NULL) {
+    return -1;
+  }
+  if ((watts = malloc(n_cols * sizeof(*watts))) == NULL) {
+    perror("malloc");
+    free(cols);
+    return -1;
+  }
+  if (c->monitor_output != NULL &&
+      (f = fopen(c->monitor_output, c->monitor_format == MONITOR_FORMAT_CSV ? "w" : "wb")) == NULL) {
+    perror("Failed to open monitor output file");
+    free(watts);
+    free(cols);
+    return -1;
+  }
+  monitor_handle_signals();
+  if (c->monitor_format == MONITOR_FORMAT_TRACE) {
+    if ((w = monitor_trace_start(f, cols, n_cols)) == NULL) {
+      perror("Failed to start trace");
+      ret = -1;
+    }
+  } else if (monitor_write_header(f, c->monitor_format, cols, n_cols)) {
+    perror("Failed to write monitor output");
+    ret = -1;
+  }
+  // deadlines are absolute multiples of the interval from the start, so scheduling delays don't accumulate
+  start_ns = last_ns = now_ns();
+  for (k = 1; !ret && !monitor_stop && (c->monitor_iterations == 0 || n_records < c->monitor_iterations); k++) {
+    if ((err = monitor_sleep_until(start_ns + k * interval_ns)) != 0) {
+      ret = err < 0 ? -1 : 0;
+      break;
+    }
+    cur_ns = now_ns();
+    if (w != NULL) {
+      if (raplcap_trace_writer_sample(w) || fflush(f)) {
+        perror("Failed to write trace");
+        ret = -1;
+      }
+    } else {
+      // use the actual elapsed time, which is only approximately the interval
+      monitor_sample(cols, n_cols, (cur_ns - last_ns) / 1000000000.0, watts);
+      last_ns = cur_ns;
+      if (monitor_write_record(f, c->monitor_format, cur_ns - start_ns, watts, n_cols)) {
+        perror("Failed to write monitor output");
+        ret = -1;
+      }
+    }
+    n_records++;
+    // if sampling overran any deadlines, skip them rather than sampling back-to-back
+    while (start_ns + (k + 1) * interval_ns <= cur_ns) {
+      k++;
+    }
+  }
+  if (w != NULL && raplcap_trace_writer_finish(w)) {
+    perror("Failed to finish trace");
+    ret = -1;
+  }
+  if (f != stdout && fclose(f)) {
+    perror("Failed to close monitor output file");
+    ret = -1;
+  }
+  free(watts);
+  free(cols);
+  return ret;
+}
+
+// The watch table has a header line, then a line per package/die/zone, with a cell per value
+typedef enum watch_cell {
+  WATCH_CELL_WATTS,
+  WATCH_CELL_PL1_WATTS,
+  WATCH_CELL_PL1_SECONDS,
+  WATCH_CELL_PL2_WATTS,
+  WATCH_CELL_PL2_SECONDS,
+  WATCH_CELL_PL4_WATTS,
+  WATCH_CELL_ENABLED,
+  WATCH_CELL_CLAMPED,
+  WATCH_CELL_LOCKED,
+  WATCH_CELL_CLAMPED_PCT,
+  WATCH_NCELLS
+} watch_cell;
+
+static const char* const WATCH_CELL_NAMES[WATCH_NCELLS] = {
+  "WATTS", "PL1_W", "PL1_S", "PL2_W", "PL2_S", "PL4_W", "EN", "CL", "LK", "CLAMP%"
+};
+static const int WATCH_CELL_WIDTHS[WATCH_NCELLS] = { 9, 9, 9, 9, 9, 9, 3, 3, 3, 7 };
+// the package, die, and zone that start each line
+#define WATCH_LABEL_WIDTH 16
+// large enough for any cell's text, and for the escape sequence that positions the cursor at a cell
+#define WATCH_CELL_MAX 16
+#define WATCH_CURSOR_MAX 24
+
+typedef struct watch_row {
+  uint32_t pkg;
+  uint32_t die;
+  raplcap_zone zone;
+  // index into energy snapshots
+  uint32_t idx;
+  // bit constraint is set if the constraint is supported
+  uint32_t constraints;
+  double joules_max;
+  // the last counter value, or < 0 if unavailable
+  double joules;
+  uint64_t clamped_ns;
+  // each cell's text as it's currently displayed
+  char cells[WATCH_NCELLS][WATCH_CELL_MAX];
+} watch_row;
+
+typedef struct watch_table {
+  watch_row* rows;
+  uint32_t n_rows;
+  double* snapshot;
+  uint32_t n_snapshot;
+  // the screen column of each cell
+  int cols[WATCH_NCELLS];
+  // every refresh is rendered here, then written at once
+  char* frame;
+  size_t frame_size;
+} watch_table;
+
+static void watch_table_destroy(watch_table* t) {
+  free(t->frame);
+  free(t->snapshot);
+  free(t->rows);
+}
+
+// Rows are ordered by package, then die, then zone, like monitor columns
+static int watch_table_init(watch_table* t, const rapl_configure_ctx* c) {
+  monitor_column* cols;
+  uint32_t offset = 0;
+  uint32_t pkg = 0;
+  uint32_t i;
+  int j;
+  int len;
+  memset(t, 0, sizeof(*t));
+  if ((cols = get_monitor_columns(c, &t->n_rows)) == NULL) {
+    return -1;
+  }
+  if ((len = raplcap_get_energy_snapshot(NULL, NULL, 0)) <= 0) {
+    perror("Failed to get energy snapshot length");
+    free(cols);
+    return -1;
+  }
+  t->n_snapshot = (uint32_t) len;
+  t->frame_size = t->n_rows * WATCH_NCELLS * (WATCH_CURSOR_MAX + WATCH_CELL_MAX) + 1;
+  if ((t->rows = calloc(t->n_rows, sizeof(*t->rows))) == NULL ||
+      (t->snapshot = malloc(t->n_snapshot * sizeof(*t->snapshot))) == NULL ||
+      (t->frame = malloc(t->frame_size)) == NULL) {
+    perror("Failed to allocate watch table");
+    watch_table_destroy(t);
+    free(cols);
+    return -1;
+  }
+  for (i = 0; i < t->n_rows; i++) {
+    for (; pkg < cols[i].pkg; pkg++) {
+      offset += raplcap_get_num_die(NULL, pkg);
+    }
+    t->rows[i].pkg = cols[i].pkg;
+    t->rows[i].die = cols[i].die;
+    t->rows[i].zone = cols[i].zone;
+    t->rows[i].idx = (offset + cols[i].die) * RAPLCAP_NZONES + (uint32_t) cols[i].zone;
+    t->rows[i].joules_max = cols[i].joules_max;
+    t->rows[i].joules = -1;
+    for (j = 0; j < RAPLCAP_NCONSTRAINTS; j++) {
+      if (raplcap_pd_is_constraint_supported(NULL, cols[i].pkg, cols[i].die, cols[i].zone,
+                                             (raplcap_constraint) j) > 0) {
+        t->rows[i].constraints |= 1U << j;
+      }
+    }
+  }
+  free(cols);
+  t->cols[0] = WATCH_LABEL_WIDTH + 2;
+  for (j = 1; j < WATCH_NCELLS; j++) {
+    t->cols[j] = t->cols[j - 1] + WATCH_CELL_WIDTHS[j - 1] + 1;
+  }
+  return 0;
+}
+
+// Clear the screen and draw what doesn't change: the header and each line's package, die, and zone
+static void watch_draw_labels(const watch_table* t) {
+  uint32_t i;
+  int j;
+  printf("\033[?25l\033[H\033[2J%3s %3s %-8s", "PKG", "DIE", "ZONE");
+  for (j = 0; j < WATCH_NCELLS; j++) {
+    printf(" %*s", WATCH_CELL_WIDTHS[j], WATCH_CELL_NAMES[j]);
+  }
+  for (i = 0; i < t->n_rows; i++) {
+    printf("\033[%"PRIu32";1H%3"PRIu32" %3"PRIu32" %-8s", i + 2, t->rows[i].pkg, t->rows[i].die,
+           ZONE_NAMES[t->rows[i].zone]);
+  }
+  fflush(stdout);
+}
+
+// Format a cell's text, right-aligned to its width, or "-" if the value isn't available or doesn't fit
+static void watch_format(char* text, watch_cell cell, int available, int precision, double val) {
+  const int width = WATCH_CELL_WIDTHS[cell];
+  if (!available || isnan(val) || snprintf(text, WATCH_CELL_MAX, "%*.*f", width, precision, val) > width) {
+    snprintf(text, WATCH_CELL_MAX, "%*s", width, "-");
+  }
+}
+
+// Append a cell to the frame, only if its text changed
+static size_t watch_draw_cell(watch_table* t, uint32_t i, watch_cell cell, const char* text, size_t len) {
+  char* cur = t->rows[i].cells[cell];
+  int n;
+  if (strcmp(cur, text)) {
+    n = snprintf(&t->frame[len], t->frame_size - len, "\033[%"PRIu32";%dH%s", i + 2, t->cols[cell], text);
+    if (n > 0 && (size_t) n < t->frame_size - len) {
+      len += (size_t) n;
+      strcpy(cur, text);
+    }
+  }
+  return len;
+}
+
+// Render every row's changed cells in a single pass, reading each die's zone states together
+// Power isn't available until there's an interval (interval_ns > 0)
+static size_t watch_render(watch_table* t, uint64_t interval_ns, uint64_t elapsed_ns) {
+  raplcap_zone_state states[RAPLCAP_NZONES];
+  char text[WATCH_CELL_MAX];
+  const raplcap_zone_state* s;
+  watch_row* r;
+  double joules;
+  size_t len = 0;
+  uint32_t i;
+  int z;
+  for (i = 0; i < t->n_rows; i++) {
+    r = &t->rows[i];
+    if (i == 0 || r->pkg != t->rows[i - 1].pkg || r->die != t->rows[i - 1].die) {
+      if (raplcap_pd_get_zone_states(NULL, r->pkg, r->die, states, RAPLCAP_NZONES) < 0) {
+        memset(states, 0, sizeof(states));
+        for (z = 0; z < RAPLCAP_NZONES; z++) {
+          states[z].enabled = states[z].clamped = states[z].locked = -1;
+        }
+      }
+    }
+    s = &states[r->zone];
+    joules = t->snapshot[r->idx];
+    watch_format(text, WATCH_CELL_WATTS, interval_ns > 0, 2,
+                 get_watts(r->joules, joules, r->joules_max, interval_ns / 1000000000.0));
+    r->joules = joules;
+    len = watch_draw_cell(t, i, WATCH_CELL_WATTS, text, len);
+    watch_format(text, WATCH_CELL_PL1_WATTS, r->constraints & (1U << RAPLCAP_CONSTRAINT_LONG_TERM), 2,
+                 s->limits[RAPLCAP_CONSTRAINT_LONG_TERM].watts);
+    len = watch_draw_cell(t, i, WATCH_CELL_PL1_WATTS, text, len);
+    watch_format(text, WATCH_CELL_PL1_SECONDS, r->constraints & (1U << RAPLCAP_CONSTRAINT_LONG_TERM), 4,
+                 s->limits[RAPLCAP_CONSTRAINT_LONG_TERM].seconds);
+    len = watch_draw_cell(t, i, WATCH_CELL_PL1_SECONDS, text, len);
+    watch_format(text, WATCH_CELL_PL2_WATTS, r->constraints & (1U << RAPLCAP_CONSTRAINT_SHORT_TERM), 2,
+                 s->limits[RAPLCAP_CONSTRAINT_SHORT_TERM].watts);
+    len = watch_draw_cell(t, i, WATCH_CELL_PL2_WATTS, text, len);
+    watch_format(text, WATCH_CELL_PL2_SECONDS, r->constraints & (1U << RAPLCAP_CONSTRAINT_SHORT_TERM), 4,
+                 s->limits[RAPLCAP_CONSTRAINT_SHORT_TERM].seconds);
+    len = watch_draw_cell(t, i, WATCH_CELL_PL2_SECONDS, text, len);
+    watch_format(text, WATCH_CELL_PL4_WATTS, r->constraints & (1U << RAPLCAP_CONSTRAINT_PEAK_POWER), 2,
+                 s->limits[RAPLCAP_CONSTRAINT_PEAK_POWER].watts);
+    len = watch_draw_cell(t, i, WATCH_CELL_PL4_WATTS, text, len);
+    watch_format(text, WATCH_CELL_ENABLED, s->enabled >= 0, 0, s->enabled);
+    len = watch_draw_cell(t, i, WATCH_CELL_ENABLED, text, len);
+    watch_format(text, WATCH_CELL_CLAMPED, s->clamped >= 0, 0, s->clamped);
+    len = watch_draw_cell(t, i, WATCH_CELL_CLAMPED, text, len);
+    watch_format(text, WATCH_CELL_LOCKED, s->locked >= 0, 0, s->locked);
+    len = watch_draw_cell(t, i, WATCH_CELL_LOCKED, text, len);
+    // the state read at the end of an interval is attributed to all of it
+    if (s->clamped > 0) {
+      r->clamped_ns += interval_ns;
+    }
+    watch_format(text, WATCH_CELL_CLAMPED_PCT, s->clamped >= 0 && elapsed_ns > 0, 1,
+                 100.0 * (double) r->clamped_ns / (double) elapsed_ns);
+    len = watch_draw_cell(t, i, WATCH_CELL_CLAMPED_PCT, text, len);
+  }
+  return len;
+}
+
+static int watch_refresh(watch_table* t, uint64_t interval_ns, uint64_t elapsed_ns) {
+  size_t len;
+  if (raplcap_get_energy_snapshot(NULL, t->snapshot, t->n_snapshot) < 0) {
+    perror("Failed to get energy snapshot");
+    return -1;
+  }
+  len = watch_render(t, interval_ns, elapsed_ns);
+  if ((len > 0 && fwrite(t->frame, len, 1, stdout) != 1) || fflush(stdout)) {
+    perror("Failed to write watch output");
+    return -1;
+  }
+  return 0;
+}
+
+static int watch(const rapl_configure_ctx* c) {
+  assert(c != NULL);
+  watch_table t;
+  uint64_t interval_ns = (uint64_t) (c->watch_interval * 1000000000.0);
+  uint64_t start_ns;
+  uint64_t last_ns;
+  uint64_t cur_ns;
+  uint64_t k;
+  unsigned long n_refreshes = 0;
+  int ret;
+  int err;
+  if (interval_ns == 0) {
+    fprintf(stderr, "Watch interval is too small\n");
+    return -1;
+  }
+  if (watch_table_init(&t, c)) {
+    return -1;
+  }
+  monitor_handle_signals();
+  watch_draw_labels(&t);
+  // draw everything but power right away, then refresh on deadlines like monitoring does
+  start_ns = last_ns = now_ns();
+  ret = watch_refresh(&t, 0, 0);
+  for (k = 1; !ret && !monitor_stop && (c->monitor_iterations == 0 || n_refreshes < c->monitor_iterations); k++) {
+    if ((err = monitor_sleep_until(start_ns + k * interval_ns)) != 0) {
+      ret = err < 0 ? -1 : 0;
+      break;
+    }
+    cur_ns = now_ns();
+    ret = watch_refresh(&t, cur_ns - last_ns, cur_ns - start_ns);
+    last_ns = cur_ns;
+    n_refreshes++;
+    while (start_ns + (k + 1) * interval_ns <= cur_ns) {
+      k++;
+    }
+  }
+  // leave the cursor below the table
+  printf("\033[%"PRIu32";1H\033[?25h\n", t.n_rows + 2);
+  watch_table_destroy(&t);
+  return ret;
+}
+
 #define SET_VAL(optarg, val, set_val) \
   if ((val = atof(optarg)) <= 0) { \
     fprintf(stderr, "Time window and power limit values must be > 0\n"); \
@@ -350,9 +946,11 @@ int main(int argc, char** argv) {
         break;
       case 'c':
         ctx.pkg = (unsigned int) atoi(optarg);
+        ctx.has_pkg = 1;
         break;
       case 'd':
         ctx.die = (unsigned int) atoi(optarg);
+        ctx.has_die = 1;
         break;
       case 'n':
         ctx.get_packages = 1;
@@ -361,6 +959,7 @@ int main(int argc, char** argv) {
         ctx.get_die = 1;
         break;
       case 'z':
+        ctx.has_zone = 1;
         if (!strcmp(optarg, "PACKAGE")) {
           ctx.zone = RAPLCAP_ZONE_PACKAGE;
         } else if (!strcmp(optarg, "CORE")) {
@@ -417,6 +1016,35 @@ int main(int argc, char** argv) {
         ctx.set_locked = 1;
         break;
 #endif // RAPLCAP_msr
+      case 'm':
+        if ((ctx.monitor_interval = atof(optarg)) <= 0) {
+          fprintf(stderr, "Monitor interval must be > 0\n");
+          print_usage(1);
+        }
+        break;
+      case 'i':
+        ctx.monitor_iterations = strtoul(optarg, NULL, 0);
+        break;
+      case 'f':
+        if (!strcmp(optarg, "CSV")) {
+          ctx.monitor_format = MONITOR_FORMAT_CSV;
+        } else if (!strcmp(optarg, "BINARY")) {
+          ctx.monitor_format = MONITOR_FORMAT_BINARY;
+        } else if (!strcmp(optarg, "TRACE")) {
+          ctx.monitor_format = MONITOR_FORMAT_TRACE;
+        } else {
+          print_usage(1);
+        }
+        break;
+      case 'o':
+        ctx.monitor_output = optarg;
+        break;
+      case 'r':
+        if ((ctx.watch_interval = atof(optarg)) <= 0) {
+          fprintf(stderr, "Watch interval must be > 0\n");
+          print_usage(1);
+        }
+        break;
       case '?':
       default:
         print_usage(1);
@@ -450,6 +1078,14 @@ int main(int argc, char** argv) {
 #ifdef RAPLCAP_msr
   is_read_only &= !ctx.set_clamped && !ctx.set_locked;
 #endif // RAPLCAP_msr
+  if (ctx.monitor_interval > 0 && ctx.watch_interval > 0) {
+    fprintf(stderr, "Cannot monitor and watch at the same time\n");
+    print_usage(1);
+  }
+  if ((ctx.monitor_interval > 0 || ctx.watch_interval > 0) && !is_read_only) {
+    fprintf(stderr, "Cannot set values while monitoring or watching\n");
+    print_usage(1);
+  }
 #ifndef _WIN32
   if (is_read_only) {
     // request read-only access (not supported by all implementations, therefore not guaranteed)
@@ -461,7 +1097,11 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  if (!(ret = check_zone_supported(&ctx))) {
+  if (ctx.monitor_interval > 0) {
+    ret = monitor(&ctx);
+  } else if (ctx.watch_interval > 0) {
+    ret = watch(&ctx);
+  } else if (!(ret = check_zone_supported(&ctx))) {
     // perform requested action
     if (is_read_only) {
       // TODO: Should we limit output by constraint, too?
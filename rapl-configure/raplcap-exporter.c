@@ -0,0 +1,524 @@
+/**
+ * Export RAPL energy, limits, and zone state as Prometheus metrics over HTTP.
+ *
+ * Zones are sampled on a fixed interval with a persistent context, independent of scrapes.
+ * Metrics are rendered into a preallocated buffer only when a sample differs from the previous one, so a scrape only
+ * writes the current buffer to the socket - no RAPL reads, formatting, or allocations.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for sigaction, MSG_NOSIGNAL
+#define _POSIX_C_SOURCE 200809L
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "raplcap.h"
+#include "raplcap-common.h"
+#ifdef RAPLCAP_msr
+#include "raplcap-msr.h"
+#endif // RAPLCAP_msr
+
+#define ONE_BILLION 1000000000ULL
+#define DEFAULT_PORT 9386
+#define LISTEN_BACKLOG 16
+// enough for a scrape request's headers - larger requests are rejected
+#define REQUEST_MAX_SIZE 4096
+// slow clients can't hold up sampling or other scrapes for longer than this
+#define CLIENT_TIMEOUT_SECONDS 1
+// metric lines for a zone, so rebuilds don't normally need to grow the buffer
+#define BUF_SIZE_PER_ZONE 1024
+#define BUF_SIZE_HEADERS 2048
+
+#define CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+static const char RESPONSE_NOT_FOUND[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+// lowercase, like powercap zone names (package zones are named "package-N", but the package is also a label)
+static const char* const ZONE_LABELS[RAPLCAP_NZONES] = {
+  "package",
+  "core",
+  "uncore",
+  "dram",
+  "psys"
+};
+
+static const char* const CONSTRAINT_LABELS[RAPLCAP_NCONSTRAINTS] = {
+  "long_term",
+  "short_term",
+  "peak_power"
+};
+
+typedef struct exporter_zone {
+  uint32_t pkg;
+  uint32_t die;
+  raplcap_zone zone;
+  // bit constraint is set if the constraint is supported
+  uint8_t constraints;
+} exporter_zone;
+
+// negative values are unavailable, and aren't exported
+typedef struct exporter_sample {
+  double joules;
+  raplcap_limit limits[RAPLCAP_NCONSTRAINTS];
+  int enabled;
+  int clamped;
+  int locked;
+} exporter_sample;
+
+typedef struct exporter {
+  exporter_zone* zones;
+  // the latest and previous samples of each zone, allocated with calloc so padding always compares equal
+  exporter_sample* samples;
+  exporter_sample* prev;
+  uint32_t n_zones;
+  // the rendered metrics
+  char* buf;
+  size_t size;
+  size_t len;
+  // set if rendering ran out of space
+  int overflow;
+} exporter;
+
+static const char* prog;
+static const char short_options[] = "a:p:i:1h";
+static const struct option long_options[] = {
+  {"address",  required_argument, NULL, 'a'},
+  {"port",     required_argument, NULL, 'p'},
+  {"interval", required_argument, NULL, 'i'},
+  {"once",     no_argument,       NULL, '1'},
+  {"help",     no_argument,       NULL, 'h'},
+  {0, 0, 0, 0}
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static void handle_signal(int sig) {
+  (void) sig;
+  stop = 1;
+}
+
+__attribute__ ((noreturn))
+static void print_usage(int exit_code) {
+  fprintf(exit_code ? stderr : stdout,
+          "Usage: %s [OPTION]...\n\n"
+          "Serve Intel RAPL energy, limits, and zone state as Prometheus metrics at /metrics until interrupted.\n\n"
+          "Options:\n"
+          "  -h, --help               Print this message and exit\n"
+          "  -a, --address=ADDRESS    The IPv4 address to listen on (0.0.0.0 by default)\n"
+          "  -p, --port=PORT          The TCP port to listen on (%d by default)\n"
+          "  -i, --interval=SECONDS   The sampling interval (1 by default)\n"
+          "                           Must be less than the energy counter rollover period\n"
+          "  -1, --once               Print metrics from one sample to stdout and exit\n"
+          "                           E.g., for a textfile collector\n",
+          prog, DEFAULT_PORT);
+  exit(exit_code);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * ONE_BILLION + (uint64_t) ts.tv_nsec;
+}
+
+static int exporter_init(exporter* e) {
+  uint32_t n_pkg;
+  uint32_t n_die;
+  uint32_t pkg;
+  uint32_t die;
+  int zone;
+  int c;
+  memset(e, 0, sizeof(*e));
+  if ((n_pkg = raplcap_get_num_packages(NULL)) == 0) {
+    perror("raplcap_get_num_packages");
+    return -1;
+  }
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    if ((n_die = raplcap_get_num_die(NULL, pkg)) == 0) {
+      perror("raplcap_get_num_die");
+      return -1;
+    }
+    e->n_zones += n_die * RAPLCAP_NZONES;
+  }
+  if ((e->zones = calloc(e->n_zones, sizeof(*e->zones))) == NULL ||
+      (e->samples = calloc(e->n_zones, sizeof(*e->samples))) == NULL ||
+      (e->prev = calloc(e->n_zones, sizeof(*e->prev))) == NULL) {
+    perror("calloc");
+    return -1;
+  }
+  // only supported zones are sampled
+  e->n_zones = 0;
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    n_die = raplcap_get_num_die(NULL, pkg);
+    for (die = 0; die < n_die; die++) {
+      for (zone = 0; zone < RAPLCAP_NZONES; zone++) {
+        if (raplcap_pd_is_zone_supported(NULL, pkg, die, (raplcap_zone) zone) <= 0) {
+          continue;
+        }
+        e->zones[e->n_zones].pkg = pkg;
+        e->zones[e->n_zones].die = die;
+        e->zones[e->n_zones].zone = (raplcap_zone) zone;
+        for (c = 0; c < RAPLCAP_NCONSTRAINTS; c++) {
+          if (raplcap_pd_is_constraint_supported(NULL, pkg, die, (raplcap_zone) zone, (raplcap_constraint) c) > 0) {
+            e->zones[e->n_zones].constraints |= (uint8_t) (1 << c);
+          }
+        }
+        e->n_zones++;
+      }
+    }
+  }
+  e->size = BUF_SIZE_HEADERS + (e->n_zones * BUF_SIZE_PER_ZONE);
+  if ((e->buf = malloc(e->size)) == NULL) {
+    perror("malloc");
+    return -1;
+  }
+  return 0;
+}
+
+static void exporter_destroy(exporter* e) {
+  free(e->buf);
+  free(e->prev);
+  free(e->samples);
+  free(e->zones);
+}
+
+static void sample(const exporter* e) {
+  const exporter_zone* z;
+  exporter_sample* s;
+  uint32_t i;
+  int c;
+  for (i = 0; i < e->n_zones; i++) {
+    z = &e->zones[i];
+    s = &e->samples[i];
+    s->joules = raplcap_pd_get_energy_accumulated(NULL, z->pkg, z->die, z->zone);
+    for (c = 0; c < RAPLCAP_NCONSTRAINTS; c++) {
+      if (!(z->constraints & (1 << c)) ||
+          raplcap_pd_get_limit(NULL, z->pkg, z->die, z->zone, (raplcap_constraint) c, &s->limits[c])) {
+        s->limits[c].watts = -1;
+        s->limits[c].seconds = -1;
+      }
+    }
+    s->enabled = raplcap_pd_is_zone_enabled(NULL, z->pkg, z->die, z->zone);
+#ifdef RAPLCAP_msr
+    s->clamped = raplcap_msr_pd_is_zone_clamped(NULL, z->pkg, z->die, z->zone);
+    s->locked = raplcap_msr_pd_is_zone_locked(NULL, z->pkg, z->die, z->zone);
+#else
+    s->clamped = -1;
+    s->locked = -1;
+#endif // RAPLCAP_msr
+  }
+}
+
+__attribute__ ((format (printf, 2, 3)))
+static void append(exporter* e, const char* fmt, ...) {
+  va_list ap;
+  int n;
+  if (e->overflow) {
+    return;
+  }
+  va_start(ap, fmt);
+  n = vsnprintf(e->buf + e->len, e->size - e->len, fmt, ap);
+  va_end(ap);
+  if (n < 0 || (size_t) n >= e->size - e->len) {
+    e->overflow = 1;
+    return;
+  }
+  e->len += (size_t) n;
+}
+
+static void append_family(exporter* e, const char* name, const char* type, const char* help) {
+  append(e, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void append_labels(exporter* e, const char* name, const exporter_zone* z) {
+  append(e, "%s{package=\"%"PRIu32"\",die=\"%"PRIu32"\",zone=\"%s\"", name, z->pkg, z->die, ZONE_LABELS[z->zone]);
+}
+
+static void append_state(exporter* e, const char* name, const char* help, size_t offset) {
+  uint32_t i;
+  int val;
+  int has_family = 0;
+  for (i = 0; i < e->n_zones; i++) {
+    memcpy(&val, (const unsigned char*) &e->samples[i] + offset, sizeof(val));
+    if (val < 0) {
+      continue;
+    }
+    if (!has_family) {
+      append_family(e, name, "gauge", help);
+      has_family = 1;
+    }
+    append_labels(e, name, &e->zones[i]);
+    append(e, "} %d\n", val ? 1 : 0);
+  }
+}
+
+static void render_metrics(exporter* e) {
+  const exporter_sample* s;
+  uint32_t i;
+  int c;
+  e->len = 0;
+  e->overflow = 0;
+  // each family's samples must be together
+  append_family(e, "raplcap_energy_joules_total", "counter", "Energy consumed since the exporter started.");
+  for (i = 0; i < e->n_zones; i++) {
+    if (e->samples[i].joules >= 0) {
+      append_labels(e, "raplcap_energy_joules_total", &e->zones[i]);
+      append(e, "} %.6f\n", e->samples[i].joules);
+    }
+  }
+  append_family(e, "raplcap_power_limit_watts", "gauge", "Power limit of a constraint.");
+  for (i = 0; i < e->n_zones; i++) {
+    for (c = 0, s = &e->samples[i]; c < RAPLCAP_NCONSTRAINTS; c++) {
+      if (s->limits[c].watts >= 0) {
+        append_labels(e, "raplcap_power_limit_watts", &e->zones[i]);
+        append(e, ",constraint=\"%s\"} %.6f\n", CONSTRAINT_LABELS[c], s->limits[c].watts);
+      }
+    }
+  }
+  append_family(e, "raplcap_time_window_seconds", "gauge", "Time window of a constraint.");
+  for (i = 0; i < e->n_zones; i++) {
+    for (c = 0, s = &e->samples[i]; c < RAPLCAP_NCONSTRAINTS; c++) {
+      // constraints like peak power don't have a time window
+      if (s->limits[c].seconds > 0) {
+        append_labels(e, "raplcap_time_window_seconds", &e->zones[i]);
+        append(e, ",constraint=\"%s\"} %.6f\n", CONSTRAINT_LABELS[c], s->limits[c].seconds);
+      }
+    }
+  }
+  append_state(e, "raplcap_zone_enabled", "Whether a zone's power limits are enabled.",
+               offsetof(exporter_sample, enabled));
+  append_state(e, "raplcap_zone_clamped", "Whether a zone is clamped.", offsetof(exporter_sample, clamped));
+  append_state(e, "raplcap_zone_locked", "Whether a zone's configuration is locked until reset.",
+               offsetof(exporter_sample, locked));
+}
+
+// Sample, then render only if something changed
+static int update(exporter* e) {
+  exporter_sample* tmp;
+  char* buf;
+  sample(e);
+  if (e->len > 0 && !memcmp(e->samples, e->prev, e->n_zones * sizeof(*e->samples))) {
+    return 0;
+  }
+  render_metrics(e);
+  while (e->overflow) {
+    if ((buf = realloc(e->buf, e->size * 2)) == NULL) {
+      perror("realloc");
+      e->len = 0;
+      return -1;
+    }
+    e->buf = buf;
+    e->size *= 2;
+    render_metrics(e);
+  }
+  tmp = e->prev;
+  e->prev = e->samples;
+  e->samples = tmp;
+  return 0;
+}
+
+static int send_all(int fd, const char* buf, size_t len) {
+  ssize_t n;
+  while (len > 0) {
+    if ((n = send(fd, buf, len, MSG_NOSIGNAL)) < 0) {
+      if (errno == EINTR && !stop) {
+        continue;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= (size_t) n;
+  }
+  return 0;
+}
+
+static void serve(const exporter* e, int fd) {
+  // the request is only parsed in place, and the response header is small
+  char req[REQUEST_MAX_SIZE];
+  char hdr[256];
+  size_t len = 0;
+  ssize_t n;
+  int hdr_len;
+  // read the headers, so closing the socket doesn't reset the connection before the client reads the response
+  while (len < sizeof(req) - 1) {
+    if ((n = recv(fd, req + len, sizeof(req) - 1 - len, 0)) <= 0) {
+      if (n < 0 && errno == EINTR && !stop) {
+        continue;
+      }
+      return;
+    }
+    len += (size_t) n;
+    req[len] = '\0';
+    if (strstr(req, "\r\n\r\n") != NULL) {
+      break;
+    }
+  }
+  if (strncmp(req, "GET /metrics ", 13) && strncmp(req, "GET /metrics?", 13)) {
+    send_all(fd, RESPONSE_NOT_FOUND, sizeof(RESPONSE_NOT_FOUND) - 1);
+    return;
+  }
+  hdr_len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n", CONTENT_TYPE, e->len);
+  if (send_all(fd, hdr, (size_t) hdr_len) == 0) {
+    send_all(fd, e->buf, e->len);
+  }
+}
+
+static int listen_on(const char* address, uint16_t port) {
+  struct sockaddr_in addr;
+  int one = 1;
+  int fd;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+    fprintf(stderr, "Invalid IPv4 address: %s\n", address);
+    return -1;
+  }
+  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    perror("socket");
+    return -1;
+  }
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+      bind(fd, (const struct sockaddr*) &addr, sizeof(addr)) ||
+      listen(fd, LISTEN_BACKLOG)) {
+    perror("Failed to listen");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int export_loop(exporter* e, int lfd, uint64_t interval_ns) {
+  const struct timeval tv = { CLIENT_TIMEOUT_SECONDS, 0 };
+  struct pollfd pfd = { lfd, POLLIN, 0 };
+  uint64_t next_ns = now_ns() + interval_ns;
+  uint64_t cur_ns;
+  int timeout_ms;
+  int ret;
+  int fd;
+  while (!stop) {
+    cur_ns = now_ns();
+    if (cur_ns >= next_ns) {
+      if (update(e)) {
+        return -1;
+      }
+      // if sampling overran any deadlines, skip them rather than sampling back-to-back
+      do {
+        next_ns += interval_ns;
+      } while (next_ns <= cur_ns);
+      continue;
+    }
+    // round up, so the sample isn't taken early
+    timeout_ms = (int) ((next_ns - cur_ns + 999999) / 1000000);
+    if ((ret = poll(&pfd, 1, timeout_ms)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      return -1;
+    }
+    if (ret > 0 && (pfd.revents & POLLIN)) {
+      if ((fd = accept(lfd, NULL, NULL)) < 0) {
+        // the client may have given up, but the server can continue
+        continue;
+      }
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+      serve(e, fd);
+      close(fd);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  struct sigaction sa;
+  exporter e;
+  const char* address = "0.0.0.0";
+  unsigned long port = DEFAULT_PORT;
+  double interval = 1;
+  uint64_t interval_ns;
+  int once = 0;
+  int ret = 0;
+  int lfd;
+  int c;
+  prog = argv[0];
+
+  while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+    switch (c) {
+      case 'h':
+        print_usage(0);
+      case 'a':
+        address = optarg;
+        break;
+      case 'p':
+        port = strtoul(optarg, NULL, 0);
+        break;
+      case 'i':
+        interval = atof(optarg);
+        break;
+      case '1':
+        once = 1;
+        break;
+      case '?':
+      default:
+        print_usage(1);
+    }
+  }
+  if (optind < argc || !(interval > 0) || port == 0 || port > UINT16_MAX) {
+    print_usage(1);
+  }
+  if ((interval_ns = (uint64_t) (interval * ONE_BILLION)) < 1000000) {
+    fprintf(stderr, "Sampling interval is too small\n");
+    return EXIT_FAILURE;
+  }
+
+  if (raplcap_init(NULL)) {
+    perror("raplcap_init");
+    return EXIT_FAILURE;
+  }
+  if (raplcap_set_energy_accumulation(NULL, 1)) {
+    perror("raplcap_set_energy_accumulation");
+    raplcap_destroy(NULL);
+    return EXIT_FAILURE;
+  }
+  if (exporter_init(&e) || update(&e)) {
+    ret = -1;
+  } else if (once) {
+    if (fwrite(e.buf, 1, e.len, stdout) != e.len) {
+      perror("fwrite");
+      ret = -1;
+    }
+  } else if ((lfd = listen_on(address, (uint16_t) port)) < 0) {
+    ret = -1;
+  } else {
+    // stop cleanly when interrupted, without restarting poll
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    ret = export_loop(&e, lfd, interval_ns);
+    close(lfd);
+  }
+  exporter_destroy(&e);
+  if (raplcap_destroy(NULL)) {
+    perror("raplcap_destroy");
+    ret = -1;
+  }
+  return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+/**
+ * Publish RAPL energy and power to shared memory for other processes to read.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+// for shm_open, ftruncate, clock_nanosleep, sigaction
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "raplcap.h"
+#include "raplcap-shm.h"
+
+#define ONE_BILLION 1000000000ULL
+
+static const char* prog;
+static const char short_options[] = "i:n:h";
+static const struct option long_options[] = {
+  {"interval", required_argument, NULL, 'i'},
+  {"name",     required_argument, NULL, 'n'},
+  {"help",     no_argument,       NULL, 'h'},
+  {0, 0, 0, 0}
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static void handle_signal(int sig) {
+  (void) sig;
+  stop = 1;
+}
+
+__attribute__ ((noreturn))
+static void print_usage(int exit_code) {
+  fprintf(exit_code ? stderr : stdout,
+          "Usage: %s [OPTION]...\n\n"
+          "Publish Intel RAPL energy and power to shared memory until interrupted.\n\n"
+          "Options:\n"
+          "  -h, --help               Print this message and exit\n"
+          "  -i, --interval=SECONDS   The publishing interval (0.1 by default)\n"
+          "  -n, --name=NAME          The shared memory object name (%s by default)\n"
+          "                           Names must start with '/' and contain no other '/'\n",
+          prog, RAPLCAP_SHM_DEFAULT_NAME);
+  exit(exit_code);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * ONE_BILLION + (uint64_t) ts.tv_nsec;
+}
+
+static int publish_loop(raplcap_shm_publisher* p, uint64_t interval_ns) {
+  struct timespec deadline_ts;
+  uint64_t start_ns;
+  uint64_t deadline_ns;
+  uint64_t cur_ns;
+  uint64_t k;
+  int err;
+  // deadlines are absolute multiples of the interval from the start, so scheduling delays don't accumulate
+  start_ns = now_ns();
+  for (k = 1; !stop; k++) {
+    deadline_ns = start_ns + k * interval_ns;
+    deadline_ts.tv_sec = (time_t) (deadline_ns / ONE_BILLION);
+    deadline_ts.tv_nsec = (long) (deadline_ns % ONE_BILLION);
+    do {
+      err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline_ts, NULL);
+    } while (err == EINTR && !stop);
+    if (stop) {
+      break;
+    }
+    if (err) {
+      errno = err;
+      perror("clock_nanosleep");
+      return -1;
+    }
+    if (raplcap_shm_publish(p)) {
+      perror("raplcap_shm_publish");
+      return -1;
+    }
+    // if publishing overran any deadlines, skip them rather than publishing back-to-back
+    cur_ns = now_ns();
+    while (start_ns + (k + 1) * interval_ns <= cur_ns) {
+      k++;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  struct sigaction sa;
+  raplcap_shm_publisher* p;
+  const char* name = RAPLCAP_SHM_DEFAULT_NAME;
+  double interval = 0.1;
+  uint64_t interval_ns;
+  size_t len;
+  void* mem;
+  int ret = 0;
+  int fd;
+  int c;
+  prog = argv[0];
+
+  while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+    switch (c) {
+      case 'h':
+        print_usage(0);
+      case 'i':
+        interval = atof(optarg);
+        break;
+      case 'n':
+        name = optarg;
+        break;
+      case '?':
+      default:
+        print_usage(1);
+    }
+  }
+  if (optind < argc || !(interval > 0)) {
+    print_usage(1);
+  }
+  if ((interval_ns = (uint64_t) (interval * ONE_BILLION)) == 0) {
+    fprintf(stderr, "Publishing interval is too small\n");
+    return EXIT_FAILURE;
+  }
+
+  if (raplcap_init(NULL)) {
+    perror("raplcap_init");
+    return EXIT_FAILURE;
+  }
+  if ((len = raplcap_shm_get_size(NULL)) == 0) {
+    perror("raplcap_shm_get_size");
+    raplcap_destroy(NULL);
+    return EXIT_FAILURE;
+  }
+  // a stale object might have a different layout, and readers must not see a region that's being resized
+  if (shm_unlink(name) && errno != ENOENT) {
+    perror("shm_unlink");
+    raplcap_destroy(NULL);
+    return EXIT_FAILURE;
+  }
+  if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0) {
+    perror("shm_open");
+    raplcap_destroy(NULL);
+    return EXIT_FAILURE;
+  }
+  if (ftruncate(fd, (off_t) len)) {
+    perror("ftruncate");
+    ret = -1;
+  } else if ((mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    perror("mmap");
+    ret = -1;
+  }
+  close(fd);
+  if (ret) {
+    shm_unlink(name);
+    raplcap_destroy(NULL);
+    return EXIT_FAILURE;
+  }
+
+  if ((p = raplcap_shm_publisher_init(NULL, mem, len)) == NULL) {
+    perror("raplcap_shm_publisher_init");
+    ret = -1;
+  } else {
+    // stop cleanly when interrupted, without restarting clock_nanosleep
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    ret = publish_loop(p, interval_ns);
+    raplcap_shm_publisher_destroy(p);
+  }
+
+  // readers that still have the region mapped keep seeing the last published values
+  munmap(mem, len);
+  if (shm_unlink(name)) {
+    perror("shm_unlink");
+    ret = -1;
+  }
+  if (raplcap_destroy(NULL)) {
+    perror("raplcap_destroy");
+    ret = -1;
+  }
+  return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
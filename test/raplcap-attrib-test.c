@@ -0,0 +1,214 @@
+/**
+ * Attribute mock energy to fake cgroups.
+ */
+// for mkdtemp
+#define _POSIX_C_SOURCE 200809L
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "raplcap.h"
+#include "raplcap-attrib.h"
+
+// counters increase by 0x1000 units of 2^-14 J per read
+#define MOCK_JOULES_PER_READ (0x1000 / 16384.0)
+
+static char dir[] = "/tmp/raplcap-attrib-test-XXXXXX";
+
+static int equal_dbl(double a, double b) {
+  return fabs(a - b) < 1e-9;
+}
+
+static void get_path(char* buf, size_t len, const char* cgroup, const char* file) {
+  assert(snprintf(buf, len, "%s/%s%s%s", dir, cgroup, file == NULL ? "" : "/", file == NULL ? "" : file) < (int) len);
+}
+
+static void make_cgroup(const char* cgroup) {
+  char path[256];
+  get_path(path, sizeof(path), cgroup, NULL);
+  assert(mkdir(path, S_IRWXU) == 0);
+}
+
+static void set_usage(const char* cgroup, uint64_t usec) {
+  char path[256];
+  FILE* f;
+  get_path(path, sizeof(path), cgroup, "cpu.stat");
+  assert((f = fopen(path, "w")) != NULL);
+  fprintf(f, "usage_usec %"PRIu64"\nuser_usec %"PRIu64"\nsystem_usec 0\n", usec, usec);
+  assert(fclose(f) == 0);
+}
+
+static void set_bad_usage(const char* cgroup) {
+  char path[256];
+  FILE* f;
+  get_path(path, sizeof(path), cgroup, "cpu.stat");
+  assert((f = fopen(path, "w")) != NULL);
+  fprintf(f, "user_usec 0\n");
+  assert(fclose(f) == 0);
+}
+
+static void remove_cgroup(const char* cgroup) {
+  char path[256];
+  get_path(path, sizeof(path), cgroup, "cpu.stat");
+  assert(unlink(path) == 0);
+  get_path(path, sizeof(path), cgroup, NULL);
+  assert(rmdir(path) == 0);
+}
+
+// energy per sample from all PACKAGE and DRAM zones
+static double get_joules_per_sample(void) {
+  uint32_t n_pkg;
+  uint32_t pkg;
+  uint32_t die;
+  double joules = 0;
+  assert((n_pkg = raplcap_get_num_packages(NULL)) > 0);
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    for (die = 0; die < raplcap_get_num_die(NULL, pkg); die++) {
+      if (raplcap_pd_is_zone_supported(NULL, pkg, die, RAPLCAP_ZONE_PACKAGE) > 0) {
+        joules += MOCK_JOULES_PER_READ;
+      }
+      if (raplcap_pd_is_zone_supported(NULL, pkg, die, RAPLCAP_ZONE_DRAM) > 0) {
+        joules += MOCK_JOULES_PER_READ;
+      }
+    }
+  }
+  return joules;
+}
+
+static void test_root(double e) {
+  raplcap_attrib* a;
+  char path[256];
+  int id_a;
+  int id_b;
+  set_usage("root", 0);
+  set_usage("a", 0);
+  set_usage("b", 0);
+  get_path(path, sizeof(path), "root", NULL);
+  assert((a = raplcap_attrib_init(NULL, path)) != NULL);
+  get_path(path, sizeof(path), "a", NULL);
+  assert((id_a = raplcap_attrib_add_cgroup(a, path)) >= 0);
+  get_path(path, sizeof(path), "b", NULL);
+  assert((id_b = raplcap_attrib_add_cgroup(a, path)) >= 0);
+  assert(id_a != id_b);
+  get_path(path, sizeof(path), "missing", NULL);
+  assert(raplcap_attrib_add_cgroup(a, path) < 0);
+
+  // a and b use half and a quarter of the root's CPU time
+  set_usage("root", 1000);
+  set_usage("a", 500);
+  set_usage("b", 250);
+  assert(raplcap_attrib_sample(a) == 0);
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_a), e / 2));
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_b), e / 4));
+  assert(equal_dbl(raplcap_attrib_get_unattributed_energy(a), e / 4));
+
+  // only deltas are attributed, and removed cgroups get nothing
+  assert(raplcap_attrib_remove_cgroup(a, id_b) == 0);
+  assert(raplcap_attrib_remove_cgroup(a, id_b) < 0);
+  assert(raplcap_attrib_get_energy(a, id_b) < 0);
+  set_usage("root", 2000);
+  set_usage("a", 1500);
+  set_usage("b", 500);
+  assert(raplcap_attrib_sample(a) == 0);
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_a), e / 2 + e));
+  assert(equal_dbl(raplcap_attrib_get_unattributed_energy(a), e / 4));
+
+  // freed IDs are reused, and new cgroups start from 0
+  get_path(path, sizeof(path), "b", NULL);
+  assert(raplcap_attrib_add_cgroup(a, path) == id_b);
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_b), 0));
+
+  // no CPU time means no attribution
+  assert(raplcap_attrib_sample(a) == 0);
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_a), e / 2 + e));
+  assert(equal_dbl(raplcap_attrib_get_unattributed_energy(a), e / 4 + e));
+
+  // a failed read restarts the cgroup's baseline, so the missed interval isn't attributed later
+  set_usage("root", 3000);
+  set_usage("a", 2000);
+  set_bad_usage("b");
+  assert(raplcap_attrib_sample(a) == 0);
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_a), e * 2));
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_b), 0));
+  assert(equal_dbl(raplcap_attrib_get_unattributed_energy(a), e * 7 / 4));
+  set_usage("root", 4000);
+  set_usage("b", 1000);
+  assert(raplcap_attrib_sample(a) == 0);
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_b), 0));
+  assert(equal_dbl(raplcap_attrib_get_unattributed_energy(a), e * 11 / 4));
+  set_usage("root", 5000);
+  set_usage("b", 1500);
+  assert(raplcap_attrib_sample(a) == 0);
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_b), e / 2));
+  assert(equal_dbl(raplcap_attrib_get_unattributed_energy(a), e * 13 / 4));
+
+  // if the root's CPU time decreases, nothing is attributed until there's a new baseline
+  set_usage("root", 100);
+  set_usage("a", 2500);
+  assert(raplcap_attrib_sample(a) == 0);
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_a), e * 2));
+  assert(equal_dbl(raplcap_attrib_get_unattributed_energy(a), e * 17 / 4));
+  set_usage("root", 1100);
+  set_usage("a", 3000);
+  assert(raplcap_attrib_sample(a) == 0);
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_a), e * 5 / 2));
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_b), e / 2));
+  assert(equal_dbl(raplcap_attrib_get_unattributed_energy(a), e * 19 / 4));
+  assert(raplcap_attrib_destroy(a) == 0);
+}
+
+static void test_no_root(double e) {
+  raplcap_attrib* a;
+  char path[256];
+  int id_a;
+  int id_b;
+  set_usage("a", 100);
+  set_usage("b", 100);
+  assert((a = raplcap_attrib_init(NULL, NULL)) != NULL);
+  get_path(path, sizeof(path), "a", NULL);
+  assert((id_a = raplcap_attrib_add_cgroup(a, path)) >= 0);
+  get_path(path, sizeof(path), "b", NULL);
+  assert((id_b = raplcap_attrib_add_cgroup(a, path)) >= 0);
+  // tracked cgroups share all energy
+  set_usage("a", 400);
+  set_usage("b", 200);
+  assert(raplcap_attrib_sample(a) == 0);
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_a), e * 3 / 4));
+  assert(equal_dbl(raplcap_attrib_get_energy(a, id_b), e / 4));
+  assert(equal_dbl(raplcap_attrib_get_unattributed_energy(a), 0));
+  assert(raplcap_attrib_destroy(a) == 0);
+}
+
+static void test_bad_params(void) {
+  assert(raplcap_attrib_add_cgroup(NULL, dir) < 0);
+  assert(raplcap_attrib_remove_cgroup(NULL, 0) < 0);
+  assert(raplcap_attrib_sample(NULL) < 0);
+  assert(raplcap_attrib_get_energy(NULL, 0) < 0);
+  assert(raplcap_attrib_get_unattributed_energy(NULL) < 0);
+  assert(raplcap_attrib_destroy(NULL) < 0);
+}
+
+int main(void) {
+  double e;
+  assert(mkdtemp(dir) != NULL);
+  make_cgroup("root");
+  make_cgroup("a");
+  make_cgroup("b");
+  assert(raplcap_init(NULL) == 0);
+  assert((e = get_joules_per_sample()) > 0);
+  test_root(e);
+  test_no_root(e);
+  test_bad_params();
+  assert(raplcap_destroy(NULL) == 0);
+  remove_cgroup("root");
+  remove_cgroup("a");
+  remove_cgroup("b");
+  assert(rmdir(dir) == 0);
+  return 0;
+}
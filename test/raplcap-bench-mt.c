@@ -0,0 +1,171 @@
+/**
+ * Measures energy counter read throughput with concurrent threads, each reading a different package/die.
+ * Threads are assigned to package/die round-robin, so there should be at least as many package/die as threads.
+ * Per-thread throughput that drops as threads are added indicates contention between package/die, e.g., false
+ * sharing of per-package/die state (build with -DRAPLCAP_CACHE_LINE_SIZE=8 to pack that state for comparison).
+ * With a write interval, threads also rewrite their package/die's long term limit (with its current value) after that
+ * many reads, to measure reads and writes together - writes only lock their own package/die.
+ *
+ * Requires a functioning RAPL implementation with appropriate privileges to run.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "raplcap.h"
+
+#define DEFAULT_ITERATIONS 1000000
+
+typedef struct bench_thread {
+  const raplcap* rc;
+  pthread_t thread;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t iterations;
+  uint32_t write_interval;
+  uint64_t ns;
+  int err;
+} bench_thread;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void* bench_thread_run(void* arg) {
+  bench_thread* t = (bench_thread*) arg;
+  raplcap_limit limit;
+  uint64_t start;
+  uint32_t i;
+  if (t->write_interval > 0 &&
+      raplcap_pd_get_limit(t->rc, t->pkg, t->die, RAPLCAP_ZONE_PACKAGE, RAPLCAP_CONSTRAINT_LONG_TERM, &limit)) {
+    perror("raplcap_pd_get_limit");
+    t->err = 1;
+    return NULL;
+  }
+  start = now_ns();
+  for (i = 0; i < t->iterations; i++) {
+    if (raplcap_pd_get_energy_accumulated(t->rc, t->pkg, t->die, RAPLCAP_ZONE_PACKAGE) < 0) {
+      perror("raplcap_pd_get_energy_accumulated");
+      t->err = 1;
+      break;
+    }
+    if (t->write_interval > 0 && (i + 1) % t->write_interval == 0 &&
+        raplcap_pd_set_limit(t->rc, t->pkg, t->die, RAPLCAP_ZONE_PACKAGE, RAPLCAP_CONSTRAINT_LONG_TERM, &limit)) {
+      perror("raplcap_pd_set_limit");
+      t->err = 1;
+      break;
+    }
+  }
+  t->ns = now_ns() - start;
+  return NULL;
+}
+
+static int bench(bench_thread* threads, uint32_t n_threads) {
+  uint64_t ns = 0;
+  uint32_t i;
+  int ret = 0;
+  for (i = 0; i < n_threads; i++) {
+    threads[i].ns = 0;
+    threads[i].err = 0;
+    if ((errno = pthread_create(&threads[i].thread, NULL, bench_thread_run, &threads[i])) != 0) {
+      perror("pthread_create");
+      n_threads = i;
+      ret = -1;
+      break;
+    }
+  }
+  for (i = 0; i < n_threads; i++) {
+    pthread_join(threads[i].thread, NULL);
+    ret |= threads[i].err ? -1 : 0;
+    if (threads[i].ns > ns) {
+      ns = threads[i].ns;
+    }
+  }
+  if (ret == 0) {
+    printf("%7"PRIu32" %14"PRIu64" %18.0f\n", n_threads, ns / threads[0].iterations,
+           (double) threads[0].iterations * 1000000000.0 / (double) ns);
+  }
+  return ret;
+}
+
+int main(int argc, char** argv) {
+  raplcap rc;
+  bench_thread* threads;
+  uint32_t max_threads;
+  uint32_t iterations = DEFAULT_ITERATIONS;
+  uint32_t write_interval = 0;
+  uint32_t n_pkg;
+  uint32_t n_pkg_die = 0;
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t n;
+  uint32_t i;
+  int ret = EXIT_SUCCESS;
+  if (raplcap_init(&rc)) {
+    perror("raplcap_init");
+    return EXIT_FAILURE;
+  }
+  if ((n_pkg = raplcap_get_num_packages(&rc)) == 0) {
+    perror("raplcap_get_num_packages");
+    raplcap_destroy(&rc);
+    return EXIT_FAILURE;
+  }
+  // die counts may differ between packages
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    n_pkg_die += raplcap_get_num_die(&rc, pkg);
+  }
+  max_threads = n_pkg_die;
+  if ((argc > 1 && (max_threads = (uint32_t) strtoul(argv[1], NULL, 0)) == 0) ||
+      (argc > 2 && (iterations = (uint32_t) strtoul(argv[2], NULL, 0)) == 0) ||
+      (argc > 3 && (write_interval = (uint32_t) strtoul(argv[3], NULL, 0)) == 0)) {
+    fprintf(stderr, "Usage: %s [max_threads] [iterations] [write_interval]\n", argv[0]);
+    raplcap_destroy(&rc);
+    return EXIT_FAILURE;
+  }
+  if (raplcap_set_energy_accumulation(&rc, 1)) {
+    perror("raplcap_set_energy_accumulation");
+    ret = EXIT_FAILURE;
+  } else if ((threads = calloc(max_threads, sizeof(*threads))) == NULL) {
+    perror("calloc");
+    ret = EXIT_FAILURE;
+  } else {
+    for (i = 0, pkg = 0, die = 0; i < max_threads; i++) {
+      threads[i].rc = &rc;
+      threads[i].iterations = iterations;
+      threads[i].write_interval = write_interval;
+      threads[i].pkg = pkg;
+      threads[i].die = die;
+      if (++die >= raplcap_get_num_die(&rc, pkg)) {
+        die = 0;
+        pkg = (pkg + 1) % n_pkg;
+      }
+    }
+    if (max_threads > n_pkg_die) {
+      fprintf(stderr, "Warning: more threads than package/die, some will share a package/die\n");
+    }
+    printf("%7s %14s %18s\n", "threads", "ns_per_read", "reads_per_thread_s");
+    // double thread counts up to the max, so per-thread throughput can be compared as concurrency increases
+    for (n = 1; ret == EXIT_SUCCESS; n = n * 2 > max_threads ? max_threads : n * 2) {
+      if (bench(threads, n)) {
+        ret = EXIT_FAILURE;
+      }
+      if (n == max_threads) {
+        break;
+      }
+    }
+    free(threads);
+  }
+  if (raplcap_destroy(&rc)) {
+    perror("raplcap_destroy");
+  }
+  return ret;
+}
@@ -0,0 +1,325 @@
+/**
+ * Measures per-call latency and syscall counts of RAPLCap functions for each supported package, die, and zone.
+ * Latencies include the overhead of reading CLOCK_MONOTONIC around each call.
+ * Syscall counts are read from /proc/self/io (syscr + syscw) before and after all iterations of a function.
+ * Setting limits is only benchmarked if requested, and only rewrites the current values.
+ * Setting a zone's limits on all packages and die with raplcap_set_limits_all is compared against serial
+ * raplcap_pd_set_limits calls, but only if every package/die has the same current limits.
+ *
+ * Requires a functioning RAPL implementation with appropriate privileges to run.
+ *
+ * @author Connor Imes
+ * @date 2026-10-14
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "raplcap.h"
+
+#define NZONES (RAPLCAP_ZONE_PSYS + 1)
+
+#define DEFAULT_ITERATIONS 10000
+
+static const char* ZONE_NAMES[NZONES] = {
+  "PACKAGE",
+  "CORE",
+  "UNCORE",
+  "DRAM",
+  "PSYS"
+};
+
+typedef enum bench_fn {
+  BENCH_IS_ZONE_ENABLED,
+  BENCH_GET_LIMITS,
+  BENCH_SET_LIMITS,
+  BENCH_GET_ENERGY_COUNTER,
+  BENCH_GET_ENERGY_COUNTER_MAX,
+} bench_fn;
+
+static const char* BENCH_FN_NAMES[BENCH_GET_ENERGY_COUNTER_MAX + 1] = {
+  "raplcap_pd_is_zone_enabled",
+  "raplcap_pd_get_limits",
+  "raplcap_pd_set_limits",
+  "raplcap_pd_get_energy_counter",
+  "raplcap_pd_get_energy_counter_max"
+};
+
+typedef struct bench_ctx {
+  raplcap* rc;
+  uint64_t* ns;
+  double* snapshot;
+  uint32_t snapshot_len;
+  uint32_t iterations;
+} bench_ctx;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// returns 0 if unavailable
+static uint64_t get_syscall_count(void) {
+  char line[64];
+  uint64_t total = 0;
+  uint64_t val;
+  FILE* f;
+  if ((f = fopen("/proc/self/io", "r")) == NULL) {
+    return 0;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (sscanf(line, "syscr: %"SCNu64, &val) == 1 || sscanf(line, "syscw: %"SCNu64, &val) == 1) {
+      total += val;
+    }
+  }
+  fclose(f);
+  return total;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+  const uint64_t x = *((const uint64_t*) a);
+  const uint64_t y = *((const uint64_t*) b);
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void print_header(void) {
+  printf("%-36s %-4s %-4s %-8s %10s %10s %10s %10s\n",
+         "function", "pkg", "die", "zone", "min_ns", "median_ns", "p99_ns", "syscalls");
+}
+
+static void print_result(const bench_ctx* ctx, const char* fn, const char* pkg, const char* die, const char* zone,
+                         uint64_t syscalls) {
+  qsort(ctx->ns, ctx->iterations, sizeof(*ctx->ns), cmp_u64);
+  printf("%-36s %-4s %-4s %-8s %10"PRIu64" %10"PRIu64" %10"PRIu64" %10.2f\n", fn, pkg, die, zone,
+         ctx->ns[0], ctx->ns[ctx->iterations / 2], ctx->ns[(uint32_t) (ctx->iterations * 0.99)],
+         (double) syscalls / ctx->iterations);
+}
+
+static int bench_call(bench_fn fn, raplcap* rc, uint32_t pkg, uint32_t die, raplcap_zone zone,
+                      raplcap_limit* ll, raplcap_limit* ls) {
+  switch (fn) {
+    case BENCH_IS_ZONE_ENABLED:
+      return raplcap_pd_is_zone_enabled(rc, pkg, die, zone) < 0 ? -1 : 0;
+    case BENCH_GET_LIMITS:
+      return raplcap_pd_get_limits(rc, pkg, die, zone, ll, ls);
+    case BENCH_SET_LIMITS:
+      return raplcap_pd_set_limits(rc, pkg, die, zone, ll, ls);
+    case BENCH_GET_ENERGY_COUNTER:
+      return raplcap_pd_get_energy_counter(rc, pkg, die, zone) < 0 ? -1 : 0;
+    case BENCH_GET_ENERGY_COUNTER_MAX:
+      return raplcap_pd_get_energy_counter_max(rc, pkg, die, zone) < 0 ? -1 : 0;
+    default:
+      return -1;
+  }
+}
+
+static int bench_zone(const bench_ctx* ctx, bench_fn fn, uint32_t pkg, uint32_t die, raplcap_zone zone) {
+  raplcap_limit ll;
+  raplcap_limit ls;
+  char pkg_str[16];
+  char die_str[16];
+  uint64_t syscalls;
+  uint64_t start;
+  uint32_t i;
+  // set_limits rewrites the current values
+  if (raplcap_pd_get_limits(ctx->rc, pkg, die, zone, &ll, &ls)) {
+    perror("raplcap_pd_get_limits");
+    return -1;
+  }
+  if (zone == RAPLCAP_ZONE_PSYS) {
+    // some implementations don't allow setting the PSYS short term time window
+    ls.seconds = 0;
+  }
+  syscalls = get_syscall_count();
+  for (i = 0; i < ctx->iterations; i++) {
+    start = now_ns();
+    if (bench_call(fn, ctx->rc, pkg, die, zone, &ll, &ls)) {
+      perror(BENCH_FN_NAMES[fn]);
+      return -1;
+    }
+    ctx->ns[i] = now_ns() - start;
+  }
+  syscalls = get_syscall_count() - syscalls;
+  snprintf(pkg_str, sizeof(pkg_str), "%"PRIu32, pkg);
+  snprintf(die_str, sizeof(die_str), "%"PRIu32, die);
+  print_result(ctx, BENCH_FN_NAMES[fn], pkg_str, die_str, ZONE_NAMES[zone], syscalls);
+  return 0;
+}
+
+static int bench_snapshot(const bench_ctx* ctx) {
+  uint64_t syscalls;
+  uint64_t start;
+  uint32_t i;
+  syscalls = get_syscall_count();
+  for (i = 0; i < ctx->iterations; i++) {
+    start = now_ns();
+    if (raplcap_get_energy_snapshot(ctx->rc, ctx->snapshot, ctx->snapshot_len) < 0) {
+      perror("raplcap_get_energy_snapshot");
+      return -1;
+    }
+    ctx->ns[i] = now_ns() - start;
+  }
+  syscalls = get_syscall_count() - syscalls;
+  print_result(ctx, "raplcap_get_energy_snapshot", "*", "*", "*", syscalls);
+  return 0;
+}
+
+// returns 1 if the zone is supported with the same limits on every package/die, so they can all be rewritten at once
+static int get_common_limits(const bench_ctx* ctx, uint32_t n_pkg, raplcap_zone zone,
+                             raplcap_limit* ll, raplcap_limit* ls) {
+  raplcap_limit pd_ll;
+  raplcap_limit pd_ls;
+  uint32_t n_die;
+  uint32_t pkg;
+  uint32_t die;
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    n_die = raplcap_get_num_die(ctx->rc, pkg);
+    for (die = 0; die < n_die; die++) {
+      if (raplcap_pd_is_zone_supported(ctx->rc, pkg, die, zone) != 1 ||
+          raplcap_pd_get_limits(ctx->rc, pkg, die, zone, &pd_ll, &pd_ls)) {
+        return 0;
+      }
+      if (pkg == 0 && die == 0) {
+        *ll = pd_ll;
+        *ls = pd_ls;
+      } else if (memcmp(ll, &pd_ll, sizeof(pd_ll)) || memcmp(ls, &pd_ls, sizeof(pd_ls))) {
+        return 0;
+      }
+    }
+  }
+  if (zone == RAPLCAP_ZONE_PSYS) {
+    // some implementations don't allow setting the PSYS short term time window
+    ls->seconds = 0;
+  }
+  return 1;
+}
+
+static int set_limits_serial(const bench_ctx* ctx, uint32_t n_pkg, raplcap_zone zone,
+                             const raplcap_limit* ll, const raplcap_limit* ls) {
+  uint32_t n_die;
+  uint32_t pkg;
+  uint32_t die;
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    n_die = raplcap_get_num_die(ctx->rc, pkg);
+    for (die = 0; die < n_die; die++) {
+      if (raplcap_pd_set_limits(ctx->rc, pkg, die, zone, ll, ls)) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static int bench_set_all(const bench_ctx* ctx, uint32_t n_pkg, raplcap_zone zone) {
+  raplcap_limit ll;
+  raplcap_limit ls;
+  uint64_t syscalls;
+  uint64_t start;
+  uint32_t i;
+  int all;
+  if (!get_common_limits(ctx, n_pkg, zone, &ll, &ls)) {
+    return 0;
+  }
+  for (all = 0; all <= 1; all++) {
+    syscalls = get_syscall_count();
+    for (i = 0; i < ctx->iterations; i++) {
+      start = now_ns();
+      if (all ? raplcap_set_limits_all(ctx->rc, zone, &ll, &ls) : set_limits_serial(ctx, n_pkg, zone, &ll, &ls)) {
+        perror(all ? "raplcap_set_limits_all" : "raplcap_pd_set_limits");
+        return -1;
+      }
+      ctx->ns[i] = now_ns() - start;
+    }
+    syscalls = get_syscall_count() - syscalls;
+    print_result(ctx, all ? "raplcap_set_limits_all" : "raplcap_pd_set_limits (serial)", "*", "*", ZONE_NAMES[zone],
+                 syscalls);
+  }
+  return 0;
+}
+
+static int bench(bench_ctx* ctx, int write) {
+  uint32_t n_pkg;
+  uint32_t n_die;
+  uint32_t pkg;
+  uint32_t die;
+  int fn;
+  int zone;
+  int supported;
+  if ((n_pkg = raplcap_get_num_packages(ctx->rc)) == 0) {
+    perror("raplcap_get_num_packages");
+    return -1;
+  }
+  print_header();
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    if ((n_die = raplcap_get_num_die(ctx->rc, pkg)) == 0) {
+      perror("raplcap_get_num_die");
+      return -1;
+    }
+    for (die = 0; die < n_die; die++) {
+      for (zone = 0; zone < NZONES; zone++) {
+        if ((supported = raplcap_pd_is_zone_supported(ctx->rc, pkg, die, (raplcap_zone) zone)) < 0) {
+          perror("raplcap_pd_is_zone_supported");
+          return -1;
+        }
+        if (!supported) {
+          continue;
+        }
+        for (fn = 0; fn <= BENCH_GET_ENERGY_COUNTER_MAX; fn++) {
+          if ((fn != BENCH_SET_LIMITS || write) && bench_zone(ctx, (bench_fn) fn, pkg, die, (raplcap_zone) zone)) {
+            return -1;
+          }
+        }
+      }
+    }
+  }
+  for (zone = 0; write && zone < NZONES; zone++) {
+    if (bench_set_all(ctx, n_pkg, (raplcap_zone) zone)) {
+      return -1;
+    }
+  }
+  return bench_snapshot(ctx);
+}
+
+int main(int argc, char** argv) {
+  raplcap rc;
+  bench_ctx ctx;
+  int write = 0;
+  int snapshot_len;
+  int ret = EXIT_SUCCESS;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.rc = &rc;
+  ctx.iterations = DEFAULT_ITERATIONS;
+  if (argc > 1 && (ctx.iterations = (uint32_t) strtoul(argv[1], NULL, 0)) == 0) {
+    fprintf(stderr, "Usage: %s [iterations] [write_flag]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (argc > 2) {
+    write = atoi(argv[2]);
+  }
+  if (raplcap_init(&rc)) {
+    perror("raplcap_init");
+    return EXIT_FAILURE;
+  }
+  if ((snapshot_len = raplcap_get_energy_snapshot(&rc, NULL, 0)) < 0) {
+    perror("raplcap_get_energy_snapshot");
+    ret = EXIT_FAILURE;
+  } else if ((ctx.ns = malloc(ctx.iterations * sizeof(*ctx.ns))) == NULL ||
+             (ctx.snapshot = malloc((size_t) snapshot_len * sizeof(*ctx.snapshot))) == NULL) {
+    perror("malloc");
+    ret = EXIT_FAILURE;
+  } else {
+    ctx.snapshot_len = (uint32_t) snapshot_len;
+    if (bench(&ctx, write)) {
+      ret = EXIT_FAILURE;
+    }
+  }
+  free(ctx.snapshot);
+  free(ctx.ns);
+  if (raplcap_destroy(&rc)) {
+    perror("raplcap_destroy");
+  }
+  return ret;
+}
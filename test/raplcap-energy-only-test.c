@@ -0,0 +1,43 @@
+/**
+ * Monitor a zone whose energy counter is readable but whose power limit isn't with a mock implementation.
+ * Must be run with RAPLCAP_MSR_MOCK_DENY set to the core zone's power limit register.
+ */
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include "raplcap.h"
+
+#define NZONES (RAPLCAP_ZONE_PSYS + 1)
+
+int main(void) {
+  raplcap_limit ll;
+  double joules[NZONES];
+  assert(raplcap_init(NULL) == 0);
+  assert(raplcap_pd_is_zone_supported(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE) == 1);
+  assert(raplcap_pd_is_zone_supported(NULL, 0, 0, RAPLCAP_ZONE_CORE) == 0);
+
+  // energy operations still work
+  assert(raplcap_pd_get_energy_counter(NULL, 0, 0, RAPLCAP_ZONE_CORE) >= 0);
+  assert(raplcap_pd_get_energy_counter_max(NULL, 0, 0, RAPLCAP_ZONE_CORE) > 0);
+  assert(raplcap_get_energy_snapshot(NULL, joules, NZONES) == NZONES);
+  assert(joules[RAPLCAP_ZONE_PACKAGE] >= 0);
+  assert(joules[RAPLCAP_ZONE_CORE] >= 0);
+  assert(raplcap_set_energy_accumulation(NULL, 1) == 0);
+  assert(raplcap_pd_get_energy_accumulated(NULL, 0, 0, RAPLCAP_ZONE_CORE) > 0);
+
+  // power limit operations don't
+  errno = 0;
+  assert(raplcap_pd_get_limits(NULL, 0, 0, RAPLCAP_ZONE_CORE, &ll, NULL) < 0);
+  assert(errno == ENOTSUP);
+  errno = 0;
+  assert(raplcap_pd_is_zone_enabled(NULL, 0, 0, RAPLCAP_ZONE_CORE) < 0);
+  assert(errno == ENOTSUP);
+  errno = 0;
+  assert(raplcap_pd_set_zone_enabled(NULL, 0, 0, RAPLCAP_ZONE_CORE, 1) < 0);
+  assert(errno == ENOTSUP);
+
+  assert(raplcap_destroy(NULL) == 0);
+  return 0;
+}
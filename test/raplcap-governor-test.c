@@ -0,0 +1,122 @@
+/**
+ * Govern a power budget with a mock implementation.
+ */
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include "raplcap.h"
+#include "raplcap-governor.h"
+
+#define NZONES (RAPLCAP_ZONE_PSYS + 1)
+
+// the mock's power unit is 1/8 W
+#define MOCK_POWER_UNIT 0.125
+
+#define BUDGET_WATTS 100.0
+
+// sum the written long term limits of governed zones, optionally checking that they follow the governor's assignments
+static double get_total_limit(const raplcap_governor* g, int strict, uint32_t* n_zones) {
+  raplcap_limit limit;
+  uint32_t n_pkg;
+  uint32_t pkg;
+  uint32_t die;
+  int zone;
+  double total = 0;
+  double assigned;
+  *n_zones = 0;
+  assert((n_pkg = raplcap_get_num_packages(NULL)) > 0);
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    for (die = 0; die < raplcap_get_num_die(NULL, pkg); die++) {
+      for (zone = 0; zone < NZONES; zone++) {
+        if ((assigned = raplcap_governor_get_limit(g, pkg, die, (raplcap_zone) zone)) < 0) {
+          assert(zone != RAPLCAP_ZONE_PACKAGE);
+          continue;
+        }
+        assert(raplcap_pd_get_limit(NULL, pkg, die, (raplcap_zone) zone, RAPLCAP_CONSTRAINT_LONG_TERM, &limit) == 0);
+        // writes are never skipped by rate limiting in strict mode, only if they're within a step
+        assert(!strict || limit.watts <= assigned + MOCK_POWER_UNIT);
+        total += limit.watts;
+        (*n_zones)++;
+      }
+    }
+  }
+  return total;
+}
+
+static void test_bad_params(void) {
+  raplcap_governor_config cfg = { 0 };
+  errno = 0;
+  assert(raplcap_governor_init(NULL, NULL) == NULL);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_governor_init(NULL, &cfg) == NULL);
+  assert(errno == EINVAL);
+  // the minimum can't be met
+  cfg.budget_watts = BUDGET_WATTS;
+  cfg.min_watts = BUDGET_WATTS;
+  errno = 0;
+  assert(raplcap_governor_init(NULL, &cfg) == NULL);
+  assert(errno == EINVAL);
+  assert(raplcap_governor_update(NULL) < 0);
+  assert(raplcap_governor_set_budget(NULL, BUDGET_WATTS) < 0);
+  assert(raplcap_governor_get_limit(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE) < 0);
+  assert(raplcap_governor_destroy(NULL) < 0);
+}
+
+static void test_budget(int dram) {
+  raplcap_governor_config cfg = { BUDGET_WATTS, 1, MOCK_POWER_UNIT, 0, dram };
+  raplcap_governor* g;
+  uint64_t n_writes;
+  uint32_t n_zones;
+  uint32_t n_zones_2;
+  int i;
+  assert((g = raplcap_governor_init(NULL, &cfg)) != NULL);
+  assert(raplcap_governor_set_budget(g, 0) < 0);
+  for (i = 0; i < 10; i++) {
+    assert(raplcap_governor_update(g) == 0);
+    assert(get_total_limit(g, 1, &n_zones) <= BUDGET_WATTS);
+  }
+  assert(raplcap_governor_get_num_writes(g) > 0);
+  // changes smaller than the step aren't written
+  assert(raplcap_governor_set_budget(g, BUDGET_WATTS + MOCK_POWER_UNIT * n_zones / 2) == 0);
+  n_writes = raplcap_governor_get_num_writes(g);
+  assert(raplcap_governor_update(g) == 0);
+  assert(raplcap_governor_get_num_writes(g) == n_writes);
+  // lowering the budget lowers limits
+  assert(raplcap_governor_set_budget(g, BUDGET_WATTS / 2) == 0);
+  assert(raplcap_governor_update(g) == 0);
+  assert(raplcap_governor_get_num_writes(g) > n_writes);
+  assert(get_total_limit(g, 1, &n_zones_2) <= BUDGET_WATTS / 2);
+  assert(n_zones_2 == n_zones);
+  assert(raplcap_governor_destroy(g) == 0);
+}
+
+static void test_rate_limit(void) {
+  // an hour between writes
+  raplcap_governor_config cfg = { BUDGET_WATTS, 1, MOCK_POWER_UNIT, 3600000000000ULL, 0 };
+  raplcap_governor* g;
+  uint64_t n_writes;
+  uint32_t n_zones;
+  assert((g = raplcap_governor_init(NULL, &cfg)) != NULL);
+  assert(raplcap_governor_update(g) == 0);
+  n_writes = raplcap_governor_get_num_writes(g);
+  assert(raplcap_governor_set_budget(g, BUDGET_WATTS / 4) == 0);
+  assert(raplcap_governor_update(g) == 0);
+  assert(raplcap_governor_get_num_writes(g) == n_writes);
+  // limits that weren't lowered are still within the old budget
+  assert(get_total_limit(g, 0, &n_zones) <= BUDGET_WATTS);
+  assert(raplcap_governor_destroy(g) == 0);
+}
+
+int main(void) {
+  test_bad_params();
+  assert(raplcap_init(NULL) == 0);
+  test_budget(0);
+  test_budget(1);
+  test_rate_limit();
+  assert(raplcap_destroy(NULL) == 0);
+  return 0;
+}
@@ -59,7 +59,56 @@ static void test_set(const raplcap_limit* ll, const raplcap_limit* ls, raplcap*
   equal_dbl(ls->seconds, ls_verify.seconds);
 }
 
+static void test_txn(const raplcap_limit* ll, const raplcap_limit* ls, raplcap* rc, uint32_t p, uint32_t d, uint32_t i,
+                     int enabled) {
+  raplcap_limit ll_new, ls_new, ll_verify, ls_verify;
+  raplcap_txn* txn;
+  memcpy(&ll_new, ll, sizeof(raplcap_limit));
+  memcpy(&ls_new, ls, sizeof(raplcap_limit));
+  ll_new.watts += 1.0;
+  ls_new.watts += 1.0;
+  printf("    Testing raplcap_txn_commit(...)\n");
+  assert((txn = raplcap_txn_begin(rc, p, d, (raplcap_zone) i)) != NULL);
+  assert(raplcap_txn_set_limit(txn, RAPLCAP_CONSTRAINT_LONG_TERM, &ll_new) == 0);
+  assert(raplcap_txn_set_limit(txn, RAPLCAP_CONSTRAINT_SHORT_TERM, &ls_new) == 0);
+  assert(raplcap_txn_set_zone_enabled(txn, enabled) == 0);
+  assert(raplcap_txn_commit(txn) == 0);
+  assert(raplcap_pd_get_limits(rc, p, d, (raplcap_zone) i, &ll_verify, &ls_verify) == 0);
+  equal_dbl(ll_new.watts, ll_verify.watts);
+  equal_dbl(ls_new.watts, ls_verify.watts);
+  assert(raplcap_pd_is_zone_enabled(rc, p, d, (raplcap_zone) i) == enabled);
+  // reset to original values
+  assert((txn = raplcap_txn_begin(rc, p, d, (raplcap_zone) i)) != NULL);
+  assert(raplcap_txn_set_limit(txn, RAPLCAP_CONSTRAINT_LONG_TERM, ll) == 0);
+  assert(raplcap_txn_set_limit(txn, RAPLCAP_CONSTRAINT_SHORT_TERM, ls) == 0);
+  assert(raplcap_txn_commit(txn) == 0);
+  assert(raplcap_pd_get_limits(rc, p, d, (raplcap_zone) i, &ll_verify, &ls_verify) == 0);
+  equal_dbl(ll->watts, ll_verify.watts);
+  equal_dbl(ls->watts, ls_verify.watts);
+}
+
+static void test_snapshot(raplcap* rc, uint32_t n_pkg) {
+  double* joules;
+  uint32_t p, d, n = 0, offset = 0;
+  printf("  Testing raplcap_get_energy_snapshot(...)\n");
+  for (p = 0; p < n_pkg; p++) {
+    n += raplcap_get_num_die(rc, p) * NZONES;
+  }
+  assert(raplcap_get_energy_snapshot(rc, NULL, 0) == (int) n);
+  joules = malloc(n * sizeof(*joules));
+  assert(joules != NULL);
+  assert(raplcap_get_energy_snapshot(rc, joules, n) == (int) n);
+  // entries are ordered by package, then die, then zone, with die counts that may differ between packages
+  for (p = 0; p < n_pkg; p++) {
+    for (d = 0; d < raplcap_get_num_die(rc, p); d++, offset++) {
+      assert(joules[(offset * NZONES) + RAPLCAP_ZONE_PACKAGE] >= 0);
+    }
+  }
+  free(joules);
+}
+
 static void test(raplcap* rc, int ro) {
+  raplcap_zone_state states[NZONES];
   raplcap_limit ll, ls;
   uint32_t i, p, d = 0;
   int supported, enabled;
@@ -81,6 +130,9 @@ static void test(raplcap* rc, int ro) {
     assert(raplcap_get_num_die(rc, 0) == n_die);
   }
   for (p = 0; p < n_pkg; p++) {
+  // die counts may differ between packages
+  n_die = raplcap_get_num_die(rc, p);
+  assert(n_die > 0);
   for (d = 0; d < n_die; d++) {
     for (i = 0; i < NZONES; i++) {
       printf("  Package %d, zone %d (%s)...\n", p, i, ZONE_NAMES[i]);
@@ -112,14 +164,22 @@ static void test(raplcap* rc, int ro) {
           assert(ls.seconds > 0);
           assert(ls.watts >= 0);
         }
+        printf("    Testing raplcap_pd_get_zone_states(...)\n");
+        assert(raplcap_pd_get_zone_states(rc, p, d, states, NZONES) == NZONES);
+        assert(states[i].enabled == enabled);
+        assert(equal_dbl(states[i].limits[RAPLCAP_CONSTRAINT_LONG_TERM].watts, ll.watts));
+        assert(equal_dbl(states[i].limits[RAPLCAP_CONSTRAINT_LONG_TERM].seconds, ll.seconds));
         printf("    Testing raplcap_pd_get_energy_counter(...)\n");
         joules = raplcap_pd_get_energy_counter(rc, p, d, (raplcap_zone) i);
         assert(joules >= 0);
         printf("    Testing raplcap_pd_get_energy_counter_max(...)\n");
         joules = raplcap_pd_get_energy_counter_max(rc, p, d, (raplcap_zone) i);
         assert(joules >= 0);
+        printf("    Testing raplcap_pd_get_power(...)\n");
+        assert(raplcap_pd_get_power(rc, p, d, (raplcap_zone) i, 0.01) >= 0);
         if (!ro) {
           test_set(&ll, &ls, rc, p, d, i);
+          test_txn(&ll, &ls, rc, p, d, i, enabled);
         }
       } else{
         printf("    Zone not supported, continuing...\n");
@@ -127,6 +187,12 @@ static void test(raplcap* rc, int ro) {
     }
   }
   }
+  test_snapshot(rc, n_pkg);
+  if (!ro) {
+    printf("  Testing raplcap_set_limits_all(...)\n");
+    assert(raplcap_pd_get_limits(rc, 0, 0, RAPLCAP_ZONE_PACKAGE, &ll, &ls) == 0);
+    assert(raplcap_set_limits_all(rc, RAPLCAP_ZONE_PACKAGE, &ll, &ls) == 0);
+  }
   // test bad zone values
   printf("  Testing bad zone values\n");
   assert(raplcap_pd_is_zone_supported(rc, 0, 0, (raplcap_zone) NZONES) < 0);
@@ -134,7 +200,7 @@ static void test(raplcap* rc, int ro) {
   // test bad package values
   printf("  Testing bad package value\n");
   assert(raplcap_pd_is_zone_supported(rc, p, 0, RAPLCAP_ZONE_PACKAGE) < 0);
-  assert(raplcap_pd_is_zone_supported(rc, 0, d, RAPLCAP_ZONE_PACKAGE) < 0);
+  assert(raplcap_pd_is_zone_supported(rc, 0, raplcap_get_num_die(rc, 0), RAPLCAP_ZONE_PACKAGE) < 0);
   printf("  Testing raplcap_destroy(...)\n");
   assert(raplcap_destroy(rc) == 0);
 }
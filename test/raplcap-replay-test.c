@@ -0,0 +1,126 @@
+/**
+ * Replay a trace and synthesize wrapping counters with a mock implementation.
+ */
+// for setenv, mkstemp
+#define _POSIX_C_SOURCE 200809L
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "raplcap.h"
+#include "raplcap-trace.h"
+
+// the mock's energy status unit
+#define MOCK_ENERGY_UNIT (1.0 / 16384)
+
+#define N_COLS 3
+#define N_RECORDS 4
+
+static const raplcap_trace_column COLS[N_COLS] = {
+  { 0, 0, RAPLCAP_ZONE_PACKAGE, 0, MOCK_ENERGY_UNIT },
+  // a coarser unit is converted
+  { 1, 0, RAPLCAP_ZONE_DRAM, 0, 2 * MOCK_ENERGY_UNIT },
+  // not in the topology
+  { 5, 0, RAPLCAP_ZONE_PACKAGE, 0, MOCK_ENERGY_UNIT },
+};
+
+// the first column wraps, then doesn't change
+static const uint32_t COUNTERS[N_RECORDS][N_COLS] = {
+  { 0xFFFFFF00, 10, 0 },
+  { 0x00000000, 20, 1 },
+  { 0x00000400, 30, 2 },
+  { 0x00000400, 40, 3 },
+};
+
+// the first column's energy since the first record, in mock units
+static const uint32_t REPLAYED[N_RECORDS] = { 0, 0x100, 0x500, 0x500 };
+
+static int equal_dbl(double a, double b) {
+  return fabs(a - b) < 1e-9;
+}
+
+static void write_trace(const char* path) {
+  raplcap_trace_header hdr;
+  uint32_t dt = 1;
+  uint32_t r;
+  FILE* f;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, RAPLCAP_TRACE_MAGIC, sizeof(hdr.magic));
+  hdr.version = RAPLCAP_TRACE_VERSION;
+  hdr.header_size = sizeof(hdr) + sizeof(COLS);
+  hdr.record_size = sizeof(uint32_t) * (N_COLS + 1);
+  hdr.n_columns = N_COLS;
+  hdr.time_unit_ns = 1000;
+  assert((f = fopen(path, "wb")) != NULL);
+  assert(fwrite(&hdr, sizeof(hdr), 1, f) == 1);
+  assert(fwrite(COLS, sizeof(COLS), 1, f) == 1);
+  for (r = 0; r < N_RECORDS; r++) {
+    assert(fwrite(&dt, sizeof(dt), 1, f) == 1);
+    assert(fwrite(COUNTERS[r], sizeof(COUNTERS[r]), 1, f) == 1);
+  }
+  assert(fclose(f) == 0);
+}
+
+static void test_replay(void) {
+  uint32_t pos;
+  uint32_t loop;
+  uint32_t r;
+  assert(raplcap_init(NULL) == 0);
+  assert(raplcap_get_num_packages(NULL) == 2);
+  // records are replayed one per read, and loops continue from the last record's energy
+  // initialization already read each counter once when probing for support
+  for (pos = 1; pos <= 2 * N_RECORDS; pos++) {
+    loop = pos / N_RECORDS;
+    r = pos % N_RECORDS;
+    assert(equal_dbl(raplcap_pd_get_energy_counter(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE),
+                     (loop * REPLAYED[N_RECORDS - 1] + REPLAYED[r]) * MOCK_ENERGY_UNIT));
+    assert(equal_dbl(raplcap_pd_get_energy_counter(NULL, 1, 0, RAPLCAP_ZONE_DRAM),
+                     (loop * 60 + r * 20) * MOCK_ENERGY_UNIT));
+  }
+  // zones that aren't in the trace don't consume energy
+  assert(equal_dbl(raplcap_pd_get_energy_counter(NULL, 1, 0, RAPLCAP_ZONE_PACKAGE), 0));
+  assert(equal_dbl(raplcap_pd_get_energy_counter(NULL, 1, 0, RAPLCAP_ZONE_PACKAGE), 0));
+  assert(raplcap_destroy(NULL) == 0);
+}
+
+static void test_energy_increment(void) {
+  double joules;
+  int i;
+  // counters wrap every other read, starting with the read when probing for support during initialization
+  assert(setenv("RAPLCAP_MSR_MOCK_ENERGY_INCREMENT", "0x80000000", 1) == 0);
+  assert(raplcap_init(NULL) == 0);
+  assert(raplcap_set_energy_accumulation(NULL, 1) == 0);
+  for (i = 0; i < 3; i++) {
+    joules = raplcap_pd_get_energy_counter(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE);
+    assert(equal_dbl(joules, i % 2 ? 0 : 0x80000000 * MOCK_ENERGY_UNIT));
+  }
+  // the baseline, then the 3 reads above, then this one
+  joules = raplcap_pd_get_energy_accumulated(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE);
+  assert(equal_dbl(joules, 4.0 * 0x80000000 * MOCK_ENERGY_UNIT));
+  assert(raplcap_destroy(NULL) == 0);
+  assert(unsetenv("RAPLCAP_MSR_MOCK_ENERGY_INCREMENT") == 0);
+}
+
+int main(void) {
+  char path[] = "/tmp/raplcap-replay-test-XXXXXX";
+  int fd;
+  assert((fd = mkstemp(path)) >= 0);
+  assert(close(fd) == 0);
+  assert(setenv("RAPLCAP_MSR_MOCK_NUM_PKG", "2", 1) == 0);
+
+  // an empty file isn't a trace
+  assert(setenv("RAPLCAP_MSR_MOCK_TRACE", path, 1) == 0);
+  assert(raplcap_init(NULL) < 0);
+
+  write_trace(path);
+  test_replay();
+  assert(unsetenv("RAPLCAP_MSR_MOCK_TRACE") == 0);
+  test_energy_increment();
+  assert(unlink(path) == 0);
+  return 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * Profile regions with a mock implementation.
+ */
+// for pthread, tmpfile
+#define _POSIX_C_SOURCE 200809L
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raplcap.h"
+#include "raplcap-roi.h"
+#include "raplcap-sampler.h"
+
+// counters increase by 0x1000 units of 2^-14 J per read
+#define MOCK_JOULES_PER_READ (0x1000 / 16384.0)
+
+#define N_REGIONS 4
+#define N_ITERATIONS 100
+
+static int equal_dbl(double a, double b) {
+  return fabs(a - b) < 1e-9;
+}
+
+static void* run_regions(void* arg) {
+  int i;
+  (void) arg;
+  for (i = 0; i < N_ITERATIONS; i++) {
+    raplcap_roi_begin(1);
+    raplcap_roi_end(1);
+  }
+  return NULL;
+}
+
+static void test_counters(void) {
+  pthread_t thread;
+  uint64_t count;
+  double seconds;
+  double joules;
+  FILE* f;
+  char line[256];
+  int i;
+  assert(raplcap_roi_init(NULL, NULL, 0, 0, N_REGIONS, 2) == 0);
+  // already initialized
+  assert(raplcap_roi_init(NULL, NULL, 0, 0, N_REGIONS, 2) < 0);
+
+  // each marker reads the counter once
+  for (i = 0; i < N_ITERATIONS; i++) {
+    raplcap_roi_begin(0);
+    // nested recursion is measured at the outermost level
+    raplcap_roi_begin(0);
+    raplcap_roi_end(0);
+    raplcap_roi_end(0);
+  }
+  assert(raplcap_roi_get(0, &count, &seconds, &joules) == 0);
+  assert(count == N_ITERATIONS);
+  assert(seconds >= 0);
+  assert(equal_dbl(joules, N_ITERATIONS * MOCK_JOULES_PER_READ));
+
+  // threads have their own tables, and the third thread is over the limit
+  assert(pthread_create(&thread, NULL, run_regions, NULL) == 0);
+  assert(pthread_join(thread, NULL) == 0);
+  run_regions(NULL);
+  assert(pthread_create(&thread, NULL, run_regions, NULL) == 0);
+  assert(pthread_join(thread, NULL) == 0);
+  assert(raplcap_roi_get(1, &count, NULL, &joules) == 0);
+  assert(count == 2 * N_ITERATIONS);
+  assert(equal_dbl(joules, 2 * N_ITERATIONS * MOCK_JOULES_PER_READ));
+
+  // errors are recorded instead of measured
+  raplcap_roi_end(2);
+  raplcap_roi_begin(N_REGIONS);
+  assert(raplcap_roi_get(2, &count, NULL, NULL) == 0);
+  assert(count == 0);
+  assert(raplcap_roi_get(N_REGIONS, &count, NULL, NULL) < 0);
+
+  assert((f = tmpfile()) != NULL);
+  assert(raplcap_roi_report(f) == 0);
+  rewind(f);
+  assert(fgets(line, sizeof(line), f) != NULL);
+  assert(strstr(line, "JOULES") != NULL);
+  // regions 0, 1, and 2, then dropped markers
+  for (i = 0; i < 3; i++) {
+    assert(fgets(line, sizeof(line), f) != NULL);
+  }
+  assert(fgets(line, sizeof(line), f) != NULL);
+  assert(strstr(line, "dropped") != NULL);
+  assert(fgets(line, sizeof(line), f) == NULL);
+  assert(fclose(f) == 0);
+  assert(raplcap_roi_destroy() == 0);
+}
+
+static void test_sampler(void) {
+  raplcap_sampler* s;
+  uint64_t count;
+  double joules;
+  int i;
+  assert((s = raplcap_sampler_start(NULL, 1000000, 16, -1)) != NULL);
+  assert(raplcap_roi_init(NULL, s, 0, 0, N_REGIONS, 1) == 0);
+  for (i = 0; i < N_ITERATIONS; i++) {
+    raplcap_roi_begin(3);
+    raplcap_roi_end(3);
+  }
+  assert(raplcap_roi_get(3, &count, NULL, &joules) == 0);
+  assert(count == N_ITERATIONS);
+  // estimated from power, not counted reads
+  assert(joules >= 0);
+  assert(raplcap_roi_destroy() == 0);
+  assert(raplcap_sampler_stop(s) == 0);
+}
+
+int main(void) {
+  errno = 0;
+  assert(raplcap_roi_get(0, NULL, NULL, NULL) < 0);
+  assert(raplcap_roi_report(stdout) < 0);
+  assert(raplcap_roi_destroy() < 0);
+  // markers are no-ops when not initialized
+  raplcap_roi_begin(0);
+  raplcap_roi_end(0);
+  assert(raplcap_init(NULL) == 0);
+  assert(raplcap_roi_init(NULL, NULL, 0, 0, 0, 1) < 0);
+  assert(raplcap_roi_init(NULL, NULL, 0, 0, 1, 0) < 0);
+  test_counters();
+  test_sampler();
+  assert(raplcap_destroy(NULL) == 0);
+  return 0;
+}
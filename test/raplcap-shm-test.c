@@ -0,0 +1,120 @@
+/**
+ * Publish to shared memory with a mock implementation and read it back.
+ */
+// for shm_open, ftruncate, snprintf
+#define _POSIX_C_SOURCE 200112L
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "raplcap.h"
+#include "raplcap-shm.h"
+
+// the mock energy unit is 2^-14 J, and counters increase by 0x1000 units per read
+#define MOCK_JOULES_PER_READ (0x1000 / 16384.0)
+
+#define N_PUBLISH 10
+
+static int equal_dbl(double a, double b) {
+  return fabs(a - b) < 1e-9;
+}
+
+static void test_publish_read(const char* name) {
+  raplcap_shm_publisher* p;
+  raplcap_shm* shm;
+  double joules;
+  double watts;
+  uint64_t ns;
+  uint64_t ns_prev;
+  uint32_t n_pkg;
+  uint32_t pkg;
+  uint32_t die;
+  size_t len;
+  void* mem;
+  int zone;
+  int fd;
+  int i;
+
+  assert(raplcap_init(NULL) == 0);
+  assert((n_pkg = raplcap_get_num_packages(NULL)) > 0);
+  assert((len = raplcap_shm_get_size(NULL)) > sizeof(raplcap_shm_header));
+  assert((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR)) >= 0);
+  assert(ftruncate(fd, (off_t) len) == 0);
+  assert((mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) != MAP_FAILED);
+  assert(close(fd) == 0);
+
+  assert(raplcap_shm_publisher_init(NULL, NULL, len) == NULL);
+  assert(raplcap_shm_publisher_init(NULL, mem, len - 1) == NULL);
+  assert((p = raplcap_shm_publisher_init(NULL, mem, len)) != NULL);
+
+  assert((shm = raplcap_shm_open(name)) != NULL);
+  assert(raplcap_shm_get_num_packages(shm) == n_pkg);
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    assert(raplcap_shm_get_num_die(shm, pkg) == raplcap_get_num_die(NULL, pkg));
+  }
+  assert(raplcap_shm_get_num_die(shm, n_pkg) == 0);
+  // only the baseline is published, so power isn't available yet
+  assert(raplcap_shm_read(shm, 0, 0, RAPLCAP_ZONE_PACKAGE, &joules, NULL, &ns_prev) == 0);
+  assert(equal_dbl(joules, 0));
+  errno = 0;
+  assert(raplcap_shm_read(shm, 0, 0, RAPLCAP_ZONE_PACKAGE, NULL, &watts, NULL) < 0);
+  assert(errno == ENODATA);
+  for (zone = RAPLCAP_ZONE_PACKAGE; zone <= RAPLCAP_ZONE_PSYS; zone++) {
+    errno = 0;
+    if (raplcap_pd_is_zone_supported(NULL, 0, 0, (raplcap_zone) zone) > 0) {
+      assert(raplcap_shm_read(shm, 0, 0, (raplcap_zone) zone, &joules, NULL, NULL) == 0);
+    } else {
+      assert(raplcap_shm_read(shm, 0, 0, (raplcap_zone) zone, &joules, NULL, NULL) < 0);
+      assert(errno == ENODATA);
+    }
+  }
+  assert(raplcap_shm_read(shm, n_pkg, 0, RAPLCAP_ZONE_PACKAGE, &joules, NULL, NULL) < 0);
+  assert(raplcap_shm_read(shm, 0, raplcap_get_num_die(NULL, 0), RAPLCAP_ZONE_PACKAGE, &joules, NULL, NULL) < 0);
+
+  // the publisher reads each counter once per publish
+  for (i = 1; i <= N_PUBLISH; i++) {
+    assert(raplcap_shm_publish(p) == 0);
+    for (pkg = 0; pkg < n_pkg; pkg++) {
+      for (die = 0; die < raplcap_get_num_die(NULL, pkg); die++) {
+        assert(raplcap_shm_read(shm, pkg, die, RAPLCAP_ZONE_PACKAGE, &joules, &watts, &ns) == 0);
+        assert(equal_dbl(joules, i * MOCK_JOULES_PER_READ));
+        assert(watts >= 0);
+        assert(ns >= ns_prev);
+      }
+    }
+    ns_prev = ns;
+  }
+
+  assert(raplcap_shm_close(shm) == 0);
+  assert(raplcap_shm_publisher_destroy(p) == 0);
+  assert(munmap(mem, len) == 0);
+  assert(raplcap_destroy(NULL) == 0);
+}
+
+static void test_bad_params(const char* name) {
+  assert(raplcap_shm_publish(NULL) < 0);
+  assert(raplcap_shm_publisher_destroy(NULL) < 0);
+  assert(raplcap_shm_close(NULL) < 0);
+  assert(raplcap_shm_get_num_packages(NULL) == 0);
+  assert(raplcap_shm_get_num_die(NULL, 0) == 0);
+  assert(raplcap_shm_read(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE, NULL, NULL, NULL) < 0);
+  // the object has been unlinked
+  assert(raplcap_shm_open(name) == NULL);
+}
+
+int main(void) {
+  char name[64];
+  snprintf(name, sizeof(name), "/raplcap-shm-test-%ld", (long) getpid());
+  test_publish_read(name);
+  assert(shm_unlink(name) == 0);
+  test_bad_params(name);
+  return 0;
+}
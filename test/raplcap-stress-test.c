@@ -0,0 +1,145 @@
+/**
+ * Stress concurrent reads and writes on one context with a mock implementation.
+ */
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "raplcap.h"
+
+// counters increase by 0x1000 units of 2^-14 J per read
+#define MOCK_JOULES_PER_READ (0x1000 / 16384.0)
+
+#define N_THREADS 4
+#define N_ITERATIONS 10000
+#define N_WATTS 8
+#define MIN_WATTS 10
+
+typedef struct stress_thread {
+  pthread_t thread;
+  uint32_t pkg;
+  uint32_t die;
+  raplcap_constraint constraint;
+} stress_thread;
+
+static int equal_dbl(double a, double b) {
+  return fabs(a - b) < 1e-9;
+}
+
+// integral watts are exact in the mock's 1/8 W power unit
+static double get_watts(uint32_t i) {
+  return MIN_WATTS + (double) (i % N_WATTS);
+}
+
+static void* set_limits(void* arg) {
+  const stress_thread* t = (const stress_thread*) arg;
+  raplcap_limit limit = { 0, 0 };
+  uint32_t i;
+  for (i = 0; i < N_ITERATIONS; i++) {
+    limit.watts = get_watts(i);
+    assert(raplcap_pd_set_limit(NULL, t->pkg, t->die, RAPLCAP_ZONE_PACKAGE, t->constraint, &limit) == 0);
+    // only this thread writes this constraint, so another thread's read-modify-write must not have reverted it
+    assert(raplcap_pd_get_limit(NULL, t->pkg, t->die, RAPLCAP_ZONE_PACKAGE, t->constraint, &limit) == 0);
+    assert(equal_dbl(limit.watts, get_watts(i)));
+  }
+  return NULL;
+}
+
+static void* get_limits(void* arg) {
+  const stress_thread* t = (const stress_thread*) arg;
+  raplcap_limit limit_long;
+  raplcap_limit limit_short;
+  uint32_t i;
+  for (i = 0; i < N_ITERATIONS; i++) {
+    // reads don't lock, but never see a partial write
+    assert(raplcap_pd_get_limits(NULL, t->pkg, t->die, RAPLCAP_ZONE_PACKAGE, &limit_long, &limit_short) == 0);
+    assert(limit_long.watts >= MIN_WATTS && limit_long.watts < MIN_WATTS + N_WATTS);
+    assert(limit_short.watts >= MIN_WATTS && limit_short.watts < MIN_WATTS + N_WATTS);
+  }
+  return NULL;
+}
+
+static void* get_energy_accumulated(void* arg) {
+  const stress_thread* t = (const stress_thread*) arg;
+  uint32_t i;
+  for (i = 0; i < N_ITERATIONS; i++) {
+    assert(raplcap_pd_get_energy_accumulated(NULL, t->pkg, t->die, RAPLCAP_ZONE_PACKAGE) >= 0);
+  }
+  return NULL;
+}
+
+static void run_threads(stress_thread* threads, uint32_t n, void* (*fn)(void*)) {
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    assert(pthread_create(&threads[i].thread, NULL, fn, &threads[i]) == 0);
+  }
+  for (i = 0; i < n; i++) {
+    assert(pthread_join(threads[i].thread, NULL) == 0);
+  }
+}
+
+// Threads write the long and short term limits of every package/die concurrently, which share an MSR on each
+static void test_writes(uint32_t n_pkg_die) {
+  stress_thread* threads;
+  raplcap_limit limit_long = { 0, MIN_WATTS };
+  raplcap_limit limit_short = { 0, MIN_WATTS };
+  uint32_t n_pkg = raplcap_get_num_packages(NULL);
+  uint32_t pkg;
+  uint32_t die;
+  uint32_t i;
+  assert((threads = calloc(3 * n_pkg_die, sizeof(*threads))) != NULL);
+  for (pkg = 0, i = 0; pkg < n_pkg; pkg++) {
+    for (die = 0; die < raplcap_get_num_die(NULL, pkg); die++, i += 3) {
+      assert(raplcap_pd_set_limits(NULL, pkg, die, RAPLCAP_ZONE_PACKAGE, &limit_long, &limit_short) == 0);
+      threads[i].constraint = RAPLCAP_CONSTRAINT_LONG_TERM;
+      threads[i + 1].constraint = RAPLCAP_CONSTRAINT_SHORT_TERM;
+      threads[i].pkg = threads[i + 1].pkg = threads[i + 2].pkg = pkg;
+      threads[i].die = threads[i + 1].die = threads[i + 2].die = die;
+    }
+  }
+  for (i = 0; i < 3 * n_pkg_die; i++) {
+    assert(pthread_create(&threads[i].thread, NULL, i % 3 == 2 ? get_limits : set_limits, &threads[i]) == 0);
+  }
+  for (i = 0; i < 3 * n_pkg_die; i++) {
+    assert(pthread_join(threads[i].thread, NULL) == 0);
+  }
+  // neither writer's read-modify-write lost the other's updates
+  for (i = 0; i < 3 * n_pkg_die; i += 3) {
+    assert(raplcap_pd_get_limits(NULL, threads[i].pkg, threads[i].die, RAPLCAP_ZONE_PACKAGE,
+                                 &limit_long, &limit_short) == 0);
+    assert(equal_dbl(limit_long.watts, get_watts(N_ITERATIONS - 1)));
+    assert(equal_dbl(limit_short.watts, get_watts(N_ITERATIONS - 1)));
+  }
+  free(threads);
+}
+
+// Threads accumulate energy from the same package/die, which must be updated in the order counters are read
+static void test_energy_accumulation(void) {
+  stress_thread threads[N_THREADS] = { 0 };
+  double joules;
+  assert(raplcap_set_energy_accumulation(NULL, 1) == 0);
+  run_threads(threads, N_THREADS, get_energy_accumulated);
+  // the baseline read when enabling, then the threads' reads, then this read - a reordered update would appear to
+  // be a rollover and add an entire counter range
+  joules = raplcap_pd_get_energy_accumulated(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE);
+  assert(equal_dbl(joules, (N_THREADS * N_ITERATIONS + 1) * MOCK_JOULES_PER_READ));
+  assert(raplcap_set_energy_accumulation(NULL, 0) == 0);
+}
+
+int main(void) {
+  uint32_t n_pkg;
+  uint32_t n_pkg_die = 0;
+  uint32_t pkg;
+  assert(raplcap_init(NULL) == 0);
+  assert((n_pkg = raplcap_get_num_packages(NULL)) > 0);
+  for (pkg = 0; pkg < n_pkg; pkg++) {
+    n_pkg_die += raplcap_get_num_die(NULL, pkg);
+  }
+  test_writes(n_pkg_die);
+  test_energy_accumulation();
+  assert(raplcap_destroy(NULL) == 0);
+  return 0;
+}
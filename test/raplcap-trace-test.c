@@ -0,0 +1,167 @@
+/**
+ * Write traces with a mock implementation and read them back.
+ */
+// for fdopen, mkstemp
+#define _POSIX_C_SOURCE 200809L
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "raplcap.h"
+#include "raplcap-trace.h"
+
+// the mock energy unit is 2^-14 J, and counters increase by 0x1000 units per read
+#define MOCK_ENERGY_UNIT (1.0 / 16384.0)
+#define MOCK_JOULES_PER_READ (0x1000 * MOCK_ENERGY_UNIT)
+
+// enough to span several index entries
+#define N_SAMPLES 2500
+
+static int equal_dbl(double a, double b) {
+  return fabs(a - b) < 1e-9;
+}
+
+static void test_write_read(const char* path) {
+  const raplcap_trace_column cols[] = {
+    { 0, 0, RAPLCAP_ZONE_PACKAGE, 0, 0 },
+    { 0, 0, RAPLCAP_ZONE_CORE, 0, 0 },
+  };
+  const uint32_t n_cols = sizeof(cols) / sizeof(cols[0]);
+  const raplcap_trace_header* hdr;
+  const raplcap_trace_column* cols_read;
+  raplcap_trace_writer* w;
+  raplcap_trace* t;
+  FILE* f;
+  double joules[2];
+  uint64_t ns;
+  uint64_t ns_prev;
+  uint64_t idx;
+  uint64_t i;
+  uint32_t j;
+
+  assert((f = fopen(path, "wb")) != NULL);
+  assert(raplcap_init(NULL) == 0);
+  assert(raplcap_trace_writer_start(NULL, NULL, cols, n_cols) == NULL);
+  assert(raplcap_trace_writer_start(NULL, f, cols, 0) == NULL);
+  assert((w = raplcap_trace_writer_start(NULL, f, cols, n_cols)) != NULL);
+  for (i = 0; i < N_SAMPLES; i++) {
+    assert(raplcap_trace_writer_sample(w) == 0);
+  }
+  assert(raplcap_trace_writer_finish(w) == 0);
+  assert(raplcap_destroy(NULL) == 0);
+  assert(fclose(f) == 0);
+
+  assert((t = raplcap_trace_open(path)) != NULL);
+  assert((hdr = raplcap_trace_get_header(t)) != NULL);
+  assert(memcmp(hdr->magic, RAPLCAP_TRACE_MAGIC, sizeof(hdr->magic)) == 0);
+  assert(hdr->version == RAPLCAP_TRACE_VERSION);
+  assert(hdr->n_columns == n_cols);
+  assert(hdr->record_size == (n_cols + 1) * sizeof(uint32_t));
+  assert((cols_read = raplcap_trace_get_columns(t)) != NULL);
+  for (j = 0; j < n_cols; j++) {
+    assert(cols_read[j].pkg == cols[j].pkg);
+    assert(cols_read[j].die == cols[j].die);
+    assert(cols_read[j].zone == cols[j].zone);
+    // the mock's 32-bit counters are recorded raw
+    assert(equal_dbl(cols_read[j].energy_unit, MOCK_ENERGY_UNIT));
+  }
+  // baseline + samples
+  assert(raplcap_trace_get_num_records(t) == N_SAMPLES + 1);
+
+  // each record reads each counter once
+  ns_prev = 0;
+  for (i = 0; i <= N_SAMPLES; i++) {
+    assert(raplcap_trace_get_record(t, i, &ns, joules) == 0);
+    assert(ns >= ns_prev);
+    for (j = 0; j < n_cols; j++) {
+      assert(equal_dbl(joules[j], (double) i * MOCK_JOULES_PER_READ));
+    }
+    // the last record at or before a record's time can only be a later record with the same timestamp
+    assert(raplcap_trace_find_record(t, ns, &idx) == 0);
+    assert(idx >= i);
+    assert(raplcap_trace_get_record(t, idx, &ns_prev, NULL) == 0);
+    assert(ns_prev == ns);
+  }
+  assert(raplcap_trace_get_record(t, N_SAMPLES + 1, &ns, joules) < 0);
+  for (j = 0; j < n_cols; j++) {
+    assert(equal_dbl(raplcap_trace_get_energy(t, j, 0, UINT64_MAX), N_SAMPLES * MOCK_JOULES_PER_READ));
+  }
+  assert(raplcap_trace_get_energy(t, n_cols, 0, UINT64_MAX) < 0);
+  assert(raplcap_trace_get_energy(t, 0, 1, 0) < 0);
+  assert(raplcap_trace_close(t) == 0);
+}
+
+// Write a trace by hand with known timestamps and a counter that wraps
+static void test_read_wrap(const char* path) {
+  raplcap_trace_header hdr;
+  raplcap_trace_column col;
+  raplcap_trace* t;
+  FILE* f;
+  uint32_t rec[2];
+  uint64_t idx;
+  uint32_t i;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, RAPLCAP_TRACE_MAGIC, sizeof(hdr.magic));
+  hdr.version = RAPLCAP_TRACE_VERSION;
+  hdr.header_size = sizeof(hdr) + sizeof(col);
+  hdr.record_size = sizeof(rec);
+  hdr.n_columns = 1;
+  hdr.time_unit_ns = 1000;
+  memset(&col, 0, sizeof(col));
+  col.energy_unit = 1.0;
+  assert((f = fopen(path, "wb")) != NULL);
+  assert(fwrite(&hdr, sizeof(hdr), 1, f) == 1);
+  assert(fwrite(&col, sizeof(col), 1, f) == 1);
+  // a record every 10 us, each consuming 1 J, wrapping after 5 records
+  for (i = 0; i < 3000; i++) {
+    rec[0] = i > 0 ? 10 : 0;
+    rec[1] = UINT32_MAX - 4 + i;
+    assert(fwrite(rec, sizeof(rec), 1, f) == 1);
+  }
+  // a trailing partial record is ignored
+  assert(fwrite(rec, sizeof(rec[0]), 1, f) == 1);
+  assert(fclose(f) == 0);
+
+  assert((t = raplcap_trace_open(path)) != NULL);
+  assert(raplcap_trace_get_num_records(t) == 3000);
+  assert(raplcap_trace_find_record(t, 0, &idx) == 0 && idx == 0);
+  assert(raplcap_trace_find_record(t, 9999, &idx) == 0 && idx == 0);
+  assert(raplcap_trace_find_record(t, 10000, &idx) == 0 && idx == 1);
+  assert(raplcap_trace_find_record(t, 10240000, &idx) == 0 && idx == 1024);
+  assert(raplcap_trace_find_record(t, 10249999, &idx) == 0 && idx == 1024);
+  assert(raplcap_trace_find_record(t, UINT64_MAX, &idx) == 0 && idx == 2999);
+  assert(equal_dbl(raplcap_trace_get_energy(t, 0, 0, 100000), 10));
+  assert(equal_dbl(raplcap_trace_get_energy(t, 0, 25000, 20505000), 2048));
+  assert(equal_dbl(raplcap_trace_get_energy(t, 0, 0, UINT64_MAX), 2999));
+  assert(raplcap_trace_close(t) == 0);
+
+  // corrupt the magic
+  assert((f = fopen(path, "r+b")) != NULL);
+  assert(fputc('X', f) == 'X');
+  assert(fclose(f) == 0);
+  assert(raplcap_trace_open(path) == NULL);
+}
+
+int main(void) {
+  char path[] = "raplcap-trace-test.XXXXXX";
+  FILE* f;
+  assert(raplcap_trace_open(NULL) == NULL);
+  assert(raplcap_trace_close(NULL) < 0);
+  assert(raplcap_trace_get_header(NULL) == NULL);
+  assert(raplcap_trace_get_num_records(NULL) == 0);
+  assert(raplcap_trace_writer_sample(NULL) < 0);
+  assert(raplcap_trace_writer_finish(NULL) < 0);
+  // reserve a unique file name
+  assert((f = fdopen(mkstemp(path), "wb")) != NULL);
+  assert(fclose(f) == 0);
+  test_write_read(path);
+  test_read_wrap(path);
+  remove(path);
+  printf("Trace tests passed\n");
+  return 0;
+}
@@ -8,8 +8,11 @@
 #include <errno.h>
 #include <stdlib.h>
 #include "raplcap.h"
+#include "raplcap-sampler.h"
 
 int main(void) {
+  raplcap_limit limit = { 0 };
+  raplcap_txn* txn;
   // basically all we can test is some uninitialized parameters
   // the context can't be complete garbage though, it must be zeroed out - we'll just use the global context
   errno = 0;
@@ -33,6 +36,53 @@ int main(void) {
   errno = 0;
   assert(raplcap_pd_get_energy_counter_max(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE) < 0);
   assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_pd_get_power(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE, 0) < 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_pd_get_power(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE, 0.001) < 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_get_energy_snapshot(NULL, NULL, 0) < 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_pd_get_zone_states(NULL, 0, 0, NULL, 0) < 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_set_energy_accumulation(NULL, 1) < 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_pd_get_energy_accumulated(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE) < 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_sampler_start(NULL, 1000000, 2, -1) == NULL);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_sampler_start_adaptive(NULL, 1000000, 0, 0.1, 2, -1) == NULL);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_sampler_start_adaptive(NULL, 1000000, 8000000, -1, 2, -1) == NULL);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_sampler_get_power(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE) < 0);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_set_limits_all(NULL, (raplcap_zone) -1, NULL, NULL) < 0);
+  assert(errno == EINVAL);
+  // errno depends on whether topology can be discovered without a context
+  assert(raplcap_set_limits_all(NULL, RAPLCAP_ZONE_PACKAGE, NULL, NULL) < 0);
+  errno = 0;
+  assert(raplcap_txn_begin(NULL, 0, 0, (raplcap_zone) -1) == NULL);
+  assert(errno == EINVAL);
+  errno = 0;
+  assert(raplcap_txn_commit(NULL) < 0);
+  assert(errno == EINVAL);
+  // parameters are validated at commit, which always releases the transaction
+  assert((txn = raplcap_txn_begin(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE)) != NULL);
+  assert(raplcap_txn_set_limit(txn, RAPLCAP_CONSTRAINT_LONG_TERM, &limit) == 0);
+  errno = 0;
+  assert(raplcap_txn_commit(txn) < 0);
+  assert(errno == EINVAL);
   // just verify that it doesn't crash (API doesn't specify what to return or whether to set errno in this case)
   raplcap_destroy(NULL);
   // also verifying that it doesn't crash
@@ -0,0 +1,82 @@
+/**
+ * Batch reads of temporary files with the io_uring engine.
+ */
+// for mkstemp
+#define _POSIX_C_SOURCE 200809L
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "raplcap-uring.h"
+
+#define N_FILES 3
+
+static const char* CONTENTS[N_FILES] = { "12345\n", "0123456789abcdef", "" };
+
+static int make_file(const char* contents) {
+  char path[] = "/tmp/raplcap-uring-test-XXXXXX";
+  int fd;
+  assert((fd = mkstemp(path)) >= 0);
+  assert(unlink(path) == 0);
+  assert(write(fd, contents, strlen(contents)) == (ssize_t) strlen(contents));
+  return fd;
+}
+
+static void test_params(const int* fds) {
+  raplcap_uring_read reads[1] = { { 0, 8, 0 } };
+  assert(raplcap_uring_init(NULL, N_FILES, reads, 1) == NULL);
+  assert(raplcap_uring_init(fds, 0, reads, 1) == NULL);
+  assert(raplcap_uring_init(fds, N_FILES, NULL, 1) == NULL);
+  assert(raplcap_uring_init(fds, N_FILES, reads, 0) == NULL);
+  reads[0].file = N_FILES;
+  assert(raplcap_uring_init(fds, N_FILES, reads, 1) == NULL);
+  reads[0].file = 0;
+  reads[0].len = 0;
+  assert(raplcap_uring_init(fds, N_FILES, reads, 1) == NULL);
+  assert(raplcap_uring_destroy(NULL) < 0);
+}
+
+int main(void) {
+  // every file from the start, the middle of the second file, and past the end of the third
+  const raplcap_uring_read reads[] = { { 0, 24, 0 }, { 1, 8, 0 }, { 1, 4, 10 }, { 2, 8, 0 } };
+  const uint32_t n_reads = sizeof(reads) / sizeof(reads[0]);
+  raplcap_uring* u;
+  const void* buf;
+  int fds[N_FILES];
+  uint32_t i;
+  int j;
+  for (i = 0; i < N_FILES; i++) {
+    fds[i] = make_file(CONTENTS[i]);
+  }
+  test_params(fds);
+  if ((u = raplcap_uring_init(fds, N_FILES, reads, n_reads)) == NULL) {
+    // not built with io_uring, or the kernel doesn't have (or allow) it
+    printf("Skipping: io_uring is not available: %s\n", strerror(errno));
+  } else {
+    // results are the same for every submission
+    for (j = 0; j < 2; j++) {
+      assert(raplcap_uring_submit(u) == 0);
+      // only one user at a time
+      assert(raplcap_uring_submit(u) != 0);
+      assert(raplcap_uring_get_result(u, 0, &buf) == 6);
+      assert(memcmp(buf, "12345\n", 6) == 0);
+      assert(raplcap_uring_get_result(u, 1, &buf) == 8);
+      assert(memcmp(buf, "01234567", 8) == 0);
+      assert(raplcap_uring_get_result(u, 2, &buf) == 4);
+      assert(memcmp(buf, "abcd", 4) == 0);
+      assert(raplcap_uring_get_result(u, 3, NULL) == 0);
+      assert(raplcap_uring_get_result(u, n_reads, NULL) < 0);
+      raplcap_uring_release(u);
+    }
+    assert(raplcap_uring_destroy(u) == 0);
+  }
+  for (i = 0; i < N_FILES; i++) {
+    assert(close(fds[i]) == 0);
+  }
+  return 0;
+}
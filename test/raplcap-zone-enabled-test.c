@@ -0,0 +1,43 @@
+/**
+ * Enabling and disabling a zone only changes the requested die, with a mock implementation.
+ * Must be run with at least two die in the first package (RAPLCAP_MSR_MOCK_NUM_DIE).
+ */
+/* force assertions */
+#undef NDEBUG
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include "raplcap.h"
+
+static int equal_dbl(double a, double b) {
+  return fabs(a - b) < 1e-9;
+}
+
+int main(void) {
+  raplcap_limit ll0;
+  raplcap_limit ls0;
+  raplcap_limit ll;
+  raplcap_limit ls;
+  assert(raplcap_init(NULL) == 0);
+  assert(raplcap_get_num_die(NULL, 0) >= 2);
+  assert(raplcap_pd_is_zone_enabled(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE) == 1);
+  assert(raplcap_pd_get_limits(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE, &ll0, &ls0) == 0);
+
+  // die 1's register differs from die 0's, so writing die 0's value to die 1 is detectable
+  assert(raplcap_pd_get_limits(NULL, 0, 1, RAPLCAP_ZONE_PACKAGE, &ll, &ls) == 0);
+  ll.watts += 5;
+  assert(raplcap_pd_set_limits(NULL, 0, 1, RAPLCAP_ZONE_PACKAGE, &ll, &ls) == 0);
+  assert(raplcap_pd_set_zone_enabled(NULL, 0, 1, RAPLCAP_ZONE_PACKAGE, 0) == 0);
+  assert(raplcap_pd_is_zone_enabled(NULL, 0, 1, RAPLCAP_ZONE_PACKAGE) == 0);
+  assert(raplcap_pd_get_limits(NULL, 0, 1, RAPLCAP_ZONE_PACKAGE, &ll, &ls) == 0);
+  assert(equal_dbl(ll.watts, ll0.watts + 5));
+
+  // die 0 is unchanged
+  assert(raplcap_pd_is_zone_enabled(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE) == 1);
+  assert(raplcap_pd_get_limits(NULL, 0, 0, RAPLCAP_ZONE_PACKAGE, &ll, &ls) == 0);
+  assert(equal_dbl(ll.watts, ll0.watts) && equal_dbl(ll.seconds, ll0.seconds));
+  assert(equal_dbl(ls.watts, ls0.watts) && equal_dbl(ls.seconds, ls0.seconds));
+
+  assert(raplcap_destroy(NULL) == 0);
+  return 0;
+}